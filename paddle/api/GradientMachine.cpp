@@ -159,3 +159,12 @@ SequenceGenerator* GradientMachine::asSequenceGenerator(
   r->setBeamSize(beam_size);
   return r;
 }
+
+Predictor* GradientMachine::asPredictor() throw(UnsupportError) {
+  return Predictor::createByGradientMachineSharedPtr(&m->machine);
+}
+
+PredictorPool* GradientMachine::asPredictorPool(size_t size) throw(
+    UnsupportError) {
+  return PredictorPool::createByGradientMachineSharedPtr(&m->machine, size);
+}
@@ -206,6 +206,7 @@ private:
   friend class Trainer;
   friend class GradientMachine;
   friend class Arguments;
+  friend class Predictor;
 };
 
 struct VectorPrivate;
@@ -404,6 +405,8 @@ private:
   friend class Trainer;
   friend class GradientMachine;
   friend class SequenceGenerator;
+  friend class Predictor;
+  friend class PredictorPool;
 };
 
 enum GradientMatchineCreateMode {
@@ -621,6 +624,8 @@ private:
 };
 
 class SequenceGenerator;
+class Predictor;
+class PredictorPool;
 
 struct GradientMachinePrivate;
 class GradientMachine {
@@ -695,6 +700,20 @@ public:
       size_t begin_id = 0UL, size_t end_id = 0UL, size_t max_length = 100UL,
       size_t beam_size = -1UL);
 
+  /**
+   * Create a predictor sharing the parameter values of this machine.
+   *
+   * @note  Load the parameters before, the values loaded later are shared
+   *        but not the quantized values.
+   */
+  Predictor* asPredictor() throw(UnsupportError);
+
+  /**
+   * Create a pool of size predictors sharing the parameter values of this
+   * machine, for the forward of many threads.
+   */
+  PredictorPool* asPredictorPool(size_t size) throw(UnsupportError);
+
 private:
   GradientMachinePrivate* m;
 
@@ -706,6 +725,81 @@ private:
   static std::vector<int> defaultParamTypes;
 };
 
+struct PredictorPrivate;
+/**
+ * A replica of a network for inference.
+ *
+ * It has its own layers and outputs, and shares the parameter values of the
+ * GradientMachine it is created from, so the predictors of a machine can
+ * forward in different threads as long as the values are not changed. One
+ * predictor is not thread safe.
+ */
+class Predictor {
+private:
+  Predictor();
+  DISABLE_COPY_AND_ASSIGN(Predictor);
+
+public:
+  virtual ~Predictor();
+
+  /**
+   * The PASS_TEST forward.
+   *
+   * @note  The outArgs are the outputs of the layers, valid until the next
+   *        forward.
+   */
+  void forward(const Arguments& inArgs, Arguments* outArgs);
+
+  /// A new predictor sharing the parameter values, without copying them.
+  Predictor* clone() const;
+
+  Matrix* getLayerOutput(const std::string& layerName) const;
+
+private:
+  PredictorPrivate* m;
+
+  static Predictor* createByGradientMachineSharedPtr(void* ptr) throw(
+      UnsupportError);
+  friend class GradientMachine;
+  friend class PredictorPool;
+};
+
+struct PredictorPoolPrivate;
+/**
+ * The predictors of a GradientMachine shared by many threads.
+ *
+ * forward() runs on an idle predictor, waiting for one if all of them are
+ * busy.
+ */
+class PredictorPool {
+private:
+  PredictorPool();
+  DISABLE_COPY_AND_ASSIGN(PredictorPool);
+
+public:
+  virtual ~PredictorPool();
+
+  /**
+   * The PASS_TEST forward, thread safe.
+   *
+   * @note  The outArgs are copied from the outputs of the predictor.
+   */
+  void forward(const Arguments& inArgs, Arguments* outArgs);
+
+  /// Add num predictors cloned from the first one.
+  void addPredictors(size_t num);
+
+  /// Number of predictors.
+  size_t getSize() const;
+
+private:
+  PredictorPoolPrivate* m;
+
+  static PredictorPool* createByGradientMachineSharedPtr(
+      void* ptr, size_t size) throw(UnsupportError);
+  friend class GradientMachine;
+};
+
 struct TrainerPrivate;
 class Trainer {
 private:
@@ -771,6 +865,22 @@ public:
   virtual float getScore(size_t id) const throw(RangeError) = 0;
 };
 
+/**
+ * The results of SequenceGenerator::generateSequences(), the N-best
+ * generated results of each input sequence of a batch.
+ */
+class IBatchSequenceResults {
+public:
+  virtual ~IBatchSequenceResults();
+
+  /// Number of input sequences.
+  virtual size_t getNumSequences() const = 0;
+
+  /// The results of the seqId-th input sequence, sorted by score.
+  virtual ISequenceResults* getResults(size_t seqId) const
+      throw(RangeError) = 0;
+};
+
 struct SequenceGeneratorPrivate;
 class SequenceGenerator {
   DISABLE_COPY_AND_ASSIGN(SequenceGenerator);
@@ -788,6 +898,21 @@ public:
    */
   ISequenceResults* generateSequence(const Arguments& inArgs) const;
 
+  /**
+   * Generate Sequences for a batch of inputs.
+   *
+   * The machine must generate with a beam search layer group, e.g. the
+   * beam_search() of the trainer config helpers. All the input sequences
+   * are decoded in one forward, each with its own beam, which is stopped
+   * as soon as its results can not be improved.
+   *
+   * @note  The beam size, the max length and the number of results of each
+   *        sequence are the ones of the beam search config, not the ones
+   *        set to this generator. The dict is used to get the sentences.
+   */
+  IBatchSequenceResults* generateSequences(const Arguments& inArgs) const
+      throw(UnsupportError);
+
   void setDict(const std::vector<std::string>& dict);
   void setBos(size_t bos);
   void setEos(size_t eos);
@@ -0,0 +1,148 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+
+#include "PaddleAPI.h"
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/parameter/Argument.h"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+struct PredictorPrivate {
+  std::shared_ptr<paddle::NeuralNetwork> network;
+
+  template <typename T>
+  inline T& cast(void* ptr) {
+    return *(T*)(ptr);
+  }
+};
+
+Predictor::Predictor() : m(new PredictorPrivate()) {}
+
+Predictor::~Predictor() { delete m; }
+
+Predictor* Predictor::createByGradientMachineSharedPtr(void* ptr) throw(
+    UnsupportError) {
+  auto& machine = *(std::shared_ptr<paddle::GradientMachine>*)(ptr);
+  auto nn = std::dynamic_pointer_cast<paddle::NeuralNetwork>(machine);
+  if (!nn) {
+    throw UnsupportError();
+  }
+  auto predictor = new Predictor();
+  predictor->m->network.reset(nn->createInferenceReplica());
+  return predictor;
+}
+
+void Predictor::forward(const Arguments& inArgs, Arguments* outArgs) {
+  auto& in =
+      m->cast<std::vector<paddle::Argument>>(inArgs.getInternalArgumentsPtr());
+  auto& out = m->cast<std::vector<paddle::Argument>>(
+      outArgs->getInternalArgumentsPtr());
+  m->network->forward(in, &out, paddle::PASS_TEST);
+}
+
+Predictor* Predictor::clone() const {
+  auto predictor = new Predictor();
+  predictor->m->network.reset(m->network->createInferenceReplica());
+  return predictor;
+}
+
+Matrix* Predictor::getLayerOutput(const std::string& layerName) const {
+  auto mat = m->network->getLayerOutput(layerName);
+  return Matrix::createByPaddleMatrixPtr(&mat);
+}
+
+struct PredictorPoolPrivate {
+  std::vector<std::unique_ptr<Predictor>> predictors;
+  /// the predictors which are not running a forward
+  std::vector<Predictor*> idle;
+  mutable std::mutex lock;
+  std::condition_variable idleCond;
+
+  Predictor* acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    idleCond.wait(guard, [this]() { return !idle.empty(); });
+    Predictor* predictor = idle.back();
+    idle.pop_back();
+    return predictor;
+  }
+
+  void release(Predictor* predictor) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      idle.push_back(predictor);
+    }
+    idleCond.notify_one();
+  }
+};
+
+PredictorPool::PredictorPool() : m(new PredictorPoolPrivate()) {}
+
+PredictorPool::~PredictorPool() { delete m; }
+
+PredictorPool* PredictorPool::createByGradientMachineSharedPtr(
+    void* ptr, size_t size) throw(UnsupportError) {
+  std::unique_ptr<Predictor> first(
+      Predictor::createByGradientMachineSharedPtr(ptr));
+  auto pool = new PredictorPool();
+  pool->m->idle.push_back(first.get());
+  pool->m->predictors.push_back(std::move(first));
+  if (size > 1) {
+    pool->addPredictors(size - 1);
+  }
+  return pool;
+}
+
+void PredictorPool::forward(const Arguments& inArgs, Arguments* outArgs) {
+  auto& out = *(std::vector<paddle::Argument>*)(
+      outArgs->getInternalArgumentsPtr());
+  Predictor* predictor = m->acquire();
+  std::vector<paddle::Argument> predictorOut;
+  auto& in = *(std::vector<paddle::Argument>*)(
+      inArgs.getInternalArgumentsPtr());
+  predictor->m->network->forward(in, &predictorOut, paddle::PASS_TEST);
+  // the outputs of the predictor are overwritten by its next forward
+  out.resize(predictorOut.size());
+  for (size_t i = 0; i < predictorOut.size(); ++i) {
+    out[i].resizeAndCopyFrom(predictorOut[i]);
+  }
+  m->release(predictor);
+}
+
+void PredictorPool::addPredictors(size_t num) {
+  Predictor* first;
+  {
+    std::lock_guard<std::mutex> guard(m->lock);
+    first = m->predictors.front().get();
+  }
+  // the replicas are built without blocking the running forwards
+  std::vector<std::unique_ptr<Predictor>> predictors;
+  for (size_t i = 0; i < num; ++i) {
+    predictors.emplace_back(first->clone());
+  }
+  {
+    std::lock_guard<std::mutex> guard(m->lock);
+    for (auto& predictor : predictors) {
+      m->idle.push_back(predictor.get());
+      m->predictors.push_back(std::move(predictor));
+    }
+  }
+  m->idleCond.notify_all();
+}
+
+size_t PredictorPool::getSize() const {
+  std::lock_guard<std::mutex> guard(m->lock);
+  return m->predictors.size();
+}
@@ -15,6 +15,8 @@ limitations under the License. */
 
 #include "PaddleAPI.h"
 #include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/gserver/gradientmachines/RecurrentGradientMachine.h"
 #include "paddle/parameter/Argument.h"
 #include "paddle/utils/Flags.h"
 #include <vector>
@@ -22,16 +24,34 @@ limitations under the License. */
 #include <algorithm>
 #include <iterator>
 
+// a node of the prefix tree of the partial sequences, which share their
+// prefixes through the index of the parent node
+struct PathNode {
+  int id;
+  int parent;  // -1 for the first id
+};
+
 // used to represent partial sequence
 struct Path {
-  std::vector<int> ids;
+  std::vector<int> ids;  // only filled for the final paths
+  int node;              // index of the last node, -1 for the empty path
+  size_t length;
   float logProb;
   paddle::MachineState machineState;
 
-  Path() { logProb = 0; }
+  Path() : node(-1), length(0), logProb(0) {}
+
+  Path(int node, size_t length, float logProb,
+       const paddle::MachineState& machineState)
+      : node(node), length(length), logProb(logProb),
+        machineState(machineState) {}
 
-  Path(std::vector<int>& ids, float logProb, paddle::MachineState& machineState)
-      : ids(ids), logProb(logProb), machineState(machineState) {}
+  void fillIds(const std::vector<PathNode>& nodes) {
+    ids.resize(length);
+    for (int i = length - 1, n = node; i >= 0; n = nodes[n].parent, --i) {
+      ids[i] = nodes[n].id;
+    }
+  }
 
   bool operator<(const Path& other) const { return (logProb > other.logProb); }
 };
@@ -44,6 +64,7 @@ static void findNBest(paddle::GradientMachine* gradMachine,
                       std::vector<paddle::Argument>& inArgs,
                       std::vector<Path>& finalPaths, size_t bos_id,
                       size_t eos_id, size_t max_length) {
+  std::vector<PathNode> nodes;
   std::vector<Path> paths;
   Path emptyPath;
   paths.push_back(emptyPath);
@@ -62,7 +83,7 @@ static void findNBest(paddle::GradientMachine* gradMachine,
       Path& path = paths[j];
       if (path.machineState.size() > 0) {
         gradMachine->setState(path.machineState);
-        feedback.ids->setElement(0, path.ids.back());
+        feedback.ids->setElement(0, nodes[path.node].id);
       }
       gradMachine->forward(inArgs, &outArgs, paddle::PASS_TEST);
       gradMachine->getState(machineState);
@@ -70,11 +91,11 @@ static void findNBest(paddle::GradientMachine* gradMachine,
       for (size_t k = 0; k < beam; k++) {
         id = outArgs[0].ids->getElement(k);
         float prob = outArgs[0].in->getElement(0, k);
-        std::vector<int> nids(path.ids);
-        nids.push_back(id);
+        nodes.push_back({id, path.node});
         float newLogProb = path.logProb + log(prob);
-        Path newPath(nids, newLogProb, machineState);
-        if (id == (int)eos_id || nids.size() >= max_length) {
+        Path newPath(nodes.size() - 1, path.length + 1, newLogProb,
+                     machineState);
+        if (id == (int)eos_id || newPath.length >= max_length) {
           finalPaths.push_back(newPath);
           if (minFinalPathLogProb > newPath.logProb) {
             minFinalPathLogProb = newPath.logProb;
@@ -100,7 +121,7 @@ static void findNBest(paddle::GradientMachine* gradMachine,
     if (finalPaths.size() >= beam && minFinalPathLogProb >= maxPathLogProb) {
       break;
     }
-    paths = newPaths;
+    paths.swap(newPaths);
   }  // end while
 
   std::partial_sort(finalPaths.begin(),
@@ -109,6 +130,9 @@ static void findNBest(paddle::GradientMachine* gradMachine,
   if (finalPaths.size() > beam) {
     finalPaths.resize(beam);
   }
+  for (auto& path : finalPaths) {
+    path.fillIds(nodes);
+  }
 }
 
 struct SequenceGeneratorPrivate {
@@ -199,6 +223,28 @@ private:
   std::shared_ptr<std::vector<std::string>> dict_;
 };
 
+class BatchPathSequenceResults : public IBatchSequenceResults {
+public:
+  BatchPathSequenceResults(
+      const std::vector<std::shared_ptr<std::vector<Path>>>& paths,
+      const std::shared_ptr<std::vector<std::string>>& dict)
+      : paths_(paths), dict_(dict) {}
+
+  size_t getNumSequences() const { return paths_.size(); }
+  ISequenceResults* getResults(size_t seqId) const throw(RangeError) {
+    if (seqId < getNumSequences()) {
+      return new PathSequenceResults(paths_[seqId], dict_);
+    } else {
+      RangeError e;
+      throw e;
+    }
+  }
+
+private:
+  std::vector<std::shared_ptr<std::vector<Path>>> paths_;
+  std::shared_ptr<std::vector<std::string>> dict_;
+};
+
 ISequenceResults* SequenceGenerator::generateSequence(
     const Arguments& inArgs) const {
   auto& in_args =
@@ -212,6 +258,52 @@ ISequenceResults* SequenceGenerator::generateSequence(
   return new PathSequenceResults(path, m->dict);
 }
 
+IBatchSequenceResults* SequenceGenerator::generateSequences(
+    const Arguments& inArgs) const throw(UnsupportError) {
+  auto network = std::dynamic_pointer_cast<paddle::NeuralNetwork>(m->machine);
+  if (!network) {
+    throw UnsupportError();
+  }
+  paddle::RecurrentGradientMachine* generator = nullptr;
+  network->forEachLayer([&generator](const paddle::LayerPtr& layer) {
+    layer->accessSubNetwork([&generator](paddle::NeuralNetwork& subNetwork) {
+      auto group = dynamic_cast<paddle::RecurrentGradientMachine*>(&subNetwork);
+      if (group && group->isGenerating()) {
+        generator = group;
+      }
+    });
+    return generator != nullptr;
+  });
+  if (!generator) {
+    throw UnsupportError();
+  }
+
+  auto& in_args =
+      m->cast<std::vector<paddle::Argument>>(inArgs.getInternalArgumentsPtr());
+  std::vector<paddle::Argument> outArgs;
+  network->forward(in_args, &outArgs, paddle::PASS_TEST);
+
+  // without beam search, the only element holds the result of each sequence
+  auto& finalPaths = generator->getFinalPaths();
+  bool beamSearch = generator->getBeamSize() > 1;
+  size_t numSequences = beamSearch || finalPaths.empty() ? finalPaths.size()
+                                                        : finalPaths[0].size();
+  std::vector<std::shared_ptr<std::vector<Path>>> paths(numSequences);
+  for (size_t i = 0; i < numSequences; ++i) {
+    paths[i] = std::make_shared<std::vector<Path>>();
+    size_t numResults = beamSearch ? finalPaths[i].size() : 1;
+    for (size_t j = 0; j < numResults; ++j) {
+      auto& result = beamSearch ? finalPaths[i][j] : finalPaths[0][i];
+      Path path;
+      path.ids = result.ids;
+      path.length = result.ids.size();
+      path.logProb = result.logProb;
+      paths[i]->push_back(std::move(path));
+    }
+  }
+  return new BatchPathSequenceResults(paths, m->dict);
+}
+
 SequenceGenerator* SequenceGenerator::createByGradientMachineSharedPtr(
     void* ptr) {
   SequenceGenerator* r = new SequenceGenerator();
@@ -238,3 +330,5 @@ void SequenceGenerator::setBeamSize(size_t beamSize) {
 }
 
 ISequenceResults::~ISequenceResults() {}
+
+IBatchSequenceResults::~IBatchSequenceResults() {}
@@ -30,7 +30,8 @@ source .test_env/bin/activate
 
 pip --timeout 600  install ../../dist/*.whl
 
-test_list="testArguments.py testGradientMachine.py testMatrix.py  testVector.py testTrain.py"
+test_list="testArguments.py testGradientMachine.py testMatrix.py  testVector.py testTrain.py\
+  testSequenceGenerator.py"
 
 export PYTHONPATH=$PWD/../../../python/
 
@@ -0,0 +1,60 @@
+# Copyright (c) 2016 Baidu, Inc. All Rights Reserved
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from py_paddle import swig_paddle
+import unittest
+import numpy
+
+# The generation model of trainer/tests/test_recurrent_machine_generation,
+# with beam_size=2 and num_results_per_sample=2.
+CONFIG_FILE = "../../trainer/tests/sample_trainer_rnn_gen.conf"
+MODEL_DIR = "../../trainer/tests/rnn_gen_test_model_dir/t1"
+
+
+class TestSequenceGenerator(unittest.TestCase):
+    def test_generate_sequences(self):
+        trainer_config = swig_paddle.TrainerConfig.createFromTrainerConfigFile(
+            CONFIG_FILE)
+        machine = swig_paddle.GradientMachine.createByModelConfig(
+            trainer_config.getModelConfig())
+        machine.loadParameters(MODEL_DIR)
+        generator = machine.asSequenceGenerator(
+            [str(i) for i in xrange(5)])
+
+        batch_size = 15
+        args = swig_paddle.Arguments.createArguments(2)
+        args.setSlotIds(0, swig_paddle.IVector.create(range(batch_size)))
+        dummy = numpy.random.rand(batch_size * 2).astype("float32").tolist()
+        args.setSlotValue(1, swig_paddle.Matrix.createDense(dummy, batch_size,
+                                                            2))
+
+        results = generator.generateSequences(args)
+        self.assertIsInstance(results, swig_paddle.IBatchSequenceResults)
+        self.assertEqual(batch_size, results.getNumSequences())
+        for i in xrange(batch_size):
+            seq_results = results.getResults(i)
+            self.assertEqual(2, seq_results.getSize())
+            # same as trainer/tests/rnn_gen_test_model_dir/r1.test.beam
+            self.assertEqual([1, 2, 3, 4], list(seq_results.getSequence(0)))
+            self.assertAlmostEqual(0, seq_results.getScore(0), places=5)
+            self.assertEqual("1 2 3 4",
+                             seq_results.getSentence(0, True).strip())
+            self.assertEqual([0, 1, 2, 3, 4],
+                             list(seq_results.getSequence(1)))
+            self.assertAlmostEqual(-0.2, seq_results.getScore(1), places=5)
+
+
+if __name__ == '__main__':
+    swig_paddle.initPaddle("--use_gpu=0", "--config_args=beam_search=1")
+    unittest.main()
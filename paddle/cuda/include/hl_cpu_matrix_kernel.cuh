@@ -24,6 +24,15 @@ limitations under the License. */
  */
 template <class T, class Op>
 void hl_cpu_apply_unary_op(Op op, T* A_h, int dimM, int dimN, int lda) {
+  if (lda == dimN) {
+    /* contiguous matrix, process it as one unit-stride (vectorizable) loop */
+    size_t size = (size_t)dimM * dimN;
+    for (size_t i = 0; i < size; i++) {
+      op.cpuOperator(A_h[i]);
+    }
+    return;
+  }
+
   for (int i = 0; i < dimM; i ++) {
     for (int j = 0; j < dimN; j++) {
       op.cpuOperator(A_h[i*lda + j]);
@@ -42,6 +51,15 @@ void hl_cpu_apply_binary_op(Op op,
                             int dimN,
                             int lda,
                             int ldb) {
+  if (BAsRowVector == 0 && BAsColVector == 0 && lda == dimN && ldb == dimN) {
+    /* contiguous matrices, process them as one unit-stride loop */
+    size_t size = (size_t)dimM * dimN;
+    for (size_t i = 0; i < size; i++) {
+      op.cpuOperator(A_h[i], B_h[i]);
+    }
+    return;
+  }
+
   for (int i = 0; i < dimM; i ++) {
     for (int j = 0; j < dimN; j++) {
       if (BAsRowVector == 0 && BAsColVector == 0) {
@@ -70,6 +88,16 @@ void hl_cpu_apply_ternary_op(Op op,
                              int lda,
                              int ldb,
                              int ldc) {
+  if (CAsRowVector == 0 && CAsColVector == 0 &&
+      lda == dimN && ldb == dimN && ldc == dimN) {
+    /* contiguous matrices, process them as one unit-stride loop */
+    size_t size = (size_t)dimM * dimN;
+    for (size_t i = 0; i < size; i++) {
+      op.cpuOperator(A_h[i], B_h[i], C_h[i]);
+    }
+    return;
+  }
+
   for (int i = 0; i < dimM; i ++) {
     for (int j = 0; j < dimN; j++) {
       if (CAsRowVector == 0 && CAsColVector == 0) {
@@ -100,6 +128,15 @@ void hl_cpu_apply_quaternary_op(Op op,
                                 int ldb,
                                 int ldc,
                                 int ldd) {
+  if (lda == dimN && ldb == dimN && ldc == dimN && ldd == dimN) {
+    /* contiguous matrices, process them as one unit-stride loop */
+    size_t size = (size_t)dimM * dimN;
+    for (size_t i = 0; i < size; i++) {
+      op.cpuOperator(A_h[i], B_h[i], C_h[i], D_h[i]);
+    }
+    return;
+  }
+
   for (int i = 0; i < dimM; i ++) {
     for (int j = 0; j < dimN; j++) {
       op.cpuOperator(A_h[i*lda + j],
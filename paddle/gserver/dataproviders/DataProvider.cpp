@@ -19,6 +19,7 @@ limitations under the License. */
 #include "paddle/utils/StringUtil.h"
 #include "paddle/utils/Logging.h"
 #include <algorithm>
+#include <random>
 #include <unistd.h>
 #include "ProtoDataProvider.h"
 
@@ -135,7 +136,7 @@ void DoubleBuffer::asyncLoadBatch() {
       DataBatch newBatch;
       {
         REGISTER_TIMER("getNextBatchInternal");
-        actualSize = dataPool_->getNextBatchInternal(batchSize_, &newBatch);
+        actualSize = dataPool_->loadNextBatch(batchSize_, &newBatch);
       }
       insertOneBatch(&newBatch);
     } while (actualSize > 0);
@@ -149,6 +150,144 @@ void DoubleBuffer::startAsyncLoad() {
   taskReadySem_.post();
 }
 
+/// bucket_pool_size in number of batches when it is not set
+static const int64_t kDefaultBucketPoolBatches = 4;
+
+BucketBatcher::BucketBatcher(DataProvider* dataPool, const DataConfig& config,
+                             bool useGpu)
+    : dataPool_(dataPool),
+      useGpu_(useGpu),
+      boundaries_(config.bucket_boundaries().begin(),
+                  config.bucket_boundaries().end()),
+      poolSize_(config.bucket_pool_size()),
+      buckets_(boundaries_.size() + 1),
+      exhausted_(false) {
+  for (size_t i = 0; i < boundaries_.size(); ++i) {
+    CHECK_GT(boundaries_[i], i == 0 ? 0 : boundaries_[i - 1])
+        << "bucket_boundaries should be positive and increasing";
+  }
+  CHECK_GE(poolSize_, 0);
+  reset();
+}
+
+void BucketBatcher::reset() {
+  for (auto& bucket : buckets_) {
+    bucket.pool.clear();
+    bucket.size = 0;
+  }
+  exhausted_ = false;
+}
+
+int64_t BucketBatcher::getNextBatch(int64_t size, DataBatch* batch,
+                                    bool random) {
+  int64_t poolSize = poolSize_ > 0 ? poolSize_
+                                   : kDefaultBucketPoolBatches * size;
+  poolSize = std::max(poolSize, size);
+  while (true) {
+    int bucket = chooseBucket(poolSize, random);
+    if (bucket >= 0) {
+      return drawBatch(&buckets_[bucket], size, batch, random);
+    }
+    if (exhausted_) {
+      batch->clear();
+      return 0;
+    }
+    DataBatch newBatch;
+    if (dataPool_->getNextBatchInternal(size, &newBatch) > 0) {
+      addBatch(&newBatch);
+    } else {
+      exhausted_ = true;
+    }
+  }
+}
+
+void BucketBatcher::addBatch(DataBatch* batch) {
+  const std::vector<Argument>& streams = batch->getStreams();
+  int64_t numSequences = batch->getNumSequences();
+  // the batch size counts either the sequences or the samples
+  bool countSequences = batch->getSize() == numSequences;
+  for (const Argument& arg : streams) {
+    CHECK(!arg.value || !arg.value->isSparse())
+        << "Bucketing does not support sparse streams";
+    CHECK(arg.sequenceStartPositions || arg.getBatchSize() == numSequences)
+        << "A non-sequence stream should have one sample per sequence";
+  }
+
+  for (int64_t i = 0; i < numSequences; ++i) {
+    Sequence seq;
+    seq.streams.resize(streams.size());
+    int length = 1;
+    for (size_t j = 0; j < streams.size(); ++j) {
+      int numSamples = seq.streams[j].resizeAndCopyFrom(streams[j], i, 1,
+                                                        /* useGpu= */ false);
+      if (streams[j].sequenceStartPositions) {
+        length = std::max(length, numSamples);
+      }
+      if (j == 0) {
+        seq.size = countSequences ? 1 : numSamples;
+      }
+    }
+    size_t id = std::lower_bound(boundaries_.begin(), boundaries_.end(),
+                                 length) - boundaries_.begin();
+    buckets_[id].size += seq.size;
+    buckets_[id].pool.push_back(std::move(seq));
+  }
+}
+
+int BucketBatcher::chooseBucket(int64_t poolSize, bool random) {
+  std::vector<int> candidates;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    // drain all the buckets at the end of the pass
+    if (buckets_[i].size >= (exhausted_ ? 1 : poolSize)) {
+      candidates.push_back(i);
+    }
+  }
+  if (candidates.empty()) {
+    return -1;
+  }
+  if (!random) {
+    return candidates[0];
+  }
+  std::uniform_int_distribution<size_t> dist(0, candidates.size() - 1);
+  return candidates[dist(ThreadLocalRandomEngine::get())];
+}
+
+int64_t BucketBatcher::drawBatch(Bucket* bucket, int64_t size,
+                                 DataBatch* batch, bool random) {
+  auto& pool = bucket->pool;
+  std::vector<std::vector<Argument>> streams;
+  int64_t batchSize = 0;
+  while (!pool.empty()) {
+    if (random) {
+      std::uniform_int_distribution<size_t> dist(0, pool.size() - 1);
+      std::swap(pool.front(), pool[dist(ThreadLocalRandomEngine::get())]);
+    }
+    Sequence& seq = pool.front();
+    if (batchSize > 0 && batchSize + seq.size > size) {
+      break;
+    }
+    streams.resize(seq.streams.size());
+    for (size_t j = 0; j < seq.streams.size(); ++j) {
+      streams[j].push_back(std::move(seq.streams[j]));
+    }
+    batchSize += seq.size;
+    bucket->size -= seq.size;
+    pool.pop_front();
+  }
+
+  std::vector<Argument>& args = batch_.getStreams();
+  args.resize(streams.size());
+  for (size_t j = 0; j < streams.size(); ++j) {
+    args[j].concat(streams[j], useGpu_, HPPL_STREAM_DEFAULT, PASS_TEST);
+  }
+  if (useGpu_) {
+    hl_stream_synchronize(HPPL_STREAM_DEFAULT);
+  }
+  batch_.setSize(batchSize);
+  *batch = batch_;
+  return batchSize;
+}
+
 ClassRegistrar<DataProvider, DataConfig, ModelConfig, bool>
 DataProvider::registrar_;
 
@@ -165,7 +304,7 @@ REGISTER_DATA_PROVIDER(proto_sequence, ProtoSequenceDataProvider);
 
 int64_t DataProvider::getNextBatch(int64_t size, DataBatch* batch) {
   int64_t batchSize = doubleBuffer_ ? getNextBatchFromBuffer(size, batch)
-                                    : getNextBatchInternal(size, batch);
+                                    : loadNextBatch(size, batch);
 
   if (!batchSize) return 0;
 
@@ -15,6 +15,7 @@ limitations under the License. */
 
 #pragma once
 
+#include <deque>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -292,6 +293,76 @@ protected:
   bool pending_;
 };
 
+/**
+ * @brief Group the sequences of similar length into the same batch.
+ *
+ * The batches read from the data provider are split into sequences, which
+ * are buffered in buckets according to their length (see bucket_boundaries
+ * in DataConfig). Once a bucket has buffered bucket_pool_size samples, a
+ * batch is drawn randomly from it. At the end of the pass, the remaining
+ * sequences are given in batches from randomly chosen buckets.
+ *
+ * The length of a sequence is the number of timesteps of its longest
+ * sequence stream. Sparse streams are not supported.
+ */
+class BucketBatcher {
+public:
+  BucketBatcher(DataProvider* dataPool, const DataConfig& config, bool useGpu);
+
+  /**
+   * @brief drop the buffered sequences, called at the start of a pass.
+   */
+  void reset();
+
+  /**
+   * @brief get the next batch, of at most size samples.
+   * @param[in]    random    whether to draw the batch randomly, otherwise
+   *                         the sequences are given in the order they are read
+   * @return actual size of obtained samples, 0 at the end of the pass
+   */
+  int64_t getNextBatch(int64_t size, DataBatch* batch, bool random);
+
+protected:
+  /// one sequence of each stream, copied to cpu memory
+  struct Sequence {
+    std::vector<Argument> streams;
+    /// in the unit of the batch size: 1, or its number of samples
+    int64_t size;
+  };
+
+  struct Bucket {
+    std::deque<Sequence> pool;
+    /// total size of the sequences in pool
+    int64_t size;
+  };
+
+  /**
+   * @brief split a batch into sequences, and buffer them in the buckets.
+   */
+  void addBatch(DataBatch* batch);
+
+  /**
+   * @brief choose the bucket to draw the next batch from.
+   * @return -1 if more batches need to be read.
+   */
+  int chooseBucket(int64_t poolSize, bool random);
+
+  /**
+   * @brief move at most size samples of bucket into batch.
+   */
+  int64_t drawBatch(Bucket* bucket, int64_t size, DataBatch* batch,
+                    bool random);
+
+  DataProvider* dataPool_;
+  bool useGpu_;
+  std::vector<int> boundaries_;
+  int64_t poolSize_;
+  std::vector<Bucket> buckets_;
+  /// whether the data provider reached the end of the pass
+  bool exhausted_;
+  DataBatch batch_;
+};
+
 /**
  * @brief Base class for DataProvider, which supplies data for training
  * @note It can supplies multiple streams of data.
@@ -317,6 +388,9 @@ public:
         skipShuffle_(false),
         usageRatio_(config.usage_ratio()),
         useGpu_(useGpu) {
+    if (config_.bucket_boundaries_size() > 0) {
+      bucketBatcher_.reset(new BucketBatcher(this, config_, useGpu_));
+    }
     if (config_.async_load_data()) {
       initAsyncLoader();
     }
@@ -347,6 +421,9 @@ public:
    * at the end of the function
    */
   virtual void reset() {
+    if (bucketBatcher_ != nullptr) {
+      bucketBatcher_->reset();
+    }
     if (doubleBuffer_ != nullptr) {
       LOG(INFO) << "the double-buffer is starting ...";
       doubleBuffer_->startAsyncLoad();
@@ -368,11 +445,25 @@ public:
    */
   virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch) = 0;
 
+  /**
+   * @brief Get next batch training samples from getNextBatchInternal(),
+   * through the bucketing batcher if bucket_boundaries are configured.
+   * @param[in]    size      size of training samples to get
+   * @param[out]   batch     a batch of training samples
+   * @return actual size of obtained training samples
+   */
+  int64_t loadNextBatch(int64_t size, DataBatch* batch) {
+    return bucketBatcher_ ? bucketBatcher_->getNextBatch(size, batch,
+                                                         !skipShuffle_)
+                          : getNextBatchInternal(size, batch);
+  }
+
 protected:
   DataConfig config_;
   bool skipShuffle_;
   float usageRatio_;
   bool useGpu_;
+  std::unique_ptr<BucketBatcher> bucketBatcher_;
   std::unique_ptr<DoubleBuffer> doubleBuffer_;
   ThreadLocal<std::vector<MatrixPtr>> constantSlots_;
   /**
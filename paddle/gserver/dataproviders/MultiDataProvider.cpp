@@ -89,7 +89,7 @@ int64_t MultiDataProvider::getNextBatchInternal(int64_t size,
                   totalDataRatio_);
     DataBatch subBatch;
     int64_t realSize =
-        subDataProviders_[i]->getNextBatchInternal(subSize, &subBatch);
+        subDataProviders_[i]->loadNextBatch(subSize, &subBatch);
     if (realSize == 0) {
       // current subDataProvider has no data
       if (!isTestMode()) {
@@ -103,7 +103,7 @@ int64_t MultiDataProvider::getNextBatchInternal(int64_t size,
           subDataProviders_[i]->reset();
           subBatch.clear();
           realSize =
-              subDataProviders_[i]->getNextBatchInternal(subSize, &subBatch);
+              subDataProviders_[i]->loadNextBatch(subSize, &subBatch);
           CHECK_GT(realSize, 0);
         }
       } else {
@@ -31,6 +31,7 @@ namespace paddle {
 REGISTER_DATA_PROVIDER(proto_group, DataProviderGroup<ProtoDataProvider>);
 REGISTER_DATA_PROVIDER(proto_sequence_group,
                        DataProviderGroup<ProtoSequenceDataProvider>);
+REGISTER_DATA_PROVIDER(proto_stream, ProtoStreamDataProvider);
 
 ProtoDataProvider::ProtoDataProvider(const DataConfig& config, bool useGpu,
                                      bool loadDataAll)
@@ -478,7 +479,8 @@ int64_t ProtoDataProvider::getNextBatchInternal(int64_t size,
   int64_t numScannedSeqs = 0;
   std::lock_guard<RWLock> guard(lock_);
   if (iidData()) {
-    size = std::min<int64_t>(getSize() - currentSequenceIndex_, size);
+    size = std::min<int64_t>(
+        ProtoDataProvider::getSize() - currentSequenceIndex_, size);
     numScannedSeqs = numSequences = size;
   } else {
     int64_t sz = 0;
@@ -899,4 +901,223 @@ int64_t ProtoSequenceDataProvider::getNextBatchInternal(int64_t size,
   return batch->getSize();
 }
 
+/// buffer capacity when buffer_capacity is not set in the config
+static const size_t kDefaultStreamBufferCapacity = 100000;
+/// number of samples read to decide whether the data is iid
+static const size_t kIidCheckSamples = 10000;
+
+ProtoStreamDataProvider::ProtoStreamDataProvider(const DataConfig& config,
+                                                 bool useGpu)
+    : ProtoDataProvider(config, useGpu, /* loadDataAll= */ false),
+      nextFile_(0),
+      numActiveParsers_(0),
+      stopped_(false),
+      bufferedSamples_(0) {
+  CHECK_EQ(usageRatio_, 1.0f) << "usage_ratio is not supported by "
+                              << "proto_stream, the size is not known";
+  loadFileList(config_.files(), fileList_);
+  CHECK_GT(fileList_.size(), 0UL);
+  bufferCapacity_ = config_.buffer_capacity() ? config_.buffer_capacity()
+                                              : kDefaultStreamBufferCapacity;
+  readFirstFile();
+  LOG(INFO) << "stream " << fileList_.size() << " files with "
+            << config_.file_group_conf().load_thread_num()
+            << " threads, buffer_capacity=" << bufferCapacity_
+            << " iid=" << iid_;
+}
+
+ProtoStreamDataProvider::~ProtoStreamDataProvider() { stopParsers(); }
+
+void ProtoStreamDataProvider::readFirstFile() {
+  std::ifstream is(fileList_[0]);
+  CHECK(is) << "Fail to open " << fileList_[0];
+  bool dataCompression = str::endsWith(fileList_[0], ".gz");
+  ProtoReader reader(&is, dataCompression);
+  DataHeader header;
+  CHECK(reader.read(&header));
+  checkDataHeader(header);
+
+  iid_ = true;
+  DataSample sample;
+  for (size_t i = 0; i < kIidCheckSamples && reader.read(&sample); ++i) {
+    if (!sample.is_beginning()) {
+      iid_ = false;
+      break;
+    }
+  }
+}
+
+void ProtoStreamDataProvider::reset() {
+  stopParsers();
+  if (!skipShuffle_) {
+    std::random_shuffle(fileList_.begin(), fileList_.end());
+  }
+  startParsers();
+  DataProvider::reset();
+}
+
+void ProtoStreamDataProvider::startParsers() {
+  buffer_.clear();
+  bufferedSamples_ = 0;
+  nextFile_ = 0;
+  stopped_ = false;
+  size_t numParsers = std::max(config_.file_group_conf().load_thread_num(), 1);
+  numActiveParsers_ = numParsers;
+  for (size_t i = 0; i < numParsers; ++i) {
+    parsers_.emplace_back(new std::thread([this] { parseFiles(); }));
+  }
+}
+
+void ProtoStreamDataProvider::stopParsers() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopped_ = true;
+  }
+  pushCV_.notify_all();
+  for (auto& parser : parsers_) {
+    parser->join();
+  }
+  parsers_.clear();
+}
+
+void ProtoStreamDataProvider::parseFiles() {
+  while (true) {
+    std::string fileName;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (stopped_ || nextFile_ == fileList_.size()) {
+        break;
+      }
+      fileName = fileList_[nextFile_++];
+    }
+    if (!parseFile(fileName)) {
+      break;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    --numActiveParsers_;
+  }
+  pullCV_.notify_all();
+}
+
+bool ProtoStreamDataProvider::parseFile(const std::string& fileName) {
+  std::ifstream is(fileName);
+  CHECK(is) << "Fail to open " << fileName;
+  bool dataCompression = str::endsWith(fileName, ".gz");
+  ProtoReader reader(&is, dataCompression);
+  DataHeader header;
+  CHECK(reader.read(&header));
+  checkDataHeader(header);
+
+  Sequence sequence;
+  DataSample sample;
+  while (reader.read(&sample)) {
+    checkSample(sample);
+    CHECK(!iid_ || sample.is_beginning())
+        << fileName << " has sequences, but the samples at the beginning of "
+        << fileList_[0] << " are iid";
+    if (sample.is_beginning() && !sequence.empty()) {
+      if (!pushSequence(&sequence)) {
+        return false;
+      }
+    }
+    sequence.emplace_back();
+    sequence.back().Swap(&sample);
+  }
+  CHECK(is.eof()) << "Fail to read file " << fileName;
+  return sequence.empty() || pushSequence(&sequence);
+}
+
+bool ProtoStreamDataProvider::pushSequence(Sequence* sequence) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  pushCV_.wait(lock, [this] {
+    return stopped_ || bufferedSamples_ < bufferCapacity_;
+  });
+  if (stopped_) {
+    return false;
+  }
+  bufferedSamples_ += sequence->size();
+  buffer_.emplace_back(std::move(*sequence));
+  sequence->clear();
+  lock.unlock();
+  pullCV_.notify_all();
+  return true;
+}
+
+void ProtoStreamDataProvider::clearSlots() {
+  for (auto& slot : slots_) {
+    slot.indexData.clear();
+    slot.denseData.clear();
+    slot.sparseNonValueData.clear();
+    slot.sparseFloatValueData.clear();
+    slot.subIndices.clear();
+    slot.varDenseData.clear();
+    slot.varIndices.clear();
+    slot.strData.clear();
+    if (!slot.indices.empty()) {
+      slot.indices.resize(1);
+    }
+  }
+  sampleNums_ = 0;
+  sequenceStartPositions_.clear();
+  shuffledSequenceIds_.clear();
+  currentSequenceIndex_ = 0;
+}
+
+int64_t ProtoStreamDataProvider::getNextBatchInternal(int64_t size,
+                                                      DataBatch* batch) {
+  std::vector<Sequence> sequences;
+  size_t numSamples = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // fill the buffer before picking random sequences.
+    size_t minSamples = skipShuffle_ ? std::min<size_t>(size, bufferCapacity_)
+                                     : bufferCapacity_;
+    pullCV_.wait(lock, [this, minSamples] {
+      return bufferedSamples_ >= minSamples || numActiveParsers_ == 0;
+    });
+    while (!buffer_.empty()) {
+      if (!skipShuffle_) {
+        size_t i = ThreadLocalRand::rand() % buffer_.size();
+        std::swap(buffer_[i], buffer_.front());
+      }
+      size_t len = buffer_.front().size();
+      // like sequenceLoop(), a sequence longer than size is a batch.
+      if (numSamples + len > (size_t)size && numSamples > 0) {
+        break;
+      }
+      numSamples += len;
+      bufferedSamples_ -= len;
+      sequences.emplace_back(std::move(buffer_.front()));
+      buffer_.pop_front();
+    }
+  }
+  pushCV_.notify_all();
+  if (numSamples == 0) {
+    return 0;
+  }
+
+  clearSlots();
+  for (auto& sequence : sequences) {
+    if (!iid_) {
+      sequenceStartPositions_.push_back(sampleNums_);
+    }
+    for (auto& sample : sequence) {
+      fillSlots(sample);
+      ++sampleNums_;
+    }
+  }
+  if (iid_) {
+    shuffledSequenceIds_.resize(sampleNums_);
+  } else {
+    sequenceStartPositions_.push_back(sampleNums_);
+    shuffledSequenceIds_.resize(sequences.size());
+  }
+  for (size_t i = 0; i < shuffledSequenceIds_.size(); ++i) {
+    shuffledSequenceIds_[i] = i;
+  }
+  return ProtoDataProvider::getNextBatchInternal(numSamples, batch);
+}
+
 }  // namespace paddle
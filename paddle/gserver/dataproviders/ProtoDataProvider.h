@@ -15,6 +15,10 @@ limitations under the License. */
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "paddle/utils/Stat.h"
@@ -174,4 +178,78 @@ public:
   virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
 };
 
+/**
+ * @brief Stream the proto data files instead of loading them all in memory.
+ *
+ * load_thread_num threads parse the files, in a random order unless the
+ * shuffle is skipped, into a shuffle buffer of at most buffer_capacity
+ * samples. Each batch is made of sequences picked randomly from the buffer,
+ * so batches are available as soon as the buffer is filled, while the rest of
+ * the pass is still being read.
+ *
+ * Whether the data is iid is decided from the first samples of the first
+ * file. It is fatal if a later file has sequences in iid data.
+ */
+class ProtoStreamDataProvider : public ProtoDataProvider {
+public:
+  ProtoStreamDataProvider(const DataConfig& config, bool useGpu);
+  ~ProtoStreamDataProvider();
+  virtual void reset();
+  virtual void shuffle() {}
+  /// the size is not known before reading the whole pass
+  virtual int64_t getSize() { return -1; }
+  virtual int64_t getNextBatchInternal(int64_t size, DataBatch* batch);
+
+protected:
+  /// samples of a sequence, or one sample for iid data
+  typedef std::vector<DataSample> Sequence;
+
+  /**
+   * @brief read the header and the first samples of the first file.
+   */
+  void readFirstFile();
+
+  void startParsers();
+  void stopParsers();
+
+  /**
+   * @brief main function of a parser thread, parse the files left.
+   */
+  void parseFiles();
+
+  /**
+   * @brief parse a file into the buffer.
+   * @return false if the parsers are stopped.
+   */
+  bool parseFile(const std::string& fileName);
+
+  /**
+   * @brief push a sequence into the buffer, waiting for room.
+   * @return false if the parsers are stopped.
+   */
+  bool pushSequence(Sequence* sequence);
+
+  /**
+   * @brief remove the data of the previous batch from slots_.
+   */
+  void clearSlots();
+
+protected:
+  std::vector<std::string> fileList_;
+  bool iid_;
+  /// number of samples in buffer_ when it is full.
+  size_t bufferCapacity_;
+
+  std::vector<std::unique_ptr<std::thread>> parsers_;
+  /// the next file to parse in fileList_.
+  size_t nextFile_;
+  size_t numActiveParsers_;
+  bool stopped_;
+  std::deque<Sequence> buffer_;
+  size_t bufferedSamples_;
+  std::mutex mutex_;
+  std::condition_variable pushCV_;
+  std::condition_variable pullCV_;
+};
+
 }  // namespace paddle
@@ -16,11 +16,17 @@ limitations under the License. */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
 #include <unordered_set>
 #include <list>
 
 #include "DataProvider.h"
 #include "paddle/utils/PythonUtil.h"
+#include "paddle/utils/SharedMemoryRing.h"
 
 namespace paddle {
 
@@ -72,6 +78,11 @@ enum CacheType {
   CACHE_PASS_IN_MEM = 1,  // First pass will load data from PyDataProvider2,
                           // then cache all data in memory. Load data from
                           // memory in rest passes.
+  CACHE_PASS_IN_BINARY = 2,  // First pass will load data from
+                             // PyDataProvider2, then cache the scanned slot
+                             // data in memory in a compact binary format. Rest
+                             // passes build the arguments from it without
+                             // python.
 };
 
 struct SlotHeader {  // Slot Header will parse from python object's slots field.
@@ -180,10 +191,412 @@ public:
    */
   virtual std::deque<PyObjectPtr>* load() = 0;
 
+  /**
+   * Whether the cache stores the scanned arguments instead of the python
+   * objects. If so, the rest passes use loadArguments() instead of load().
+   */
+  virtual bool storesArguments() { return false; }
+
+  /**
+   * invoke with the arguments of each batch read from python.
+   * @param args the arguments scanned from the samples of the batch.
+   * @param sampleBatchSizes the batch size of each sample, empty if all the
+   *                         samples have batch size 1.
+   */
+  virtual void dropArguments(const std::vector<Argument>& args,
+                             const std::vector<size_t>& sampleBatchSizes) {}
+
+  /**
+   * invoke when a pass read from python is finished.
+   */
+  virtual void finishPass() {}
+
+  /**
+   * Load a batch from the stored arguments.
+   * @param size batch size.
+   * @param canOverBatchSize whether the last sample can make the batch larger
+   *                         than size.
+   * @param shuffle whether to shuffle the samples, at the start of a pass.
+   * @param [out] args arguments of the batch.
+   * @return the batch size, 0 at the end of pass.
+   */
+  virtual size_t loadArguments(size_t size, bool canOverBatchSize,
+                               bool shuffle, std::vector<Argument>* args) {
+    LOG(FATAL) << "Not implemented";
+    return 0;
+  }
+
   /**
    * Factory method. Convert CacheType to IPyDataProviderCache*
    */
-  static IPyDataProviderCache* create(CacheType ct);
+  static IPyDataProviderCache* create(
+      CacheType ct, const std::vector<SlotHeader>& headers);
+};
+
+/**
+ * Slot data scanned from samples.
+ *
+ * The data is stored column by column: for each slot, the rows of all the
+ * samples are stored contiguously, together with the offsets of each sample.
+ * The arguments of a batch made of any samples can be built from them by
+ * memcpy, without python. It is used by the binary cache, and is also the
+ * format in which the worker processes send their samples.
+ */
+class ScannedSamples {
+public:
+  /// the i-th sample of a ScannedSamples
+  typedef std::pair<const ScannedSamples*, size_t> Sample;
+
+  explicit ScannedSamples(const std::vector<SlotHeader>& headers)
+      : headers_(headers) {
+    clear();
+  }
+
+  void clear() {
+    slots_.clear();
+    slots_.resize(headers_.size());
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      slots_[i].sampleRows.push_back(0);
+      if (headers_[i].seqType == SQT_SUBSEQ) {
+        slots_[i].sampleSubSeqs.push_back(0);
+      }
+      if (isSparse(headers_[i])) {
+        slots_[i].rowNnz.push_back(0);
+      }
+    }
+    batchSizes_.clear();
+    numSamples_ = 0;
+  }
+
+  /**
+   * Append the samples of a batch.
+   * @param args the arguments scanned from the samples of the batch.
+   * @param sampleBatchSizes the batch size of each sample, empty if all the
+   *                         samples have batch size 1.
+   */
+  void add(const std::vector<Argument>& args,
+           const std::vector<size_t>& sampleBatchSizes) {
+    CHECK_EQ(args.size(), headers_.size());
+    size_t numSamples = 0;
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      size_t n = addSlot(headers_[i], args[i], &slots_[i]);
+      CHECK(i == 0 || n == numSamples) << "Slots have different batch sizes";
+      numSamples = n;
+    }
+    CHECK(sampleBatchSizes.empty() ||
+          sampleBatchSizes.size() == numSamples);
+    // either all the samples have a batch size, or none.
+    CHECK(numSamples_ == 0 || batchSizes_.empty() == sampleBatchSizes.empty());
+    batchSizes_.insert(batchSizes_.end(), sampleBatchSizes.begin(),
+                       sampleBatchSizes.end());
+    numSamples_ += numSamples;
+  }
+
+  size_t getNumSamples() const {
+    return numSamples_;
+  }
+
+  size_t getBatchSize(size_t i) const {
+    return batchSizes_.empty() ? 1 : batchSizes_[i];
+  }
+
+  /**
+   * Release the memory reserved for more samples.
+   */
+  void shrink() {
+    for (auto& slot : slots_) {
+      slot.sampleRows.shrink_to_fit();
+      slot.sampleSubSeqs.shrink_to_fit();
+      slot.subSeqLengths.shrink_to_fit();
+      slot.rowNnz.shrink_to_fit();
+      slot.ids.shrink_to_fit();
+      slot.values.shrink_to_fit();
+    }
+    batchSizes_.shrink_to_fit();
+  }
+
+  /**
+   * Append the samples to buf, to be read by deserialize().
+   */
+  void serialize(std::vector<char>* buf) const {
+    writeVector(batchSizes_, buf);
+    for (auto& slot : slots_) {
+      writeVector(slot.sampleRows, buf);
+      writeVector(slot.sampleSubSeqs, buf);
+      writeVector(slot.subSeqLengths, buf);
+      writeVector(slot.rowNnz, buf);
+      writeVector(slot.ids, buf);
+      writeVector(slot.values, buf);
+    }
+  }
+
+  /**
+   * Replace the samples by the ones serialized in data[0, size).
+   */
+  void deserialize(const char* data, size_t size) {
+    const char* end = data + size;
+    data = readVector(data, end, &batchSizes_);
+    for (auto& slot : slots_) {
+      data = readVector(data, end, &slot.sampleRows);
+      data = readVector(data, end, &slot.sampleSubSeqs);
+      data = readVector(data, end, &slot.subSeqLengths);
+      data = readVector(data, end, &slot.rowNnz);
+      data = readVector(data, end, &slot.ids);
+      data = readVector(data, end, &slot.values);
+    }
+    CHECK(data == end);
+    numSamples_ = slots_.empty() ? 0 : slots_[0].sampleRows.size() - 1;
+  }
+
+  /**
+   * Fill the arguments of a batch made of the samples.
+   */
+  static void fill(const std::vector<SlotHeader>& headers,
+                   const std::vector<Sample>& samples,
+                   std::vector<Argument>* args) {
+    args->resize(headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+      fillSlot(headers[i], i, samples, &(*args)[i]);
+    }
+  }
+
+private:
+  /**
+   * Scanned data of a slot.
+   */
+  struct SlotData {
+    /// first row of each sample, number of samples + 1
+    std::vector<size_t> sampleRows;
+    /// first sub-sequence of each sample, for sub-sequence slots
+    std::vector<size_t> sampleSubSeqs;
+    /// number of rows of each sub-sequence
+    std::vector<int> subSeqLengths;
+    /// first non-zero of each row, for sparse slots
+    std::vector<size_t> rowNnz;
+    /// id of each row for index slots, column of each non-zero for sparse
+    std::vector<int> ids;
+    /// dense rows, or value of each non-zero for sparse value slots
+    std::vector<real> values;
+  };
+
+  static bool isSparse(const SlotHeader& header) {
+    return header.slotType == ST_NON_SPARSE_VALUE ||
+           header.slotType == ST_SPARSE_VALUE;
+  }
+
+  template <typename T>
+  static void writeVector(const std::vector<T>& vec, std::vector<char>* buf) {
+    uint64_t size = vec.size();
+    const char* sizeBytes = reinterpret_cast<const char*>(&size);
+    buf->insert(buf->end(), sizeBytes, sizeBytes + sizeof(size));
+    const char* bytes = reinterpret_cast<const char*>(vec.data());
+    buf->insert(buf->end(), bytes, bytes + size * sizeof(T));
+  }
+
+  template <typename T>
+  static const char* readVector(const char* data, const char* end,
+                                std::vector<T>* vec) {
+    uint64_t size;
+    CHECK_LE(data + sizeof(size), end);
+    memcpy(&size, data, sizeof(size));
+    data += sizeof(size);
+    CHECK_LE(size * sizeof(T), (uint64_t)(end - data));
+    vec->resize(size);
+    memcpy(vec->data(), data, size * sizeof(T));
+    return data + size * sizeof(T);
+  }
+
+  /**
+   * Append the data of a slot of a batch.
+   * @return number of samples of the batch.
+   */
+  static size_t addSlot(const SlotHeader& header, const Argument& arg,
+                        SlotData* slot) {
+    size_t numRows = 0;
+    switch (header.slotType) {
+      case ST_DENSE: {
+        numRows = arg.value->getHeight();
+        const real* data = arg.value->getData();
+        slot->values.insert(slot->values.end(), data,
+                            data + numRows * header.dim);
+        break;
+      }
+      case ST_INDEX: {
+        numRows = arg.ids->getSize();
+        const int* data = arg.ids->getData();
+        slot->ids.insert(slot->ids.end(), data, data + numRows);
+        break;
+      }
+      case ST_NON_SPARSE_VALUE:
+      case ST_SPARSE_VALUE: {
+        auto smat = dynamic_cast<CpuSparseMatrix*>(arg.value.get());
+        CHECK(smat);
+        numRows = smat->getHeight();
+        const int* rows = smat->getRows();
+        size_t nnz = rows[numRows];
+        slot->ids.insert(slot->ids.end(), smat->getCols(),
+                         smat->getCols() + nnz);
+        if (header.slotType == ST_SPARSE_VALUE) {
+          slot->values.insert(slot->values.end(), smat->getValue(),
+                              smat->getValue() + nnz);
+        }
+        size_t base = slot->rowNnz.back();
+        for (size_t r = 1; r <= numRows; ++r) {
+          slot->rowNnz.push_back(base + rows[r]);
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Not implemented " << header.slotType;
+    }
+
+    size_t rowBase = slot->sampleRows.back();
+    if (header.seqType == SQT_NONE) {
+      for (size_t r = 1; r <= numRows; ++r) {
+        slot->sampleRows.push_back(rowBase + r);
+      }
+      return numRows;
+    }
+
+    const int* seqStarts = arg.sequenceStartPositions->getData(false);
+    size_t numSeqs = arg.sequenceStartPositions->getSize() - 1;
+    CHECK_EQ((size_t)seqStarts[numSeqs], numRows);
+    for (size_t s = 1; s <= numSeqs; ++s) {
+      slot->sampleRows.push_back(rowBase + seqStarts[s]);
+    }
+    if (header.seqType == SQT_SUBSEQ) {
+      const int* subSeqStarts = arg.subSequenceStartPositions->getData(false);
+      size_t numSubSeqs = arg.subSequenceStartPositions->getSize() - 1;
+      size_t subSeqBase = slot->subSeqLengths.size();
+      size_t k = 0;
+      for (size_t s = 1; s <= numSeqs; ++s) {
+        // an empty sub-sequence between two sequences is kept with the first.
+        while (k < numSubSeqs && subSeqStarts[k + 1] <= seqStarts[s]) {
+          slot->subSeqLengths.push_back(subSeqStarts[k + 1] - subSeqStarts[k]);
+          ++k;
+        }
+        slot->sampleSubSeqs.push_back(subSeqBase + k);
+      }
+      CHECK_EQ(k, numSubSeqs);
+    }
+    return numSeqs;
+  }
+
+  /**
+   * Fill the argument of the slotId-th slot with the samples.
+   */
+  static void fillSlot(const SlotHeader& header, size_t slotId,
+                       const std::vector<Sample>& samples, Argument* arg) {
+    size_t numRows = 0;
+    size_t nnz = 0;
+    size_t numSubSeqs = 0;
+    for (auto& sample : samples) {
+      const SlotData& slot = sample.first->slots_[slotId];
+      size_t s = sample.second;
+      numRows += slot.sampleRows[s + 1] - slot.sampleRows[s];
+      if (!slot.rowNnz.empty()) {
+        nnz += slot.rowNnz[slot.sampleRows[s + 1]] -
+               slot.rowNnz[slot.sampleRows[s]];
+      }
+      if (header.seqType == SQT_SUBSEQ) {
+        numSubSeqs += slot.sampleSubSeqs[s + 1] - slot.sampleSubSeqs[s];
+      }
+    }
+
+    switch (header.slotType) {
+      case ST_DENSE: {
+        Matrix::resizeOrCreate(arg->value, numRows, header.dim, false, false);
+        real* data = arg->value->getData();
+        for (auto& sample : samples) {
+          const SlotData& slot = sample.first->slots_[slotId];
+          size_t begin = slot.sampleRows[sample.second] * header.dim;
+          size_t len = slot.sampleRows[sample.second + 1] * header.dim - begin;
+          memcpy(data, slot.values.data() + begin, len * sizeof(real));
+          data += len;
+        }
+        break;
+      }
+      case ST_INDEX: {
+        IVector::resizeOrCreate(arg->ids, numRows, false);
+        int* data = arg->ids->getData();
+        for (auto& sample : samples) {
+          const SlotData& slot = sample.first->slots_[slotId];
+          size_t begin = slot.sampleRows[sample.second];
+          size_t len = slot.sampleRows[sample.second + 1] - begin;
+          memcpy(data, slot.ids.data() + begin, len * sizeof(int));
+          data += len;
+        }
+        break;
+      }
+      case ST_NON_SPARSE_VALUE:
+      case ST_SPARSE_VALUE: {
+        bool hasValue = header.slotType == ST_SPARSE_VALUE;
+        Matrix::resizeOrCreateSparseMatrix(arg->value, numRows, header.dim,
+                                           nnz,
+                                           hasValue ? FLOAT_VALUE : NO_VALUE);
+        auto smat = (CpuSparseMatrix*) (arg->value.get());
+        int* rows = smat->getRows();
+        int* cols = smat->getCols();
+        real* values = smat->getValue();
+        size_t row = 0;
+        rows[0] = 0;
+        for (auto& sample : samples) {
+          const SlotData& slot = sample.first->slots_[slotId];
+          size_t rowBegin = slot.sampleRows[sample.second];
+          size_t rowEnd = slot.sampleRows[sample.second + 1];
+          size_t nnzBegin = slot.rowNnz[rowBegin];
+          for (size_t r = rowBegin; r < rowEnd; ++r, ++row) {
+            rows[row + 1] = rows[row] + (slot.rowNnz[r + 1] - slot.rowNnz[r]);
+          }
+          size_t len = slot.rowNnz[rowEnd] - nnzBegin;
+          memcpy(cols, slot.ids.data() + nnzBegin, len * sizeof(int));
+          cols += len;
+          if (hasValue) {
+            memcpy(values, slot.values.data() + nnzBegin, len * sizeof(real));
+            values += len;
+          }
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Not implemented " << header.slotType;
+    }
+
+    if (header.seqType == SQT_NONE) {
+      return;
+    }
+    ICpuGpuVector::resizeOrCreate(arg->sequenceStartPositions,
+                                  samples.size() + 1, false);
+    int* seqStarts = arg->sequenceStartPositions->getMutableData(false);
+    seqStarts[0] = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      const SlotData& slot = samples[i].first->slots_[slotId];
+      size_t s = samples[i].second;
+      seqStarts[i + 1] =
+          seqStarts[i] + (slot.sampleRows[s + 1] - slot.sampleRows[s]);
+    }
+    if (header.seqType == SQT_SUBSEQ) {
+      ICpuGpuVector::resizeOrCreate(arg->subSequenceStartPositions,
+                                    numSubSeqs + 1, false);
+      int* subSeqStarts =
+          arg->subSequenceStartPositions->getMutableData(false);
+      size_t k = 0;
+      subSeqStarts[0] = 0;
+      for (auto& sample : samples) {
+        const SlotData& slot = sample.first->slots_[slotId];
+        for (size_t j = slot.sampleSubSeqs[sample.second];
+             j < slot.sampleSubSeqs[sample.second + 1]; ++j, ++k) {
+          subSeqStarts[k + 1] = subSeqStarts[k] + slot.subSeqLengths[j];
+        }
+      }
+    }
+  }
+
+  const std::vector<SlotHeader>& headers_;
+  std::vector<SlotData> slots_;
+  /// batch size of each sample, empty if they are all 1
+  std::vector<size_t> batchSizes_;
+  size_t numSamples_;
 };
 
 /**
@@ -193,6 +606,11 @@ public:
  *
  * Here, we start a thread to read data. It is totally asynchronous for reading
  * data. And it support cache strategies.
+ *
+ * If num_workers is set, the generator runs in num_workers forked processes
+ * instead, each over a shard of the file list. They scan the samples into
+ * ScannedSamples and send them through a SharedMemoryRing, so the trainer
+ * process builds the batches without python.
  */
 class PyDataProvider2 : public DataProvider {
 public:
@@ -334,8 +752,16 @@ private:
     for (auto & header : headers_) {
       DBG << header;
     }
-    cache_.reset(IPyDataProviderCache::create(
-        (CacheType)self.getIntAttrWithError<int>("cache")));
+    CacheType cacheType = (CacheType)self.getIntAttrWithError<int>("cache");
+    cache_.reset(IPyDataProviderCache::create(cacheType, headers_));
+
+    this->numWorkers_ = self.getIntAttr<size_t>("num_workers", &ok);
+    if (!ok) {
+      this->numWorkers_ = 0;
+    }
+    CHECK(numWorkers_ == 0 || cacheType != CACHE_PASS_IN_MEM)
+        << "num_workers cannot be used with CACHE_PASS_IN_MEM, because the "
+        << "python objects are not in the trainer process";
   }
 
   PyObjectPtr loadPyFileLists(const std::string& fileListName) {
@@ -419,6 +845,213 @@ private:
     DBG << "load thread end";
   }
 
+  /**
+   * A worker process and the thread reading the samples it sends.
+   */
+  struct Worker {
+    pid_t pid;
+    std::unique_ptr<SharedMemoryRing> ring;
+    std::unique_ptr<std::thread> reader;
+    /// whether the process was waited
+    bool exited;
+  };
+
+  /// capacity of the ring buffer of each worker.
+  static const size_t kWorkerRingSize = 16 * 1024 * 1024;
+  /// number of samples a worker scans and sends at once.
+  static const size_t kWorkerMessageSamples = 128;
+
+  void startWorkers() {
+    DBG << "Start " << numWorkers_ << " workers.";
+    numActiveReaders_ = numWorkers_;
+    for (size_t i = 0; i < numWorkers_; ++i) {
+      workers_.emplace_back(new Worker());
+      workers_.back()->ring.reset(new SharedMemoryRing(kWorkerRingSize));
+      workers_.back()->exited = false;
+    }
+    {
+      // no other thread calls python while forking.
+      PyGuard guard;
+      fflush(stdout);
+      fflush(stderr);
+      for (size_t i = 0; i < numWorkers_; ++i) {
+        pid_t pid = fork();
+        PCHECK(pid >= 0) << "Cannot fork PyDataProvider2 worker";
+        if (pid == 0) {
+          // The pool allocators are unlocked by their fork handlers, but the
+          // lock of glog may have been held by another thread of the trainer
+          // when forking. So the worker drops all its log messages, and a
+          // failed CHECK only tells that the worker failed.
+          logging::setMinLogLevel(NUM_SEVERITIES);
+          logging::installFailureFunction(workerFailure);
+          reinitPythonAfterFork();
+          workerMain(i);
+          _exit(0);
+        }
+        workers_[i]->pid = pid;
+      }
+    }
+    for (auto& worker : workers_) {
+      Worker* w = worker.get();
+      w->reader.reset(new std::thread([this, w] {
+        readWorker(w);
+      }));
+    }
+  }
+
+  void stopWorkers() {
+    if (workers_.empty()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(mtx_);
+      exit_ = true;
+    }
+    pushCV_.notify_all();
+    for (auto& worker : workers_) {
+      worker->ring->stop();
+    }
+    for (auto& worker : workers_) {
+      worker->reader->join();
+      if (!worker->exited) {
+        kill(worker->pid, SIGKILL);
+        waitpid(worker->pid, nullptr, 0);
+      }
+    }
+    workers_.clear();
+  }
+
+  /// called by a failed CHECK in a worker process, see startWorkers()
+  static void workerFailure() {
+    static const char kMessage[] =
+        "PyDataProvider2 worker failed, "
+        "run it with num_workers=0 to see the error\n";
+    ssize_t ret = write(STDERR_FILENO, kMessage, sizeof(kMessage) - 1);
+    (void)ret;
+    _exit(1);
+  }
+
+  /**
+   * Main function of the workerId-th worker process. It reads the files
+   * i * numWorkers_ + workerId like loadThread(), and sends the samples to
+   * the trainer process.
+   */
+  void workerMain(size_t workerId) {
+    pid_t trainer = getppid();
+    SharedMemoryRing::AliveCallback isTrainerAlive = [trainer] {
+      return getppid() == trainer;
+    };
+    SharedMemoryRing& ring = *workers_[workerId]->ring;
+
+    std::deque<PyObjectPtr> contexts;
+    for (size_t i = workerId; i < fileLists_.size(); i += numWorkers_) {
+      py::CallableHelper generator(this->generator_);
+      generator.setArgsSize(2);
+      generator.getArgs().set(0, instance_);
+      generator.getArgs().set(1, PyString_FromString(fileLists_[i].c_str()),
+                              true);
+      contexts.emplace_back(generator());
+      CHECK_PY(contexts.back()) << "Generator error.";
+      CHECK(PyIter_Check(contexts.back()));
+    }
+
+    PositionRandom p(skipShuffle_);
+    ScannedSamples samples(headers_);
+    std::deque<PyObjectPtr> data;
+    std::vector<size_t> sampleBatchSizes;
+    std::vector<Argument> args;
+    std::vector<char> buf;
+    auto send = [&]() -> bool {
+      scanSamples(data, &args);
+      samples.clear();
+      samples.add(args, sampleBatchSizes);
+      buf.clear();
+      samples.serialize(&buf);
+      data.clear();
+      sampleBatchSizes.clear();
+      return ring.writeMessage(buf, isTrainerAlive);
+    };
+
+    while (!contexts.empty()) {
+      size_t cid = p(contexts.size());
+      bool atEnd;
+      PyObject* obj = py::iterNext(contexts[cid], &atEnd);
+      if (atEnd || obj == nullptr) {
+        std::swap(contexts[cid], contexts.front());
+        contexts.pop_front();
+        continue;
+      }
+      data.emplace_back(obj);
+      if (calcBatchSize_) {
+        py::CallableHelper calcBatchSize(this->calcBatchSize_);
+        calcBatchSize.setArgsSize(1);
+        calcBatchSize.getArgs().set(0, obj);
+        PyObjectPtr bs(calcBatchSize());
+        CHECK_PY(bs);
+        bool ok;
+        sampleBatchSizes.push_back(py::castInt<size_t>(bs.get(), &ok));
+        CHECK(ok) << "CalcBatchSize must return int or long";
+      }
+      if (data.size() >= kWorkerMessageSamples && !send()) {
+        return;  // the trainer stopped reading.
+      }
+    }
+    if (!data.empty() && !send()) {
+      return;
+    }
+    ring.close();
+  }
+
+  /**
+   * Read the samples sent by a worker into samplePool_.
+   */
+  void readWorker(Worker* worker) {
+    SharedMemoryRing::AliveCallback isWorkerAlive = [this, worker] {
+      if (exit_) {
+        return false;
+      }
+      int status;
+      if (waitpid(worker->pid, &status, WNOHANG) == worker->pid) {
+        worker->exited = true;
+        return false;
+      }
+      return true;
+    };
+
+    std::vector<char> msg;
+    while (worker->ring->readMessage(&msg, isWorkerAlive)) {
+      auto samples = std::make_shared<ScannedSamples>(headers_);
+      samples->deserialize(msg.data(), msg.size());
+      size_t batchSize = 0;
+      for (size_t i = 0; i < samples->getNumSamples(); ++i) {
+        batchSize += samples->getBatchSize(i);
+      }
+
+      std::unique_lock<std::mutex> l(mtx_);
+      pushCV_.wait(l, [this] {
+        return this->poolActualSize_ < poolSize_ || exit_;
+      });
+      if (exit_) {
+        break;
+      }
+      for (size_t i = 0; i < samples->getNumSamples(); ++i) {
+        samplePool_.emplace_back(samples, i);
+      }
+      poolActualSize_ += batchSize;
+      l.unlock();
+      pullCV_.notify_all();
+    }
+    CHECK(exit_ || worker->ring->isClosed())
+        << "PyDataProvider2 worker " << worker->pid << " died";
+
+    {
+      std::lock_guard<std::mutex> guard(mtx_);
+      --numActiveReaders_;
+    }
+    pullCV_.notify_all();
+    DBG << "worker reader end";
+  }
+
   inline void resetImpl(bool startNewThread) {
     DBG << "Reseting " << startNewThread;
     if (loadThread_) {  // is loading.
@@ -426,19 +1059,25 @@ private:
       loadThread_->join();
       loadThread_.reset();
     }
+    stopWorkers();
     {
       PyGuard g;
       callingContexts_.clear();
       dataPool_.clear();
     }
+    samplePool_.clear();
     poolActualSize_ = 0;
     exit_ = false;
     if (startNewThread && cache_->reset()) {
-      DBG << "Start new thread.";
-      loadThread_.reset(new std::thread([this] {
-        loadThread();
-      }));
-      callingContextCreated_.wait();
+      if (numWorkers_ > 0) {
+        startWorkers();
+      } else {
+        DBG << "Start new thread.";
+        loadThread_.reset(new std::thread([this] {
+          loadThread();
+        }));
+        callingContextCreated_.wait();
+      }
     }
     DBG << "Reset done";
   }
@@ -455,6 +1094,13 @@ private:
   ThreadBarrier callingContextCreated_;
   std::unique_ptr<IPyDataProviderCache> cache_;
 
+  size_t numWorkers_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  /// samples read from the workers.
+  std::deque<std::pair<std::shared_ptr<ScannedSamples>, size_t>> samplePool_;
+  /// number of workers whose samples are not all read.
+  size_t numActiveReaders_;
+
   PyObjectPtr instance_;
   size_t poolSize_;
   size_t minPoolSize_;
@@ -518,6 +1164,21 @@ public:
   int64_t getNextBatchInternal(int64_t size_, DataBatch *batch) {
     CHECK_GE(size_, 0);
     size_t size = (size_t) size_;
+    if (!workers_.empty()) {
+      return getNextBatchFromWorkers(size, batch);
+    }
+    if (!loadThread_ && cache_->storesArguments()) {  // no python at all.
+      DataBatch cpuBatch;
+      size_t bsize = cache_->loadArguments(size, canOverBatchSize_,
+                                           !skipShuffle_,
+                                           &cpuBatch.getStreams());
+      if (bsize == 0) {
+        return 0;
+      }
+      cpuBatch.setSize(bsize);
+      setBatch(cpuBatch, size, batch);
+      return bsize;
+    }
     if (loadThread_) {  // loading from thread should wait for data pool ready.
                         // but, loading from cache, cache object should ensure
                         // data pool ready.
@@ -533,6 +1194,7 @@ public:
     }
     std::deque<PyObjectPtr> data;
     size_t bsize = 0;
+    std::vector<size_t> sampleBatchSizes;
     std::deque<PyObjectPtr>* poolPtr = nullptr;
 
     if (this->loadThread_) {  // loading from thread.
@@ -581,6 +1243,7 @@ public:
             break;
           } else {
             bsize += tmp;
+            sampleBatchSizes.push_back(tmp);
           }
         } else {
           bsize += 1;
@@ -597,12 +1260,95 @@ public:
     }
 
     if (bsize == 0) {  // end of pass. In data pool, cannot get any data.
+      if (this->loadThread_) {
+        cache_->finishPass();
+      }
       return 0;
     }
 
     DataBatch cpuBatch;
     cpuBatch.setSize(bsize);
     auto& inArgs = cpuBatch.getStreams();
+    scanSamples(data, &inArgs);
+
+    if (this->loadThread_) {
+      cache_->dropArguments(inArgs, sampleBatchSizes);
+    }
+    {
+      PyGuard g;
+      cache_->drop(&data);
+    }
+
+    DBG << "Reading CPU Batch Done.";
+    setBatch(cpuBatch, size, batch);
+    return bsize;
+  }
+
+private:
+  /**
+   * Loading a batch from the samples sent by the workers.
+   */
+  int64_t getNextBatchFromWorkers(size_t size, DataBatch* batch) {
+    size_t bsize = 0;
+    std::vector<size_t> sampleBatchSizes;
+    std::vector<ScannedSamples::Sample> samples;
+    // keep the samples alive until the batch is filled.
+    std::vector<std::shared_ptr<ScannedSamples>> holders;
+    {
+      std::unique_lock<std::mutex> l(mtx_);
+      pullCV_.wait(l, [this, &size] {
+        return this->poolActualSize_ >= std::max(size, this->minPoolSize_)
+            || numActiveReaders_ == 0;
+      });
+
+      if (unittest::OnPoolFilled) {
+        (*unittest::OnPoolFilled)(this->poolActualSize_);
+      }
+
+      while (bsize < size && !samplePool_.empty()) {
+        if (!skipShuffle_) {
+          size_t i = ThreadLocalRand::rand() % samplePool_.size();
+          if (i != 0) {
+            std::swap(samplePool_[i], samplePool_.front());
+          }
+        }
+        auto& sample = samplePool_.front();
+        size_t tmp = sample.first->getBatchSize(sample.second);
+        if (bsize + tmp > size && !canOverBatchSize_) {
+          break;
+        }
+        bsize += tmp;
+        if (calcBatchSize_) {
+          sampleBatchSizes.push_back(tmp);
+        }
+        samples.emplace_back(sample.first.get(), sample.second);
+        holders.emplace_back(std::move(sample.first));
+        samplePool_.pop_front();
+      }
+      poolActualSize_ -= bsize;
+    }
+    this->pushCV_.notify_all();
+
+    if (bsize == 0) {  // end of pass.
+      cache_->finishPass();
+      return 0;
+    }
+
+    DataBatch cpuBatch;
+    cpuBatch.setSize(bsize);
+    auto& inArgs = cpuBatch.getStreams();
+    ScannedSamples::fill(headers_, samples, &inArgs);
+    cache_->dropArguments(inArgs, sampleBatchSizes);
+    setBatch(cpuBatch, size, batch);
+    return bsize;
+  }
+
+  /**
+   * Scan the slots of the python samples into the arguments.
+   */
+  void scanSamples(const std::deque<PyObjectPtr>& data,
+                   std::vector<Argument>* args) {
+    auto& inArgs = *args;
     inArgs.resize(headers_.size());
     std::vector<std::unique_ptr<IFieldScanner> > scanners;
     scanners.reserve(headers_.size());
@@ -635,14 +1381,12 @@ public:
     for (size_t i=0; i < headers_.size(); ++i) {
       scanners[i]->finishFill(inArgs[i]);
     }
+  }
 
-    {
-      PyGuard g;
-      cache_->drop(&data);
-    }
-
-    DBG << "Reading CPU Batch Done.";
-
+  /**
+   * Set the batch from the cpu batch, copying it to gpu if necessary.
+   */
+  void setBatch(DataBatch& cpuBatch, size_t size, DataBatch* batch) {
     if (useGpu_) {
       std::vector<Argument>& cpuArguments = cpuBatch.getStreams();
       DataBatch& gpuBatch = *batch;
@@ -657,7 +1401,6 @@ public:
     } else {
       *batch = cpuBatch;
     }
-    return bsize;
   }
 };
 
@@ -1025,13 +1768,103 @@ private:
   std::unique_ptr<std::deque<PyObjectPtr> > droppedPool_;
 };
 
+/**
+ * Cache One Pass In Binary strategy.
+ *
+ * In first pass, will load data from python, and store the slot data scanned
+ * from them as ScannedSamples. The rest passes build the arguments of each
+ * batch from them by memcpy, without python, and the cache takes much less
+ * memory than python objects.
+ */
+class CacheOnePassInBinary : public IPyDataProviderCache {
+public:
+  explicit CacheOnePassInBinary(const std::vector<SlotHeader>& headers)
+      : headers_(headers), samples_(headers), complete_(false), pos_(0) {}
+
+  virtual bool reset() {
+    if (!complete_) {  // first pass, or the first pass was not finished.
+      samples_.clear();
+      return true;
+    }
+    pos_ = 0;
+    return false;
+  }
+
+  virtual void drop(std::deque<PyObjectPtr>* data) {
+    data->clear();
+  }
+
+  virtual std::deque<PyObjectPtr>* load() {
+    return nullptr;
+  }
+
+  virtual bool storesArguments() {
+    return true;
+  }
+
+  virtual void dropArguments(const std::vector<Argument>& args,
+                             const std::vector<size_t>& sampleBatchSizes) {
+    samples_.add(args, sampleBatchSizes);
+  }
+
+  virtual void finishPass() {
+    if (complete_) {
+      return;
+    }
+    samples_.shrink();
+    order_.resize(samples_.getNumSamples());
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = i;
+    }
+    complete_ = true;
+    LOG(INFO) << "Cached " << order_.size() << " samples in binary";
+  }
+
+  virtual size_t loadArguments(size_t size, bool canOverBatchSize,
+                               bool shuffle, std::vector<Argument>* args) {
+    CHECK(complete_);
+    if (pos_ == 0 && shuffle) {
+      std::shuffle(order_.begin(), order_.end(),
+                   ThreadLocalRandomEngine::get());
+    }
+    size_t bsize = 0;
+    batch_.clear();
+    while (bsize < size && pos_ < order_.size()) {
+      size_t n = samples_.getBatchSize(order_[pos_]);
+      if (bsize + n > size && !canOverBatchSize) {
+        break;
+      }
+      bsize += n;
+      batch_.emplace_back(&samples_, order_[pos_++]);
+    }
+    if (bsize != 0) {
+      ScannedSamples::fill(headers_, batch_, args);
+    }
+    return bsize;
+  }
+
+private:
+  const std::vector<SlotHeader>& headers_;
+  ScannedSamples samples_;
+  /// whether the first pass was finished
+  bool complete_;
+  /// samples in the order of the current pass
+  std::vector<size_t> order_;
+  /// next sample in order_
+  size_t pos_;
+  std::vector<ScannedSamples::Sample> batch_;
+};
+
 
-IPyDataProviderCache* IPyDataProviderCache::create(CacheType ct) {
+IPyDataProviderCache* IPyDataProviderCache::create(
+    CacheType ct, const std::vector<SlotHeader>& headers) {
   switch (ct) {
     case NO_CACHE:
       return new NoCacheStrategy();
     case CACHE_PASS_IN_MEM:
       return new CacheOnePassInMemory();
+    case CACHE_PASS_IN_BINARY:
+      return new CacheOnePassInBinary(headers);
     default:
       LOG(FATAL) << "Not implemented";
   }
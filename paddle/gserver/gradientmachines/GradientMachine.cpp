@@ -25,6 +25,7 @@ limitations under the License. */
 #include "NeuralNetwork.h"
 #include "MultiNetwork.h"
 #include "GradientMachineMode.h"
+#include "paddle/parameter/MappedModel.h"
 
 namespace paddle {
 
@@ -61,9 +62,12 @@ GradientMachine* GradientMachine::create(
 
 GradientMachine* GradientMachine::create(const std::string& modelFile,
                                          DataConfig* dataConfig) {
-  std::ifstream is(modelFile);
-  CHECK(is) << "Fail to open " << modelFile;
-  return create(is, dataConfig);
+  TrainerConfig trainerConfig;
+  GradientMachine* ret = create(modelFile, &trainerConfig);
+  if (dataConfig && trainerConfig.has_data_config()) {
+    *dataConfig = trainerConfig.data_config();
+  }
+  return ret;
 }
 
 GradientMachine* GradientMachine::create(std::istream& is,
@@ -76,8 +80,59 @@ GradientMachine* GradientMachine::create(std::istream& is,
   return ret;
 }
 
+/**
+ * Create a gradient machine for inference from a mapped model file.
+ *
+ * For a single-threaded cpu network, the dense parameters are bound to the
+ * read-only mapping before the layers are created, so no value is copied.
+ * Otherwise the values are copied out of the mapping.
+ */
+GradientMachine* GradientMachine::createFromMappedModel(
+    const std::string& modelFile, TrainerConfig* trainerConfig) {
+  auto model = std::make_shared<MappedModel>(modelFile);
+  TrainerConfig trainerConfigTemp;
+  CHECK(trainerConfigTemp.ParseFromString(model->getConfig()))
+      << "Fail to parse config";
+  const ModelConfig& config = trainerConfigTemp.model_config();
+
+  std::unique_ptr<GradientMachine> machine;
+  if (!FLAGS_use_gpu && FLAGS_trainer_count == 1 && !FLAGS_parallel_nn &&
+      config.type() != "multi_nn") {
+    NeuralNetwork* nn = NeuralNetwork::create(config);
+    machine.reset(nn);
+    size_t numBound = 0;
+    nn->init(config, [&](int paramId, Parameter* para) {
+      para->setID(paramId);
+      if (model->bindParameter(para)) {
+        ++numBound;
+      } else {
+        para->enableType(PARAMETER_VALUE);
+        model->loadParameter(para);
+      }
+    });
+    LOG(INFO) << "Mapped " << numBound << " of "
+              << model->getNumParameters() << " parameters from "
+              << modelFile;
+  } else {
+    machine.reset(GradientMachine::create(config));
+    for (auto& para : machine->getParameters()) {
+      model->loadParameter(para.get());
+    }
+  }
+
+  machine->onLoadParameter();
+
+  if (trainerConfig) {
+    *trainerConfig = trainerConfigTemp;
+  }
+  return machine.release();
+}
+
 GradientMachine* GradientMachine::create(const std::string& modelFile,
                                          TrainerConfig* trainerConfig) {
+  if (MappedModel::isMappedModel(modelFile)) {
+    return createFromMappedModel(modelFile, trainerConfig);
+  }
   std::ifstream is(modelFile);
   CHECK(is) << "Fail to open " << modelFile;
   return create(is, trainerConfig);
@@ -110,6 +110,11 @@ public:
    * Create a gradient machine from the merged model file.
    * The merged model file can be generated using tools/merge_model
    * If trainerConfig is not null, it will be filled with the TrainerConfig
+   *
+   * A model merged with --mmap_model_format is memory-mapped instead of
+   * being read. The machine is then only usable for inference: the cpu
+   * parameter values share the read-only mapping and no gradient buffer
+   * is created.
    */
   static GradientMachine* create(const std::string& modelFile,
                                  TrainerConfig* trainerConfig);
@@ -266,6 +271,9 @@ public:
 protected:
   virtual void onLoadParameter() {}
 
+  static GradientMachine* createFromMappedModel(const std::string& modelFile,
+                                                TrainerConfig* trainerConfig);
+
   std::vector<ParameterPtr> parameters_;
   std::vector<ParameterPtr> nonStaticParameters_;
 };
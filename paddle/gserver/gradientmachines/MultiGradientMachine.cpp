@@ -24,12 +24,26 @@ limitations under the License. */
 
 P_DEFINE_bool(allow_only_one_model_on_one_gpu, true,
               "If true, do not allow multiple models on one GPU device");
+P_DEFINE_bool(cpu_reduce_scatter, false,
+              "If true, reduce the gradient of each dense CPU parameter as "
+              "soon as it is ready in all the trainer threads, during "
+              "backward(), instead of after backward() finishes");
 #ifdef PADDLE_METRIC_LEARNING
 P_DECLARE_bool(external);
 #endif
 
 namespace paddle {
 
+// number of gradient values merged at a time by mergeGradDense(), the block
+// of the main gradient stays in cache while the threads gradients are added
+static const size_t kMergeBlockSize = 4096;
+
+// whether the gradient of a CPU parameter is merged by mergeGradDense()
+static bool isDenseCpuGradient(const Parameter& para) {
+  return !para.useGpu() && !para.isStatic() && !para.isSparseRemoteUpdate() &&
+         !para.isGradSparseUpdate();
+}
+
 // get types of the parameters which need to be merged after backward()
 static void fillMergeTypes(PassType passType,
     std::vector<ParameterType>* mergeTypes) {
@@ -162,13 +176,25 @@ MultiGradientMachine::MultiGradientMachine(
 
   // combination of all trainers mainPara into GradientMachine parameters
   hasNonstaticCpuParamters_ = false;
+  numDenseCpuParameters_ = 0;
+  hasSparseCpuParameters_ = false;
   for (size_t pid = 0; pid  < parameters_.size(); pid++) {
     if (parameters_[pid]->useGpu()) {
       parameters_[pid] = threads_[paraMainThread_[pid]]->getParameters()[pid];
     } else if (!parameters_[pid]->isStatic()) {
       hasNonstaticCpuParamters_ = true;
+      if (isDenseCpuGradient(*parameters_[pid])) {
+        ++numDenseCpuParameters_;
+      } else {
+        hasSparseCpuParameters_ = true;
+      }
     }
   }
+  cpuReduceScatter_ = FLAGS_cpu_reduce_scatter;
+  cpuGradReadyCounts_.reset(new std::atomic<int>[parameters_.size()]);
+  for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+    cpuGradReadyCounts_[pid] = 0;
+  }
 
   gradBufs_.resize(numThreads_);
   for (int i = 0; i < numThreads_; ++i) {
@@ -199,6 +225,15 @@ void MultiGradientMachine::notifyGradientTransfer(int paramId) {
   gradQueue_.enqueue(paramId);
 }
 
+void MultiGradientMachine::notifyCpuGradientReady(int paramId) {
+  if (++cpuGradReadyCounts_[paramId] < numThreads_) return;
+  // the threads notify again only after the merge of this batch
+  cpuGradReadyCounts_[paramId] = 0;
+  for (auto& thread : threads_) {
+    thread->notifyGradientReduce(paramId);
+  }
+}
+
 void MultiGradientMachine::allocGradBufs() {
   if (numLogicalDevices_ == 0) return;
   if (gradBufs_[0][0].bufs.size() >= mergeTypes_.size()) return;
@@ -397,7 +432,8 @@ TrainerThread::TrainerThread(
     : multiMachine_(multiMachine),
       config_(config),
       threadId_(threadId),
-      inArgsCopied_(false) {
+      inArgsCopied_(false),
+      numCpuGradReduced_(0) {
   int numThreads = multiMachine->getNumThreads();
 
   auto& mainParas = multiMachine->getParameters();
@@ -437,6 +473,7 @@ TrainerThread::TrainerThread(
   nn->init(config_, slaveParamInitCb);
   gradientMachine_.reset(nn);
   parameters_ = gradientMachine_->getParameters();
+  cpuGradReady_.resize(parameters_.size(), false);
   if (!FLAGS_parallel_nn) {
     for (auto& para : parameters_) {
       para->setDevice(deviceId_);
@@ -501,6 +538,7 @@ void TrainerThread::stop() {
 
 void TrainerThread::computeThread() {
   VLOG(1) << "gradComputeThread " << threadId_;
+  Timeline::setThreadName("gradComputeThread " + std::to_string(threadId_));
 
   if (deviceId_ >= 0) {
     hl_init(deviceId_);
@@ -595,8 +633,16 @@ void TrainerThread::backward() {
 }
 
 void TrainerThread::backwardCallback(Parameter* para) {
-  // CPU parameters are merged in the end
-  if (!para->useGpu()) return;
+  if (!para->useGpu()) {
+    // CPU parameters are merged in the end, except the dense ones in
+    // --cpu_reduce_scatter mode, which are reduced once ready in all threads
+    if (multiMachine_->isCpuReduceScatter() && isDenseCpuGradient(*para)) {
+      cpuGradReady_[para->getID()] = true;
+      multiMachine_->notifyCpuGradientReady(para->getID());
+      reduceCpuGradients(/* wait= */ false);
+    }
+    return;
+  }
 
   int paramId = para->getID();
   if (multiMachine_->getNumThreads() == 1) {
@@ -613,6 +659,7 @@ void TrainerThread::backwardCallback(Parameter* para) {
 
 void TrainerThread::copyGradToBufferThread() {
   VLOG(1) << "copyGradToBufferThread " << threadId_;
+  Timeline::setThreadName("copyGradToBufferThread " + std::to_string(threadId_));
 
   if (deviceId_ >= 0) {
     hl_init(deviceId_);
@@ -651,6 +698,7 @@ void TrainerThread::copyGradToBufferThread() {
 
 void TrainerThread::gradCollectThread() {
   VLOG(1) << "gradCollectThread " << threadId_;
+  Timeline::setThreadName("gradCollectThread " + std::to_string(threadId_));
 
   if (deviceId_ >= 0) {
     hl_init(deviceId_);
@@ -711,6 +759,7 @@ void TrainerThread::doCallback(int pid) {
 
 void TrainerThread::valueDispatchThread() {
   VLOG(1) << "valueDispatchThread " << threadId_;
+  Timeline::setThreadName("valueDispatchThread " + std::to_string(threadId_));
 
   if (deviceId_ >= 0) {
     hl_init(deviceId_);
@@ -778,6 +827,28 @@ void TrainerThread::mergeCpuGradients() {
   CHECK_EQ(mergeTypes_.size(), 1UL);
   CHECK_EQ(mergeTypes_[0], PARAMETER_GRADIENT);
 
+  bool reduceScatter = multiMachine_->isCpuReduceScatter();
+  if (reduceScatter) {
+    // the gradients of the parameters whose callback is not called, e.g.
+    // those of the layers which do not need gradient, are ready now
+    for (size_t pid = 0; pid < parameters_.size(); ++pid) {
+      if (isDenseCpuGradient(*parameters_[pid]) && !cpuGradReady_[pid]) {
+        multiMachine_->notifyCpuGradientReady(pid);
+      }
+    }
+    {
+      REGISTER_TIMER("waitReduceGradDense");
+      reduceCpuGradients(/* wait= */ true);
+    }
+    cpuGradReady_.assign(parameters_.size(), false);
+    numCpuGradReduced_ = 0;
+    if (!multiMachine_->hasSparseCpuParameters()) {
+      REGISTER_TIMER("waitAfterMerge");
+      multiMachine_->waitAfterMerge();
+      return;
+    }
+  }
+
   {
     REGISTER_TIMER("waitbeforeMerge");
     multiMachine_->waitBeforeMerge();
@@ -788,6 +859,7 @@ void TrainerThread::mergeCpuGradients() {
   CHECK(slaveParameters.size());
   for (auto& para : multiMachine_->getNonStaticParameters()) {
     if (para->useGpu()) continue;
+    if (reduceScatter && isDenseCpuGradient(*para)) continue;
     if (para->isSparseRemoteUpdate()) {
       REGISTER_TIMER("mergeRemoteGradSparse");
       mergeGradSparseRemote(para.get(), slaveParameters);
@@ -854,17 +926,36 @@ void TrainerThread::mergeGradDense(
   size_t startSeq = interval.first;
   size_t copySize = interval.second - interval.first;
 
-  // setup sub bufs
+  // merge block by block, so that the block of destGrad stays in cache
   CpuVector destGrad(0, nullptr);
-  destGrad.subVecFrom(*para->getBuf(PARAMETER_GRADIENT), startSeq, copySize);
-
-  // merge
   CpuVector slaveGradSub(0, nullptr);
-  for (auto slaveParams : slaveParameters) {
-    slaveGradSub.subVecFrom(
-      *(*slaveParams)[pid]->getBuf(PARAMETER_GRADIENT),
-      startSeq, copySize);
-    destGrad.add(slaveGradSub);
+  for (size_t begin = startSeq; begin < startSeq + copySize;
+       begin += kMergeBlockSize) {
+    size_t size = std::min(kMergeBlockSize, startSeq + copySize - begin);
+    destGrad.subVecFrom(*para->getBuf(PARAMETER_GRADIENT), begin, size);
+    for (auto slaveParams : slaveParameters) {
+      slaveGradSub.subVecFrom(
+        *(*slaveParams)[pid]->getBuf(PARAMETER_GRADIENT), begin, size);
+      destGrad.add(slaveGradSub);
+    }
+  }
+}
+
+void TrainerThread::reduceCpuGradients(bool wait) {
+  size_t numParameters = multiMachine_->getNumDenseCpuParameters();
+  while (numCpuGradReduced_ < numParameters) {
+    // only this thread dequeues, so the queue does not get empty after the
+    // check
+    if (!wait && cpuGradReduceQueue_.empty()) break;
+    int pid = cpuGradReduceQueue_.dequeue();
+    std::vector<const std::vector<ParameterPtr>*> slaveParameters =
+        multiMachine_->getSlaveParameters();
+    {
+      REGISTER_TIMER("reduceGradDense");
+      mergeGradDense(multiMachine_->getParameters()[pid].get(),
+                     slaveParameters);
+    }
+    ++numCpuGradReduced_;
   }
 }
 
@@ -89,7 +89,13 @@ struct GradBuffer {
  *     and call the callback supplied by the user to update parameter value.
  *
  *  CPU parameter value has only one copy. And their gradients are merged at the
- *  end of backward().
+ *  end of backward(). Each parameter is split into numThreads chunks, and each
+ *  thread adds the chunk it owns of all the thread gradients to the main
+ *  gradient (reduce-scatter). With --cpu_reduce_scatter, the chunks of a dense
+ *  parameter are reduced as soon as its gradient is ready in all the threads,
+ *  during the backward() of the remaining layers, instead of after a barrier
+ *  at the end of backward(). The chunks are the ones SgdThreadUpdater updates
+ *  in each of its threads.
  *
  *  * Handling of sparse update
  *  Currently, sparse update is only supported for CPU parameters.
@@ -260,6 +266,19 @@ protected:
   /// for paramId is ready
   void notifyGradientTransfer(int paramId);
 
+  /// Whether the dense CPU gradients are reduced during backward()
+  bool isCpuReduceScatter() const { return cpuReduceScatter_; }
+
+  /// Number of the parameters reduced by reduceCpuGradients()
+  size_t getNumDenseCpuParameters() const { return numDenseCpuParameters_; }
+
+  bool hasSparseCpuParameters() const { return hasSparseCpuParameters_; }
+
+  /// Called by TrainerThread when the gradient of the dense CPU parameter
+  /// paramId is ready in the thread. Once it is ready in all the threads,
+  /// every thread is notified to reduce its chunk.
+  void notifyCpuGradientReady(int paramId);
+
   const std::vector<Argument>& getInArgs() {
     return inArgs_;
   }
@@ -312,6 +331,12 @@ protected:
 
   bool hasNonstaticCpuParamters_;
 
+  bool cpuReduceScatter_;
+  size_t numDenseCpuParameters_;
+  bool hasSparseCpuParameters_;
+  /// number of the threads in which the gradient is ready, by parameter id
+  std::unique_ptr<std::atomic<int>[]> cpuGradReadyCounts_;
+
   /// store main parameter only
   std::unique_ptr<GradientMachine> gradientMachine_;
 
@@ -412,6 +437,10 @@ public:
     valueReadyQueue_.enqueue(paramId);
   }
 
+  void notifyGradientReduce(int paramId) {
+    cpuGradReduceQueue_.enqueue(paramId);
+  }
+
   void prefetch();
 
   /// copy the output gradient from the main GradientMachine.
@@ -432,6 +461,10 @@ protected:
     Parameter* para,
     std::vector<const std::vector<ParameterPtr>*>& slaveParameters);
 
+  /// Reduce the chunks of the dense CPU gradients ready in all the threads.
+  /// If wait is true, wait until all of them are reduced.
+  void reduceCpuGradients(bool wait);
+
   void computeThread();
   void valueDispatchThread();
   void copyGradToBufferThread();
@@ -497,6 +530,12 @@ protected:
 
   /// indicate whether inArgs is copied before forward()
   bool inArgsCopied_;
+
+  /// dense CPU gradients ready to be reduced in --cpu_reduce_scatter mode
+  PidQueue cpuGradReduceQueue_;
+  /// whether the gradient is reported to notifyCpuGradientReady()
+  std::vector<bool> cpuGradReady_;
+  size_t numCpuGradReduced_;
 };
 
 
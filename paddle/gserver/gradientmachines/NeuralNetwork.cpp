@@ -13,6 +13,8 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 
+#include <set>
+
 #include "paddle/utils/Util.h"
 
 #include "paddle/utils/Logging.h"
@@ -25,6 +27,12 @@ limitations under the License. */
 #include "MultiNetwork.h"
 #include "paddle/gserver/layers/AgentLayer.h"
 
+P_DEFINE_bool(reuse_inference_memory, false,
+              "In PASS_TEST, recycle the output value of a layer once all "
+              "the layers reading it have run. Only the outputs of the "
+              "output layers, the data layers and the evaluator inputs are "
+              "available after forward.");
+
 namespace paddle {
 void parameterInitNN(int paramId, Parameter* para,
                      std::vector<ParameterPtr>* sharedParams) {
@@ -63,8 +71,60 @@ NeuralNetwork* NeuralNetwork::create(const ModelConfig& config) {
   }
 }
 
+NeuralNetwork* NeuralNetwork::createInferenceReplica() {
+  CHECK(rootNetwork_ == nullptr) << "Only a root network can be replicated";
+  std::unique_ptr<NeuralNetwork> replica(create(config_));
+  auto& params = parameters_;
+  bool useGpu = params.empty() ? FLAGS_use_gpu : params[0]->useGpu();
+  replica->init(config_,
+                [&params](int paramId, Parameter* para) {
+                  CHECK_EQ(params[paramId]->getName(), para->getName());
+                  para->shareValue(*params[paramId]);
+                },
+                {PARAMETER_VALUE}, useGpu);
+  return replica.release();
+}
+
 std::map<std::string, bool> NeuralNetwork::dllInitMap;
 
+/**
+ * The parameters which are only read by the layers computing on the
+ * quantized value of a parameter: fc layers and the fc and table
+ * projections.
+ */
+static std::set<std::string> getQuantizedOnlyParameters(
+    const ModelConfig& config) {
+  std::set<std::string> quantizedOnly;
+  std::set<std::string> dense;
+  for (const auto& layer : config.layers()) {
+    for (const auto& input : layer.inputs()) {
+      if (!input.has_input_parameter_name()) {
+        continue;
+      }
+      bool quantized =
+          layer.type() == "fc" ||
+          (layer.type() == "mixed" && input.has_proj_conf() &&
+           (input.proj_conf().type() == "fc" ||
+            input.proj_conf().type() == "table"));
+      (quantized ? quantizedOnly : dense).insert(input.input_parameter_name());
+    }
+    if (layer.has_bias_parameter_name()) {
+      dense.insert(layer.bias_parameter_name());
+    }
+  }
+  for (const auto& subModel : config.sub_models()) {
+    for (const auto& memory : subModel.memories()) {
+      if (memory.has_boot_bias_parameter_name()) {
+        dense.insert(memory.boot_bias_parameter_name());
+      }
+    }
+  }
+  for (const auto& name : dense) {
+    quantizedOnly.erase(name);
+  }
+  return quantizedOnly;
+}
+
 void NeuralNetwork::init(const ModelConfig& config, ParamInitCallback callback,
                          const std::vector<ParameterType>& parameterTypes,
                          bool useGpu) {
@@ -88,9 +148,11 @@ void NeuralNetwork::init(const ModelConfig& config, ParamInitCallback callback,
     parameterMap_ = *(rootNetwork_->getParameterMap());
   } else {
     parameters_.reserve(config.parameters_size());
+    auto quantizedOnly = getQuantizedOnlyParameters(config);
     for (const auto& para_config : config.parameters()) {
       auto parameter = std::make_shared<Parameter>(para_config, useGpu,
                                                    /*initialize=*/false);
+      parameter->setQuantizedOnly(quantizedOnly.count(para_config.name()));
       paramCallback(parameters_.size(), parameter.get());
       if (!callback) {
         for (ParameterType type :
@@ -174,6 +236,134 @@ void NeuralNetwork::init(const ModelConfig& config, ParamInitCallback callback,
     CHECK(it != layerMap_.end());
     outputLayers_.push_back(it->second);
   }
+
+  planInferenceMemory();
+}
+
+void NeuralNetwork::planInferenceMemory() {
+  lastUse_.clear();
+  deadAt_.clear();
+  // The layers of sub-models and of other devices read outputs which are
+  // not visible in the layer configs.
+  if (!FLAGS_reuse_inference_memory || FLAGS_parallel_nn ||
+      config_.sub_models_size() > 0) {
+    return;
+  }
+
+  const size_t kAlive = layers_.size();
+  std::unordered_map<std::string, size_t> layerIndex;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    layerIndex[layers_[i]->getName()] = i;
+  }
+  lastUse_.resize(layers_.size());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    lastUse_[i] = i;
+  }
+  for (const auto& layerConfig : config_.layers()) {
+    auto layer = layerIndex.find(layerConfig.name());
+    if (layer == layerIndex.end()) {
+      continue;
+    }
+    for (const auto& input : layerConfig.inputs()) {
+      auto it = layerIndex.find(input.input_layer_name());
+      if (it != layerIndex.end()) {
+        lastUse_[it->second] = std::max(lastUse_[it->second], layer->second);
+      }
+    }
+  }
+
+  auto keepAlive = [&](const std::string& name) {
+    auto it = layerIndex.find(name);
+    if (it != layerIndex.end()) {
+      lastUse_[it->second] = kAlive;
+    }
+  };
+  for (auto& layer : dataLayers_) {
+    keepAlive(layer->getName());
+  }
+  for (auto& layer : outputLayers_) {
+    keepAlive(layer->getName());
+  }
+  for (const auto& evaluator : config_.evaluators()) {
+    for (const auto& name : evaluator.input_layers()) {
+      keepAlive(name);
+    }
+  }
+
+  deadAt_.resize(layers_.size());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    if (lastUse_[i] < kAlive) {
+      deadAt_[lastUse_[i]].push_back(i);
+    }
+  }
+  recycledBytes_.assign(layers_.size(), 0);
+
+  size_t numAlive = 0;
+  size_t maxAlive = 0;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    maxAlive = std::max(maxAlive, ++numAlive);
+    numAlive -= deadAt_[i].size();
+  }
+  LOG(INFO) << "Inference memory plan: " << layers_.size()
+            << " layer outputs, at most " << maxAlive << " alive at once";
+}
+
+void NeuralNetwork::assignOutputBuffer(size_t i) {
+  MatrixPtr& value = layers_[i]->getOutput().value;
+  if (value || recycledBytes_[i] == 0 || freeOutputs_.empty()) {
+    return;
+  }
+  // the smallest buffer which is large enough, otherwise the largest one
+  auto best = freeOutputs_.end();
+  size_t bestSize = 0;
+  for (auto it = freeOutputs_.begin(); it != freeOutputs_.end(); ++it) {
+    size_t size = (*it)->getMemoryHandle()->getAllocSize();
+    bool fits = size >= recycledBytes_[i];
+    bool bestFits = bestSize >= recycledBytes_[i];
+    if (best == freeOutputs_.end() || (fits && (!bestFits || size < bestSize)) ||
+        (!fits && !bestFits && size > bestSize)) {
+      best = it;
+      bestSize = size;
+    }
+  }
+  value = *best;
+  freeOutputs_.erase(best);
+}
+
+void NeuralNetwork::recycleOutputs(size_t step) {
+  pendingOutputs_.insert(pendingOutputs_.end(), deadAt_[step].begin(),
+                         deadAt_[step].end());
+  for (auto it = pendingOutputs_.begin(); it != pendingOutputs_.end();) {
+    MatrixPtr& value = layers_[*it]->getOutput().value;
+    if (!value || value->isSparse() || !value->getMemoryHandle() ||
+        value.use_count() > 1) {
+      it = pendingOutputs_.erase(it);
+      continue;
+    }
+
+    auto handle = value->getMemoryHandle();
+    char* begin = reinterpret_cast<char*>(handle->getBuf());
+    char* end = begin + handle->getAllocSize();
+    bool referenced = false;
+    for (size_t k = 0; k <= step && !referenced; ++k) {
+      const MatrixPtr& other = layers_[k]->getOutput().value;
+      if (lastUse_[k] <= step || !other || other == value ||
+          other->isSparse()) {
+        continue;
+      }
+      char* data = reinterpret_cast<char*>(other->getData());
+      referenced = data >= begin && data < end;
+    }
+    if (referenced) {
+      ++it;
+      continue;
+    }
+
+    recycledBytes_[*it] = value->getElementCnt() * sizeof(real);
+    freeOutputs_.push_back(value);
+    value = nullptr;
+    it = pendingOutputs_.erase(it);
+  }
 }
 
 void NeuralNetwork::connect(LayerPtr agentLayer, LayerPtr realLayer,
@@ -235,13 +425,22 @@ void NeuralNetwork::forward(const std::vector<Argument>& inArgs,
     dataLayers_[i]->setData(inArgs[i]);
   }
 
+  bool planMemory = passType == PASS_TEST && !lastUse_.empty();
   {
-    for (auto& layer : layers_) {
+    for (size_t i = 0; i < layers_.size(); ++i) {
+      auto& layer = layers_[i];
       REGISTER_TIMER_INFO("ForwardTimer", layer->getName().c_str());
       gLayerStackTrace.push(layer->getName());
+      if (planMemory) {
+        assignOutputBuffer(i);
+      }
       layer->forward(passType);
+      if (planMemory) {
+        recycleOutputs(i);
+      }
     }
   }
+  pendingOutputs_.clear();
 
   outArgs->clear();
   outArgs->reserve(outputLayers_.size());
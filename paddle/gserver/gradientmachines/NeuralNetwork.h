@@ -109,6 +109,17 @@ public:
 
   static NeuralNetwork* create(const ModelConfig& config);
 
+  /**
+   * @brief A new network of the config of this network for PASS_TEST, whose
+   * parameters share the values of the parameters of this network.
+   *
+   * The replica has its own layers and outputs and no gradient, so the
+   * replicas of a network can forward concurrently as long as the values
+   * are not changed. The values loaded after the replica is created are
+   * shared as well.
+   */
+  NeuralNetwork* createInferenceReplica();
+
   ParameterMap* getParameterMap() { return &parameterMap_; }
 
   /**
@@ -142,6 +153,32 @@ protected:
       : subModelName_(subModelName),
         rootNetwork_(rootNetwork) {}
 
+  /**
+   * @brief Liveness analysis of the layer outputs for
+   * --reuse_inference_memory, run once by init().
+   *
+   * The output of layers_[i] is dead after layers_[lastUse_[i]] has run.
+   * The outputs of the data layers, the output layers and the inputs of the
+   * evaluators are never dead. lastUse_ is empty if the plan is disabled.
+   */
+  void planInferenceMemory();
+
+  /**
+   * @brief Give layers_[i] a free output buffer before its PASS_TEST forward,
+   * if its output was recycled in the last forward.
+   */
+  void assignOutputBuffer(size_t i);
+
+  /**
+   * @brief After layers_[step] has run, move the output values which are
+   * dead to freeOutputs_.
+   *
+   * A value is only recycled if the layer is its only owner and no output
+   * which is still alive is a view of its memory. Otherwise it stays with
+   * its layer.
+   */
+  void recycleOutputs(size_t step);
+
   std::string subModelName_;
   ModelConfig config_;
   std::vector<LayerPtr> layers_;
@@ -155,6 +192,15 @@ protected:
 
   NeuralNetwork* rootNetwork_;
 
+  std::vector<size_t> lastUse_;
+  /// deadAt_[i]: the layers whose outputs are dead after layers_[i] has run
+  std::vector<std::vector<size_t>> deadAt_;
+  /// dead layers whose outputs could not be recycled yet
+  std::vector<size_t> pendingOutputs_;
+  /// the size in bytes of the output value recycled from each layer
+  std::vector<size_t> recycledBytes_;
+  std::vector<MatrixPtr> freeOutputs_;
+
   /// Whether parameter of this NN is initialized by its own
   /// (i.e., not by callback supplied with the caller)
   bool paramSelfInited_;
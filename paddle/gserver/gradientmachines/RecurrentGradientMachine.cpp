@@ -127,6 +127,7 @@ RecurrentGradientMachine::RecurrentGradientMachine(
     const std::string& subModelName, NeuralNetwork* rootNetwork)
     : NeuralNetwork(subModelName),
       rootNetwork_(rootNetwork),
+      fillAllPathIds_(false),
       beamSearchCtrlCallbacks_(nullptr),
       beamSearchStatistics_(nullptr) {
   CHECK(!subModelName_.empty());
@@ -1023,20 +1024,16 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath, size_t curPathId,
     if (id == -1) break;
 
     real newLogProb = generator_.config.log_prob() ? std::log(prob) : prob;
+    // the node is only added to the prefix tree if the path is kept
     Path newPath(curPath, id, newLogProb, curPathId /*machineId*/,
-                 k /*topIndex*/);
+                 k /*topIndex*/, pathNodes_.size() /*node*/, fillAllPathIds_);
     if (this->beamSearchCtrlCallbacks_) {
       if (beamSearchCtrlCallbacks_->stopDetermineCandidates(
               newPath.seqId, newPath.ids, newPath.probHistory))
         return;
     }
-    // outFrameLines_.size() > 1UL
-    if (dataArgsSize_) {
-      newPath.machineIdVec = curPath.machineIdVec;
-      newPath.machineIdVec.push_back(curPathId);
-    }
     bool atEos =
-        eosVec[index] == 1U || newPath.ids.size() >= (size_t)maxSequenceLength_;
+        eosVec[index] == 1U || newPath.length >= maxSequenceLength_;
     // adjustNewPath
     newPath.adjustProb(calc_id, atEos);
     if (this->beamSearchCtrlCallbacks_) {
@@ -1044,8 +1041,9 @@ void RecurrentGradientMachine::singlePathExpand(Path& curPath, size_t curPathId,
           newPath.seqId, newPath.ids, newPath.probHistory, &newPath.logProb);
     }
     if (!newPath.isDropable()) {
-      atEos ? finalPaths_[curPath.seqId].push_back(newPath)
-            : newPaths.push_back(newPath);
+      pathNodes_.push_back({id, static_cast<int>(curPathId), curPath.node});
+      atEos ? finalPaths_[curPath.seqId].push_back(std::move(newPath))
+            : newPaths.push_back(std::move(newPath));
     }
   }  // for expandWidth
 
@@ -1103,7 +1101,7 @@ size_t RecurrentGradientMachine::beamShrink(std::vector<Path>& newPaths,
       std::remove_if(finalPaths_[seqId].begin(), finalPaths_[seqId].end(),
                      [&](Path& p) { return p.logProb < minPathLogProb; }),
       finalPaths_[seqId].end());
-  for (auto p : finalPaths_[seqId]) {
+  for (const auto& p : finalPaths_[seqId]) {
     if (minFinalPathLogProb_[seqId] > p.logProb) {
       minFinalPathLogProb_[seqId] = p.logProb;
     }
@@ -1125,6 +1123,9 @@ void RecurrentGradientMachine::fillGenOutputs() {
                       finalPaths_[i].begin() + minFinalPathsSize,
                       finalPaths_[i].end(), Path::greaterPath);
     finalPaths_[i].resize(minFinalPathsSize);
+    for (auto& path : finalPaths_[i]) {
+      fillPathIds(path);
+    }
   }
 
   batchMachineIdVec_.clear();
@@ -1154,13 +1155,41 @@ void RecurrentGradientMachine::fillGenOutputs() {
       starts[i + 1] = generator_.ids.size();
     }
   } else {
+    int* starts =
+        generator_.outArg.sequenceStartPositions->getMutableData(false);
+    starts[0] = 0;
     for (size_t i = 0; i < finalPaths_.size(); ++i) {
       CHECK(!finalPaths_[i].empty());
-      generator_.ids = finalPaths_[i][0].ids;
+      Path& path = finalPaths_[i][0];
+      generator_.ids.insert(generator_.ids.end(), path.ids.begin(),
+                            path.ids.end());
+      starts[i + 1] = generator_.ids.size();
+      if (dataArgsSize_) {
+        batchMachineIdVec_.insert(batchMachineIdVec_.end(),
+                                  path.machineIdVec.begin(),
+                                  path.machineIdVec.end());
+      }
     }
   }
 }
 
+void RecurrentGradientMachine::fillPathIds(Path& path) {
+  path.ids.resize(path.length);
+  if (dataArgsSize_) {
+    path.machineIdVec.resize(path.length);
+  }
+  int node = path.node;
+  for (int i = path.length - 1; i >= 0; --i) {
+    CHECK_GE(node, 0);
+    const PathNode& pathNode = pathNodes_[node];
+    path.ids[i] = pathNode.id;
+    if (dataArgsSize_) {
+      path.machineIdVec[i] = pathNode.machineId;
+    }
+    node = pathNode.parent;
+  }
+}
+
 void RecurrentGradientMachine::copyDataOutlinkFrame(size_t machineCur) {
   for (size_t i = 0; i < dataArgsSize_; i++) {
     Argument outFrame;
@@ -1199,6 +1228,12 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
   minFinalPathLogProb_.clear();
   minFinalPathLogProb_.resize(batchSize, 0);
 
+  // the DIY probability functions and the control callbacks read the ids of
+  // every path, otherwise only the final paths are filled from pathNodes_
+  fillAllPathIds_ =
+      gDiyProbStart || gDiyProbMethod || this->beamSearchCtrlCallbacks_;
+  pathNodes_.clear();
+
   std::vector<Path> paths;
   std::vector<Path> newPaths;
   for (size_t i = 0; i < batchSize; ++i) {
@@ -1240,7 +1275,7 @@ void RecurrentGradientMachine::beamSearch(size_t batchSize) {
     beamExpand(paths, newPaths);
     if (newPaths.empty()) break;
 
-    paths = newPaths;
+    paths.swap(newPaths);
     newPaths.clear();
   }  // end for machineCur
   fillGenOutputs();
@@ -178,9 +178,25 @@ public:
    */
   void stopBeamSearch();
 
+  /**
+   * @brief A node of the prefix tree of the paths in beam search. The paths
+   * share their prefixes through the index of their parent node, instead of
+   * copying them at each expansion.
+   */
+  struct PathNode {
+    int id;         // the generated id
+    int machineId;  // index of the sample expanded in its frame
+    int parent;     // index of the parent node, -1 for the first id
+  };
+
   struct Path {
     /**
      * @brief ids, path of beam search.
+     *
+     * @note  In beam search, it is only filled for the final paths, and for
+     *        all the paths when the control callbacks or the DIY probability
+     *        functions are used, as they read it. The other paths are only
+     *        represented by their last node.
      */
     std::vector<int> ids;
 
@@ -192,6 +208,10 @@ public:
     int machineId;  // index of sample in frame
     int topIndex;   // index of MaxIdLayer output in one sample
     int seqId;      // index of sequence in batch generation
+    int length;     // number of ids
+    int node;       // index of the last node in pathNodes_, -1 if empty
+
+    /// only filled for the final paths in beam search
     std::vector<int> machineIdVec;
 
     /**
@@ -208,8 +228,14 @@ public:
     Path() {
       logProb = 0;
       seqId = 0;
+      length = 0;
+      node = -1;
+    }
+    explicit Path(size_t seqId) : seqId(seqId) {
+      logProb = 0;
+      length = 0;
+      node = -1;
     }
-    explicit Path(size_t seqId) : seqId(seqId) { logProb = 0; }
 
     /**
      * @brief Create a new path based on an old path and
@@ -220,14 +246,22 @@ public:
      * @param logProb   probability of the new node.
      * @param machineId sample index of a frame in RNN
      * @param topIndex  index of MaxIdLayer output in one sample
+     * @param node      index of the new node in the prefix tree
+     * @param copyIds   whether to fill ids
      */
-    Path(Path& old, int newId, real logProb, int machineId, int topIndex)
-        : ids(old.ids),
-          logProb(old.logProb + logProb),
+    Path(const Path& old, int newId, real logProb, int machineId, int topIndex,
+         int node, bool copyIds)
+        : logProb(old.logProb + logProb),
           machineId(machineId),
           topIndex(topIndex),
-          seqId(old.seqId) {
-      ids.push_back(newId);
+          seqId(old.seqId),
+          length(old.length + 1),
+          node(node) {
+      if (copyIds) {
+        ids.reserve(length);
+        ids = old.ids;
+        ids.push_back(newId);
+      }
       if (!old.probHistory.empty()) {
         this->probHistory = old.probHistory;
         // probHistory store current prob, not sum
@@ -272,12 +306,24 @@ public:
 
   /**
    * @brief access beam search results.
-   * @return beam search results.
+   * @return beam search results. With beam search, the i-th element holds
+   * the results of the i-th sequence of the batch, sorted by probability.
+   * Otherwise the only element holds one result per sequence.
    */
   const std::vector<std::vector<Path>>& getFinalPaths() const {
     return this->finalPaths_;
   }
 
+  /*
+   * @return beam size in beam search
+   */
+  size_t getBeamSize() const { return generator_.config.beam_size(); }
+
+  /*
+   * @return whether the layer group generates sequences
+   */
+  bool isGenerating() const { return eosFrameLine_ != nullptr; }
+
 protected:
   void resizeOrCreateFrames(int numFrames);
   void resizeBootFrame(int numSequences);
@@ -400,11 +446,6 @@ protected:
   IVectorPtr cpuEos_;
 
 private:
-  /*
-   * @return beam size in beam search
-   */
-  size_t getBeamSize() { return generator_.config.beam_size(); }
-
   /*
    * @return number of sequence in a batch in generation
    */
@@ -488,11 +529,21 @@ private:
    */
   void fillGenOutputs();
 
+  /*
+   * @brief fill path.ids, and path.machineIdVec if there is a data outlink,
+   * from the prefix tree.
+   */
+  void fillPathIds(Path& path);
+
   std::vector<int> machineIds_;
   std::vector<int> topIds_;
   std::vector<int> seqIds_;
   std::vector<int> batchMachineIdVec_;
   std::vector<std::vector<Path>> finalPaths_;
+  /// the prefix tree of the paths of the current beam search
+  std::vector<PathNode> pathNodes_;
+  /// whether all the paths need their ids, see Path::ids
+  bool fillAllPathIds_;
   std::vector<real> minFinalPathLogProb_;
   BeamSearchControlCallbacks* beamSearchCtrlCallbacks_;
   BeamSearchStatisticsCallbacks* beamSearchStatistics_;
@@ -0,0 +1,195 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "RequestBatcher.h"
+
+#include <chrono>
+
+#include "paddle/utils/Stat.h"
+
+P_DEFINE_int32(batching_max_batch_size, 32,
+               "max number of samples in a batch of RequestBatcher");
+P_DEFINE_int32(batching_max_delay_us, 1000,
+               "max time in microseconds a request waits in RequestBatcher "
+               "for the others of its batch");
+
+namespace paddle {
+
+BatchingPolicy::BatchingPolicy()
+    : maxBatchSize(FLAGS_batching_max_batch_size),
+      maxDelayUs(FLAGS_batching_max_delay_us) {}
+
+RequestBatcher::RequestBatcher(const std::vector<GradientMachinePtr>& machines,
+                               const BatchingPolicy& policy)
+    : policy_(policy),
+      queuedSize_(0),
+      stopping_(false),
+      numBatches_(0),
+      numSamples_(0) {
+  CHECK(!machines.empty());
+  CHECK_GT(policy_.maxBatchSize, 0UL);
+  for (auto& machine : machines) {
+    workers_.emplace_back([this, machine]() { run(machine.get()); });
+  }
+}
+
+RequestBatcher::~RequestBatcher() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stopping_ = true;
+  }
+  queueCond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void RequestBatcher::forward(const std::vector<Argument>& inArgs,
+                             std::vector<Argument>* outArgs) {
+  CHECK(!inArgs.empty());
+  Request request;
+  request.inArgs = &inArgs;
+  request.outArgs = outArgs;
+  request.size = inArgs[0].getNumSequences();
+  request.done = false;
+
+  std::unique_lock<std::mutex> guard(lock_);
+  CHECK(!stopping_);
+  request.arrival = nowInMicroSec();
+  // the waiting workers only need to know when a batch may start
+  bool notify =
+      queue_.empty() || (queuedSize_ < policy_.maxBatchSize &&
+                         queuedSize_ + request.size >= policy_.maxBatchSize);
+  queue_.push_back(&request);
+  queuedSize_ += request.size;
+  if (notify) {
+    queueCond_.notify_one();
+  }
+  request.doneCond.wait(guard, [&request]() { return request.done; });
+}
+
+bool RequestBatcher::popBatch(std::vector<Request*>* batch) {
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    if (queue_.empty()) {
+      if (stopping_) {
+        return false;
+      }
+      queueCond_.wait(guard);
+      continue;
+    }
+    if (queuedSize_ >= policy_.maxBatchSize || stopping_) {
+      break;
+    }
+    uint64_t deadline = queue_.front()->arrival + policy_.maxDelayUs;
+    uint64_t now = nowInMicroSec();
+    if (now >= deadline) {
+      break;
+    }
+    queueCond_.wait_for(guard, std::chrono::microseconds(deadline - now));
+  }
+
+  batch->clear();
+  size_t batchSize = 0;
+  while (!queue_.empty() &&
+         (batch->empty() ||
+          batchSize + queue_.front()->size <= policy_.maxBatchSize)) {
+    batch->push_back(queue_.front());
+    batchSize += queue_.front()->size;
+    queuedSize_ -= queue_.front()->size;
+    queue_.pop_front();
+  }
+  if (!queue_.empty()) {
+    // the rest may be ready for another worker
+    queueCond_.notify_one();
+  }
+  return true;
+}
+
+void RequestBatcher::run(GradientMachine* machine) {
+  std::vector<Request*> batch;
+  std::vector<Argument> inArgs;
+  std::vector<Argument> outArgs;
+  while (popBatch(&batch)) {
+    forwardBatch(machine, batch, &inArgs, &outArgs);
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto request : batch) {
+      request->done = true;
+      request->doneCond.notify_one();
+    }
+  }
+}
+
+void RequestBatcher::forwardBatch(GradientMachine* machine,
+                                  const std::vector<Request*>& batch,
+                                  std::vector<Argument>* inArgs,
+                                  std::vector<Argument>* outArgs) {
+  numBatches_.fetch_add(1, std::memory_order_relaxed);
+  const std::vector<Argument>* batchInArgs = batch[0]->inArgs;
+  if (batch.size() > 1) {
+    size_t numInputs = batch[0]->inArgs->size();
+    inArgs->resize(numInputs);
+    std::vector<Argument> args(batch.size());
+    for (size_t i = 0; i < numInputs; ++i) {
+      for (size_t j = 0; j < batch.size(); ++j) {
+        CHECK_EQ(numInputs, batch[j]->inArgs->size());
+        args[j] = (*batch[j]->inArgs)[i];
+      }
+      (*inArgs)[i].concat(args);
+    }
+    batchInArgs = inArgs;
+  }
+  // the outputs share the memory of the layers, so they are always copied
+  machine->forward(*batchInArgs, outArgs, PASS_TEST);
+
+  /// the first row and the first sequence of each request
+  std::vector<int32_t> rowStarts(batch.size() + 1, 0);
+  std::vector<int32_t> seqStarts(batch.size() + 1, 0);
+  for (size_t j = 0; j < batch.size(); ++j) {
+    const Argument& arg = (*batch[j]->inArgs)[0];
+    rowStarts[j + 1] = rowStarts[j] + arg.getBatchSize();
+    seqStarts[j + 1] = seqStarts[j] + batch[j]->size;
+  }
+  numSamples_.fetch_add(seqStarts.back(), std::memory_order_relaxed);
+
+  for (auto request : batch) {
+    request->outArgs->resize(outArgs->size());
+  }
+  for (size_t i = 0; i < outArgs->size(); ++i) {
+    const Argument& out = (*outArgs)[i];
+    // the rows of a sequence output are copied by its sequences
+    const std::vector<int32_t>* starts = &seqStarts;
+    if (!out.sequenceStartPositions && out.getBatchSize() != seqStarts.back()) {
+      CHECK_EQ(out.getBatchSize(), rowStarts.back())
+          << "output " << i << " neither has one row per input row"
+          << " nor one row per input sequence";
+      starts = &rowStarts;
+    }
+    CHECK_EQ(out.getNumSequences(), starts->back());
+    for (size_t j = 0; j < batch.size(); ++j) {
+      Argument& dest = (*batch[j]->outArgs)[i];
+      // resizeAndCopyFrom() keeps the positions which out does not have
+      if (!out.sequenceStartPositions) {
+        dest.sequenceStartPositions.reset();
+      }
+      if (!out.hasSubseq()) {
+        dest.subSequenceStartPositions.reset();
+      }
+      dest.resizeAndCopyFrom(out, (*starts)[j],
+                             (*starts)[j + 1] - (*starts)[j]);
+    }
+  }
+}
+
+}  // namespace paddle
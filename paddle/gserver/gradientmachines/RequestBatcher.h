@@ -0,0 +1,131 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GradientMachine.h"
+#include "paddle/utils/DisableCopy.h"
+
+namespace paddle {
+
+/**
+ * The latency/throughput trade-off of a RequestBatcher. A batch is
+ * forwarded as soon as it has maxBatchSize samples, or when its oldest
+ * request has waited maxDelayUs. A larger maxDelayUs gives larger batches,
+ * and so a higher throughput, at the cost of the latency under a light load.
+ * With maxDelayUs = 0, the requests queued while the machines are busy are
+ * still forwarded together.
+ */
+struct BatchingPolicy {
+  /// initialized by --batching_max_batch_size and --batching_max_delay_us
+  BatchingPolicy();
+
+  BatchingPolicy(size_t maxBatchSize, uint64_t maxDelayUs)
+      : maxBatchSize(maxBatchSize), maxDelayUs(maxDelayUs) {}
+
+  /// max number of samples in a batch, a sequence counts as one sample
+  size_t maxBatchSize;
+  /// max time in microseconds a request waits for the others of its batch
+  uint64_t maxDelayUs;
+};
+
+/**
+ * Coalesces the concurrent PASS_TEST forwards of single requests into
+ * batches, to make better use of the matrix multiplications.
+ *
+ * Each machine is driven by its own worker thread, e.g. the replicas of
+ * NeuralNetwork::createInferenceReplica(). A worker concatenates the inputs
+ * of the queued requests (sequences included) with Argument::concat(),
+ * runs one forward, and copies the rows of each output back to the request
+ * it comes from.
+ *
+ * All the requests must have the same input layers. The outputs must either
+ * have one row per input row, or one row per input sequence.
+ */
+class RequestBatcher {
+public:
+  RequestBatcher(const std::vector<GradientMachinePtr>& machines,
+                 const BatchingPolicy& policy);
+
+  /// forwards the queued requests and stops the workers
+  ~RequestBatcher();
+
+  /**
+   * Forward one request and wait for its outputs. Thread safe.
+   * A request larger than maxBatchSize is forwarded as one batch.
+   */
+  void forward(const std::vector<Argument>& inArgs,
+               std::vector<Argument>* outArgs);
+
+  const BatchingPolicy& getPolicy() const { return policy_; }
+
+  /// number of forwards of the machines
+  size_t getNumBatches() const {
+    return numBatches_.load(std::memory_order_relaxed);
+  }
+
+  /// number of samples of all the forwarded requests
+  size_t getNumSamples() const {
+    return numSamples_.load(std::memory_order_relaxed);
+  }
+
+private:
+  DISABLE_COPY(RequestBatcher);
+
+  struct Request {
+    const std::vector<Argument>* inArgs;
+    std::vector<Argument>* outArgs;
+    /// number of samples
+    size_t size;
+    /// nowInMicroSec() when it is queued
+    uint64_t arrival;
+    bool done;
+    /// the caller waits for the outputs
+    std::condition_variable doneCond;
+  };
+
+  /// forward the batches with machine until the batcher is stopped
+  void run(GradientMachine* machine);
+
+  /// wait for the next batch, false if the batcher is stopped
+  bool popBatch(std::vector<Request*>* batch);
+
+  void forwardBatch(GradientMachine* machine,
+                    const std::vector<Request*>& batch,
+                    std::vector<Argument>* inArgs,
+                    std::vector<Argument>* outArgs);
+
+  BatchingPolicy policy_;
+  std::vector<std::thread> workers_;
+
+  std::mutex lock_;
+  /// the workers wait for a batch
+  std::condition_variable queueCond_;
+  std::deque<Request*> queue_;
+  /// number of samples in queue_
+  size_t queuedSize_;
+  bool stopping_;
+
+  std::atomic<size_t> numBatches_;
+  std::atomic<size_t> numSamples_;
+};
+
+}  // namespace paddle
@@ -24,8 +24,6 @@ bool CRFDecodingLayer::init(const LayerMap& layerMap,
   if (!CRFLayer::init(layerMap, parameterMap)) {
     return false;
   }
-  crf_.reset(new LinearChainCRF(
-      numClasses_, parameter_->getBuf(PARAMETER_VALUE)->getData(), nullptr));
   return true;
 }
 
@@ -44,10 +42,21 @@ void CRFDecodingLayer::forward(PassType passType) {
   const int* starts = output.sequenceStartPositions->getData(false);
   CHECK_EQ(starts[numSequences], (int)batchSize);
 
-  for (size_t i = 0; i < numSequences; ++i) {
-    crf_->decode(output.value->getData() + numClasses_ * starts[i],
-                 output_.ids->getData() + starts[i], starts[i + 1] - starts[i]);
+  // one LinearChainCRF for each slot
+  size_t numSlots = getNumSlots(batchSize);
+  while (crfs_.size() < numSlots) {
+    crfs_.emplace_back(numClasses_,
+                       parameter_->getBuf(PARAMETER_VALUE)->getData());
   }
+  forEachSequences(
+      numSlots, numSequences, starts,
+      [&](size_t slot, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          crfs_[slot].decode(output.value->getData() + numClasses_ * starts[i],
+                             output_.ids->getData() + starts[i],
+                             starts[i + 1] - starts[i]);
+        }
+      });
 
   if (inputLayers_.size() == 2) {
     const Argument& label = getInput(1);
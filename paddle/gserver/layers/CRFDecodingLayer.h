@@ -29,6 +29,7 @@ namespace paddle {
  * It also calculate error, output_.value[i] is 1 for incorrect decoding
  * or 0 for correct decoding)
  * See LinearChainCRF.h for the detail of the CRF formulation.
+ * Like CRFLayer, the sequences of a large batch are decoded in parallel.
  */
 class CRFDecodingLayer : public CRFLayer {
 public:
@@ -36,9 +37,6 @@ public:
   virtual bool init(const LayerMap& layerMap, const ParameterMap& parameterMap);
   virtual void forward(PassType passType);
   virtual void backward(const UpdateCallback& callback);
-
-protected:
-  std::unique_ptr<LinearChainCRF> crf_;
 };
 
 }  // namespace paddle
@@ -15,6 +15,10 @@ limitations under the License. */
 
 #include "CRFLayer.h"
 
+#include <algorithm>
+
+#include "paddle/math/MathThreadPool.h"
+
 namespace paddle {
 
 REGISTER_LAYER(crf, CRFLayer);
@@ -51,6 +55,38 @@ bool CRFLayer::init(const LayerMap& layerMap,
   return true;
 }
 
+size_t CRFLayer::getNumSlots(size_t batchSize) {
+  // the work of a sequence is about length * numClasses^2
+  return MathThreadPool::isEnabled(batchSize * numClasses_ * numClasses_)
+             ? MathThreadPool::global().getNumThreads()
+             : 1;
+}
+
+void CRFLayer::forEachSequences(size_t numSlots, size_t numSequences,
+                                const int* starts, const SequenceFunc& func) {
+  if (numSlots == 1) {
+    func(0, 0, numSequences);
+    return;
+  }
+  // the first sequence of each slot, so that the slots have about the same
+  // number of rows.
+  std::vector<size_t> begins(numSlots + 1);
+  int batchSize = starts[numSequences];
+  for (size_t slot = 0; slot <= numSlots; ++slot) {
+    int row = batchSize * slot / numSlots;
+    begins[slot] =
+        std::lower_bound(starts, starts + numSequences, row) - starts;
+  }
+  MathThreadPool::global().parallelFor(
+      numSlots, 1, [&](size_t begin, size_t end) {
+        for (size_t slot = begin; slot < end; ++slot) {
+          if (begins[slot] < begins[slot + 1]) {
+            func(slot, begins[slot], begins[slot + 1]);
+          }
+        }
+      });
+}
+
 void CRFLayer::forward(PassType passType) {
   Layer::forward(passType);
 
@@ -68,18 +104,19 @@ void CRFLayer::forward(PassType passType) {
   const int* starts = label.sequenceStartPositions->getData(false);
   CHECK_EQ(starts[numSequences], batchSize);
 
-  for (size_t i = 0; i < numSequences; ++i) {
-    if (i >= crfs_.size()) {
-      crfs_.emplace_back(numClasses_,
-                         parameter_->getBuf(PARAMETER_VALUE)->getData(),
-                         parameter_->getBuf(PARAMETER_GRADIENT)
-                            ? parameter_->getBuf(PARAMETER_GRADIENT)->getData()
-                            : nullptr);
-    }
-    output_.value->getData()[i] = crfs_[i].forward(
-        output.value->getData() + numClasses_ * starts[i],
-        label.ids->getData() + starts[i], starts[i + 1] - starts[i]);
+  while (crfs_.size() < numSequences) {
+    crfs_.emplace_back(numClasses_,
+                       parameter_->getBuf(PARAMETER_VALUE)->getData());
   }
+  forEachSequences(
+      getNumSlots(batchSize), numSequences, starts,
+      [&](size_t slot, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          output_.value->getData()[i] = crfs_[i].forward(
+              output.value->getData() + numClasses_ * starts[i],
+              label.ids->getData() + starts[i], starts[i + 1] - starts[i]);
+        }
+      });
 
   if (weightLayer_) {
     const MatrixPtr& weight = getInputValue(*weightLayer_);
@@ -91,19 +128,39 @@ void CRFLayer::backward(const UpdateCallback &callback) {
   const Argument& output = getInput(0);
   const Argument& label = getInput(1);
   const int* starts = label.sequenceStartPositions->getData(false);
-  int numSequences = label.sequenceStartPositions->getSize() - 1;
-
-  for (int i = 0; i < numSequences; ++i) {
-    crfs_[i].backward(output.value->getData() + numClasses_ * starts[i],
-                      output.grad->getData() + numClasses_ * starts[i],
-                      label.ids->getData() + starts[i],
-                      starts[i + 1] - starts[i]);
-    if (weightLayer_) {
-      real weight = getInputValue(*weightLayer_)->getElement(i, 0);
-      MatrixPtr grad = output.grad->subRowMatrix(starts[i], starts[i+1]);
-      grad->mulScalar(weight);
+  size_t numSequences = label.sequenceStartPositions->getSize() - 1;
+
+  const VectorPtr& paraGrad = parameter_->getBuf(PARAMETER_GRADIENT);
+  size_t numSlots = getNumSlots(output.getBatchSize());
+  if (paraGrad) {
+    slotGrads_.resize(numSlots);
+    for (size_t slot = 1; slot < numSlots; ++slot) {
+      Vector::resizeOrCreate(slotGrads_[slot], paraGrad->getSize(), false);
+      slotGrads_[slot]->zeroMem();
     }
   }
+  forEachSequences(
+      numSlots, numSequences, starts,
+      [&](size_t slot, size_t begin, size_t end) {
+        real* slotGrad = nullptr;
+        if (paraGrad) {
+          slotGrad = (slot == 0 ? paraGrad : slotGrads_[slot])->getData();
+        }
+        for (size_t i = begin; i < end; ++i) {
+          crfs_[i].backward(output.value->getData() + numClasses_ * starts[i],
+                            output.grad->getData() + numClasses_ * starts[i],
+                            label.ids->getData() + starts[i],
+                            starts[i + 1] - starts[i], slotGrad);
+          if (weightLayer_) {
+            real weight = getInputValue(*weightLayer_)->getElement(i, 0);
+            MatrixPtr grad = output.grad->subRowMatrix(starts[i], starts[i+1]);
+            grad->mulScalar(weight);
+          }
+        }
+      });
+  for (size_t slot = 1; paraGrad && slot < numSlots; ++slot) {
+    paraGrad->add(*slotGrads_[slot]);
+  }
 
   if (coeff_ != real(1.0f)) {
     output.grad->mulScalar(coeff_);
@@ -15,6 +15,7 @@ limitations under the License. */
 
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include "Layer.h"
@@ -26,6 +27,11 @@ namespace paddle {
  * A layer for calculating the cost of sequential conditional random field
  * model.
  * See LinearChainCRF.h for the detail of the CRF formulation.
+ *
+ * The sequences of a batch are split across MathThreadPool when the batch
+ * is large enough (see MathThreadPool::isEnabled). In backward, each thread
+ * adds the parameter gradient of its sequences into its own buffer, and the
+ * buffers are summed at the end.
  */
 class CRFLayer : public Layer {
 public:
@@ -35,9 +41,28 @@ public:
   virtual void backward(const UpdateCallback& callback);
 
 protected:
+  /// process the sequences [begin, end) with the slot-th thread.
+  typedef std::function<void(size_t slot, size_t begin, size_t end)>
+      SequenceFunc;
+
+  /**
+   * @brief number of the threads which process a batch, 1 if the batch is
+   * too small to be split.
+   */
+  size_t getNumSlots(size_t batchSize);
+
+  /**
+   * @brief split the sequences into numSlots groups of about the same number
+   * of rows and run func on them, in parallel if numSlots > 1.
+   */
+  void forEachSequences(size_t numSlots, size_t numSequences,
+                        const int* starts, const SequenceFunc& func);
+
   size_t numClasses_;
   ParameterPtr parameter_;
   std::vector<LinearChainCRF> crfs_;
+  /// parameter gradients of the slots 1, 2, ... (slot 0 adds to parameter_)
+  std::vector<VectorPtr> slotGrads_;
   LayerPtr weightLayer_;  // weight for each sequence
   real coeff_;  // weight for the layer
 };
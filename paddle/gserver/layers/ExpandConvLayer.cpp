@@ -17,6 +17,11 @@ limitations under the License. */
 #include "paddle/utils/Stat.h"
 #include "ExpandConvLayer.h"
 
+P_DEFINE_int32(exconv_batch_frames, 0,
+               "On cpu, the number of frames which ExpandConvLayer expands "
+               "into one buffer and multiplies with one gemm per group. "
+               "0 means frame by frame.");
+
 namespace paddle {
 
 REGISTER_LAYER(exconv, ExpandConvLayer);
@@ -118,6 +123,82 @@ void ExpandConvLayer::expandFwdOnce(MatrixPtr image, int inIdx, int startIdx) {
   }
 }
 
+size_t ExpandConvLayer::getBatchFrames(size_t batchSize) {
+  if (useGpu_ || FLAGS_exconv_batch_frames <= 1) {
+    return 1;
+  }
+  return std::min(batchSize, (size_t)FLAGS_exconv_batch_frames);
+}
+
+void ExpandConvLayer::expandFrames(MatrixPtr image, size_t startIdx,
+                                   size_t numFrames, int inIdx) {
+  size_t subN = subN_[inIdx];
+  size_t imgSize = imgSizeH_[inIdx] * imgSizeW_[inIdx] * channels_[inIdx];
+  resetExpandInput(subK_[inIdx] * groups_[inIdx], numFrames * subN);
+  for (size_t n = 0; n < numFrames; ++n) {
+    CpuMatrix imageTmp(image->getData() + (startIdx + n) * image->getWidth(),
+                       1, imgSize);
+    CpuMatrix expandTmp(expandInput_->getData() + n * subN,
+                        expandInput_->getHeight(), subN,
+                        expandInput_->getStride(), false);
+    expandTmp.convExpand(imageTmp, imgSizeH_[inIdx], imgSizeW_[inIdx],
+                         channels_[inIdx], filterSize_[inIdx],
+                         filterSize_[inIdx], stride_[inIdx], stride_[inIdx],
+                         padding_[inIdx], padding_[inIdx], outputH_[inIdx],
+                         outputW_[inIdx]);
+  }
+}
+
+void ExpandConvLayer::gatherOutputGrad(MatrixPtr v, size_t startIdx,
+                                       size_t numFrames) {
+  size_t subN = v->getWidth() / numFilters_;
+  Matrix::resizeOrCreate(batchOutput_, numFilters_, numFrames * subN, false,
+                         useGpu_);
+  for (size_t n = 0; n < numFrames; ++n) {
+    CpuMatrix gradTmp(v->getData() + (startIdx + n) * v->getWidth(),
+                      numFilters_, subN);
+    CpuMatrix batchTmp(batchOutput_->getData() + n * subN, numFilters_, subN,
+                       batchOutput_->getStride(), false);
+    batchTmp.assign(gradTmp);
+  }
+}
+
+void ExpandConvLayer::expandFwdBatch(MatrixPtr image, int inIdx,
+                                     size_t startIdx, size_t numFrames) {
+  int subM = subM_[inIdx];
+  int subN = subN_[inIdx];
+  int subK = subK_[inIdx];
+  size_t batchN = numFrames * subN;
+
+  expandFrames(image, startIdx, numFrames, inIdx);
+  Matrix::resizeOrCreate(batchOutput_, numFilters_, batchN, false, useGpu_);
+
+  real *wgtData = weights_[inIdx]->getW()->getData();
+  real *expInData = expandInput_->getData();
+  real *outData = batchOutput_->getData();
+  for (int g = 0; g < groups_[inIdx]; ++g) {
+    MatrixPtr A =
+        Matrix::create(wgtData, subK, subM, true, useGpu_);  // mark transpose
+    MatrixPtr B = Matrix::create(expInData, subK, batchN, false, useGpu_);
+    MatrixPtr C = Matrix::create(outData, subM, batchN, false, useGpu_);
+    C->mul(A, B, 1, 0);
+
+    wgtData += subK * subM;
+    expInData += subK * batchN;
+    outData += subM * batchN;
+  }
+
+  /* scatter the frames back to the output rows */
+  MatrixPtr outValue = getOutputValue();
+  for (size_t n = 0; n < numFrames; ++n) {
+    real *outData = outValue->getData() + (startIdx + n) * outValue->getWidth();
+    CpuMatrix outTmp(outData, numFilters_, subN);
+    CpuMatrix batchTmp(batchOutput_->getData() + n * subN, numFilters_, subN,
+                       batchOutput_->getStride(), false);
+    outTmp.add(batchTmp);
+  }
+}
+
 void ExpandConvLayer::addSharedBias() {
   size_t mapW = getSize() / numFilters_;
   size_t mapH = getOutputValue()->getElementCnt() / mapW;
@@ -164,6 +245,15 @@ void ExpandConvLayer::forward(PassType passType) {
   for (size_t i = 0; i != inputLayers_.size(); ++i) {
     LayerPtr prevLayer = getPrev(i);
     image = prevLayer->getOutputValue();
+    size_t batchFrames = getBatchFrames(image->getHeight());
+    if (batchFrames > 1) {
+      for (size_t off = 0; off < image->getHeight(); off += batchFrames) {
+        REGISTER_TIMER_INFO("expandFwdBatch", getName().c_str());
+        expandFwdBatch(image, i, off,
+                       std::min(batchFrames, image->getHeight() - off));
+      }
+      continue;
+    }
     for (size_t off = 0; off < image->getHeight(); off++) {
       REGISTER_TIMER_INFO("expandFwdOnce", getName().c_str());
       expandFwdOnce(image, i, off);
@@ -236,6 +326,13 @@ void ExpandConvLayer::bpropWeights(MatrixPtr v, int inpIdx) {
   int subN = subN_[inpIdx];
   int subK = subK_[inpIdx];
   size_t batchSize = inputV->getHeight();
+  size_t batchFrames = getBatchFrames(batchSize);
+  if (batchFrames > 1) {
+    for (size_t n = 0; n < batchSize; n += batchFrames) {
+      bpropWeightsBatch(v, inpIdx, n, std::min(batchFrames, batchSize - n));
+    }
+    return;
+  }
   resetExpandInput(subK * groups_[inpIdx], subN);
   resetConvOutput(batchSize, inpIdx);
 
@@ -275,6 +372,13 @@ void ExpandConvLayer::bpropActs(MatrixPtr v, int inpIdx) {
   int subK = subK_[inpIdx];
   size_t batchSize = v->getHeight();
   MatrixPtr tgtGrad = prevLayer->getOutputGrad();
+  size_t batchFrames = getBatchFrames(batchSize);
+  if (batchFrames > 1) {
+    for (size_t n = 0; n < batchSize; n += batchFrames) {
+      bpropActsBatch(v, inpIdx, n, std::min(batchFrames, batchSize - n));
+    }
+    return;
+  }
 
   /* reset the expand-grad memory */
   resetExpandInput(subK * groups_[inpIdx], subN);
@@ -323,4 +427,70 @@ void ExpandConvLayer::bpropActs(MatrixPtr v, int inpIdx) {
   }
 }
 
+void ExpandConvLayer::bpropWeightsBatch(MatrixPtr v, int inpIdx,
+                                        size_t startIdx, size_t numFrames) {
+  int subM = subM_[inpIdx];
+  int subN = subN_[inpIdx];
+  int subK = subK_[inpIdx];
+  size_t batchN = numFrames * subN;
+
+  expandFrames(getPrev(inpIdx)->getOutputValue(), startIdx, numFrames, inpIdx);
+  gatherOutputGrad(v, startIdx, numFrames);
+
+  real *wGradData = weights_[inpIdx]->getWGrad()->getData();
+  real *expandInData = expandInput_->getData();
+  real *gradData = batchOutput_->getData();
+  for (int g = 0; g < groups_[inpIdx]; g++) {
+    MatrixPtr A = Matrix::create(expandInData, subK, batchN, false, useGpu_);
+    MatrixPtr B = Matrix::create(gradData, subM, batchN, true, useGpu_);
+    MatrixPtr C = Matrix::create(wGradData, subK, subM, false, useGpu_);
+    C->mul(A, B, 1, 1);
+
+    gradData += subM * batchN;
+    wGradData += subK * subM;
+    expandInData += subK * batchN;
+  }
+}
+
+void ExpandConvLayer::bpropActsBatch(MatrixPtr v, int inpIdx, size_t startIdx,
+                                     size_t numFrames) {
+  int subM = subM_[inpIdx];
+  int subN = subN_[inpIdx];
+  int subK = subK_[inpIdx];
+  size_t batchN = numFrames * subN;
+  MatrixPtr tgtGrad = getPrev(inpIdx)->getOutputGrad();
+
+  resetExpandInput(subK * groups_[inpIdx], batchN);
+  gatherOutputGrad(v, startIdx, numFrames);
+
+  real *wgtData = weights_[inpIdx]->getW()->getData();
+  real *expandInData = expandInput_->getData();
+  real *gradData = batchOutput_->getData();
+  for (int g = 0; g < groups_[inpIdx]; g++) {
+    MatrixPtr C = Matrix::create(expandInData, subK, batchN, false, useGpu_);
+    MatrixPtr B = Matrix::create(gradData, subM, batchN, false, useGpu_);
+    MatrixPtr A = Matrix::create(wgtData, subK, subM, false, useGpu_);
+    C->mul(A, B);
+
+    expandInData += subK * batchN;
+    gradData += subM * batchN;
+    wgtData += subK * subM;
+  }
+
+  /* shrink the frames back to the input gradient */
+  size_t imgSize = imgSizeH_[inpIdx] * imgSizeW_[inpIdx] * channels_[inpIdx];
+  for (size_t n = 0; n < numFrames; ++n) {
+    CpuMatrix gradTmp(expandInput_->getData() + n * subN,
+                      expandInput_->getHeight(), subN,
+                      expandInput_->getStride(), false);
+    CpuMatrix tgtTmp(tgtGrad->getData() + (startIdx + n) * imgSize, 1,
+                     imgSize);
+    tgtTmp.convShrink(gradTmp, imgSizeH_[inpIdx], imgSizeW_[inpIdx],
+                      channels_[inpIdx], filterSize_[inpIdx],
+                      filterSize_[inpIdx], stride_[inpIdx], stride_[inpIdx],
+                      padding_[inpIdx], padding_[inpIdx], outputH_[inpIdx],
+                      outputW_[inpIdx], 1.0f, 1.0f);
+  }
+}
+
 }  // namespace paddle
@@ -50,6 +50,10 @@ protected:
   MatrixPtr expandInput_;
   /// The transpose of output, which is an auxiliary matrix.
   MatrixPtr transOutValue_;
+  /// Output (or output gradient) of several frames in the layout of the
+  /// batched expandInput_, only used on cpu. shape:
+  /// (numFilters_, numFrames * outputSizeH * outputSizeW)
+  MatrixPtr batchOutput_;
 
 public:
   explicit ExpandConvLayer(const LayerConfig& config) : ConvBaseLayer(config) {}
@@ -80,6 +84,31 @@ public:
    */
   void expandFwdOnce(MatrixPtr image, int inIdx, int startIdx);
 
+  /**
+   * Number of frames which are expanded and multiplied at once,
+   * see FLAGS_exconv_batch_frames. Return 1 for frame by frame.
+   */
+  size_t getBatchFrames(size_t batchSize);
+
+  /**
+   * Expand numFrames input samples side by side into expandInput_,
+   * frame n occupies the columns [n * subN, (n + 1) * subN).
+   */
+  void expandFrames(MatrixPtr image, size_t startIdx, size_t numFrames,
+                    int inIdx);
+
+  /**
+   * Copy the output gradients of numFrames samples into batchOutput_.
+   */
+  void gatherOutputGrad(MatrixPtr v, size_t startIdx, size_t numFrames);
+
+  /**
+   * Expand numFrames input samples and perform one matrix multiplication
+   * per group.
+   */
+  void expandFwdBatch(MatrixPtr image, int inIdx, size_t startIdx,
+                      size_t numFrames);
+
   /**
    * Add shared bias.
    */
@@ -95,6 +124,10 @@ public:
   void backward(const UpdateCallback& callback);
   void bpropWeights(MatrixPtr v, int inpIdx);
   void bpropActs(MatrixPtr v, int inpIdx);
+  void bpropWeightsBatch(MatrixPtr v, int inpIdx, size_t startIdx,
+                         size_t numFrames);
+  void bpropActsBatch(MatrixPtr v, int inpIdx, size_t startIdx,
+                      size_t numFrames);
 };
 
 }  // namespace paddle
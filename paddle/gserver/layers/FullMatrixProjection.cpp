@@ -29,7 +29,13 @@ FullMatrixProjection::FullMatrixProjection(const ProjectionConfig& config,
 
 void FullMatrixProjection::forward() {
   REGISTER_TIMER_INFO("FwMulTimer", getName().c_str());
-  out_->value->mul(in_->value, weight_->getW(), 1, 1);
+  auto quantized = parameter_->getQuantizedValue();
+  if (quantized &&
+      (passType_ == PASS_TEST || parameter_->isValueReleased())) {
+    quantized->mul(*in_->value, *out_->value, 1, 1);
+  } else {
+    out_->value->mul(in_->value, weight_->getW(), 1, 1);
+  }
 }
 
 void FullMatrixProjection::backward(const UpdateCallback& callback) {
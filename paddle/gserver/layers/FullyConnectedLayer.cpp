@@ -85,6 +85,13 @@ void FullyConnectedLayer::forward(PassType passType) {
     auto input = getInput(i);
     CHECK(input.value) << "The input of 'fc' layer must be matrix";
     REGISTER_TIMER_INFO("FwMulTimer", getName().c_str());
+    auto& parameter = weights_[i]->getParameterPtr();
+    auto quantized = parameter->getQuantizedValue();
+    if (quantized &&
+        (passType == PASS_TEST || parameter->isValueReleased())) {
+      quantized->mul(*input.value, *outV, 1, i == 0 ? 0 : 1);
+      continue;
+    }
     i == 0 ? outV->mul(input.value, weights_[i]->getW(), 1, 0)
            : outV->mul(input.value, weights_[i]->getW(), 1, 1);
   }
@@ -14,26 +14,22 @@ limitations under the License. */
 
 
 #include <algorithm>
+#include "paddle/math/MathFunctions.h"
 #include "LinearChainCRF.h"
 
 namespace paddle {
 
-LinearChainCRF::LinearChainCRF(int numClasses, real* para, real* grad)
+LinearChainCRF::LinearChainCRF(int numClasses, real* para)
     : numClasses_(numClasses) {
   a_ = Matrix::create(para, 1, numClasses_);
   b_ = Matrix::create(para + numClasses_, 1, numClasses_);
   w_ = Matrix::create(para + 2 * numClasses_, numClasses_, numClasses_);
 
-  if (grad) {
-    da_ = Matrix::create(grad, 1, numClasses_);
-    db_ = Matrix::create(grad + numClasses_, 1, numClasses_);
-    dw_ = Matrix::create(grad + 2 * numClasses_, numClasses_, numClasses_);
-  }
-
   ones_ = Matrix::create(1, numClasses_);
   ones_->one();
 
   expW_ = Matrix::create(numClasses_, numClasses_);
+  tmp_ = Matrix::create(1, numClasses_);
 }
 
 // normalize x so that its sum is 1 and return the original sum;
@@ -79,13 +75,21 @@ real LinearChainCRF::forward(real* x, int* s, int length) {
   real ll = -maxX[0] - log(normalizeL1(alpha, numClasses_));
 
   for (int k = 1; k < length; ++k) {
-    for (int i = 0; i < numClasses_; ++i) {
-      real sum = 0;
-      for (int j = 0; j < numClasses_; ++j) {
-        sum += alpha[(k - 1) * numClasses_ + j]  // (*)
-               * expW[j * numClasses_ + i];
+    // alpha_k = (alpha_{k-1} * expW) .* expX_k. The inner loops run over
+    // the contiguous classes i, so that they are vectorized.
+    real* prevAlpha = alpha + (k - 1) * numClasses_;
+    real* curAlpha = alpha + k * numClasses_;
+    std::fill(curAlpha, curAlpha + numClasses_, 0);
+    for (int j = 0; j < numClasses_; ++j) {
+      real prev = prevAlpha[j];  // (*)
+      const real* expWRow = expW + j * numClasses_;
+      for (int i = 0; i < numClasses_; ++i) {
+        curAlpha[i] += prev * expWRow[i];
       }
-      alpha[k * numClasses_ + i] = expX[k * numClasses_ + i] * sum;
+    }
+    const real* curExpX = expX + k * numClasses_;
+    for (int i = 0; i < numClasses_; ++i) {
+      curAlpha[i] *= curExpX[i];
     }
     // normalizeL1 is to avoid underflow or overflow at (*)
     ll -= maxX[k] + log(normalizeL1(alpha + k * numClasses_, numClasses_));
@@ -108,19 +112,20 @@ real LinearChainCRF::forward(real* x, int* s, int length) {
   return -ll;
 }
 
-void LinearChainCRF::backward(real* x, real* dx, int* s, int length) {
+void LinearChainCRF::backward(real* x, real* dx, int* s, int length,
+                              real* grad) {
   MatrixPtr matX = Matrix::create(x, length, numClasses_);
   MatrixPtr matDX = Matrix::create(dx, length, numClasses_);
   MatrixPtr matGrad = Matrix::create(length, numClasses_);
   Matrix::resizeOrCreate(beta_, length, numClasses_);
   real* b = b_->getData();
-  real* dw = dw_ ? dw_->getData() : nullptr;
+  real* dw = grad ? grad + 2 * numClasses_ : nullptr;
 
   real* alpha = alpha_->getData();
   real* beta = beta_->getData();
   real* expW = expW_->getData();
   real* expX = expX_->getData();
-  real* grad = matGrad->getData();
+  real* tmp = tmp_->getData();
 
   for (int i = 0; i < numClasses_; ++i) {
     beta[(length - 1) * numClasses_ + i] = exp(b[i]);
@@ -128,14 +133,14 @@ void LinearChainCRF::backward(real* x, real* dx, int* s, int length) {
   normalizeL1(beta + (length - 1) * numClasses_, numClasses_);
 
   for (int k = length - 2; k >= 0; --k) {
+    // beta_k = expW * (beta_{k+1} .* expX_{k+1})
+    for (int j = 0; j < numClasses_; ++j) {
+      tmp[j] =
+          beta[(k + 1) * numClasses_ + j] * expX[(k + 1) * numClasses_ + j];
+    }
     for (int i = 0; i < numClasses_; ++i) {
-      real sum = 0;
-      for (int j = 0; j < numClasses_; ++j) {
-        sum += expW[i * numClasses_ + j]  // (**)
-               * beta[(k + 1) * numClasses_ + j] *
-               expX[(k + 1) * numClasses_ + j];
-      }
-      beta[k * numClasses_ + i] = sum;
+      beta[k * numClasses_ + i] =  // (**)
+          dotProduct<real>(numClasses_, expW + i * numClasses_, tmp);
     }
     // normalizeL1 is to avoid underflow or overflow at (**)
     normalizeL1(beta + k * numClasses_, numClasses_);
@@ -143,34 +148,35 @@ void LinearChainCRF::backward(real* x, real* dx, int* s, int length) {
 
   matGrad->dotMul(*alpha_, *beta_);
   matGrad->rowNormalizeL1(*matGrad);
+  real* gradX = matGrad->getData();
   for (int k = 0; k < length; ++k) {
-    grad[k * numClasses_ + s[k]] -= (real)1;
+    gradX[k * numClasses_ + s[k]] -= (real)1;
   }
   matDX->add(*matGrad);
-  if (da_) {
-    da_->add(*matGrad->subMatrix(/* startRow= */ 0, /* numRows= */ 1));
-  }
-  if (db_) {
-    db_->add(*matGrad->subMatrix(/* startRow= */ length - 1, 1));
+  if (grad) {
+    MatrixPtr da = Matrix::create(grad, 1, numClasses_);
+    MatrixPtr db = Matrix::create(grad + numClasses_, 1, numClasses_);
+    da->add(*matGrad->subMatrix(/* startRow= */ 0, /* numRows= */ 1));
+    db->add(*matGrad->subMatrix(/* startRow= */ length - 1, 1));
   }
 
   beta_->dotMul(*beta_, *expX_);
   beta_->rowNormalizeL1(*beta_);
 
   for (int k = 1; dw && k < length; ++k) {
-    real sum = 0;
+    // dw += expW .* (alpha_{k-1}^T * beta_k) / (alpha_{k-1} * expW * beta_k^T)
+    const real* prevAlpha = alpha + (k - 1) * numClasses_;
+    const real* curBeta = beta + k * numClasses_;
     for (int i = 0; i < numClasses_; ++i) {
-      for (int j = 0; j < numClasses_; ++j) {
-        sum += expW[i * numClasses_ + j] * alpha[(k - 1) * numClasses_ + i] *
-               beta[k * numClasses_ + j];
-      }
+      tmp[i] = dotProduct<real>(numClasses_, expW + i * numClasses_, curBeta);
     }
-    sum = 1 / sum;
+    real sum = 1 / dotProduct<real>(numClasses_, prevAlpha, tmp);
     for (int i = 0; i < numClasses_; ++i) {
+      real scale = sum * prevAlpha[i];
+      const real* expWRow = expW + i * numClasses_;
+      real* dwRow = dw + i * numClasses_;
       for (int j = 0; j < numClasses_; ++j) {
-        dw[i * numClasses_ + j] += sum * expW[i * numClasses_ + j] *
-                                   alpha[(k - 1) * numClasses_ + i] *
-                                   beta[k * numClasses_ + j];
+        dwRow[j] += scale * expWRow[j] * curBeta[j];
       }
     }
     dw[s[k - 1] * numClasses_ + s[k]] -= (real)1;
@@ -190,18 +196,27 @@ void LinearChainCRF::decode(real* x, int* s, int length) {
     alpha[i] = a[i] + x[i];
   }
   for (int k = 1; k < length; ++k) {
-    for (int i = 0; i < numClasses_; ++i) {
-      real maxScore = -std::numeric_limits<real>::max();
-      int maxJ = 0;
-      for (int j = 0; j < numClasses_; ++j) {
-        real score = alpha[(k - 1) * numClasses_ + j] + w[j * numClasses_ + i];
-        if (score > maxScore) {
-          maxScore = score;
-          maxJ = j;
+    // the max over j is updated for all the classes i at once, so that the
+    // inner loop is vectorized. The first best j is kept, as before.
+    real* prevAlpha = alpha + (k - 1) * numClasses_;
+    real* curAlpha = alpha + k * numClasses_;
+    int* curTrack = track + k * numClasses_;
+    std::fill(curAlpha, curAlpha + numClasses_,
+              -std::numeric_limits<real>::max());
+    std::fill(curTrack, curTrack + numClasses_, 0);
+    for (int j = 0; j < numClasses_; ++j) {
+      real prev = prevAlpha[j];
+      const real* wRow = w + j * numClasses_;
+      for (int i = 0; i < numClasses_; ++i) {
+        real score = prev + wRow[i];
+        if (score > curAlpha[i]) {
+          curAlpha[i] = score;
+          curTrack[i] = j;
         }
       }
-      alpha[k * numClasses_ + i] = maxScore + x[k * numClasses_ + i];
-      track[k * numClasses_ + i] = maxJ;
+    }
+    for (int i = 0; i < numClasses_; ++i) {
+      curAlpha[i] += x[k * numClasses_ + i];
     }
   }
   real maxScore = -std::numeric_limits<real>::max();
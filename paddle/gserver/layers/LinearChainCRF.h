@@ -34,7 +34,7 @@ public:
     where Z is a normalization value so that the sum of P(s) over all possible
     sequences is 1, and x is the input feature to the CRF.
    */
-  LinearChainCRF(int numClasses, real* para, real* grad);
+  LinearChainCRF(int numClasses, real* para);
 
   /*
     Calculate the negative log likelihood of s given x.
@@ -45,12 +45,15 @@ public:
 
   /*
     Calculate the gradient with respect to x, a, b, and w.
-    The gradient of x will be stored in dx.
+    The gradient of x will be stored in dx, the gradient of a, b and w in
+    grad, which has the same layout as para. grad can be nullptr.
     backward() can only be called after a corresponding call to forward() with
     the same x, s and length.
-    NOTE: The gradient is added to dx and grad (provided at constructor).
+    NOTE: The gradient is added to dx and grad.
+    Different LinearChainCRF objects can run at the same time in different
+    threads, if they do not add to the same grad.
    */
-  void backward(real* x, real* dx, int* s, int length);
+  void backward(real* x, real* dx, int* s, int length, real* grad);
 
   /*
     Find the most probable sequence given x. The result will be stored in s.
@@ -62,9 +65,6 @@ protected:
   MatrixPtr a_;
   MatrixPtr b_;
   MatrixPtr w_;
-  MatrixPtr da_;
-  MatrixPtr db_;
-  MatrixPtr dw_;
   MatrixPtr ones_;
 
   MatrixPtr expX_;
@@ -72,6 +72,8 @@ protected:
   MatrixPtr beta_;
   MatrixPtr maxX_;
   MatrixPtr expW_;
+  // expW_ * (beta .* expX) of one time step, see backward()
+  MatrixPtr tmp_;
 
   // track_(k,i) = j means that the best sequence at time k for class i comes
   // from the sequence at time k-1 for class j
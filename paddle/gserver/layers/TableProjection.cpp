@@ -37,7 +37,13 @@ void TableProjection::prefetch(const Argument* in) {
 
 void TableProjection::forward() {
   CHECK(in_->ids);
-  out_->value->selectRows(*table_->getW(), *in_->ids);
+  auto quantized = parameter_->getQuantizedValue();
+  if (quantized &&
+      (passType_ == PASS_TEST || parameter_->isValueReleased())) {
+    quantized->selectRows(*out_->value, *in_->ids);
+  } else {
+    out_->value->selectRows(*table_->getW(), *in_->ids);
+  }
 }
 
 void TableProjection::backward(const UpdateCallback& callback) {
@@ -0,0 +1,78 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+
+#include "ModelConfigUtil.h"
+
+#include <algorithm>
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+ParameterConfig* addParameter(ModelConfig& config, const std::string& name,
+                              size_t height, size_t width) {
+  ParameterConfig* para = config.add_parameters();
+  para->set_name(name);
+  para->set_size(height * width);
+  para->add_dims(height);
+  para->add_dims(width);
+  para->set_initial_std(0.1);
+  return para;
+}
+
+LayerConfig* addDataLayer(ModelConfig& config, const std::string& name,
+                          size_t size) {
+  LayerConfig* layer = config.add_layers();
+  layer->set_name(name);
+  layer->set_type("data");
+  layer->set_size(size);
+  config.add_input_layer_names(name);
+  return layer;
+}
+
+LayerConfig* addFcLayer(ModelConfig& config, const std::string& name,
+                        size_t size, const std::string& activation,
+                        const std::vector<std::string>& inputs,
+                        bool withBias) {
+  std::vector<size_t> inputSizes;
+  for (auto& input : inputs) {
+    auto inputLayer = std::find_if(
+        config.layers().begin(), config.layers().end(),
+        [&](const LayerConfig& conf) { return conf.name() == input; });
+    CHECK(inputLayer != config.layers().end()) << "Unknown layer " << input;
+    inputSizes.push_back(inputLayer->size());
+  }
+
+  LayerConfig* layer = config.add_layers();
+  layer->set_name(name);
+  layer->set_type("fc");
+  layer->set_size(size);
+  layer->set_active_type(activation);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::string weight = inputs.size() == 1
+                             ? "_" + name + ".w"
+                             : "_" + name + "." + inputs[i] + ".w";
+    addParameter(config, weight, inputSizes[i], size);
+    LayerInputConfig* inputConfig = layer->add_inputs();
+    inputConfig->set_input_layer_name(inputs[i]);
+    inputConfig->set_input_parameter_name(weight);
+  }
+  if (withBias) {
+    addParameter(config, "_" + name + ".bias", 1, size);
+    layer->set_bias_parameter_name("_" + name + ".bias");
+  }
+  return layer;
+}
+
+}  // namespace paddle
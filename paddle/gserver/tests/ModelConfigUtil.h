@@ -0,0 +1,49 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "ModelConfig.pb.h"
+
+namespace paddle {
+
+/**
+ * @brief Helpers to build the ModelConfig of a small network in a test,
+ * without the python config parser.
+ */
+
+/// Add a height x width parameter initialized with std 0.1 to config.
+ParameterConfig* addParameter(ModelConfig& config, const std::string& name,
+                              size_t height, size_t width);
+
+/// Add a data layer of the given size, which is an input layer of config.
+LayerConfig* addDataLayer(ModelConfig& config, const std::string& name,
+                          size_t size);
+
+/**
+ * @brief Add a fc layer reading the layers named inputs, which must already
+ * be in config.
+ *
+ * The weight of a single input is "_<name>.w", the weights of several inputs
+ * are "_<name>.<input>.w". If withBias, the bias is "_<name>.bias".
+ */
+LayerConfig* addFcLayer(ModelConfig& config, const std::string& name,
+                        size_t size, const std::string& activation,
+                        const std::vector<std::string>& inputs,
+                        bool withBias = false);
+
+}  // namespace paddle
@@ -0,0 +1,132 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+P_DECLARE_bool(reuse_inference_memory);
+
+static const size_t kInputSize = 20;
+static const size_t kHiddenSize = 64;
+static const size_t kOutputSize = 10;
+
+/**
+ * input -> fc1 -> fc2 -> fc3 -> sum(fc1, fc3) -> out
+ *                    \-> fc4 (only read by an evaluator)
+ */
+static ModelConfig makeConfig() {
+  ModelConfig config;
+  config.set_type("nn");
+  addDataLayer(config, "input", kInputSize);
+
+  addFcLayer(config, "fc1", kHiddenSize, "tanh", {"input"});
+  addFcLayer(config, "fc2", kHiddenSize, "sigmoid", {"fc1"});
+  addFcLayer(config, "fc4", kOutputSize, "", {"fc2"});
+  addFcLayer(config, "fc3", kHiddenSize, "tanh", {"fc2"});
+  LayerConfig* sum = config.add_layers();
+  sum->set_name("sum");
+  sum->set_type("addto");
+  sum->set_size(kHiddenSize);
+  sum->set_active_type("");
+  sum->add_inputs()->set_input_layer_name("fc1");
+  sum->add_inputs()->set_input_layer_name("fc3");
+  addFcLayer(config, "out", kOutputSize, "softmax", {"sum"});
+  config.add_output_layer_names("out");
+
+  EvaluatorConfig* evaluator = config.add_evaluators();
+  evaluator->set_name("fc4_sum");
+  evaluator->set_type("sum");
+  evaluator->add_input_layers("fc4");
+  return config;
+}
+
+static unique_ptr<NeuralNetwork> createNetwork(const ModelConfig& config,
+                                               bool reuseMemory) {
+  bool flag = FLAGS_reuse_inference_memory;
+  FLAGS_reuse_inference_memory = reuseMemory;
+  unique_ptr<NeuralNetwork> network(NeuralNetwork::create(config));
+  network->init(config);
+  FLAGS_reuse_inference_memory = flag;
+  return network;
+}
+
+static void checkSame(const MatrixPtr& expected, const MatrixPtr& actual) {
+  ASSERT_TRUE(expected != nullptr);
+  ASSERT_TRUE(actual != nullptr);
+  ASSERT_EQ(expected->getHeight(), actual->getHeight());
+  ASSERT_EQ(expected->getWidth(), actual->getWidth());
+  EXPECT_EQ(0, memcmp(expected->getData(), actual->getData(),
+                      expected->getElementCnt() * sizeof(real)));
+}
+
+TEST(NeuralNetwork, reuseInferenceMemory) {
+  ModelConfig config = makeConfig();
+  auto network = createNetwork(config, false);
+  auto planned = createNetwork(config, true);
+  network->randParameters();
+  auto& params = network->getParameters();
+  auto& plannedParams = planned->getParameters();
+  ASSERT_EQ(params.size(), plannedParams.size());
+  for (size_t i = 0; i < params.size(); ++i) {
+    plannedParams[i]->getBuf(PARAMETER_VALUE)
+        ->copyFrom(*params[i]->getBuf(PARAMETER_VALUE));
+  }
+
+  for (size_t batchSize : {16, 7, 16, 32}) {
+    vector<Argument> inArgs(1);
+    inArgs[0].value = Matrix::create(batchSize, kInputSize, false, false);
+    inArgs[0].value->randomizeUniform();
+    vector<Argument> outArgs;
+    vector<Argument> plannedOutArgs;
+    network->forward(inArgs, &outArgs, PASS_TEST);
+    planned->forward(inArgs, &plannedOutArgs, PASS_TEST);
+
+    ASSERT_EQ(1UL, plannedOutArgs.size());
+    checkSame(outArgs[0].value, plannedOutArgs[0].value);
+    checkSame(network->getLayerOutput("fc4"), planned->getLayerOutput("fc4"));
+    // the outputs of the other hidden layers have been recycled
+    for (auto name : {"fc1", "fc2", "fc3", "sum"}) {
+      EXPECT_TRUE(network->getLayerOutput(name) != nullptr);
+      EXPECT_TRUE(planned->getLayerOutput(name) == nullptr) << name;
+    }
+  }
+
+  // training passes are not planned
+  vector<Argument> inArgs(1);
+  inArgs[0].value = Matrix::create(5, kInputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  vector<Argument> outArgs;
+  vector<Argument> plannedOutArgs;
+  network->forward(inArgs, &outArgs, PASS_TRAIN);
+  planned->forward(inArgs, &plannedOutArgs, PASS_TRAIN);
+  checkSame(outArgs[0].value, plannedOutArgs[0].value);
+  for (auto name : {"fc1", "fc2", "fc3", "sum"}) {
+    checkSame(network->getLayerOutput(name), planned->getLayerOutput(name));
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+static const size_t kInputSize = 20;
+static const size_t kHiddenSize = 64;
+static const size_t kOutputSize = 10;
+
+/// input -> fc1 -> fc2 -> out
+static ModelConfig makeConfig() {
+  ModelConfig config;
+  config.set_type("nn");
+  addDataLayer(config, "input", kInputSize);
+
+  addFcLayer(config, "fc1", kHiddenSize, "tanh", {"input"});
+  addFcLayer(config, "fc2", kHiddenSize, "sigmoid", {"fc1"});
+  addFcLayer(config, "out", kOutputSize, "softmax", {"fc2"});
+  config.add_output_layer_names("out");
+  return config;
+}
+
+static vector<Argument> makeInput(size_t batchSize) {
+  vector<Argument> inArgs(1);
+  inArgs[0].value = Matrix::create(batchSize, kInputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  return inArgs;
+}
+
+static void checkSame(const MatrixPtr& expected, const MatrixPtr& actual) {
+  ASSERT_TRUE(expected != nullptr);
+  ASSERT_TRUE(actual != nullptr);
+  ASSERT_EQ(expected->getHeight(), actual->getHeight());
+  ASSERT_EQ(expected->getWidth(), actual->getWidth());
+  EXPECT_EQ(0, memcmp(expected->getData(), actual->getData(),
+                      expected->getElementCnt() * sizeof(real)));
+}
+
+TEST(NeuralNetwork, inferenceReplicaSharesParameters) {
+  ModelConfig config = makeConfig();
+  unique_ptr<NeuralNetwork> network(NeuralNetwork::create(config));
+  network->init(config);
+  network->randParameters();
+
+  unique_ptr<NeuralNetwork> replica(network->createInferenceReplica());
+  unique_ptr<NeuralNetwork> replicaOfReplica(replica->createInferenceReplica());
+  auto& params = network->getParameters();
+  for (auto* nn : {replica.get(), replicaOfReplica.get()}) {
+    auto& replicaParams = nn->getParameters();
+    ASSERT_EQ(params.size(), replicaParams.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+      EXPECT_EQ(params[i]->getBuf(PARAMETER_VALUE)->getData(),
+                replicaParams[i]->getBuf(PARAMETER_VALUE)->getData());
+      EXPECT_TRUE(replicaParams[i]->getBuf(PARAMETER_GRADIENT) == nullptr);
+    }
+  }
+
+  vector<Argument> inArgs = makeInput(16);
+  vector<Argument> outArgs;
+  vector<Argument> replicaOutArgs;
+  network->forward(inArgs, &outArgs, PASS_TEST);
+  replicaOfReplica->forward(inArgs, &replicaOutArgs, PASS_TEST);
+  checkSame(outArgs[0].value, replicaOutArgs[0].value);
+
+  // the replicas see the later updates of the shared values
+  params[0]->getBuf(PARAMETER_VALUE)->mulScalar(2);
+  network->forward(inArgs, &outArgs, PASS_TEST);
+  replica->forward(inArgs, &replicaOutArgs, PASS_TEST);
+  checkSame(outArgs[0].value, replicaOutArgs[0].value);
+}
+
+TEST(NeuralNetwork, concurrentInferenceReplicas) {
+  const size_t numThreads = 4;
+  const size_t numBatches = 20;
+  ModelConfig config = makeConfig();
+  unique_ptr<NeuralNetwork> network(NeuralNetwork::create(config));
+  network->init(config);
+  network->randParameters();
+
+  vector<vector<Argument>> inputs;
+  vector<MatrixPtr> expected;
+  for (size_t i = 0; i < numBatches; ++i) {
+    inputs.push_back(makeInput(1 + i % 8));
+    vector<Argument> outArgs;
+    network->forward(inputs.back(), &outArgs, PASS_TEST);
+    expected.push_back(Matrix::create(outArgs[0].value->getHeight(),
+                                      kOutputSize, false, false));
+    expected.back()->copyFrom(*outArgs[0].value);
+  }
+
+  vector<unique_ptr<NeuralNetwork>> replicas;
+  for (size_t tid = 0; tid < numThreads; ++tid) {
+    replicas.emplace_back(network->createInferenceReplica());
+  }
+  vector<thread> threads;
+  for (size_t tid = 0; tid < numThreads; ++tid) {
+    threads.emplace_back([&, tid]() {
+      for (size_t i = tid; i < numThreads * numBatches; ++i) {
+        size_t batch = i % numBatches;
+        vector<Argument> outArgs;
+        replicas[tid]->forward(inputs[batch], &outArgs, PASS_TEST);
+        checkSame(expected[batch], outArgs[0].value);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -29,6 +29,7 @@ P_DECLARE_bool(use_gpu);
 P_DECLARE_int32(gpu_id);
 P_DECLARE_double(checkgrad_eps);
 P_DECLARE_bool(thread_local_rand_use_global_seed);
+P_DECLARE_int32(exconv_batch_frames);
 P_DECLARE_bool(prev_batch_state);
 
 TEST(Operator, dot_mul) {
@@ -266,6 +267,10 @@ void testConvLayer(const string& type, bool trans, bool useGpu) {
 
 TEST(Layer, convLayer) {
   testConvLayer("exconv", /* trans= */ false, /* useGpu= */ false);
+  // expand several frames at once, with a last chunk of partial size
+  FLAGS_exconv_batch_frames = 3;
+  testConvLayer("exconv", /* trans= */ false, /* useGpu= */ false);
+  FLAGS_exconv_batch_frames = 0;
 #ifndef PADDLE_ONLY_CPU
   testConvLayer("exconv", /* trans= */ false, /* useGpu= */ true);
   testConvLayer("cudnn_conv", /* trans= */ false, /* useGpu= */ true);
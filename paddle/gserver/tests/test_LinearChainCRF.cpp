@@ -15,12 +15,18 @@ limitations under the License. */
 
 #include <gtest/gtest.h>
 #include <vector>
+#include "paddle/gserver/layers/DataLayer.h"
 #include "paddle/gserver/layers/LinearChainCRF.h"
+#include "paddle/math/MathThreadPool.h"
+#include "paddle/utils/Stat.h"
 #include "paddle/utils/Util.h"
 
 using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
 
+P_DECLARE_int32(math_num_threads);
+P_DECLARE_int32(math_parallel_threshold);
+
 static inline bool getNextSequence(vector<int>& seq, int numClasses) {
   for (auto& v : seq) {
     if (++v < numClasses) {
@@ -37,7 +43,7 @@ TEST(LinearChainCRF, decoding) {
   real* a = para.getData();
   real* b = para.getData() + numClasses;
   real* w = para.getData() + 2 * numClasses;
-  LinearChainCRF crf(4, para.getData(), nullptr);
+  LinearChainCRF crf(4, para.getData());
   for (int length : {1, 2, 3, 10}) {
     for (int tries = 0; tries < 10; ++tries) {
       CpuMatrix x(length, numClasses);
@@ -67,8 +73,167 @@ TEST(LinearChainCRF, decoding) {
   }
 }
 
+// a batch of random sequences for a crf or crf_decoding layer
+class CRFLayerTest {
+public:
+  CRFLayerTest(const string& type, int numClasses, int numSequences,
+               int maxLength) {
+    vector<int> starts = {0};
+    for (int i = 0; i < numSequences; ++i) {
+      starts.push_back(starts.back() + 1 + rand() % maxLength);  // NOLINT
+    }
+    int batchSize = starts.back();
+
+    Argument x;
+    x.value = Matrix::create(batchSize, numClasses, false, false);
+    x.value->randomizeUniform();
+    x.grad = Matrix::create(batchSize, numClasses, false, false);
+    x.sequenceStartPositions =
+        ICpuGpuVector::create(starts.size(), /* useGpu= */ false);
+    x.sequenceStartPositions->copyFrom(starts.data(), starts.size(), false);
+    Argument label;
+    label.ids = IVector::create(batchSize, false);
+    label.ids->rand(numClasses);
+    label.sequenceStartPositions = x.sequenceStartPositions;
+    xLayer_ = createDataLayer("x", numClasses, x);
+    labelLayer_ = createDataLayer("label", 1, label);
+
+    ParameterConfig paraConfig;
+    paraConfig.set_name("para");
+    paraConfig.set_size(numClasses * (numClasses + 2));
+    para_ = std::make_shared<Parameter>(paraConfig, false, false);
+    para_->enableType(PARAMETER_VALUE);
+    para_->enableType(PARAMETER_GRADIENT);
+    para_->getBuf(PARAMETER_VALUE)->randnorm(0, 1);
+
+    LayerConfig config;
+    config.set_name(type);
+    config.set_type(type);
+    config.set_size(numClasses);
+    LayerInputConfig* input = config.add_inputs();
+    input->set_input_layer_name("x");
+    input->set_input_parameter_name("para");
+    config.add_inputs()->set_input_layer_name("label");
+    layer_ = Layer::create(config);
+    LayerMap layerMap = {{"x", xLayer_}, {"label", labelLayer_}};
+    ParameterMap parameterMap = {{"para", para_}};
+    layer_->init(layerMap, parameterMap);
+  }
+
+  void forward() { layer_->forward(PASS_TRAIN); }
+
+  void backward() {
+    xLayer_->getOutputGrad()->zeroMem();
+    para_->getBuf(PARAMETER_GRADIENT)->zeroMem();
+    layer_->backward(nullptr);
+  }
+
+  LayerPtr layer_;
+  LayerPtr xLayer_;
+  ParameterPtr para_;
+
+private:
+  LayerPtr createDataLayer(const string& name, int size,
+                           const Argument& data) {
+    LayerConfig config;
+    config.set_name(name);
+    config.set_type("data");
+    config.set_size(size);
+    auto layer = std::make_shared<DataLayer>(config);
+    layer->setData(data);
+    layer->forward(PASS_TRAIN);
+    return layer;
+  }
+
+  LayerPtr labelLayer_;
+};
+
+static void expectNear(const real* a, const real* b, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    EXPECT_NEAR(a[i], b[i], 1e-4 * std::max<real>(1, std::fabs(a[i])));
+  }
+}
+
+TEST(CRFLayer, parallel) {
+  int threshold = FLAGS_math_parallel_threshold;
+  for (int numSequences : {1, 3, 50}) {
+    // the same sequence lengths for both layers
+    srand(numSequences);
+    CRFLayerTest crf("crf", 5, numSequences, 10);
+    srand(numSequences);
+    CRFLayerTest decoding("crf_decoding", 5, numSequences, 10);
+    decoding.para_->getBuf(PARAMETER_VALUE)
+        ->copyFrom(*crf.para_->getBuf(PARAMETER_VALUE));
+    decoding.xLayer_->getOutputValue()->copyFrom(
+        *crf.xLayer_->getOutputValue());
+
+    auto copyOf = [](const MatrixPtr& m) {
+      MatrixPtr copy = Matrix::create(m->getHeight(), m->getWidth());
+      copy->copyFrom(*m);
+      return copy;
+    };
+    vector<MatrixPtr> costs, xGrads, paraGrads;
+    vector<vector<int>> ids;
+    for (int parallel : {0, 1}) {
+      FLAGS_math_parallel_threshold = parallel;
+      crf.forward();
+      crf.backward();
+      costs.push_back(copyOf(crf.layer_->getOutputValue()));
+      xGrads.push_back(copyOf(crf.xLayer_->getOutputGrad()));
+      VectorPtr paraGrad = crf.para_->getBuf(PARAMETER_GRADIENT);
+      paraGrads.push_back(copyOf(Matrix::create(
+          paraGrad->getData(), 1, paraGrad->getSize(), false, false)));
+
+      decoding.forward();
+      IVectorPtr result = decoding.layer_->getOutput().ids;
+      ids.emplace_back(result->getData(),
+                       result->getData() + result->getSize());
+    }
+    FLAGS_math_parallel_threshold = threshold;
+
+    for (auto results : {&costs, &xGrads, &paraGrads}) {
+      expectNear((*results)[0]->getData(), (*results)[1]->getData(),
+                 (*results)[0]->getElementCnt());
+    }
+    EXPECT_EQ(ids[0], ids[1]);
+  }
+}
+
+TEST(CRFLayer, parallelBenchmark) {
+  const int kIterations = 5;
+  CRFLayerTest crf("crf", 20, 2000, 40);
+  CRFLayerTest decoding("crf_decoding", 20, 2000, 40);
+
+  int threshold = FLAGS_math_parallel_threshold;
+  for (int parallel : {0, 1}) {
+    FLAGS_math_parallel_threshold = parallel ? threshold : 0;
+    Timer forward, backward, decode;
+    for (int i = 0; i < kIterations; ++i) {
+      forward.start();
+      crf.forward();
+      forward.stop();
+      backward.start();
+      crf.backward();
+      backward.stop();
+      decode.start();
+      decoding.forward();
+      decode.stop();
+    }
+    LOG(INFO) << (parallel ? "parallel" : "serial") << " ("
+              << MathThreadPool::global().getNumThreads() << " threads) "
+              << "20 classes, 2000 sequences: "
+              << "forward " << forward.get() / kIterations << "us, "
+              << "backward " << backward.get() / kIterations << "us, "
+              << "decoding " << decode.get() / kIterations << "us";
+  }
+  FLAGS_math_parallel_threshold = threshold;
+}
+
 int main(int argc, char** argv) {
   initMain(argc, argv);
   testing::InitGoogleTest(&argc, argv);
+  if (FLAGS_math_num_threads < 0) {
+    FLAGS_math_num_threads = 4;
+  }
   return RUN_ALL_TESTS();
 }
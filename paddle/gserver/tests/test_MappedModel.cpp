@@ -0,0 +1,167 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/parameter/MappedModel.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+static const string kModelFile = "./test_mapped_model";
+static const size_t kInputSize = 20;
+static const size_t kHiddenSize = 32;
+static const size_t kOutputSize = 10;
+
+static TrainerConfig makeConfig() {
+  TrainerConfig trainerConfig;
+  ModelConfig& config = *trainerConfig.mutable_model_config();
+  config.set_type("nn");
+  addDataLayer(config, "input", kInputSize);
+  addFcLayer(config, "hidden", kHiddenSize, "tanh", {"input"},
+             /* withBias= */ true);
+  addFcLayer(config, "out", kOutputSize, "softmax", {"hidden"},
+             /* withBias= */ true);
+  config.add_output_layer_names("out");
+  OptimizationConfig& optConfig = *trainerConfig.mutable_opt_config();
+  optConfig.set_batch_size(16);
+  optConfig.set_algorithm("sgd");
+  optConfig.set_learning_rate(0.01);
+  return trainerConfig;
+}
+
+TEST(MappedModel, zeroCopyLoad) {
+  TrainerConfig trainerConfig = makeConfig();
+  unique_ptr<GradientMachine> machine(
+      GradientMachine::create(trainerConfig.model_config()));
+  machine->randParameters();
+  MappedModel::write(kModelFile, trainerConfig.SerializeAsString(),
+                     machine->getParameters());
+  ASSERT_TRUE(MappedModel::isMappedModel(kModelFile));
+
+  TrainerConfig loadedConfig;
+  unique_ptr<GradientMachine> mapped(
+      GradientMachine::create(kModelFile, &loadedConfig));
+  EXPECT_EQ(trainerConfig.SerializeAsString(),
+            loadedConfig.SerializeAsString());
+
+  auto& params = machine->getParameters();
+  auto& mappedParams = mapped->getParameters();
+  ASSERT_EQ(params.size(), mappedParams.size());
+  for (size_t i = 0; i < params.size(); ++i) {
+    auto& value = params[i]->getBuf(PARAMETER_VALUE);
+    auto& mappedValue = mappedParams[i]->getBuf(PARAMETER_VALUE);
+    ASSERT_EQ(value->getSize(), mappedValue->getSize());
+    EXPECT_EQ(0, memcmp(value->getData(), mappedValue->getData(),
+                        value->getSize() * sizeof(real)));
+    // bound to the page aligned values of the mapping
+    EXPECT_EQ(0UL, (uintptr_t)mappedValue->getData() % MappedModel::kAlignment)
+        << params[i]->getName();
+    EXPECT_TRUE(mappedParams[i]->getBuf(PARAMETER_GRADIENT) == nullptr);
+  }
+
+  vector<Argument> inArgs(1);
+  inArgs[0].value = Matrix::create(8, kInputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  vector<Argument> outArgs;
+  vector<Argument> mappedOutArgs;
+  machine->forward(inArgs, &outArgs, PASS_TEST);
+  mapped->forward(inArgs, &mappedOutArgs, PASS_TEST);
+  ASSERT_EQ(1UL, mappedOutArgs.size());
+  auto& out = outArgs[0].value;
+  EXPECT_EQ(0, memcmp(out->getData(), mappedOutArgs[0].value->getData(),
+                      out->getElementCnt() * sizeof(real)));
+
+  // the mapping outlives the file name and the MappedModel object
+  machine.reset();
+  remove(kModelFile.c_str());
+  mapped->forward(inArgs, &mappedOutArgs, PASS_TEST);
+}
+
+TEST(MappedModel, copyLoad) {
+  TrainerConfig trainerConfig = makeConfig();
+  unique_ptr<GradientMachine> machine(
+      GradientMachine::create(trainerConfig.model_config()));
+  machine->randParameters();
+  MappedModel::write(kModelFile, trainerConfig.SerializeAsString(),
+                     machine->getParameters());
+
+  auto model = make_shared<MappedModel>(kModelFile);
+  EXPECT_EQ(machine->getParameters().size(), model->getNumParameters());
+  EXPECT_EQ(trainerConfig.SerializeAsString(), model->getConfig());
+  for (auto& para : machine->getParameters()) {
+    // the value buffer is already enabled, so it can only be copied
+    EXPECT_FALSE(model->bindParameter(para.get()));
+    Parameter copy(para->getConfig(), /* useGpu */ false);
+    copy.setID(para->getID());
+    model->loadParameter(&copy);
+    auto& value = para->getBuf(PARAMETER_VALUE);
+    EXPECT_EQ(0, memcmp(value->getData(),
+                        copy.getBuf(PARAMETER_VALUE)->getData(),
+                        value->getSize() * sizeof(real)));
+  }
+  remove(kModelFile.c_str());
+}
+
+TEST(MappedModel, quantizedLoad) {
+  TrainerConfig trainerConfig = makeConfig();
+  unique_ptr<GradientMachine> machine(
+      GradientMachine::create(trainerConfig.model_config()));
+  machine->randParameters();
+  MappedModel::write(kModelFile, trainerConfig.SerializeAsString(),
+                     machine->getParameters(), QUANTIZED_INT8);
+
+  TrainerConfig loadedConfig;
+  unique_ptr<GradientMachine> mapped(
+      GradientMachine::create(kModelFile, &loadedConfig));
+  for (auto& para : mapped->getParameters()) {
+    auto quantized = para->getQuantizedValue();
+    EXPECT_EQ(para->canQuantize(), quantized != nullptr) << para->getName();
+    if (quantized) {
+      // bound to the page aligned values of the mapping, and the real
+      // values are released since only fc layers read them
+      EXPECT_EQ(0UL, (uintptr_t)quantized->getMemory()->getBuf() %
+                         MappedModel::kAlignment);
+      EXPECT_TRUE(para->isValueReleased());
+    }
+  }
+
+  vector<Argument> inArgs(1);
+  inArgs[0].value = Matrix::create(8, kInputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  vector<Argument> outArgs;
+  vector<Argument> mappedOutArgs;
+  machine->forward(inArgs, &outArgs, PASS_TEST);
+  mapped->forward(inArgs, &mappedOutArgs, PASS_TEST);
+  auto& out = outArgs[0].value;
+  for (size_t i = 0; i < out->getElementCnt(); ++i) {
+    EXPECT_NEAR(out->getData()[i], mappedOutArgs[0].value->getData()[i], 1e-2);
+  }
+  remove(kModelFile.c_str());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  FLAGS_use_gpu = false;
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,133 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+P_DECLARE_bool(cpu_reduce_scatter);
+
+static const size_t kInputSize = 100;
+static const size_t kHiddenSize = 300;
+static const size_t kOutputSize = 10;
+static const size_t kBatchSize = 64;
+
+/**
+ * input -> fc(tanh) -> fc(tanh) -> fc(softmax) -> square_error <- label
+ */
+static ModelConfig makeConfig() {
+  ModelConfig config;
+  config.set_type("nn");
+  addDataLayer(config, "input", kInputSize);
+  addDataLayer(config, "label", kOutputSize);
+  addFcLayer(config, "hidden1", kHiddenSize, "tanh", {"input"},
+             /* withBias= */ true);
+  addFcLayer(config, "hidden2", kHiddenSize, "tanh", {"hidden1"},
+             /* withBias= */ true);
+  addFcLayer(config, "output", kOutputSize, "softmax", {"hidden2"},
+             /* withBias= */ true);
+
+  LayerConfig* cost = config.add_layers();
+  cost->set_name("cost");
+  cost->set_type("square_error");
+  cost->set_size(1);
+  cost->add_inputs()->set_input_layer_name("output");
+  cost->add_inputs()->set_input_layer_name("label");
+  config.add_output_layer_names("cost");
+  return config;
+}
+
+static vector<Argument> makeInArgs() {
+  vector<Argument> inArgs(2);
+  for (size_t i = 0; i < 2; ++i) {
+    inArgs[i].value =
+        Matrix::create(kBatchSize, i == 0 ? kInputSize : kOutputSize, false,
+                       false);
+    inArgs[i].value->randomizeUniform();
+  }
+  return inArgs;
+}
+
+static void computeGradients(GradientMachine& machine,
+                             const vector<Argument>& inArgs) {
+  for (auto& para : machine.getParameters()) {
+    para->clearGradient();
+  }
+  vector<Argument> outArgs;
+  machine.forwardBackward(inArgs, &outArgs, PASS_TRAIN);
+}
+
+static void checkGradients(GradientMachine& expected,
+                           GradientMachine& actual) {
+  auto& expectedParas = expected.getParameters();
+  auto& actualParas = actual.getParameters();
+  ASSERT_EQ(expectedParas.size(), actualParas.size());
+  for (size_t i = 0; i < expectedParas.size(); ++i) {
+    auto& expectedGrad = expectedParas[i]->getBuf(PARAMETER_GRADIENT);
+    auto& actualGrad = actualParas[i]->getBuf(PARAMETER_GRADIENT);
+    real maxDiff = 0;
+    real maxAbs = 0;
+    for (size_t j = 0; j < expectedGrad->getSize(); ++j) {
+      real value = expectedGrad->getData()[j];
+      maxDiff = std::max(maxDiff, std::abs(value - actualGrad->getData()[j]));
+      maxAbs = std::max(maxAbs, std::abs(value));
+    }
+    EXPECT_GT(maxAbs, 0) << expectedParas[i]->getName();
+    EXPECT_LT(maxDiff, 1e-5 * maxAbs) << expectedParas[i]->getName();
+  }
+}
+
+TEST(MultiGradientMachine, cpuGradientMerge) {
+  ModelConfig config = makeConfig();
+  FLAGS_trainer_count = 1;
+  unique_ptr<GradientMachine> reference(GradientMachine::create(config));
+  reference->randParameters();
+
+  for (bool reduceScatter : {false, true}) {
+    FLAGS_cpu_reduce_scatter = reduceScatter;
+    for (int trainerCount : {2, 4, 7}) {
+      FLAGS_trainer_count = trainerCount;
+      unique_ptr<GradientMachine> machine(GradientMachine::create(config));
+      for (size_t i = 0; i < reference->getParameters().size(); ++i) {
+        machine->getParameters()[i]->getBuf(PARAMETER_VALUE)->copyFrom(
+            *reference->getParameters()[i]->getBuf(PARAMETER_VALUE));
+      }
+      // several batches, the state of the merge is reset by each batch
+      for (int batch = 0; batch < 3; ++batch) {
+        vector<Argument> inArgs = makeInArgs();
+        computeGradients(*reference, inArgs);
+        computeGradients(*machine, inArgs);
+        checkGradients(*reference, *machine);
+      }
+      machine->finish();
+    }
+  }
+  FLAGS_trainer_count = 1;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  FLAGS_use_gpu = false;
+  return RUN_ALL_TESTS();
+}
@@ -363,7 +363,8 @@ void checkSample(const vector<Argument>& args1, int64_t pos1,
 
 void testProtoDataProvider(int* numPerSlotType, bool iid, bool async,
                            bool useGpu, bool dataCompression,
-                           int numConstantSlots = 0) {
+                           int numConstantSlots = 0,
+                           const string& type = "proto") {
   mkDir(kTestDir);
   DataBatch data;
 
@@ -371,9 +372,14 @@ void testProtoDataProvider(int* numPerSlotType, bool iid, bool async,
   writeData(data, useGpu, dataCompression);
 
   DataConfig config;
-  config.set_type("proto");
+  config.set_type(type);
   config.set_files(dataCompression ? kProtoFileListCompressed : kProtoFileList);
   config.set_async_load_data(async);
+  bool stream = type == "proto_stream";
+  if (stream) {
+    // smaller than the data, so the parser waits for the batches.
+    config.set_buffer_capacity(20);
+  }
 
   for (int i = 0; i < numConstantSlots; ++i) {
     config.add_constant_slots(i + 11);
@@ -386,7 +392,9 @@ void testProtoDataProvider(int* numPerSlotType, bool iid, bool async,
   unique_ptr<DataProvider> dataProvider(DataProvider::create(config, useGpu));
   dataProvider->setSkipShuffle();
 
-  EXPECT_EQ(data.getSize(), dataProvider->getSize());
+  if (!stream) {
+    EXPECT_EQ(data.getSize(), dataProvider->getSize());
+  }
 
   int64_t batchSize = 10;
   DataBatch batch;
@@ -540,6 +548,66 @@ TEST(ProtoDataProvider, constant_slots) {
   }          // end for (int numDenseVecSlots : numSlotsArray)
 }
 
+TEST(ProtoStreamDataProvider, test) {
+  int numTwoArray[] = {0, 1};
+  for (int iid : numTwoArray) {
+    for (int async : numTwoArray) {
+      for (int dataCompression : numTwoArray) {
+        LOG(INFO) << " iid=" << iid << " async=" << async
+                  << " dataCompression=" << dataCompression;
+        int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+        numPerSlotType[SlotDef::VECTOR_DENSE] = 1;
+        numPerSlotType[SlotDef::VECTOR_SPARSE_NON_VALUE] = 1;
+        numPerSlotType[SlotDef::VECTOR_SPARSE_VALUE] = 1;
+        numPerSlotType[SlotDef::INDEX] = 1;
+        numPerSlotType[SlotDef::STRING] = 1;
+        // with one parser thread and no shuffle, the samples are read in the
+        // order of the files.
+        testProtoDataProvider(numPerSlotType, iid, async, /* useGpu= */ false,
+                              dataCompression, /* numConstantSlots= */ 0,
+                              "proto_stream");
+      }
+    }
+  }
+}
+
+TEST(ProtoStreamDataProvider, shuffle) {
+  for (bool iid : {false, true}) {
+    mkDir(kTestDir);
+    DataBatch data;
+    int numPerSlotType[SlotDef::SlotType_ARRAYSIZE] = {0};
+    numPerSlotType[SlotDef::VECTOR_DENSE] = 1;
+    numPerSlotType[SlotDef::INDEX] = 1;
+    prepareData(&data, numPerSlotType, iid, /* useGpu= */ false);
+    writeData(data, /* useGpu= */ false, /* dataCompression= */ false);
+    real expectedSum = data.getStreams()[0].value->getSum();
+
+    DataConfig config;
+    config.set_type("proto_stream");
+    config.set_files(kProtoFileList);
+    config.set_buffer_capacity(20);
+    config.mutable_file_group_conf()->set_load_thread_num(2);
+    unique_ptr<DataProvider> dataProvider(DataProvider::create(config, false));
+    for (int pass = 0; pass < 2; ++pass) {
+      dataProvider->reset();
+      DataBatch batch;
+      int64_t numSamples = 0;
+      int64_t numSeqs = 0;
+      real sum = 0;
+      while (dataProvider->getNextBatch(10, &batch) > 0) {
+        EXPECT_EQ(iid, !batch.getStreams()[0].sequenceStartPositions);
+        numSamples += batch.getSize();
+        numSeqs += batch.getNumSequences();
+        sum += batch.getStreams()[0].value->getSum();
+      }
+      EXPECT_EQ(data.getSize(), numSamples);
+      EXPECT_EQ(data.getNumSequences(), numSeqs);
+      EXPECT_NEAR(expectedSum, sum, 1e-3 * std::abs(expectedSum));
+    }
+    rmDir(kTestDir);
+  }
+}
+
 void checkSampleSequence(const vector<Argument>& args1,
                          const vector<Argument>& args2, int64_t offset,
                          int64_t numSeqs, bool useGpu) {
@@ -14,6 +14,7 @@ limitations under the License. */
 
 #ifndef PADDLE_NO_PYTHON
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <fstream>
 #include "paddle/utils/Util.h"
 #include "paddle/utils/PythonUtil.h"
@@ -353,6 +354,237 @@ TEST(PyDataProvider2, test_check) {
   }
 }
 
+static std::unique_ptr<paddle::DataProvider> createProvider(
+    const std::string& funcName,
+    const std::string& fileList = FLAGS_train_list) {
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(fileList.c_str());
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object(funcName);
+  config.set_load_data_args("");
+  return std::unique_ptr<paddle::DataProvider>(
+      paddle::DataProvider::create(config, false));
+}
+
+static void checkVectorEqual(const int* expected, const int* actual,
+                             size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_EQ(expected[i], actual[i]);
+  }
+}
+
+static void checkArgumentEqual(const paddle::Argument& expected,
+                               const paddle::Argument& actual) {
+  for (auto pos : {&paddle::Argument::sequenceStartPositions,
+                   &paddle::Argument::subSequenceStartPositions}) {
+    ASSERT_EQ(!!(expected.*pos), !!(actual.*pos));
+    if (expected.*pos) {
+      ASSERT_EQ((expected.*pos)->getSize(), (actual.*pos)->getSize());
+      checkVectorEqual((expected.*pos)->getData(false),
+                       (actual.*pos)->getData(false),
+                       (expected.*pos)->getSize());
+    }
+  }
+  ASSERT_EQ(!!expected.ids, !!actual.ids);
+  if (expected.ids) {
+    ASSERT_EQ(expected.ids->getSize(), actual.ids->getSize());
+    checkVectorEqual(expected.ids->getData(), actual.ids->getData(),
+                     expected.ids->getSize());
+  }
+  ASSERT_EQ(!!expected.value, !!actual.value);
+  if (!expected.value) {
+    return;
+  }
+  ASSERT_EQ(expected.value->getHeight(), actual.value->getHeight());
+  ASSERT_EQ(expected.value->getWidth(), actual.value->getWidth());
+  auto expectedSparse =
+      dynamic_cast<paddle::CpuSparseMatrix*>(expected.value.get());
+  auto actualSparse = dynamic_cast<paddle::CpuSparseMatrix*>(actual.value.get());
+  ASSERT_EQ(!!expectedSparse, !!actualSparse);
+  size_t size = expected.value->getElementCnt();
+  if (expectedSparse) {
+    checkVectorEqual(expectedSparse->getRows(), actualSparse->getRows(),
+                     expected.value->getHeight() + 1);
+    checkVectorEqual(expectedSparse->getCols(), actualSparse->getCols(),
+                     size);
+    ASSERT_EQ(expectedSparse->getValueType(), actualSparse->getValueType());
+    if (expectedSparse->getValueType() == paddle::NO_VALUE) {
+      return;
+    }
+  }
+  for (size_t i = 0; i < size; ++i) {
+    ASSERT_EQ(expected.value->getData()[i], actual.value->getData()[i]);
+  }
+}
+
+TEST(PyDataProvider2, cache_in_binary) {
+  auto expectedProvider = createProvider("test_no_cache");
+  auto provider = createProvider("test_cache_in_binary");
+  expectedProvider->setSkipShuffle();
+  provider->setSkipShuffle();
+  paddle::DataBatch expected;
+  paddle::DataBatch batch;
+  // the first pass reads from python, the others from the cache.
+  for (size_t pass = 0; pass < 3; ++pass) {
+    expectedProvider->reset();
+    provider->reset();
+    size_t numBatches = 0;
+    while (true) {
+      int64_t expectedSize = expectedProvider->getNextBatchInternal(10,
+                                                                    &expected);
+      int64_t size = provider->getNextBatchInternal(10, &batch);
+      ASSERT_EQ(expectedSize, size);
+      if (size == 0) {
+        break;
+      }
+      ++numBatches;
+      ASSERT_EQ(expected.getSize(), batch.getSize());
+      ASSERT_EQ(4UL, batch.getStreams().size());
+      for (size_t i = 0; i < 4; ++i) {
+        checkArgumentEqual(expected.getStream(i), batch.getStream(i));
+      }
+    }
+    ASSERT_GT(numBatches, 1UL);
+  }
+}
+
+/**
+ * Check that a pass of the provider reads all of gen_cache_samples, in any
+ * order.
+ */
+static void checkCacheSamplesPass(paddle::DataProvider* provider) {
+  provider->reset();
+  paddle::DataBatch batch;
+  size_t numSamples = 0;
+  int idSum = 0;
+  while (provider->getNextBatchInternal(10, &batch)) {
+    auto& ids = batch.getStream(3).ids;
+    numSamples += ids->getSize();
+    for (size_t i = 0; i < ids->getSize(); ++i) {
+      idSum += ids->getData()[i];
+    }
+    // the sequences of a sample stay together.
+    auto& starts = batch.getStream(0).sequenceStartPositions;
+    ASSERT_EQ(ids->getSize() + 1, starts->getSize());
+    for (size_t i = 0; i < ids->getSize(); ++i) {
+      int len = starts->getData(false)[i + 1] - starts->getData(false)[i];
+      int sampleId = batch.getStream(0).value->getData()[
+          starts->getData(false)[i] * 3];
+      ASSERT_EQ(sampleId % 4 + 1, len);
+    }
+  }
+  ASSERT_EQ(100UL, numSamples);
+  ASSERT_EQ(450, idSum);
+}
+
+TEST(PyDataProvider2, cache_in_binary_shuffle) {
+  auto provider = createProvider("test_cache_in_binary");
+  for (size_t pass = 0; pass < 3; ++pass) {
+    checkCacheSamplesPass(provider.get());
+  }
+}
+
+static std::string createShardFileList() {
+  std::string fileList = FLAGS_train_list + ".shards";
+  std::ofstream fout(fileList);
+  CHECK(fout.is_open());
+  for (int i = 0; i < 4; ++i) {
+    fout << "shard_" << i << std::endl;
+  }
+  return fileList;
+}
+
+TEST(PyDataProvider2, workers) {
+  auto provider = createProvider("test_workers", createShardFileList());
+  for (size_t pass = 0; pass < 2; ++pass) {
+    checkCacheSamplesPass(provider.get());
+  }
+  // stop the workers in the middle of a pass.
+  provider->reset();
+  paddle::DataBatch batch;
+  ASSERT_GT(provider->getNextBatchInternal(10, &batch), 0);
+  provider->reset();
+  checkCacheSamplesPass(provider.get());
+}
+
+TEST(PyDataProvider2, workers_cache_in_binary) {
+  auto provider = createProvider("test_workers_cache_in_binary",
+                                 createShardFileList());
+  // the first pass reads from the workers, the others from the cache.
+  for (size_t pass = 0; pass < 3; ++pass) {
+    checkCacheSamplesPass(provider.get());
+  }
+}
+
+/**
+ * Check that a pass of the bucketing provider reads all of test_bucketing,
+ * with the sequences of a batch in the same bucket.
+ */
+static void checkBucketingPass(paddle::DataProvider* provider) {
+  const int64_t batchSize = 8;
+  provider->reset();
+  paddle::DataBatch batch;
+  std::vector<int> labels;
+  size_t numPartialBatches = 0;
+  while (provider->getNextBatch(batchSize, &batch)) {
+    ASSERT_LE(batch.getSize(), batchSize);
+    if (batch.getSize() < batchSize) {
+      ++numPartialBatches;
+    }
+    auto& starts = batch.getStream(0).sequenceStartPositions;
+    auto& ids = batch.getStream(0).ids;
+    auto& label = batch.getStream(1).ids;
+    ASSERT_EQ(batch.getSize() + 1, starts->getSize());
+    ASSERT_EQ(batch.getSize(), label->getSize());
+    int bucket = -1;
+    for (int64_t i = 0; i < batch.getSize(); ++i) {
+      int sampleId = label->getData()[i];
+      int begin = starts->getData(false)[i];
+      int len = starts->getData(false)[i + 1] - begin;
+      ASSERT_EQ(sampleId * 7 % 40 + 1, len);
+      for (int j = 0; j < len; ++j) {
+        ASSERT_EQ(sampleId % 100, ids->getData()[begin + j]);
+      }
+      // the buckets are [1, 10], [11, 20] and [21, inf)
+      int sampleBucket = (len - 1) / 10 < 2 ? (len - 1) / 10 : 2;
+      if (bucket == -1) {
+        bucket = sampleBucket;
+      }
+      ASSERT_EQ(bucket, sampleBucket);
+      labels.push_back(sampleId);
+    }
+  }
+  // only the last batch of each bucket can be partial.
+  ASSERT_LE(numPartialBatches, 3UL);
+  std::sort(labels.begin(), labels.end());
+  ASSERT_EQ(500UL, labels.size());
+  for (size_t i = 0; i < labels.size(); ++i) {
+    ASSERT_EQ((int)i, labels[i]);
+  }
+}
+
+TEST(PyDataProvider2, bucketing) {
+  paddle::DataConfig config;
+  config.set_type("py2");
+  config.set_files(FLAGS_train_list.c_str());
+  config.set_load_data_module("test_PyDataProvider2");
+  config.set_load_data_object("test_bucketing");
+  config.set_load_data_args("");
+  config.add_bucket_boundaries(10);
+  config.add_bucket_boundaries(20);
+  for (int64_t poolSize : {0, 20}) {
+    config.set_bucket_pool_size(poolSize);
+    std::unique_ptr<paddle::DataProvider> provider(
+        paddle::DataProvider::create(config, false));
+    for (size_t pass = 0; pass < 2; ++pass) {
+      checkBucketingPass(provider.get());
+    }
+    provider->setSkipShuffle();
+    checkBucketingPass(provider.get());
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   paddle::initMain(argc, argv);
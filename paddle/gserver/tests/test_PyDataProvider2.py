@@ -109,3 +109,67 @@ def test_check(settings, filename):
                 yield_good_value = True
             yield i
 
+
+
+def gen_cache_samples():
+    for i in xrange(100):
+        seq_len = i % 4 + 1
+        yield [[float(i + j)] * 3 for j in xrange(seq_len)], \
+              [[[(k, float(i + j)) for k in xrange(j % 3)]
+                for j in xrange(m + 1)] for m in xrange(i % 3 + 1)], \
+              [i % 7, i % 11 + 7], \
+              i % 10
+
+
+cache_input_types = [
+    dense_vector(
+        3, seq_type=SequenceType.SEQUENCE), sparse_vector(
+            30, seq_type=SequenceType.SUB_SEQUENCE), sparse_binary_vector(30),
+    integer_value(10)
+]
+
+
+@provider(input_types=cache_input_types,
+          calc_batch_size=lambda x: len(x[0]))
+def test_no_cache(setting, filename):
+    for sample in gen_cache_samples():
+        yield sample
+
+
+@provider(input_types=cache_input_types,
+          calc_batch_size=lambda x: len(x[0]),
+          cache=CacheType.CACHE_PASS_IN_BINARY)
+def test_cache_in_binary(setting, filename):
+    for sample in gen_cache_samples():
+        yield sample
+
+
+def gen_shard_samples(filename):
+    # the file names are shard_0 to shard_3
+    shard = int(filename.split('_')[-1])
+    for i, sample in enumerate(gen_cache_samples()):
+        if i % 4 == shard:
+            yield sample
+
+
+@provider(input_types=cache_input_types,
+          calc_batch_size=lambda x: len(x[0]),
+          num_workers=3)
+def test_workers(setting, filename):
+    for sample in gen_shard_samples(filename):
+        yield sample
+
+
+@provider(input_types=cache_input_types,
+          calc_batch_size=lambda x: len(x[0]),
+          cache=CacheType.CACHE_PASS_IN_BINARY,
+          num_workers=2)
+def test_workers_cache_in_binary(setting, filename):
+    for sample in gen_shard_samples(filename):
+        yield sample
+
+
+@provider(input_types=[integer_value_sequence(100), integer_value(1000)])
+def test_bucketing(setting, filename):
+    for i in xrange(500):
+        yield [i % 100] * (i * 7 % 40 + 1), i
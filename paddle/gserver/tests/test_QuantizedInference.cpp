@@ -0,0 +1,200 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "paddle/gserver/gradientmachines/GradientMachine.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+static const size_t kInputSize = 64;
+static const size_t kDictSize = 1000;
+static const size_t kHiddenSize = 128;
+static const size_t kOutputSize = 32;
+
+/**
+ * input -> fc(tanh) --full_matrix_projection--> mixed(softmax)
+ * word  ---------------table_projection-------/
+ */
+static ModelConfig makeConfig() {
+  ModelConfig config;
+  config.set_type("nn");
+  addDataLayer(config, "input", kInputSize);
+  addDataLayer(config, "word", kDictSize);
+  addFcLayer(config, "fc", kHiddenSize, "tanh", {"input"},
+             /* withBias= */ true);
+
+  LayerConfig* mixed = config.add_layers();
+  mixed->set_name("mixed");
+  mixed->set_type("mixed");
+  mixed->set_size(kOutputSize);
+  mixed->set_active_type("softmax");
+  struct {
+    const char* input;
+    const char* type;
+    size_t inputSize;
+  } projections[] = {{"fc", "fc", kHiddenSize}, {"word", "table", kDictSize}};
+  for (auto& proj : projections) {
+    string name = string("_mixed.") + proj.input;
+    addParameter(config, name, proj.inputSize, kOutputSize);
+    auto input = mixed->add_inputs();
+    input->set_input_layer_name(proj.input);
+    input->set_input_parameter_name(name);
+    auto projConfig = input->mutable_proj_conf();
+    projConfig->set_type(proj.type);
+    projConfig->set_name(name);
+    projConfig->set_input_size(proj.inputSize);
+    projConfig->set_output_size(kOutputSize);
+  }
+  config.add_output_layer_names("mixed");
+  return config;
+}
+
+static void loadParameters(GradientMachine& machine,
+                           const vector<string>& values) {
+  auto& parameters = machine.getParameters();
+  ASSERT_EQ(values.size(), parameters.size());
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    istringstream is(values[i]);
+    parameters[i]->load(is);
+  }
+}
+
+static MatrixPtr forward(GradientMachine& machine,
+                         const vector<Argument>& inArgs) {
+  vector<Argument> outArgs;
+  machine.forward(inArgs, &outArgs, PASS_TEST);
+  return outArgs[0].value;
+}
+
+static real maxDiff(const MatrixPtr& a, const MatrixPtr& b) {
+  real diff = 0;
+  for (size_t i = 0; i < a->getElementCnt(); ++i) {
+    diff = std::max(diff, std::abs(a->getData()[i] - b->getData()[i]));
+  }
+  return diff;
+}
+
+/// the bytes of the pages of [buf, buf + size) which are in memory
+static size_t residentBytes(const void* buf, size_t size) {
+  uintptr_t pageSize = getpagesize();
+  uintptr_t begin = reinterpret_cast<uintptr_t>(buf) & ~(pageSize - 1);
+  size_t numPages =
+      (reinterpret_cast<uintptr_t>(buf) + size - begin + pageSize - 1) /
+      pageSize;
+  vector<unsigned char> resident(numPages);
+  PCHECK(mincore(reinterpret_cast<void*>(begin), numPages * pageSize,
+                 resident.data()) == 0);
+  return pageSize * std::count_if(resident.begin(), resident.end(),
+                                  [](unsigned char r) { return r & 1; });
+}
+
+TEST(QuantizedInference, fcAndTable) {
+  ModelConfig config = makeConfig();
+  unique_ptr<GradientMachine> machine(GradientMachine::create(config));
+  machine->randParameters();
+
+  vector<Argument> inArgs(2);
+  inArgs[0].value = Matrix::create(16, kInputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  inArgs[1].ids = IVector::create(16, false);
+  inArgs[1].ids->rand(kDictSize);
+  MatrixPtr expected = forward(*machine, inArgs);
+
+  for (auto type : {QUANTIZED_INT8, QUANTIZED_FP16}) {
+    vector<string> values;
+    for (auto& para : machine->getParameters()) {
+      ostringstream os;
+      para->save(os, type);
+      values.push_back(os.str());
+    }
+
+    // an inference machine computes on the quantized weights
+    unique_ptr<GradientMachine> quantized(
+        GradientMachine::create(config, GradientMachine::kTesting));
+    loadParameters(*quantized, values);
+    for (auto& para : quantized->getParameters()) {
+      EXPECT_EQ(para->getName().find("bias") == string::npos,
+                para->getQuantizedValue() != nullptr)
+          << para->getName();
+    }
+
+    // a trainable machine keeps the dequantized values only
+    unique_ptr<GradientMachine> dequantized(GradientMachine::create(config));
+    loadParameters(*dequantized, values);
+    for (auto& para : dequantized->getParameters()) {
+      EXPECT_TRUE(para->getQuantizedValue() == nullptr);
+    }
+
+    // only the quantized weights stay in memory for inference
+    size_t pageSize = getpagesize();
+    for (size_t i = 0; i < values.size(); ++i) {
+      auto& para = quantized->getParameters()[i];
+      auto& value = para->getBuf(PARAMETER_VALUE);
+      size_t bytes = value->getSize() * sizeof(real);
+      if (!para->getQuantizedValue()) {
+        EXPECT_FALSE(para->isValueReleased());
+        continue;
+      }
+      EXPECT_TRUE(para->isValueReleased());
+      EXPECT_EQ(QuantizedMatrix::getMemorySize(
+                    para->getConfig().dims(0), para->getConfig().dims(1),
+                    type),
+                para->getQuantizedValue()->getMemory()->getSize());
+      // only the partial pages at both ends may stay
+      EXPECT_LE(residentBytes(value->getData(), bytes), 2 * pageSize)
+          << para->getName();
+      auto& trainable = dequantized->getParameters()[i];
+      EXPECT_FALSE(trainable->isValueReleased());
+      auto& trainableValue = trainable->getBuf(PARAMETER_VALUE);
+      EXPECT_GE(residentBytes(trainableValue->getData(), bytes), bytes);
+
+      // a released value is saved from the quantized value
+      ostringstream os;
+      para->save(os);
+      istringstream is(os.str());
+      Parameter copy(para->getConfig(), /* useGpu */ false);
+      copy.load(is);
+      EXPECT_EQ(0, memcmp(trainableValue->getData(),
+                          copy.getBuf(PARAMETER_VALUE)->getData(), bytes));
+    }
+
+    MatrixPtr actual = forward(*quantized, inArgs);
+    MatrixPtr reference = forward(*dequantized, inArgs);
+    // the quantized kernels compute the same as the real kernels on the
+    // dequantized weights, up to the order of the additions
+    EXPECT_LT(maxDiff(reference, actual), 1e-5) << type;
+    // and stay close to the original model
+    EXPECT_LT(maxDiff(expected, actual), type == QUANTIZED_INT8 ? 1e-2 : 1e-3)
+        << type;
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  FLAGS_use_gpu = false;
+  return RUN_ALL_TESTS();
+}
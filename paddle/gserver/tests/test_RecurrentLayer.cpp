@@ -266,11 +266,13 @@ public:
   }
 };
 
+// if !useGpu, the "gpu" layer also runs on cpu, to compare the cpu batch
+// compute with the cpu sequence compute.
 template<class T>
 void checkRecurrentLayer(LayerConfig layerConfig, size_t batchSize,
-                         bool cpuBatch, bool gpuBatch) {
+                         bool cpuBatch, bool gpuBatch, bool useGpu = true) {
   TestRecurrentLayer<T> testCpu(layerConfig, false, cpuBatch);
-  TestRecurrentLayer<T> testGpu(layerConfig, true, gpuBatch);
+  TestRecurrentLayer<T> testGpu(layerConfig, useGpu, gpuBatch);
   testCpu.init(batchSize);
   testGpu.init(batchSize);
   auto checkError = [](MatrixPtr cpu, MatrixPtr gpu,
@@ -298,7 +300,7 @@ void checkRecurrentLayer(LayerConfig layerConfig, size_t batchSize,
 
   Argument& cpuInput = testCpu.dataLayer_->getOutput();
   Argument& gpuInput = testGpu.dataLayer_->getOutput();
-  gpuInput.resizeAndCopyFrom(cpuInput, true);
+  gpuInput.resizeAndCopyFrom(cpuInput, useGpu);
 
   const VectorPtr& cpuVec = testCpu.para_->getBuf(PARAMETER_VALUE);
   const VectorPtr& gpuVec = testGpu.para_->getBuf(PARAMETER_VALUE);
@@ -397,12 +399,59 @@ TEST(Layer, LstmLayer) {
   }
 }
 
+template<class T>
+void checkCpuBatch(LayerConfig& layerConfig) {
+  // a batch of a few sequences and a batch of many sequences
+  for (auto frameSize : {16, 128, 256}) {
+    for (auto batchSize : {5, 2000}) {
+      for (auto reversed : {false, true}) {
+        LOG(INFO) << " batchSize=" << batchSize
+                  << " frameSize=" << frameSize << " reversed=" << reversed;
+        layerConfig.set_size(frameSize);
+        layerConfig.set_reversed(reversed);
+        checkRecurrentLayer<T>(layerConfig, batchSize, /* cpuBatch= */ false,
+                               /* gpuBatch= */ true, /* useGpu= */ false);
+      }
+    }
+  }
+}
+
+TEST(Layer, CpuBatchGatedRecurrentLayer) {
+  LayerConfig layerConfig;
+  layerConfig.set_type("gated_recurrent");
+  layerConfig.set_active_type("sigmoid");
+  layerConfig.set_active_gate_type("sigmoid");
+
+  layerConfig.add_inputs();
+  LayerInputConfig& input = *(layerConfig.mutable_inputs(0));
+  input.set_input_layer_name("layer_0");
+  input.set_input_parameter_name("para_0");
+  layerConfig.set_bias_parameter_name("bias");
+
+  checkCpuBatch<GatedRecurrentLayer>(layerConfig);
+}
+
+TEST(Layer, CpuBatchLstmLayer) {
+  LayerConfig layerConfig;
+  layerConfig.set_type("lstmemory");
+  layerConfig.set_active_type("relu");
+  layerConfig.set_active_state_type("sigmoid");
+  layerConfig.set_active_gate_type("sigmoid");
+
+  layerConfig.add_inputs();
+  LayerInputConfig& input = *(layerConfig.mutable_inputs(0));
+  input.set_input_layer_name("layer_0");
+  input.set_input_parameter_name("para_0");
+  layerConfig.set_bias_parameter_name("bias");
+
+  checkCpuBatch<LstmLayer>(layerConfig);
+}
+
 int main(int argc, char** argv) {
-  if (version::isWithGpu()) {
-    testing::InitGoogleTest(&argc, argv);
-    initMain(argc, argv);
-    return RUN_ALL_TESTS();
-  } else {
-    return 0;
+  testing::InitGoogleTest(&argc, argv);
+  if (!version::isWithGpu()) {
+    testing::GTEST_FLAG(filter) = "*CpuBatch*";
   }
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
 }
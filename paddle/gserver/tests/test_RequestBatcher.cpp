@@ -0,0 +1,248 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "paddle/gserver/gradientmachines/NeuralNetwork.h"
+#include "paddle/gserver/gradientmachines/RequestBatcher.h"
+#include "paddle/utils/Stat.h"
+#include "paddle/utils/Util.h"
+#include "ModelConfigUtil.h"
+
+using namespace paddle;  // NOLINT
+using namespace std;     // NOLINT
+
+/**
+ * input -> fc1 -> out (one row per input row)
+ *             \-> last -> lastOut (one row per input sequence)
+ */
+static ModelConfig makeConfig(size_t inputSize, size_t hiddenSize,
+                              bool sequence) {
+  ModelConfig config;
+  config.set_type("nn");
+  addDataLayer(config, "input", inputSize);
+
+  addFcLayer(config, "fc1", hiddenSize, "tanh", {"input"});
+  addFcLayer(config, "out", 10, "softmax", {"fc1"});
+  config.add_output_layer_names("out");
+  if (sequence) {
+    LayerConfig* last = config.add_layers();
+    last->set_name("last");
+    last->set_type("seqlastins");
+    last->set_size(hiddenSize);
+    last->set_active_type("");
+    last->add_inputs()->set_input_layer_name("fc1");
+    addFcLayer(config, "lastOut", 10, "", {"last"});
+    config.add_output_layer_names("lastOut");
+  }
+  return config;
+}
+
+static GradientMachinePtr createNetwork(const ModelConfig& config) {
+  shared_ptr<NeuralNetwork> network(NeuralNetwork::create(config));
+  network->init(config);
+  network->randParameters();
+  return network;
+}
+
+/// a request of the given sequence lengths, or of rows if there is none
+static vector<Argument> makeRequest(size_t inputSize,
+                                    const vector<int>& seqLengths,
+                                    size_t numRows = 1) {
+  vector<Argument> inArgs(1);
+  if (!seqLengths.empty()) {
+    ICpuGpuVector::resizeOrCreate(inArgs[0].sequenceStartPositions,
+                                  seqLengths.size() + 1, false);
+    int* starts = inArgs[0].sequenceStartPositions->getMutableData(false);
+    starts[0] = 0;
+    for (size_t i = 0; i < seqLengths.size(); ++i) {
+      starts[i + 1] = starts[i] + seqLengths[i];
+    }
+    numRows = starts[seqLengths.size()];
+  }
+  inArgs[0].value = Matrix::create(numRows, inputSize, false, false);
+  inArgs[0].value->randomizeUniform();
+  return inArgs;
+}
+
+static void checkSame(const vector<Argument>& expected,
+                      const vector<Argument>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    const MatrixPtr& a = expected[i].value;
+    const MatrixPtr& b = actual[i].value;
+    ASSERT_EQ(a->getHeight(), b->getHeight());
+    ASSERT_EQ(a->getWidth(), b->getWidth());
+    for (size_t j = 0; j < a->getElementCnt(); ++j) {
+      EXPECT_NEAR(a->getData()[j], b->getData()[j], 1e-5);
+    }
+    ASSERT_EQ(expected[i].sequenceStartPositions == nullptr,
+              actual[i].sequenceStartPositions == nullptr);
+    if (expected[i].sequenceStartPositions) {
+      ASSERT_EQ(expected[i].getNumSequences(), actual[i].getNumSequences());
+      const int* s = expected[i].sequenceStartPositions->getData(false);
+      const int* t = actual[i].sequenceStartPositions->getData(false);
+      for (int j = 0; j <= expected[i].getNumSequences(); ++j) {
+        EXPECT_EQ(s[j], t[j]);
+      }
+    }
+  }
+}
+
+/**
+ * Send the requests from one thread each, and check their outputs against
+ * the forwards of the requests one by one.
+ */
+static void checkBatching(GradientMachinePtr network, RequestBatcher& batcher,
+                          const vector<vector<Argument>>& requests) {
+  vector<vector<Argument>> expected(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    vector<Argument> outArgs;
+    network->forward(requests[i], &outArgs, PASS_TEST);
+    for (auto& out : outArgs) {
+      expected[i].emplace_back();
+      expected[i].back().resizeAndCopyFrom(out, false);
+    }
+  }
+
+  vector<vector<Argument>> results(requests.size());
+  vector<thread> threads;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    threads.emplace_back(
+        [&, i]() { batcher.forward(requests[i], &results[i]); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < requests.size(); ++i) {
+    checkSame(expected[i], results[i]);
+  }
+}
+
+TEST(RequestBatcher, coalesceRows) {
+  const size_t kInputSize = 20;
+  auto network = createNetwork(makeConfig(kInputSize, 32, false));
+  vector<vector<Argument>> requests;
+  for (size_t i = 0; i < 8; ++i) {
+    requests.push_back(makeRequest(kInputSize, {}, i == 3 ? 3 : 1));
+  }
+
+  // the batch is full long before the delay
+  RequestBatcher batcher({network}, BatchingPolicy(10, 100000000));
+  checkBatching(network, batcher, requests);
+  EXPECT_EQ(1UL, batcher.getNumBatches());
+  EXPECT_EQ(10UL, batcher.getNumSamples());
+}
+
+TEST(RequestBatcher, coalesceSequences) {
+  const size_t kInputSize = 20;
+  auto network = createNetwork(makeConfig(kInputSize, 32, true));
+  vector<vector<Argument>> requests;
+  for (size_t i = 0; i < 12; ++i) {
+    vector<int> lengths = {static_cast<int>(1 + i % 5)};
+    if (i % 3 == 0) {
+      lengths.push_back(7);
+    }
+    requests.push_back(makeRequest(kInputSize, lengths));
+  }
+
+  RequestBatcher batcher({network}, BatchingPolicy(6, 100000));
+  checkBatching(network, batcher, requests);
+  EXPECT_GE(batcher.getNumBatches(), 3UL);
+  EXPECT_LT(batcher.getNumBatches(), requests.size());
+  EXPECT_EQ(16UL, batcher.getNumSamples());
+}
+
+TEST(RequestBatcher, maxDelay) {
+  const size_t kInputSize = 20;
+  const uint64_t kDelayUs = 20000;
+  auto network = createNetwork(makeConfig(kInputSize, 32, false));
+  auto request = makeRequest(kInputSize, {});
+  vector<Argument> outArgs;
+  {
+    RequestBatcher batcher({network}, BatchingPolicy(8, kDelayUs));
+    Timer timer;
+    batcher.forward(request, &outArgs);
+    EXPECT_GE(timer.stop(), kDelayUs);
+  }
+  {
+    // requests larger than maxBatchSize are not delayed
+    RequestBatcher batcher({network}, BatchingPolicy(8, kDelayUs));
+    auto large = makeRequest(kInputSize, {}, 9);
+    batcher.forward(large, &outArgs);
+    EXPECT_EQ(9UL, outArgs[0].getBatchSize());
+  }
+}
+
+/**
+ * The throughput and the latency of kNumClients clients, each sending
+ * single-sample requests one after the other, under the batching policies.
+ */
+TEST(RequestBatcher, benchmark) {
+  const size_t kInputSize = 256;
+  const size_t kNumClients = 16;
+  const size_t kNumRequests = 100;
+  const size_t kNumMachines = 2;
+  ModelConfig config = makeConfig(kInputSize, 512, false);
+  shared_ptr<NeuralNetwork> network(NeuralNetwork::create(config));
+  network->init(config);
+  network->randParameters();
+  vector<GradientMachinePtr> machines;
+  for (size_t i = 0; i < kNumMachines; ++i) {
+    machines.emplace_back(network->createInferenceReplica());
+  }
+  auto request = makeRequest(kInputSize, {});
+
+  for (auto policy : {BatchingPolicy(1, 0), BatchingPolicy(16, 0),
+                      BatchingPolicy(16, 500), BatchingPolicy(16, 2000)}) {
+    RequestBatcher batcher(machines, policy);
+    vector<StatHistogram> latencies(kNumClients);
+    vector<thread> clients;
+    Timer timer;
+    for (size_t i = 0; i < kNumClients; ++i) {
+      clients.emplace_back([&, i]() {
+        vector<Argument> outArgs;
+        for (size_t j = 0; j < kNumRequests; ++j) {
+          Timer latency;
+          batcher.forward(request, &outArgs);
+          latencies[i].add(latency.stop());
+        }
+      });
+    }
+    for (auto& client : clients) {
+      client.join();
+    }
+    timer.stop();
+    for (size_t i = 1; i < kNumClients; ++i) {
+      latencies[0].merge(latencies[i]);
+    }
+    EXPECT_EQ(kNumClients * kNumRequests, batcher.getNumSamples());
+    LOG(INFO) << "maxBatchSize=" << policy.maxBatchSize
+              << " maxDelayUs=" << policy.maxDelayUs << ": "
+              << kNumClients * kNumRequests * 1000000 / timer.get() << " qps, "
+              << "batch size "
+              << batcher.getNumSamples() / batcher.getNumBatches() << ", "
+              << "p50 " << latencies[0].getPercentile(0.5) << "us, "
+              << "p99 " << latencies[0].getPercentile(0.99) << "us";
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
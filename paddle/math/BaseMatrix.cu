@@ -21,11 +21,43 @@ limitations under the License. */
 #include "hl_matrix_apply.cuh"
 #include "SIMDFunctions.h"
 #include "MathFunctions.h"
+#include "MathThreadPool.h"
 
 namespace paddle {
 
 const char* SPARSE_SUPPORT_ERROR = "Sparse Matrix/Vector is not supported.";
 
+/**
+ * Run an element-wise cpu kernel on a dimM x dimN matrix. Large matrices are
+ * split into blocks of rows or columns which run on the MathThreadPool;
+ * kernel(row, numRows, col, numCols) applies the serial hl_cpu kernel to one
+ * block, so each element is computed exactly as in the serial path.
+ *
+ * An operand used as a row (column) vector is never shared between threads:
+ * such matrices are only split by columns (rows), so that ops which also
+ * write the vector operand stay race free and keep the serial order.
+ */
+template <bool AsRowVector, bool AsColVector, class Kernel>
+static void cpuApplyInBlocks(int dimM, int dimN, Kernel kernel) {
+  if ((AsRowVector && AsColVector) ||
+      !MathThreadPool::isEnabled((size_t)dimM * dimN)) {
+    kernel(0, dimM, 0, dimN);
+    return;
+  }
+
+  MathThreadPool& pool = MathThreadPool::global();
+  if (AsColVector || (!AsRowVector && dimM >= (int)pool.getNumThreads())) {
+    pool.parallelFor(dimM, 1, [&](size_t begin, size_t end) {
+      kernel(begin, end - begin, 0, dimN);
+    });
+  } else {
+    // split at multiples of 8 columns to keep the blocks aligned for avx
+    pool.parallelFor(dimN, 8, [&](size_t begin, size_t end) {
+      kernel(0, dimM, begin, end - begin);
+    });
+  }
+}
+
 template<class T>
 template <class Op>
 int BaseMatrixT<T>::applyUnary(Op op) {
@@ -51,7 +83,11 @@ int BaseMatrixT<T>::applyUnary(Op op, int numRows, int numCols,
   if (true == useGpu_) {
     hl_gpu_apply_unary_op(op, A, dimM, dimN, lda);
   } else {
-    hl_cpu_apply_unary_op(op, A, dimM, dimN, lda);
+    cpuApplyInBlocks<false, false>(dimM, dimN,
+        [&](int row, int numRows, int col, int numCols) {
+          hl_cpu_apply_unary_op(op, A + row * lda + col, numRows, numCols,
+                                lda);
+        });
   }
   return 0;
 }
@@ -108,8 +144,15 @@ int BaseMatrixT<T>::applyBinary(Op op, BaseMatrixT& b, int numRows, int numCols,
     hl_gpu_apply_binary_op<T, Op, bAsRowVector::value, bAsColVector::value>(
         op, A, B, dimM, dimN, lda, ldb);
   } else {
-    hl_cpu_apply_binary_op<T, Op, bAsRowVector::value, bAsColVector::value>(
-        op, A, B, dimM, dimN, lda, ldb);
+    cpuApplyInBlocks<bAsRowVector::value, bAsColVector::value>(dimM, dimN,
+        [&](int row, int numRows, int col, int numCols) {
+          hl_cpu_apply_binary_op
+            <T, Op, bAsRowVector::value, bAsColVector::value>(
+              op, A + row * lda + col,
+              B + (bAsRowVector::value ? 0 : row * ldb)
+                + (bAsColVector::value ? 0 : col),
+              numRows, numCols, lda, ldb);
+        });
   }
 
   return 0;
@@ -184,9 +227,15 @@ int BaseMatrixT<T>::applyTernary(Op op, BaseMatrixT& b, BaseMatrixT& c,
       <T, Op, cAsRowVector::value, cAsColVector::value>(
         op, A, B, C, dimM, dimN, lda, ldb, ldc);
   } else {
-    hl_cpu_apply_ternary_op
-      <T, Op, cAsRowVector::value, cAsColVector::value>(
-        op, A, B, C, dimM, dimN, lda, ldb, ldc);
+    cpuApplyInBlocks<cAsRowVector::value, cAsColVector::value>(dimM, dimN,
+        [&](int row, int numRows, int col, int numCols) {
+          hl_cpu_apply_ternary_op
+            <T, Op, cAsRowVector::value, cAsColVector::value>(
+              op, A + row * lda + col, B + row * ldb + col,
+              C + (cAsRowVector::value ? 0 : row * ldc)
+                + (cAsColVector::value ? 0 : col),
+              numRows, numCols, lda, ldb, ldc);
+        });
   }
 
   return 0;
@@ -253,8 +302,13 @@ int BaseMatrixT<T>::applyQuaternary(Op op, BaseMatrixT& b, BaseMatrixT& c,
     hl_gpu_apply_quaternary_op(op, A, B, C, D, dimM, dimN, lda, ldb,
                                ldc, ldd);
   } else {
-    hl_cpu_apply_quaternary_op(op, A, B, C, D, dimM, dimN, lda, ldb,
-                               ldc, ldd);
+    cpuApplyInBlocks<false, false>(dimM, dimN,
+        [&](int row, int numRows, int col, int numCols) {
+          hl_cpu_apply_quaternary_op(op, A + row * lda + col,
+                                     B + row * ldb + col, C + row * ldc + col,
+                                     D + row * ldd + col, numRows, numCols,
+                                     lda, ldb, ldc, ldd);
+        });
   }
 
   return 0;
@@ -469,7 +523,7 @@ void BaseMatrixT<T>::add(BaseMatrixT& b) {
 
 template<>
 void BaseMatrixT<real>::add(BaseMatrixT& b) {
-  if (useGpu_) {
+  if (useGpu_ || stride_ != width_ || b.stride_ != b.width_) {
     applyBinary(binary::Add<real>(), b);
   } else {  // cpu branch
     CHECK_EQ(height_, b.height_);
@@ -1214,7 +1268,14 @@ void BaseMatrixT<T>::assign(BaseMatrixT& b) {
   } else {  // cpu version
     CHECK_EQ(this->height_, b.height_);
     CHECK_EQ(this->width_, b.width_);
-    memcpy(data_, b.data_, sizeof(T) * height_ * width_);
+    if (stride_ == width_ && b.stride_ == b.width_) {
+      memcpy(data_, b.data_, sizeof(T) * height_ * width_);
+    } else {
+      for (size_t i = 0; i < height_; ++i) {
+        memcpy(data_ + i * stride_, b.data_ + i * b.stride_,
+               sizeof(T) * width_);
+      }
+    }
   }
 }
 
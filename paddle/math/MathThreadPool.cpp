@@ -0,0 +1,111 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "MathThreadPool.h"
+
+#include <algorithm>
+
+#include "paddle/utils/Flags.h"
+#include "paddle/utils/Locks.h"
+#include "paddle/utils/Logging.h"
+#include "paddle/utils/Util.h"
+
+P_DEFINE_int32(math_num_threads, -1,
+               "number of threads used by the cpu math kernels, "
+               "-1 means hardware concurrency / trainer_count");
+P_DEFINE_int32(math_parallel_threshold, 65536,
+               "minimum number of elements for which a cpu math kernel is "
+               "split across threads, 0 means always run serially");
+
+namespace paddle {
+
+// true on the worker threads of any MathThreadPool
+static __thread bool gInMathWorker = false;
+
+MathThreadPool::MathThreadPool(size_t numThreads) : stopping_(false) {
+  CHECK_GE(numThreads, 1UL);
+  workers_.resize(numThreads - 1);
+  for (auto& worker : workers_) {
+    worker.reset(new std::thread([this]() { this->run(); }));
+  }
+}
+
+MathThreadPool::~MathThreadPool() {
+  stopping_ = true;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    jobs_.enqueue([]() {});
+  }
+  for (auto& worker : workers_) {
+    worker->join();
+  }
+}
+
+MathThreadPool& MathThreadPool::global() {
+  static MathThreadPool pool([]() -> size_t {
+    if (FLAGS_math_num_threads > 0) {
+      return FLAGS_math_num_threads;
+    }
+    size_t numCores = std::max(1U, std::thread::hardware_concurrency());
+    return std::max(1UL, numCores / std::max(1, FLAGS_trainer_count));
+  }());
+  return pool;
+}
+
+bool MathThreadPool::isEnabled(size_t numElements) {
+  return FLAGS_math_parallel_threshold > 0 && !gInMathWorker &&
+         numElements >= (size_t)FLAGS_math_parallel_threshold &&
+         global().getNumThreads() > 1;
+}
+
+void MathThreadPool::parallelFor(size_t size, size_t blockSize,
+                                 const RangeFunc& func) {
+  size_t numThreads = getNumThreads();
+  if (gInMathWorker || numThreads == 1) {
+    func(0, size);
+    return;
+  }
+
+  Semaphore finished;
+  size_t numJobs = 0;
+  for (size_t tid = 1; tid < numThreads; ++tid) {
+    auto interval = calcSplitArrayInterval(size, tid, numThreads, blockSize);
+    if (interval.first >= interval.second) {
+      continue;
+    }
+    jobs_.enqueue([&func, &finished, interval]() {
+      func(interval.first, interval.second);
+      finished.post();
+    });
+    ++numJobs;
+  }
+
+  auto interval = calcSplitArrayInterval(size, 0, numThreads, blockSize);
+  if (interval.first < interval.second) {
+    func(interval.first, interval.second);
+  }
+  for (size_t i = 0; i < numJobs; ++i) {
+    finished.wait();
+  }
+}
+
+void MathThreadPool::run() {
+  gInMathWorker = true;
+  while (true) {
+    JobFunc job = jobs_.dequeue();
+    if (stopping_) break;
+    job();
+  }
+}
+
+}  // namespace paddle
@@ -0,0 +1,85 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "paddle/utils/Queue.h"
+
+namespace paddle {
+
+/**
+ * MathThreadPool is a process-wide pool of threads used to split cpu math
+ * kernels (e.g. the element-wise BaseMatrix operations) into blocks.
+ *
+ * Unlike SyncThreadPool, it can be used by any number of threads at the same
+ * time (e.g. all TrainerThreads of a MultiGradientMachine): each call of
+ * parallelFor() queues its blocks, the calling thread processes the first
+ * block itself and then waits for the others. A kernel called from inside a
+ * pool worker is always run serially, so nested use can not deadlock.
+ *
+ * The number of threads is set by --math_num_threads, and only jobs with at
+ * least --math_parallel_threshold elements should be split, see isEnabled().
+ */
+class MathThreadPool {
+public:
+  /// process the elements [begin, end)
+  typedef std::function<void(size_t begin, size_t end)> RangeFunc;
+
+  /**
+   * @param numThreads total number of threads working on one job,
+   *                   including the calling thread.
+   */
+  explicit MathThreadPool(size_t numThreads);
+
+  ~MathThreadPool();
+
+  /**
+   * @brief The process-wide pool, created on first use.
+   */
+  static MathThreadPool& global();
+
+  /**
+   * @brief Whether a job with numElements elements should be split by the
+   * global pool. False inside pool workers.
+   */
+  static bool isEnabled(size_t numElements);
+
+  /**
+   * @brief Number of threads working on one job, including the caller.
+   */
+  size_t getNumThreads() const { return workers_.size() + 1; }
+
+  /**
+   * @brief Split [0, size) into getNumThreads() intervals whose boundaries
+   * are multiples of blockSize, and call func on each non-empty interval.
+   * Returns when all intervals are done.
+   */
+  void parallelFor(size_t size, size_t blockSize, const RangeFunc& func);
+
+protected:
+  void run();
+
+  typedef std::function<void()> JobFunc;
+  Queue<JobFunc> jobs_;
+  bool stopping_;
+  std::vector<std::unique_ptr<std::thread>> workers_;
+};
+
+}  // namespace paddle
@@ -30,6 +30,7 @@ limitations under the License. */
 #include "paddle/utils/ThreadLocal.h"
 
 #include "SIMDFunctions.h"
+#include "MathThreadPool.h"
 
 namespace paddle {
 
@@ -1369,6 +1370,23 @@ void CpuMatrix::transpose(MatrixPtr matTrans, bool memAlloc) {
   }
 }
 
+/**
+ * For a filter offset `offset` along one image dimension, return the range
+ * [begin, end) of output positions whose input position
+ * pos * stride + offset - padding lies inside [0, imgSize).
+ */
+static inline std::pair<int, int> validOutputRange(int imgSize, int offset,
+                                                   int stride, int padding,
+                                                   int outputSize) {
+  int low = padding - offset;
+  int high = imgSize + padding - offset;
+  int begin = low > 0 ? (low + stride - 1) / stride : 0;
+  int end = high > 0 ? (high + stride - 1) / stride : 0;
+  begin = std::min(begin, outputSize);
+  end = std::min(end, outputSize);
+  return std::make_pair(begin, std::max(begin, end));
+}
+
 void CpuMatrix::convExpand(Matrix& feature, int feaImgHeight, int feaImgWidth,
                            int channels, int blockH, int blockW, int strideH,
                            int strideW, int paddingH, int paddingW,
@@ -1381,31 +1399,50 @@ void CpuMatrix::convExpand(Matrix& feature, int feaImgHeight, int feaImgWidth,
 
   size_t elemCnt = outputH * outputW * blockH * blockW * channels;
   CHECK_EQ(elemCnt, height_ * width_) << "Matrix dimensions are not equal";
+  CHECK_EQ(width_, size_t(outputH * outputW));
 
   int channelsCol = channels * blockH * blockW;
   real* srcData = feature.getData();
-  for (int c = 0; c < channelsCol; ++c) {
-    int wOffset = c % blockW;
-    int hOffset = (c / blockW) % blockH;
-    int c_im = c / blockH / blockW;
-    for (int h = 0; h < outputH; ++h) {
-      for (int w = 0; w < outputW; ++w) {
+  // this may be a column block of a wider matrix, see ExpandConvLayer
+  size_t ld = stride_;
+
+  auto expandRows = [&](size_t begin, size_t end) {
+    for (int c = begin; c < (int)end; ++c) {
+      int wOffset = c % blockW;
+      int hOffset = (c / blockW) % blockH;
+      int c_im = c / blockH / blockW;
+      auto wRange =
+          validOutputRange(feaImgWidth, wOffset, strideW, paddingW, outputW);
+      auto hRange =
+          validOutputRange(feaImgHeight, hOffset, strideH, paddingH, outputH);
+      real* dst = data_ + c * ld;
+      for (int h = 0; h < outputH; ++h, dst += outputW) {
+        if (h < hRange.first || h >= hRange.second) {
+          memset(dst, 0, outputW * sizeof(real));
+          continue;
+        }
         // no c_im*height to Exclude the channel number
-        int imgRowIdx = h * strideH + hOffset;
-        int imgColIdx = w * strideW + wOffset;
-        if ((imgRowIdx - paddingH) < 0 ||
-            (imgRowIdx - paddingH) >= feaImgHeight ||
-            (imgColIdx - paddingW) < 0 ||
-            (imgColIdx - paddingW) >= feaImgWidth) {
-          data_[(c * outputH + h) * outputW + w] = 0;
+        int imgRowIdx = h * strideH + hOffset + c_im * feaImgHeight - paddingH;
+        real* src = srcData + imgRowIdx * feaImgWidth + wOffset - paddingW;
+        memset(dst, 0, wRange.first * sizeof(real));
+        if (strideW == 1) {
+          memcpy(dst + wRange.first, src + wRange.first,
+                 (wRange.second - wRange.first) * sizeof(real));
         } else {
-          imgRowIdx += c_im * feaImgHeight - paddingH;
-          imgColIdx -= paddingW;
-          data_[(c * outputH + h) * outputW + w] =
-              srcData[imgRowIdx * feaImgWidth + imgColIdx];
+          for (int w = wRange.first; w < wRange.second; ++w) {
+            dst[w] = src[w * strideW];
+          }
         }
+        memset(dst + wRange.second, 0,
+               (outputW - wRange.second) * sizeof(real));
       }
     }
+  };
+
+  if (MathThreadPool::isEnabled(elemCnt)) {
+    MathThreadPool::global().parallelFor(channelsCol, 1, expandRows);
+  } else {
+    expandRows(0, channelsCol);
   }
 }
 
@@ -1423,29 +1460,38 @@ void CpuMatrix::convShrink(Matrix& expandFeat, int thisImgHeight,
 
   CHECK(elemCnt == expandFeat.getHeight() * expandFeat.getWidth())
       << "Matrix dimensions are not equal";
+  CHECK_EQ(expandFeat.getWidth(), size_t(outputH * outputW));
 
   real* expandData = expandFeat.getData();
-  int channelsCol = channels * blockH * blockW;
-  for (int c = 0; c < channelsCol; ++c) {
-    int wOffset = c % blockW;
-    int hOffset = (c / blockW) % blockH;
-    int c_im = c / blockW / blockH;
-    for (int h = 0; h < outputH; ++h) {
-      for (int w = 0; w < outputW; ++w) {
-        int imRowIdx = h * strideH + hOffset;
-        int imColIdx = w * strideW + wOffset;
-        if ((imRowIdx - paddingH) >= 0 &&
-            (imRowIdx - paddingH) < thisImgHeight &&
-            (imColIdx - paddingW) >= 0 &&
-            (imColIdx - paddingW) < thisImgWidth) {
-          imRowIdx += c_im * thisImgHeight - paddingH;
-          imColIdx -= paddingW;
-          data_[imRowIdx * thisImgWidth + imColIdx] =
-              alpha * expandData[(c * outputH + h) * outputW + w] +
-              beta * data_[imRowIdx * thisImgWidth + imColIdx];
+  size_t ld = expandFeat.getStride();
+  int blockPixels = blockH * blockW;
+
+  // Rows of different channels write to disjoint parts of the image, so the
+  // channels can be shrinked in parallel without changing the result.
+  auto shrinkChannels = [&](size_t begin, size_t end) {
+    for (int c = begin * blockPixels; c < (int)end * blockPixels; ++c) {
+      int wOffset = c % blockW;
+      int hOffset = (c / blockW) % blockH;
+      int c_im = c / blockW / blockH;
+      auto wRange =
+          validOutputRange(thisImgWidth, wOffset, strideW, paddingW, outputW);
+      auto hRange =
+          validOutputRange(thisImgHeight, hOffset, strideH, paddingH, outputH);
+      for (int h = hRange.first; h < hRange.second; ++h) {
+        int imRowIdx = h * strideH + hOffset + c_im * thisImgHeight - paddingH;
+        real* dst = data_ + imRowIdx * thisImgWidth + wOffset - paddingW;
+        real* src = expandData + c * ld + h * outputW;
+        for (int w = wRange.first; w < wRange.second; ++w) {
+          dst[w * strideW] = alpha * src[w] + beta * dst[w * strideW];
         }
       }
     }
+  };
+
+  if (MathThreadPool::isEnabled(elemCnt)) {
+    MathThreadPool::global().parallelFor(channels, 1, shrinkChannels);
+  } else {
+    shrinkChannels(0, channels);
   }
 }
 
@@ -2651,15 +2697,7 @@ void CpuMatrix::rowMaxId(IVector& maxIds) {
   size_t dim = getWidth();
 
   for (size_t i = 0; i < numSamples; i++) {
-    real sm = a[i * dim];
-    int maxId = 0;
-    for (size_t j = 1; j < dim; j++) {
-      if (a[i * dim + j] > sm) {
-        maxId = j;
-        sm = a[i * dim + j];
-      }
-    }
-    s[i] = maxId;
+    s[i] = simd::argMax(a + i * dim, dim);
   }
 }
 
@@ -2669,6 +2707,65 @@ void CpuMatrix::rowMax(Matrix& max) {
   max.maxRows(*this);
 }
 
+/**
+ * The beam largest elements of row[0, dim) in descending order, ties broken
+ * by the smaller column.
+ *
+ * values and ids are used as a min-heap of the best elements seen so far,
+ * so nothing is allocated. Most columns of a large row are smaller than the
+ * root of the heap, they are skipped by simd::findGreater.
+ */
+static void rowTopK(const real* row, size_t dim, size_t beam, real* values,
+                    int* ids) {
+  if (beam == 1) {
+    ids[0] = simd::argMax(row, dim);
+    values[0] = row[ids[0]];
+    return;
+  }
+
+  auto worse = [values, ids](size_t x, size_t y) {
+    return values[x] < values[y] || (values[x] == values[y] && ids[x] > ids[y]);
+  };
+  auto siftDown = [values, ids, &worse](size_t pos, size_t size) {
+    for (size_t child = 2 * pos + 1; child < size; child = 2 * pos + 1) {
+      if (child + 1 < size && worse(child + 1, child)) {
+        ++child;
+      }
+      if (!worse(child, pos)) {
+        break;
+      }
+      std::swap(values[pos], values[child]);
+      std::swap(ids[pos], ids[child]);
+      pos = child;
+    }
+  };
+
+  for (size_t j = 0; j < beam; ++j) {
+    values[j] = row[j];
+    ids[j] = j;
+  }
+  for (size_t j = beam / 2; j > 0; --j) {
+    siftDown(j - 1, beam);
+  }
+  // a later column only enters when it is strictly greater than the root,
+  // which keeps the smaller column on ties
+  for (size_t j = beam; j < dim; ++j) {
+    j += simd::findGreater(row + j, dim - j, values[0]);
+    if (j == dim) {
+      break;
+    }
+    values[0] = row[j];
+    ids[0] = j;
+    siftDown(0, beam);
+  }
+  // heap sort, the worst element goes to the end
+  for (size_t size = beam - 1; size > 0; --size) {
+    std::swap(values[0], values[size]);
+    std::swap(ids[0], ids[size]);
+    siftDown(0, size);
+  }
+}
+
 /* get beam size of max ids and values */
 void CpuMatrix::rowMax(IVector& maxIds, Matrix& maxVal) {
   CHECK(isContiguous());
@@ -2677,26 +2774,25 @@ void CpuMatrix::rowMax(IVector& maxIds, Matrix& maxVal) {
   size_t beam = maxVal.getWidth();
   CHECK_EQ(maxIds.getSize(), numSamples * beam);
   CHECK_EQ(maxVal.getHeight(), numSamples);
+  CHECK(maxVal.isContiguous());
 
   real* a = getData();
   int* s = maxIds.getData();
   real* t = maxVal.getData();
   size_t dim = getWidth();
-  for (size_t i = 0; i < numSamples; i++) {
-    std::vector<std::pair<real, size_t>> vec;
-    for (size_t j = 0; j < dim; j++) {
-      vec.push_back(std::pair<real, size_t>(a[i * dim + j], j));
-    }
-
-    std::partial_sort(
-        vec.begin(), vec.begin() + beam, vec.end(),
-        [](const std::pair<real, size_t>& l, const std::pair<real, size_t>& r) {
-          return l.first > r.first;
-        });
-    for (size_t j = 0; j < beam; j++) {
-      t[i * beam + j] = vec[j].first;
-      s[i * beam + j] = vec[j].second;
+  CHECK_LE(beam, dim);
+  if (beam == 0) {
+    return;
+  }
+  auto topKRows = [=](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      rowTopK(a + i * dim, dim, beam, t + i * beam, s + i * beam);
     }
+  };
+  if (MathThreadPool::isEnabled(numSamples * dim)) {
+    MathThreadPool::global().parallelFor(numSamples, 1, topKRows);
+  } else {
+    topKRows(0, numSamples);
   }
 }
 
@@ -502,7 +502,8 @@ public:
    *
    * The column ids and values of these elements are stored in
    * maxIds and max respectively. Note that the top k
-   * elements are not sorted.
+   * elements are not sorted on gpu. On cpu they are sorted in
+   * descending order, ties broken by the smaller column id.
    */
   virtual void rowMax(IVector& maxIds, Matrix& max) {
     LOG(FATAL) << "Not implemented";
@@ -715,6 +716,9 @@ public:
    *
    * It will expand a feature matrix according to the
    * convolution filters
+   *
+   * The width of this matrix must be outputH * outputW. On cpu, its stride
+   * may be larger, i.e. it may be a column block of a wider matrix.
    */
   virtual void convExpand(Matrix& feature, int feaImgHeight, int feaImgWidth,
                           int channels, int blockH, int blockW, int strideH,
@@ -727,6 +731,8 @@ public:
    * This function is the reverse implementation of convExpand:
    *
    * Its function is to restore a expanded-matrix into a feature matrix
+   *
+   * On cpu, expandColMat may be a column block of a wider matrix.
    */
   virtual void convShrink(Matrix& expandColMat, int thisImgHeight,
                           int thisImgWidth, int channels, int blockH,
@@ -54,8 +54,18 @@ CpuMemoryHandle::CpuMemoryHandle(size_t size) : MemoryHandle(size) {
   buf_ = allocator_->alloc(allocSize_);
 }
 
+CpuMemoryHandle::CpuMemoryHandle(void* buf, size_t size)
+    : MemoryHandle(size) {
+  allocator_ = nullptr;
+  allocSize_ = size;
+  deviceId_ = -1;
+  buf_ = buf;
+}
+
 CpuMemoryHandle::~CpuMemoryHandle() {
-  allocator_->free(buf_, allocSize_);
+  if (allocator_) {
+    allocator_->free(buf_, allocSize_);
+  }
 }
 
 }  // namespace paddle
@@ -58,6 +58,13 @@ class CpuMemoryHandle : public MemoryHandle {
 public:
   explicit CpuMemoryHandle(size_t size);
   virtual ~CpuMemoryHandle();
+
+protected:
+  /**
+   * Wrap cpu memory owned by someone else (e.g. a file mapping).
+   * The memory is not released at destructor.
+   */
+  CpuMemoryHandle(void* buf, size_t size);
 };
 
 typedef std::shared_ptr<MemoryHandle> MemoryHandlePtr;
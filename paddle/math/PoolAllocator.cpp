@@ -15,16 +15,85 @@ limitations under the License. */
 
 #include "PoolAllocator.h"
 
+#include <algorithm>
+#include "paddle/utils/Stat.h"
+
 namespace paddle {
 
+/**
+ * The locks of all the pools, which are all held while forking. Otherwise
+ * a lock held by another thread at fork() would stay locked forever in the
+ * child, where only the forking thread exists.
+ */
+struct ForkLocks {
+  std::mutex lock;
+  std::vector<std::mutex*> locks;
+};
+
+static ForkLocks& forkLocks() {
+  // never destroyed, a pool may be destroyed after the static variables
+  static ForkLocks* locks = new ForkLocks();
+  return *locks;
+}
+
+static void lockBeforeFork() {
+  ForkLocks& registry = forkLocks();
+  registry.lock.lock();
+  for (auto lock : registry.locks) {
+    lock->lock();
+  }
+}
+
+static void unlockAfterFork() {
+  ForkLocks& registry = forkLocks();
+  for (auto it = registry.locks.rbegin(); it != registry.locks.rend();
+       ++it) {
+    (*it)->unlock();
+  }
+  registry.lock.unlock();
+}
+
+static void registerForkLocks(const std::vector<std::mutex*>& locks) {
+  static std::once_flag atforkOnce;
+  std::call_once(atforkOnce, [] {
+    CHECK_EQ(0, pthread_atfork(lockBeforeFork, unlockAfterFork,
+                               unlockAfterFork));
+  });
+  ForkLocks& registry = forkLocks();
+  std::lock_guard<std::mutex> guard(registry.lock);
+  registry.locks.insert(registry.locks.end(), locks.begin(), locks.end());
+}
+
+static void unregisterForkLocks(const std::vector<std::mutex*>& locks) {
+  ForkLocks& registry = forkLocks();
+  std::lock_guard<std::mutex> guard(registry.lock);
+  for (auto lock : locks) {
+    auto it = std::find(registry.locks.begin(), registry.locks.end(), lock);
+    CHECK(it != registry.locks.end());
+    registry.locks.erase(it);
+  }
+}
+
 PoolAllocator::PoolAllocator(Allocator* allocator,
   size_t sizeLimit, const std::string& name)
     : allocator_(allocator),
       sizeLimit_(sizeLimit),
       poolMemorySize_(0),
-      name_(name) {}
+      name_(name) {
+  registerForkLocks({&mutex_});
+  if (sizeLimit_ > 0) {
+    globalStat.registerCounter(name_ + "_cached_bytes", [this]() {
+      std::lock_guard<std::mutex> guard(mutex_);
+      return (int64_t)poolMemorySize_;
+    });
+  }
+}
 
 PoolAllocator::~PoolAllocator() {
+  if (sizeLimit_ > 0) {
+    globalStat.deleteCounter(name_ + "_cached_bytes");
+  }
+  unregisterForkLocks({&mutex_});
   freeAll();
 }
 
@@ -59,6 +128,7 @@ void PoolAllocator::free(void* ptr, size_t size) {
   }
 }
 
+
 void PoolAllocator::freeAll() {
   for (auto it : pool_) {
     for (auto ptr : it.second) {
@@ -82,4 +152,289 @@ void PoolAllocator::printAll() {
   LOG(INFO) << "memory size: " << memory;
 }
 
+SizeClassPoolAllocator::ThreadCache::ThreadCache(
+    SizeClassPoolAllocator* owner)
+    : owner(owner),
+      freeLists(kNumClasses),
+      inUseBytes(0),
+      requestedBytes(0),
+      threadCachedBytes(0) {}
+
+const size_t SizeClassPoolAllocator::kMinShift;
+const size_t SizeClassPoolAllocator::kMaxShift;
+const size_t SizeClassPoolAllocator::kNumClasses;
+const size_t SizeClassPoolAllocator::kMaxThreadCacheSize;
+const size_t SizeClassPoolAllocator::kMaxThreadCacheBytes;
+
+SizeClassPoolAllocator::SizeClassPoolAllocator(Allocator* allocator,
+                                               size_t sizeLimit,
+                                               const std::string& name)
+    : PoolAllocator(allocator, 0, name),
+      sizeLimit_(sizeLimit),
+      centralLists_(kNumClasses),
+      centralCachedBytes_(0),
+      systemBytes_(0),
+      peakSystemBytes_(0),
+      retiredInUseBytes_(0),
+      retiredRequestedBytes_(0) {
+  PCHECK(pthread_key_create(&cacheKey_, releaseThreadCache) == 0);
+  registerForkLocks(getLocks());
+  globalStat.registerCounter(name + "_system_bytes", [this]() {
+    return (int64_t)getStats().systemBytes;
+  });
+  globalStat.registerCounter(name + "_peak_bytes", [this]() {
+    return (int64_t)getStats().peakSystemBytes;
+  });
+  globalStat.registerCounter(name + "_in_use_bytes", [this]() {
+    return (int64_t)getStats().inUseBytes;
+  });
+  globalStat.registerCounter(name + "_requested_bytes", [this]() {
+    return (int64_t)getStats().requestedBytes;
+  });
+  globalStat.registerCounter(name + "_cached_bytes", [this]() {
+    return (int64_t)getStats().cachedBytes;
+  });
+}
+
+SizeClassPoolAllocator::~SizeClassPoolAllocator() {
+  for (auto counter : {"_system_bytes", "_peak_bytes", "_in_use_bytes",
+                       "_requested_bytes", "_cached_bytes"}) {
+    globalStat.deleteCounter(getName() + counter);
+  }
+  unregisterForkLocks(getLocks());
+  // no thread cache is released after this, the caches of the threads which
+  // are still alive are freed here
+  pthread_key_delete(cacheKey_);
+  for (auto cache : caches_) {
+    for (size_t c = 0; c < kNumClasses; ++c) {
+      for (auto ptr : cache->freeLists[c]) {
+        systemFree(ptr, classToSize(c));
+      }
+    }
+    delete cache;
+  }
+  for (size_t c = 0; c < kNumClasses; ++c) {
+    for (auto ptr : centralLists_[c].blocks) {
+      systemFree(ptr, classToSize(c));
+    }
+  }
+}
+
+std::vector<std::mutex*> SizeClassPoolAllocator::getLocks() {
+  std::vector<std::mutex*> locks = {&cachesLock_};
+  for (auto& central : centralLists_) {
+    locks.push_back(&central.lock);
+  }
+  return locks;
+}
+
+size_t SizeClassPoolAllocator::sizeToClass(size_t size) {
+  if (size <= (1UL << kMinShift)) {
+    return 0;
+  }
+  // 2^shift < size <= 2^(shift+1)
+  size_t shift = 63 - __builtin_clzl(size - 1);
+  if (shift >= kMaxShift) {
+    return kNumClasses;
+  }
+  size_t step = 1UL << (shift - 2);
+  size_t k = (size - (1UL << shift) + step - 1) / step;
+  return (shift - kMinShift) * 4 + k;
+}
+
+size_t SizeClassPoolAllocator::classToSize(size_t sizeClass) {
+  if (sizeClass == 0) {
+    return 1UL << kMinShift;
+  }
+  size_t shift = kMinShift + (sizeClass - 1) / 4;
+  size_t k = (sizeClass - 1) % 4 + 1;
+  return (1UL << shift) + k * (1UL << (shift - 2));
+}
+
+size_t SizeClassPoolAllocator::maxThreadCacheCount(size_t sizeClass) {
+  size_t count = kMaxThreadCacheSize / classToSize(sizeClass);
+  return std::min(64UL, std::max(2UL, count));
+}
+
+size_t SizeClassPoolAllocator::poolClass(size_t size) const {
+  size_t sizeClass = sizeToClass(size);
+  // a block larger than sizeLimit_ is never kept, rounding it up is a waste
+  if (sizeClass == kNumClasses || classToSize(sizeClass) > sizeLimit_) {
+    return kNumClasses;
+  }
+  return sizeClass;
+}
+
+void* SizeClassPoolAllocator::alloc(size_t size) {
+  ThreadCache* cache = getThreadCache();
+  addRelaxed(cache->requestedBytes, size);
+  size_t sizeClass = poolClass(size);
+  if (sizeClass == kNumClasses) {
+    addRelaxed(cache->inUseBytes, size);
+    return systemAlloc(size);
+  }
+
+  size_t classSize = classToSize(sizeClass);
+  addRelaxed(cache->inUseBytes, classSize);
+  if (classSize <= kMaxThreadCacheSize) {
+    auto& list = cache->freeLists[sizeClass];
+    if (list.empty()) {
+      fetchFromCentral(cache, sizeClass, maxThreadCacheCount(sizeClass) / 2);
+    }
+    if (!list.empty()) {
+      void* ptr = list.back();
+      list.pop_back();
+      addRelaxed(cache->threadCachedBytes, -(int64_t)classSize);
+      return ptr;
+    }
+  } else {
+    CentralList& central = centralLists_[sizeClass];
+    std::lock_guard<std::mutex> guard(central.lock);
+    if (!central.blocks.empty()) {
+      void* ptr = central.blocks.back();
+      central.blocks.pop_back();
+      centralCachedBytes_ -= classSize;
+      return ptr;
+    }
+  }
+  return systemAlloc(classSize);
+}
+
+void SizeClassPoolAllocator::free(void* ptr, size_t size) {
+  ThreadCache* cache = getThreadCache();
+  addRelaxed(cache->requestedBytes, -(int64_t)size);
+  size_t sizeClass = poolClass(size);
+  if (sizeClass == kNumClasses) {
+    addRelaxed(cache->inUseBytes, -(int64_t)size);
+    systemFree(ptr, size);
+    return;
+  }
+
+  size_t classSize = classToSize(sizeClass);
+  addRelaxed(cache->inUseBytes, -(int64_t)classSize);
+  auto& list = cache->freeLists[sizeClass];
+  list.push_back(ptr);
+  addRelaxed(cache->threadCachedBytes, classSize);
+  if (classSize > kMaxThreadCacheSize) {
+    releaseToCentral(cache, sizeClass, 1);
+    return;
+  }
+  if (cache->threadCachedBytes.load(std::memory_order_relaxed) >
+      (int64_t)kMaxThreadCacheBytes) {
+    flushThreadCache(cache);
+    return;
+  }
+  size_t maxCount = maxThreadCacheCount(sizeClass);
+  if (list.size() > maxCount) {
+    releaseToCentral(cache, sizeClass, list.size() - maxCount / 2);
+  }
+}
+
+void SizeClassPoolAllocator::fetchFromCentral(ThreadCache* cache,
+                                              size_t sizeClass, size_t count) {
+  CentralList& central = centralLists_[sizeClass];
+  auto& list = cache->freeLists[sizeClass];
+  std::lock_guard<std::mutex> guard(central.lock);
+  count = std::min(count, central.blocks.size());
+  list.insert(list.end(), central.blocks.end() - count, central.blocks.end());
+  central.blocks.resize(central.blocks.size() - count);
+  size_t bytes = count * classToSize(sizeClass);
+  centralCachedBytes_ -= bytes;
+  addRelaxed(cache->threadCachedBytes, bytes);
+}
+
+void SizeClassPoolAllocator::releaseToCentral(ThreadCache* cache,
+                                              size_t sizeClass, size_t count) {
+  CentralList& central = centralLists_[sizeClass];
+  auto& list = cache->freeLists[sizeClass];
+  size_t classSize = classToSize(sizeClass);
+  std::vector<void*> overflow;
+  {
+    std::lock_guard<std::mutex> guard(central.lock);
+    for (size_t i = 0; i < count; ++i) {
+      void* ptr = list.back();
+      list.pop_back();
+      if (centralCachedBytes_ + classSize > sizeLimit_) {
+        overflow.push_back(ptr);
+      } else {
+        central.blocks.push_back(ptr);
+        centralCachedBytes_ += classSize;
+      }
+    }
+  }
+  addRelaxed(cache->threadCachedBytes, -(int64_t)(count * classSize));
+  for (auto ptr : overflow) {
+    systemFree(ptr, classSize);
+  }
+}
+
+void SizeClassPoolAllocator::flushThreadCache(ThreadCache* cache) {
+  for (size_t c = 0; c < kNumClasses; ++c) {
+    if (!cache->freeLists[c].empty()) {
+      releaseToCentral(cache, c, cache->freeLists[c].size());
+    }
+  }
+}
+
+SizeClassPoolAllocator::ThreadCache* SizeClassPoolAllocator::getThreadCache() {
+  auto cache = static_cast<ThreadCache*>(pthread_getspecific(cacheKey_));
+  if (!cache) {
+    cache = new ThreadCache(this);
+    PCHECK(pthread_setspecific(cacheKey_, cache) == 0);
+    std::lock_guard<std::mutex> guard(cachesLock_);
+    caches_.push_back(cache);
+  }
+  return cache;
+}
+
+void SizeClassPoolAllocator::releaseThreadCache(void* ptr) {
+  auto cache = static_cast<ThreadCache*>(ptr);
+  SizeClassPoolAllocator* owner = cache->owner;
+  owner->flushThreadCache(cache);
+  std::lock_guard<std::mutex> guard(owner->cachesLock_);
+  owner->retiredInUseBytes_ += cache->inUseBytes;
+  owner->retiredRequestedBytes_ += cache->requestedBytes;
+  owner->caches_.remove(cache);
+  delete cache;
+}
+
+void* SizeClassPoolAllocator::systemAlloc(size_t size) {
+  void* ptr = PoolAllocator::alloc(size);
+  size_t bytes = (systemBytes_ += size);
+  size_t peak = peakSystemBytes_;
+  while (bytes > peak && !peakSystemBytes_.compare_exchange_weak(peak, bytes)) {
+  }
+  return ptr;
+}
+
+void SizeClassPoolAllocator::systemFree(void* ptr, size_t size) {
+  PoolAllocator::free(ptr, size);
+  systemBytes_ -= size;
+}
+
+SizeClassPoolAllocator::MemoryStats SizeClassPoolAllocator::getStats() {
+  int64_t inUseBytes = 0;
+  int64_t requestedBytes = 0;
+  int64_t threadCachedBytes = 0;
+  {
+    std::lock_guard<std::mutex> guard(cachesLock_);
+    inUseBytes = retiredInUseBytes_;
+    requestedBytes = retiredRequestedBytes_;
+    for (auto cache : caches_) {
+      inUseBytes += cache->inUseBytes.load(std::memory_order_relaxed);
+      requestedBytes += cache->requestedBytes.load(std::memory_order_relaxed);
+      threadCachedBytes +=
+          cache->threadCachedBytes.load(std::memory_order_relaxed);
+    }
+  }
+  MemoryStats stats;
+  stats.systemBytes = systemBytes_;
+  stats.peakSystemBytes = peakSystemBytes_;
+  stats.inUseBytes = std::max(0L, inUseBytes);
+  stats.requestedBytes = std::max(0L, requestedBytes);
+  stats.cachedBytes = std::max(0L, threadCachedBytes) + centralCachedBytes_;
+  return stats;
+}
+
+
 }  // namespace paddle
@@ -15,6 +15,9 @@ limitations under the License. */
 
 #pragma once
 
+#include <pthread.h>
+#include <atomic>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -25,6 +28,12 @@ namespace paddle {
 
 /**
  * @brief Memory pool allocator implementation.
+ *
+ * If sizeLimit > 0, the bytes kept in the pool are reported as the counter
+ * "<name>_cached_bytes" of globalStat.
+ *
+ * The lock of the pool is held while forking, by handlers registered with
+ * pthread_atfork(), so that the child process does not inherit it locked.
  */
 class PoolAllocator {
 public:
@@ -41,10 +50,10 @@ public:
   /**
    * @brief destructor.
    */
-  ~PoolAllocator();
+  virtual ~PoolAllocator();
 
-  void* alloc(size_t size);
-  void free(void* ptr, size_t size);
+  virtual void* alloc(size_t size);
+  virtual void free(void* ptr, size_t size);
   std::string getName() { return name_; }
 
 private:
@@ -58,4 +67,124 @@ private:
   std::string name_;
 };
 
+/**
+ * @brief Memory pool which rounds sizes up to geometric size classes.
+ *
+ * Every power of two is split into four size classes, so a block is at most
+ * 25% larger than requested and blocks of near-identical sizes are reused
+ * by each other. Free blocks are first kept in a cache of the freeing
+ * thread, which is accessed without any lock. Overflowing thread caches
+ * hand a batch of blocks to the global free list of the size class, which
+ * is also where an empty thread cache refills from. The blocks of a thread
+ * cache are returned to the global lists when the thread exits.
+ *
+ * Only blocks up to kMaxThreadCacheSize bytes are kept in thread caches,
+ * and at most kMaxThreadCacheBytes per thread. At most sizeLimit bytes are
+ * kept in the global lists, blocks freed beyond that are released to the
+ * underlying allocator. Blocks whose size class is larger than sizeLimit
+ * can never be pooled, so they are allocated at their exact size. If
+ * sizeLimit == 0, it is a simple wrapper of allocator.
+ *
+ * The MemoryStats are reported as the counters "<name>_system_bytes",
+ * "<name>_peak_bytes", "<name>_in_use_bytes", "<name>_requested_bytes" and
+ * "<name>_cached_bytes" of globalStat.
+ *
+ * Like PoolAllocator, it holds all its locks while forking, so the child
+ * process of a multi-threaded process can still use it.
+ */
+class SizeClassPoolAllocator : public PoolAllocator {
+public:
+  SizeClassPoolAllocator(Allocator* allocator,
+                         size_t sizeLimit = 0,
+                         const std::string& name = "pool");
+
+  ~SizeClassPoolAllocator();
+
+  virtual void* alloc(size_t size);
+  virtual void free(void* ptr, size_t size);
+
+  struct MemoryStats {
+    /// bytes currently obtained from the underlying allocator
+    size_t systemBytes;
+    /// maximum of systemBytes so far
+    size_t peakSystemBytes;
+    /// bytes handed out by alloc() and not freed, after rounding
+    size_t inUseBytes;
+    /// bytes requested by the callers of alloc() and not freed
+    size_t requestedBytes;
+    /// bytes of the free blocks kept in the thread caches and global lists
+    size_t cachedBytes;
+  };
+
+  MemoryStats getStats();
+
+  /// the size class of size, or kNumClasses if it is too large to be pooled
+  static size_t sizeToClass(size_t size);
+  static size_t classToSize(size_t sizeClass);
+
+  static const size_t kMinShift = 5;
+  static const size_t kMaxShift = 40;
+  static const size_t kNumClasses = (kMaxShift - kMinShift) * 4 + 1;
+  static const size_t kMaxThreadCacheSize = 256 * 1024;
+  static const size_t kMaxThreadCacheBytes = 4 * 1024 * 1024;
+
+private:
+  struct ThreadCache {
+    explicit ThreadCache(SizeClassPoolAllocator* owner);
+
+    SizeClassPoolAllocator* owner;
+    std::vector<std::vector<void*>> freeLists;
+    // Written only by the owning thread, read by getStats(). A block may be
+    // freed by another thread than the one allocating it, so the in-use
+    // counters of a single thread can be negative.
+    std::atomic<int64_t> inUseBytes;
+    std::atomic<int64_t> requestedBytes;
+    std::atomic<int64_t> threadCachedBytes;
+  };
+
+  struct CentralList {
+    std::mutex lock;
+    std::vector<void*> blocks;
+  };
+
+  /// cachesLock_ and the locks of the global lists
+  std::vector<std::mutex*> getLocks();
+
+  /// the size class of size, or kNumClasses if it is not pooled
+  size_t poolClass(size_t size) const;
+
+  ThreadCache* getThreadCache();
+  static void releaseThreadCache(void* cache);
+  void flushThreadCache(ThreadCache* cache);
+
+  /// move up to count blocks of sizeClass from the global list to cache
+  void fetchFromCentral(ThreadCache* cache, size_t sizeClass, size_t count);
+  /// move the last count blocks of sizeClass from cache to the global list
+  void releaseToCentral(ThreadCache* cache, size_t sizeClass, size_t count);
+  /// the number of blocks of sizeClass which one thread cache keeps
+  static size_t maxThreadCacheCount(size_t sizeClass);
+
+  void* systemAlloc(size_t size);
+  void systemFree(void* ptr, size_t size);
+
+  static void addRelaxed(std::atomic<int64_t>& counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
+
+  size_t sizeLimit_;
+  pthread_key_t cacheKey_;
+  std::vector<CentralList> centralLists_;
+
+  std::atomic<size_t> centralCachedBytes_;
+  std::atomic<size_t> systemBytes_;
+  std::atomic<size_t> peakSystemBytes_;
+
+  // all live thread caches, and the counters of the exited threads
+  std::mutex cachesLock_;
+  std::list<ThreadCache*> caches_;
+  int64_t retiredInUseBytes_;
+  int64_t retiredRequestedBytes_;
+};
+
 }  // namespace paddle
@@ -0,0 +1,301 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "QuantizedMatrix.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "CpuSparseMatrix.h"
+#include "MathThreadPool.h"
+#include "SIMDFunctions.h"
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+// columns dequantized at a time, small enough for the buffer to stay in L1
+static const size_t kColumnBlock = 1024;
+
+static inline uint32_t floatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline float bitsFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// float to IEEE half, rounding to nearest even
+static uint16_t floatToHalf(float value) {
+  uint32_t bits = floatBits(value);
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t mantissa = bits & 0x7fffff;
+  int exponent = static_cast<int>((bits >> 23) & 0xff);
+  if (exponent == 0xff) {  // inf or nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  exponent = exponent - 127 + 15;
+  if (exponent >= 31) {  // overflow
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {  // subnormal half
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1U << shift) - 1);
+    uint32_t halfway = 1U << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    ++half;  // may carry into the exponent, which is still correct
+  }
+  return half;
+}
+
+static float halfToFloat(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      return bitsFloat(sign);
+    }
+    // subnormal half, normalize it
+    exponent = 127 - 15 + 1;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    return bitsFloat(sign | (exponent << 23) | ((mantissa & 0x3ff) << 13));
+  }
+  if (exponent == 0x1f) {
+    return bitsFloat(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return bitsFloat(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+void realToHalf(uint16_t* dst, const real* src, size_t len) {
+  size_t i = 0;
+#if defined(__F16C__) && !defined(PADDLE_TYPE_DOUBLE)
+  for (; i + 8 <= len; i += 8) {
+    __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), half);
+  }
+#endif
+  for (; i < len; ++i) {
+    dst[i] = floatToHalf(src[i]);
+  }
+}
+
+void halfToReal(real* dst, const uint16_t* src, size_t len) {
+  size_t i = 0;
+#if defined(__F16C__) && !defined(PADDLE_TYPE_DOUBLE)
+  for (; i + 8 <= len; i += 8) {
+    __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(half));
+  }
+#endif
+  for (; i < len; ++i) {
+    dst[i] = halfToFloat(src[i]);
+  }
+}
+
+QuantizedMatrix::QuantizedMatrix(size_t height, size_t width,
+                                 QuantizedType type)
+    : QuantizedMatrix(height, width, type,
+                      std::make_shared<CpuMemoryHandle>(
+                          getMemorySize(height, width, type))) {}
+
+QuantizedMatrix::QuantizedMatrix(size_t height, size_t width,
+                                 QuantizedType type,
+                                 const CpuMemHandlePtr& memory)
+    : height_(height), width_(width), type_(type), memory_(memory) {
+  CHECK(type == QUANTIZED_INT8 || type == QUANTIZED_FP16)
+      << "Unsupported quantized type " << type;
+  CHECK_EQ(memory_->getSize(), getMemorySize(height, width, type));
+  char* buf = reinterpret_cast<char*>(memory_->getBuf());
+  scales_ = type == QUANTIZED_INT8 ? reinterpret_cast<float*>(buf) : nullptr;
+  data_ = buf + (type == QUANTIZED_INT8 ? height * sizeof(float) : 0);
+}
+
+size_t QuantizedMatrix::getMemorySize(size_t height, size_t width,
+                                      QuantizedType type) {
+  size_t scalesSize = type == QUANTIZED_INT8 ? height * sizeof(float) : 0;
+  return scalesSize + height * width * type;
+}
+
+QuantizedMatrixPtr QuantizedMatrix::create(const real* data, size_t height,
+                                           size_t width, QuantizedType type) {
+  auto mat = std::make_shared<QuantizedMatrix>(height, width, type);
+  mat->quantize(data);
+  return mat;
+}
+
+void QuantizedMatrix::quantize(const real* data) {
+  if (type_ == QUANTIZED_FP16) {
+    realToHalf(reinterpret_cast<uint16_t*>(data_), data,
+               height_ * width_);
+    return;
+  }
+
+  int8_t* quantized = reinterpret_cast<int8_t*>(data_);
+  for (size_t i = 0; i < height_; ++i) {
+    const real* row = data + i * width_;
+    real maxAbs = 0;
+    for (size_t j = 0; j < width_; ++j) {
+      maxAbs = std::max(maxAbs, std::abs(row[j]));
+    }
+    scales_[i] = maxAbs / 127;
+    real inverse = maxAbs > 0 ? 127 / maxAbs : 0;
+    for (size_t j = 0; j < width_; ++j) {
+      quantized[i * width_ + j] =
+          static_cast<int8_t>(std::round(row[j] * inverse));
+    }
+  }
+}
+
+void QuantizedMatrix::dequantize(real* data) const {
+  for (size_t i = 0; i < height_; ++i) {
+    getRow(i, data + i * width_, 0, width_);
+  }
+}
+
+void QuantizedMatrix::getRow(size_t row, real* dst, size_t begin,
+                             size_t end) const {
+  size_t offset = row * width_ + begin;
+  if (type_ == QUANTIZED_INT8) {
+    simd::int8ToReal<real>(
+        dst, reinterpret_cast<const int8_t*>(data_) + offset,
+        scales_[row], end - begin);
+  } else {
+    halfToReal(dst, reinterpret_cast<const uint16_t*>(data_) + offset,
+               end - begin);
+  }
+}
+
+void QuantizedMatrix::mul(const Matrix& a, Matrix& c, real scaleAB,
+                          real scaleT) const {
+  CHECK(!a.useGpu() && !c.useGpu());
+  CHECK(!a.isTransposed() && !c.isTransposed());
+  CHECK_EQ(a.getWidth(), height_);
+  CHECK_EQ(a.getHeight(), c.getHeight());
+  CHECK_EQ(c.getWidth(), width_);
+  CpuMatrix* out = dynamic_cast<CpuMatrix*>(&c);
+  CHECK(out);
+
+  size_t stride = out->getStride();
+  for (size_t i = 0; i < out->getHeight(); ++i) {
+    real* row = out->getData() + i * stride;
+    if (scaleT == 0) {
+      memset(row, 0, sizeof(real) * width_);
+    } else if (scaleT != 1) {
+      for (size_t j = 0; j < width_; ++j) row[j] *= scaleT;
+    }
+  }
+
+  auto sparse = dynamic_cast<const CpuSparseMatrix*>(&a);
+  auto dense = dynamic_cast<const CpuMatrix*>(&a);
+  CHECK(sparse || dense) << "Unsupported input matrix type";
+  size_t numMulAdds =
+      (sparse ? sparse->getElementCnt() : a.getElementCnt()) * width_;
+  auto mulBlock = [&](size_t begin, size_t end) {
+    sparse ? mulSparse(*sparse, *out, scaleAB, begin, end)
+           : mulDense(*dense, *out, scaleAB, begin, end);
+  };
+  if (MathThreadPool::isEnabled(numMulAdds)) {
+    MathThreadPool::global().parallelFor(width_, 64, mulBlock);
+  } else {
+    mulBlock(0, width_);
+  }
+}
+
+void QuantizedMatrix::mulDense(const CpuMatrix& a, CpuMatrix& c, real scaleAB,
+                               size_t begin, size_t end) const {
+  std::vector<real> buffer(std::min(kColumnBlock, end - begin));
+  const real* aData = a.getData();
+  size_t aStride = a.getStride();
+  real* cData = c.getData();
+  size_t cStride = c.getStride();
+  for (size_t blockBegin = begin; blockBegin < end;
+       blockBegin += kColumnBlock) {
+    size_t blockEnd = std::min(end, blockBegin + kColumnBlock);
+    for (size_t k = 0; k < height_; ++k) {
+      bool dequantized = false;
+      for (size_t i = 0; i < a.getHeight(); ++i) {
+        real value = aData[i * aStride + k];
+        if (value == 0) continue;
+        if (!dequantized) {
+          // one row of weights is reused by the whole batch
+          getRow(k, buffer.data(), blockBegin, blockEnd);
+          dequantized = true;
+        }
+        simd::addScaledTo<real>(cData + i * cStride + blockBegin,
+                                buffer.data(), scaleAB * value,
+                                blockEnd - blockBegin);
+      }
+    }
+  }
+}
+
+void QuantizedMatrix::mulSparse(const CpuSparseMatrix& a, CpuMatrix& c,
+                                real scaleAB, size_t begin, size_t end) const {
+  CHECK_EQ(a.getFormat(), SPARSE_CSR) << "Only CSR input is supported";
+  std::vector<real> buffer(end - begin);
+  bool hasValue = a.getValueType() == FLOAT_VALUE;
+  for (size_t i = 0; i < a.getHeight(); ++i) {
+    real* cRow = c.getData() + i * c.getStride() + begin;
+    size_t numCols = a.getColNum(i);
+    const int* cols = a.getRowCols(i);
+    const real* values = hasValue ? a.getRowValues(i) : nullptr;
+    for (size_t n = 0; n < numCols; ++n) {
+      getRow(cols[n], buffer.data(), begin, end);
+      simd::addScaledTo<real>(cRow, buffer.data(),
+                              hasValue ? scaleAB * values[n] : scaleAB,
+                              end - begin);
+    }
+  }
+}
+
+void QuantizedMatrix::selectRows(Matrix& c, const IVector& ids) const {
+  CHECK(!c.useGpu() && !ids.useGpu());
+  CHECK_EQ(c.getHeight(), ids.getSize());
+  CHECK_EQ(c.getWidth(), width_);
+  std::vector<real> buffer(width_);
+  const int* index = ids.getData();
+  for (size_t i = 0; i < c.getHeight(); ++i) {
+    if (index[i] == -1) continue;
+    CHECK_LT(index[i], (int)height_);
+    CHECK_GE(index[i], 0);
+    getRow(index[i], buffer.data(), 0, width_);
+    simd::addScaledTo<real>(c.getData() + i * c.getStride(), buffer.data(),
+                            1, width_);
+  }
+}
+
+}  // namespace paddle
@@ -0,0 +1,140 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "Matrix.h"
+#include "MemoryHandle.h"
+#include "Vector.h"
+
+namespace paddle {
+
+/**
+ * Storage formats of a quantized matrix. Except QUANTIZED_NONE, the value
+ * of a format is the size of one element in bytes, which is what
+ * Parameter::Header::valueSize records for a quantized parameter.
+ */
+enum QuantizedType {
+  QUANTIZED_NONE = 0,
+  QUANTIZED_INT8 = 1,
+  QUANTIZED_FP16 = 2,
+};
+
+/**
+ * Convert len reals to IEEE 754 half precision, rounding to nearest even.
+ */
+void realToHalf(uint16_t* dst, const real* src, size_t len);
+
+/**
+ * Convert len IEEE 754 half precision numbers to real.
+ */
+void halfToReal(real* dst, const uint16_t* src, size_t len);
+
+class QuantizedMatrix;
+typedef std::shared_ptr<QuantizedMatrix> QuantizedMatrixPtr;
+
+/**
+ * @brief A read-only dense cpu matrix stored in fewer bits than real.
+ *
+ * - QUANTIZED_INT8: each row i is stored as int8 with its own scale,
+ *   w(i, j) = scale[i] * q(i, j) and scale[i] = max_j |w(i, j)| / 127.
+ * - QUANTIZED_FP16: IEEE 754 half precision.
+ *
+ * The kernels dequantize one block of a row at a time into a small buffer
+ * and accumulate in real. Since they read 1/4 (int8) or 1/2 (fp16) of the
+ * bytes of the real matrix, they are faster than the real kernels when the
+ * weights do not fit in cache and the batch is small, which is the case of
+ * cpu serving.
+ */
+class QuantizedMatrix {
+public:
+  QuantizedMatrix(size_t height, size_t width, QuantizedType type);
+
+  /**
+   * Wrap memory of getMemorySize() bytes, which holds the scales followed
+   * by the elements, e.g. the value of a parameter in a file mapping.
+   */
+  QuantizedMatrix(size_t height, size_t width, QuantizedType type,
+                  const CpuMemHandlePtr& memory);
+
+  /**
+   * Quantize a dense row-major height x width matrix.
+   */
+  static QuantizedMatrixPtr create(const real* data, size_t height,
+                                   size_t width, QuantizedType type);
+
+  /// The bytes of the scales and of the elements of a matrix.
+  static size_t getMemorySize(size_t height, size_t width,
+                              QuantizedType type);
+
+  size_t getHeight() const { return height_; }
+  size_t getWidth() const { return width_; }
+  QuantizedType getType() const { return type_; }
+
+  /// The scales followed by the elements, the format Parameter::save()
+  /// writes after the header.
+  const CpuMemHandlePtr& getMemory() const { return memory_; }
+
+  /// The quantized elements, getDataSize() bytes.
+  char* getData() { return data_; }
+  const char* getData() const { return data_; }
+  size_t getDataSize() const { return height_ * width_ * type_; }
+
+  /// The scale of every row for QUANTIZED_INT8, nullptr otherwise.
+  float* getScales() { return scales_; }
+  const float* getScales() const { return scales_; }
+
+  void quantize(const real* data);
+
+  void dequantize(real* data) const;
+
+  /**
+   * Dequantize the columns [begin, end) of row into dst.
+   */
+  void getRow(size_t row, real* dst, size_t begin, size_t end) const;
+
+  /**
+   * c = scaleT * c + scaleAB * (a * this).
+   *
+   * a is a dense or a CSR sparse cpu matrix. Large products are split
+   * by columns across MathThreadPool.
+   */
+  void mul(const Matrix& a, Matrix& c, real scaleAB = 1,
+           real scaleT = 1) const;
+
+  /**
+   * c.row(i) += this.row(ids[i]), ids of -1 are skipped.
+   * Same as CpuMatrix::selectRows.
+   */
+  void selectRows(Matrix& c, const IVector& ids) const;
+
+protected:
+  void mulDense(const CpuMatrix& a, CpuMatrix& c, real scaleAB, size_t begin,
+                size_t end) const;
+  void mulSparse(const CpuSparseMatrix& a, CpuMatrix& c, real scaleAB,
+                 size_t begin, size_t end) const;
+
+  size_t height_;
+  size_t width_;
+  QuantizedType type_;
+  CpuMemHandlePtr memory_;
+  float* scales_;
+  char* data_;
+};
+
+}  // namespace paddle
@@ -18,6 +18,21 @@ limitations under the License. */
 #include <immintrin.h>
 #include <algorithm>
 
+// sign extend 8 int8 in the low half of packed to int32
+static inline void int8_unpack_sse(__m128i packed, __m128i* lo, __m128i* hi) {
+  __m128i words = _mm_srai_epi16(_mm_unpacklo_epi8(packed, packed), 8);
+  *lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+  *hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+}
+
+// index of the first element equal to value, 0 if there is none (nan)
+static inline size_t first_equal(const float* data, size_t len, float value) {
+  for (size_t i = 0; i < len; ++i) {
+    if (data[i] == value) return i;
+  }
+  return 0;
+}
+
 #ifndef __AVX__
 static void addto_sse(float* a, const float* b, size_t len) {
   int offset = len % 16;
@@ -125,6 +140,68 @@ static void col_max_sse(float* result, const float* data, int dim,
   }
 }
 
+static void add_scaled_to_sse(float* a, const float* b, float scale,
+                              size_t len) {
+  __m128 ms = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128 ma0 = _mm_loadu_ps(a + i);
+    __m128 ma1 = _mm_loadu_ps(a + i + 4);
+    ma0 = _mm_add_ps(ma0, _mm_mul_ps(ms, _mm_loadu_ps(b + i)));
+    ma1 = _mm_add_ps(ma1, _mm_mul_ps(ms, _mm_loadu_ps(b + i + 4)));
+    _mm_storeu_ps(a + i, ma0);
+    _mm_storeu_ps(a + i + 4, ma1);
+  }
+  for (; i < len; ++i) a[i] += scale * b[i];
+}
+
+static void int8_to_real_sse(float* dst, const int8_t* src, float scale,
+                             size_t len) {
+  __m128 ms = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128i lo, hi;
+    int8_unpack_sse(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)),
+                    &lo, &hi);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(ms, _mm_cvtepi32_ps(lo)));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(ms, _mm_cvtepi32_ps(hi)));
+  }
+  for (; i < len; ++i) dst[i] = scale * src[i];
+}
+
+static size_t find_greater_sse(const float* data, size_t len,
+                               float threshold) {
+  __m128 mt = _mm_set1_ps(threshold);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128 c0 = _mm_cmpgt_ps(_mm_loadu_ps(data + i), mt);
+    __m128 c1 = _mm_cmpgt_ps(_mm_loadu_ps(data + i + 4), mt);
+    int mask = _mm_movemask_ps(c0) | (_mm_movemask_ps(c1) << 4);
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  while (i < len && !(data[i] > threshold)) ++i;
+  return i;
+}
+
+static size_t arg_max_sse(const float* data, size_t len) {
+  size_t i = 0;
+  float maxValue = data[0];
+  if (len >= 8) {
+    __m128 m0 = _mm_loadu_ps(data);
+    __m128 m1 = _mm_loadu_ps(data + 4);
+    for (i = 8; i + 8 <= len; i += 8) {
+      m0 = _mm_max_ps(m0, _mm_loadu_ps(data + i));
+      m1 = _mm_max_ps(m1, _mm_loadu_ps(data + i + 4));
+    }
+    m0 = _mm_max_ps(m0, m1);
+    m0 = _mm_max_ps(m0, _mm_shuffle_ps(m0, m0, _MM_SHUFFLE(1, 0, 3, 2)));
+    m0 = _mm_max_ps(m0, _mm_shuffle_ps(m0, m0, _MM_SHUFFLE(2, 3, 0, 1)));
+    maxValue = _mm_cvtss_f32(m0);
+  }
+  for (; i < len; ++i) maxValue = std::max(maxValue, data[i]);
+  return first_equal(data, len, maxValue);
+}
+
 #else
 static void addto_avx(float* a, const float* b, size_t len) {
   int offset = len % 32;
@@ -353,6 +430,70 @@ static void decayL1_avx(float* dst, float* src, float* lr, float lambda,
   }
 }
 
+static void add_scaled_to_avx(float* a, const float* b, float scale,
+                              size_t len) {
+  __m256 ms = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m256 ma0 = _mm256_loadu_ps(a + i);
+    __m256 ma1 = _mm256_loadu_ps(a + i + 8);
+    ma0 = _mm256_add_ps(ma0, _mm256_mul_ps(ms, _mm256_loadu_ps(b + i)));
+    ma1 = _mm256_add_ps(ma1, _mm256_mul_ps(ms, _mm256_loadu_ps(b + i + 8)));
+    _mm256_storeu_ps(a + i, ma0);
+    _mm256_storeu_ps(a + i + 8, ma1);
+  }
+  for (; i < len; ++i) a[i] += scale * b[i];
+}
+
+static void int8_to_real_avx(float* dst, const int8_t* src, float scale,
+                             size_t len) {
+  __m256 ms = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128i lo, hi;
+    int8_unpack_sse(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)),
+                    &lo, &hi);
+    __m256i v = _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(ms, _mm256_cvtepi32_ps(v)));
+  }
+  for (; i < len; ++i) dst[i] = scale * src[i];
+}
+
+static size_t find_greater_avx(const float* data, size_t len,
+                               float threshold) {
+  __m256 mt = _mm256_set1_ps(threshold);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m256 c0 = _mm256_cmp_ps(_mm256_loadu_ps(data + i), mt, _CMP_GT_OQ);
+    __m256 c1 = _mm256_cmp_ps(_mm256_loadu_ps(data + i + 8), mt, _CMP_GT_OQ);
+    int mask = _mm256_movemask_ps(c0) | (_mm256_movemask_ps(c1) << 8);
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  while (i < len && !(data[i] > threshold)) ++i;
+  return i;
+}
+
+static size_t arg_max_avx(const float* data, size_t len) {
+  size_t i = 0;
+  float maxValue = data[0];
+  if (len >= 16) {
+    __m256 m0 = _mm256_loadu_ps(data);
+    __m256 m1 = _mm256_loadu_ps(data + 8);
+    for (i = 16; i + 16 <= len; i += 16) {
+      m0 = _mm256_max_ps(m0, _mm256_loadu_ps(data + i));
+      m1 = _mm256_max_ps(m1, _mm256_loadu_ps(data + i + 8));
+    }
+    m0 = _mm256_max_ps(m0, m1);
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(m0),
+                          _mm256_extractf128_ps(m0, 1));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    maxValue = _mm_cvtss_f32(m);
+  }
+  for (; i < len; ++i) maxValue = std::max(maxValue, data[i]);
+  return first_equal(data, len, maxValue);
+}
+
 #endif
 
 #ifndef __AVX__
@@ -375,6 +516,22 @@ void colMaxImpl(float* result, const float* data, int dim, int numSamples) {
   SIMD_INVOKE(col_max, result, data, dim, numSamples);
 }
 
+void addScaledToImpl(float* a, const float* b, float scale, size_t len) {
+  SIMD_INVOKE(add_scaled_to, a, b, scale, len);
+}
+
+void int8ToRealImpl(float* dst, const int8_t* src, float scale, size_t len) {
+  SIMD_INVOKE(int8_to_real, dst, src, scale, len);
+}
+
+size_t argMaxImpl(const float* data, size_t len) {
+  return SIMD_INVOKE(arg_max, data, len);
+}
+
+size_t findGreaterImpl(const float* data, size_t len, float threshold) {
+  return SIMD_INVOKE(find_greater, data, len, threshold);
+}
+
 #ifdef __AVX__
 void decayL1AvxImpl(float* dst, float* src, float lambda, size_t len) {
   decayL1_avx(dst, src, lambda, len);
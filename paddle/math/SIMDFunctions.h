@@ -77,6 +77,40 @@ inline void decayL1(Type* dst, Type* src, Type lambda, size_t len) {
     }
   }
 }
+template <typename Type>
+inline void addScaledTo(Type* a, const Type* b, Type scale, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    a[i] += scale * b[i];
+  }
+}
+
+template <typename Type>
+inline void int8ToReal(Type* dst, const int8_t* src, Type scale, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    dst[i] = scale * src[i];
+  }
+}
+
+template <typename Type>
+inline size_t argMax(const Type* data, size_t len) {
+  size_t maxId = 0;
+  for (size_t i = 1; i < len; ++i) {
+    if (data[i] > data[maxId]) {
+      maxId = i;
+    }
+  }
+  return maxId;
+}
+
+template <typename Type>
+inline size_t findGreater(const Type* data, size_t len, Type threshold) {
+  size_t i = 0;
+  while (i < len && !(data[i] > threshold)) {
+    ++i;
+  }
+  return i;
+}
+
 }  // namespace naive
 
 template <typename Type>
@@ -104,6 +138,40 @@ inline void decayL1(Type* dst, Type* src, Type lambda, size_t len) {
   naive::decayL1(dst, src, lambda, len);
 }
 
+/**
+ * a += scale * b. The pointers need not be aligned.
+ */
+template <typename Type>
+inline void addScaledTo(Type* a, const Type* b, Type scale, size_t len) {
+  naive::addScaledTo(a, b, scale, len);
+}
+
+/**
+ * dst = scale * src, converting int8 to Type. The pointers need not be
+ * aligned.
+ */
+template <typename Type>
+inline void int8ToReal(Type* dst, const int8_t* src, Type scale, size_t len) {
+  naive::int8ToReal(dst, src, scale, len);
+}
+
+/**
+ * Index of the first maximum of data[0, len), len > 0.
+ */
+template <typename Type>
+inline size_t argMax(const Type* data, size_t len) {
+  return naive::argMax(data, len);
+}
+
+/**
+ * Index of the first element of data[0, len) greater than threshold, or
+ * len if there is none.
+ */
+template <typename Type>
+inline size_t findGreater(const Type* data, size_t len, Type threshold) {
+  return naive::findGreater(data, len, threshold);
+}
+
 template <size_t AlignSize>
 inline bool isPointerAlign(void* ptr) {
   return reinterpret_cast<uintptr_t>(ptr) % AlignSize == 0;
@@ -121,6 +189,10 @@ namespace internal {
 void addToImpl(float* a, const float* b, size_t len);
 void batchAddToImpl(float* a, const float* b[], int batch, size_t len);
 void colMaxImpl(float* result, const float* data, int dim, int numSamples);
+void addScaledToImpl(float* a, const float* b, float scale, size_t len);
+void int8ToRealImpl(float* dst, const int8_t* src, float scale, size_t len);
+size_t argMaxImpl(const float* data, size_t len);
+size_t findGreaterImpl(const float* data, size_t len, float threshold);
 #ifdef __AVX__
 void decayL1AvxImpl(float* dst, float* src, float lambda, size_t len);
 void decayL1AvxImpl(float* dst, float* src, float* lr, float lambda,
@@ -143,6 +215,27 @@ inline void colMax(float* result, const float* data, int dim, int numSamples) {
   internal::colMaxImpl(result, data, dim, numSamples);
 }
 
+template <>
+inline void addScaledTo(float* a, const float* b, float scale, size_t len) {
+  internal::addScaledToImpl(a, b, scale, len);
+}
+
+template <>
+inline void int8ToReal(float* dst, const int8_t* src, float scale,
+                       size_t len) {
+  internal::int8ToRealImpl(dst, src, scale, len);
+}
+
+template <>
+inline size_t argMax(const float* data, size_t len) {
+  return internal::argMaxImpl(data, len);
+}
+
+template <>
+inline size_t findGreater(const float* data, size_t len, float threshold) {
+  return internal::findGreaterImpl(data, len, threshold);
+}
+
 template <>
 inline void decayL1(float* dst, float* src, float lambda, size_t len) {
 #ifdef __AVX__
@@ -28,21 +28,102 @@ limitations under the License. */
 
 P_DEFINE_bool(allow_inefficient_sparse_update, false,
               "Whether to allow inefficient sparse update");
+P_DEFINE_bool(sparse_row_hash_index, false,
+              "Index the rows of sparse row matrices with a hash table instead "
+              "of an array of height entries. Saves memory and clearing time "
+              "for very large embedding tables of which a batch only uses a "
+              "few rows");
 
 namespace paddle {
 
 const unsigned int SparseRowCpuMatrix::kUnusedId_ = -1U;
 
+// initial number of slots of the hash index
+static const size_t kMinHashCapacity = 1024;
+
+/**
+ * simd::addTo and simd::decayL1 need aligned rows, which is only the case
+ * when the width is a multiple of the vector length.
+ */
+static inline void addToRow(real* a, const real* b, size_t width) {
+  if (simd::vec_check(width)) {
+    simd::addTo(a, b, width);
+  } else {
+    simd::addScaledTo<real>(a, b, 1, width);
+  }
+}
+
+static inline void decayL1Row(real* v, real lambda, size_t width) {
+  if (simd::vec_check(width)) {
+    simd::decayL1(v, v, lambda, width);
+  } else {
+    simd::naive::decayL1(v, v, lambda, width);
+  }
+}
+
+void SparseRowCpuMatrix::IndexDict::insertToHash(unsigned int globalId,
+                                                 unsigned int localId) {
+  CHECK_NE(globalId, kUnusedId_);
+  if ((usedSlots.size() + 1) * 2 > hashTable.size()) {
+    rehash(std::max(kMinHashCapacity, hashTable.size() * 2));
+  }
+  size_t mask = hashTable.size() - 1;
+  size_t i = hashSlot(globalId);
+  for (; hashTable[i].globalId != kUnusedId_; i = (i + 1) & mask) {
+    if (hashTable[i].globalId == globalId) {
+      hashTable[i].localId = localId;
+      return;
+    }
+  }
+  hashTable[i].globalId = globalId;
+  hashTable[i].localId = localId;
+  usedSlots.push_back(i);
+}
+
+void SparseRowCpuMatrix::IndexDict::clearHash() {
+  for (auto slot : usedSlots) {
+    hashTable[slot].globalId = kUnusedId_;
+  }
+  usedSlots.clear();
+}
+
+void SparseRowCpuMatrix::IndexDict::rehash(size_t capacity) {
+  CHECK_EQ(capacity & (capacity - 1), 0UL) << capacity;
+  std::vector<HashEntry> oldTable(capacity, HashEntry{kUnusedId_, kUnusedId_});
+  oldTable.swap(hashTable);
+  hashShift = 64;
+  for (size_t n = capacity; n > 1; n >>= 1) {
+    --hashShift;
+  }
+  std::vector<unsigned int> oldSlots;
+  oldSlots.swap(usedSlots);
+  usedSlots.reserve(oldSlots.size());
+  size_t mask = capacity - 1;
+  for (auto slot : oldSlots) {
+    const HashEntry& entry = oldTable[slot];
+    size_t i = hashSlot(entry.globalId);
+    while (hashTable[i].globalId != kUnusedId_) {
+      i = (i + 1) & mask;
+    }
+    hashTable[i] = entry;
+    usedSlots.push_back(i);
+  }
+}
+
 void SparseRowCpuMatrix::init(size_t height, size_t width) {
-  // @TODO(yuyang18) Just remove this limit
-  CHECK(simd::vec_check(width)) << width;
   height_ = height;
   if (!indexDictHandle_) {
     indexDictHandle_.reset(new IndexDict);
-    indexDictHandle_->globalIndices.assign(height, kUnusedId_);
+    if (FLAGS_sparse_row_hash_index) {
+      indexDictHandle_->useHashIndex = true;
+    } else {
+      indexDictHandle_->globalIndices.assign(height, kUnusedId_);
+    }
   }
   localIndices_ = &indexDictHandle_->localIndices;
-  globalIndices_ = indexDictHandle_->globalIndices.data();
+  globalIndices_ = indexDictHandle_->useHashIndex
+                       ? nullptr
+                       : indexDictHandle_->globalIndices.data();
 }
 
 void SparseRowCpuMatrix::mul(CpuSparseMatrix* a, CpuMatrix* b, real scaleAB,
@@ -103,7 +184,7 @@ void SparseRowCpuMatrix::sgdUpdate(BaseMatrix& value, IVector& t0,
           // W(t0) -> W(t+1)
           int tDiff = currentTime - t[0];
           real delta = tDiff * learningRate * decayRate;
-          simd::decayL1(v, v, delta, this->width_);
+          decayL1Row(v, delta, this->width_);
         }
       }
       return;
@@ -117,14 +198,14 @@ void SparseRowCpuMatrix::sgdUpdate(BaseMatrix& value, IVector& t0,
         // W(t0) -> W(t)
         int tDiff = currentTime - t[0];
         real delta = tDiff * learningRate * decayRate;
-        simd::decayL1(v, v, delta, this->width_);
+        decayL1Row(v, delta, this->width_);
       }
 
       // W(t) -> W(t+1)
       for (size_t j = 0; j < this->width_; ++j) {
         v[j] -= learningRate * g[j];
       }
-      simd::decayL1(v, v, learningRate*decayRate, this->width_);
+      decayL1Row(v, learningRate * decayRate, this->width_);
 
       // state update to t+1
       t[0] = currentTime + 1;
@@ -182,8 +263,7 @@ void SparseRowCpuMatrix::addTo(BaseMatrix& dest, std::vector<uint32_t>& ids,
   for (size_t i = 0; i < localIndices.size(); ++i) {
     uint32_t id = localIndices[i];
     if (id % numThreads == tid) {
-      simd::addTo(dest.rowBuf(id), getLocalRow(i),
-                  this->width_);
+      addToRow(dest.rowBuf(id), getLocalRow(i), this->width_);
       ids.push_back(id);
     }
   }
@@ -199,7 +279,7 @@ void SparseRowCpuMatrix::addTo(SparseRowCpuMatrix& dest, size_t tid,
     uint32_t id = localIndices[i];
     if (id % numThreads == tid) {
       dest.checkIndex(id);
-      simd::addTo(dest.getRow(id), getLocalRow(i), this->width_);
+      addToRow(dest.getRow(id), getLocalRow(i), this->width_);
     }
   }
 }
@@ -252,7 +332,7 @@ void SparsePrefetchRowCpuMatrix::setupIndices() {
   uniqueIds(localIndices);
   // for each sparse row
   for (size_t id = 0; id < localIndices.size(); ++id) {
-    globalIndices_[localIndices[id]] = id;  // sparse row -> local id
+    setLocalId(localIndices[id], id);  // sparse row -> local id
   }
   checkStoreSize();
 }
@@ -260,7 +340,7 @@ void SparsePrefetchRowCpuMatrix::setupIndices() {
 void SparseRowCpuMatrix::checkIndices() {
   std::vector<unsigned int>& localIndices = indexDictHandle_->localIndices;
   for (size_t i = 0; i < localIndices.size(); ++i) {
-    CHECK_EQ(globalIndices_[localIndices[i]], i);
+    CHECK_EQ(getLocalId(localIndices[i]), i);
   }
   checkStoreSize();
 }
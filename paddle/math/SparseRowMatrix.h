@@ -36,6 +36,49 @@ public:
     // the sparse rows.
     std::vector<unsigned int> localIndices;   // local id -> global id
     std::vector<unsigned int> globalIndices;  // global id -> local id
+
+    /**
+     * In hash index mode (--sparse_row_hash_index), globalIndices is empty
+     * and global id -> local id is kept in an open addressing hash table
+     * instead, so that the memory and the cost of clearing the indices are
+     * proportional to the number of rows used rather than the height.
+     */
+    bool useHashIndex = false;
+
+    /// local id of the global id in the hash table, kUnusedId_ if absent
+    unsigned int findInHash(unsigned int globalId) const {
+      if (hashTable.empty()) return kUnusedId_;
+      size_t mask = hashTable.size() - 1;
+      for (size_t i = hashSlot(globalId);; i = (i + 1) & mask) {
+        if (hashTable[i].globalId == globalId) return hashTable[i].localId;
+        if (hashTable[i].globalId == kUnusedId_) return kUnusedId_;
+      }
+    }
+
+    /// set (or overwrite) the local id of the global id in the hash table
+    void insertToHash(unsigned int globalId, unsigned int localId);
+
+    /// remove all the entries of the hash table, O(number of entries)
+    void clearHash();
+
+  private:
+    struct HashEntry {
+      unsigned int globalId;
+      unsigned int localId;
+    };
+
+    /// fibonacci hashing, the table size is a power of 2
+    size_t hashSlot(unsigned int globalId) const {
+      return (globalId * 0x9E3779B97F4A7C15ULL) >> hashShift;
+    }
+
+    void rehash(size_t capacity);
+
+    std::vector<HashEntry> hashTable;
+    /// slots in use, to clear them without scanning the whole table
+    std::vector<unsigned int> usedSlots;
+    /// 64 - log2(hashTable.size())
+    int hashShift = 64;
   };
   typedef std::shared_ptr<IndexDict> IndexDictPtr;
 
@@ -60,8 +103,19 @@ public:
    *  @param row row id in the original matrix
    */
   real* getRow(size_t row) {
-    CHECK_NE(globalIndices_[row], kUnusedId_);
-    return getLocalRow(globalIndices_[row]);
+    auto id = getLocalId(row);
+    CHECK_NE(id, kUnusedId_);
+    return getLocalRow(id);
+  }
+
+  /**
+   *  Get the local id of a row, kUnusedId_ if the row is not used
+   *
+   *  @param row row id in the original matrix
+   */
+  unsigned int getLocalId(size_t row) const {
+    return globalIndices_ ? globalIndices_[row]
+                          : indexDictHandle_->findInHash(row);
   }
 
   /**
@@ -156,7 +210,7 @@ public:
    *  check whether row *i* exist in indices
    */
   void checkIndex(size_t i) {
-    size_t localId = globalIndices_[i];
+    size_t localId = getLocalId(i);
     CHECK_LT(localId, localIndices_->size());
     CHECK_EQ((*localIndices_)[localId], i);
   }
@@ -174,10 +228,31 @@ protected:
 
   void init(size_t height, size_t width);
 
+  void setLocalId(size_t row, unsigned int id) {
+    if (globalIndices_) {
+      globalIndices_[row] = id;
+    } else {
+      indexDictHandle_->insertToHash(row, id);
+    }
+  }
+
+  /// add a new row and return its local id.
+  unsigned int addLocalRow(size_t row) {
+    unsigned int id = localIndices_->size();
+    setLocalId(row, id);
+    localIndices_->push_back(row);
+    checkStoreSize();
+    return id;
+  }
+
   /// clear row indices.
   void clearRows() {
-    for (auto id : *localIndices_) {
-      globalIndices_[id] = kUnusedId_;
+    if (globalIndices_) {
+      for (auto id : *localIndices_) {
+        globalIndices_[id] = kUnusedId_;
+      }
+    } else {
+      indexDictHandle_->clearHash();
     }
     localIndices_->clear();
     rowStore_.clear();
@@ -201,7 +276,8 @@ protected:
   std::vector<real, AlignedAllocator<real, 32>> rowStore_;
   IndexDictPtr indexDictHandle_;
   std::vector<unsigned int>* localIndices_;  // =&indexDictHandle_->localIndices
-  unsigned int* globalIndices_;  // =indexDictHandle_->globalIndices.data();
+  // =indexDictHandle_->globalIndices.data(), nullptr in hash index mode
+  unsigned int* globalIndices_;
   static const unsigned int kUnusedId_;
 };
 
@@ -245,11 +321,9 @@ public:
       : SparseRowCpuMatrix(nullptr, height, width, indexDictHandle, trans) {}
 
   real* getRow(size_t row) {
-    auto id = globalIndices_[row];
+    auto id = getLocalId(row);
     if (id == kUnusedId_) {
-      id = globalIndices_[row] = localIndices_->size();
-      localIndices_->push_back(row);
-      checkStoreSize();
+      id = addLocalRow(row);
     }
     return getLocalRow(id);
   }
@@ -272,11 +346,9 @@ public:
   }
 
   real* getRow(size_t row) {
-    auto id = globalIndices_[row];
+    auto id = getLocalId(row);
     if (id == kUnusedId_) {
-      id = globalIndices_[row] = localIndices_->size();
-      localIndices_->push_back(row);
-      checkStoreSize();
+      id = addLocalRow(row);
       memcpy(getLocalRow(id), sourceData_ + width_ * row,
              sizeof(float) * width_);
     }
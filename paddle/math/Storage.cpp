@@ -19,6 +19,9 @@ limitations under the License. */
 
 P_DEFINE_int32(pool_limit_size, 536870912,
                "maximum memory size managed by a memory pool, default is 512M");
+P_DEFINE_bool(pool_size_class, true,
+              "round the cpu memory pool allocations up to size classes, "
+              "and cache the free blocks per thread");
 
 namespace paddle {
 
@@ -84,12 +87,21 @@ PoolAllocator* StorageEngine::getCpuAllocator() {
     // Construct cpuAllocator_
     std::lock_guard<RWLock> guard(lock_);
     if (cpuAllocator_ == nullptr) {
+      Allocator* allocator = nullptr;
+      std::string name;
       if (FLAGS_use_gpu) {
-        cpuAllocator_ = new PoolAllocator(
-          new CudaHostAllocator(), FLAGS_pool_limit_size, "cuda_host_pool");
+        allocator = new CudaHostAllocator();
+        name = "cuda_host_pool";
+      } else {
+        allocator = new CpuAllocator();
+        name = "cpu_pool";
+      }
+      if (FLAGS_pool_size_class) {
+        cpuAllocator_ = new SizeClassPoolAllocator(
+          allocator, FLAGS_pool_limit_size, name);
       } else {
         cpuAllocator_ = new PoolAllocator(
-          new CpuAllocator(), FLAGS_pool_limit_size, "cpu_pool");
+          allocator, FLAGS_pool_limit_size, name);
       }
     }
     return cpuAllocator_;
@@ -14,8 +14,15 @@ limitations under the License. */
 
 
 #include <gtest/gtest.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "paddle/utils/Util.h"
 #include "paddle/utils/Logging.h"
+#include "paddle/utils/Stat.h"
 #define private public
 #include "paddle/math/MemoryHandle.h"
 #include "paddle/math/Allocator.h"
@@ -73,6 +80,145 @@ TEST(Allocator, Pool) {
 #endif
 }
 
+TEST(Allocator, SizeClass) {
+  typedef SizeClassPoolAllocator Pool;
+  EXPECT_EQ(0UL, Pool::sizeToClass(1));
+  EXPECT_EQ(32UL, Pool::classToSize(0));
+  for (size_t size = 1; size < (1 << 20); size += size / 7 + 1) {
+    size_t sizeClass = Pool::sizeToClass(size);
+    ASSERT_LT(sizeClass, Pool::kNumClasses);
+    EXPECT_LE(size, Pool::classToSize(sizeClass));
+    EXPECT_LE(Pool::classToSize(sizeClass), std::max(32UL, size * 5 / 4));
+    if (sizeClass > 0) {
+      EXPECT_LT(Pool::classToSize(sizeClass - 1), size);
+    }
+  }
+  EXPECT_EQ(Pool::kNumClasses - 1, Pool::sizeToClass(1UL << Pool::kMaxShift));
+  EXPECT_EQ(Pool::kNumClasses,
+            Pool::sizeToClass((1UL << Pool::kMaxShift) + 1));
+}
+
+TEST(Allocator, SizeClassPool) {
+  const size_t kLargeSize = SizeClassPoolAllocator::kMaxThreadCacheSize * 3;
+  SizeClassPoolAllocator pool(new CpuAllocator(), kLargeSize * 3 / 2);
+
+  /* near-identical sizes share one block */
+  void* ptr1 = pool.alloc(1000);
+  pool.free(ptr1, 1000);
+  void* ptr2 = pool.alloc(1010);
+  EXPECT_EQ(ptr1, ptr2);
+  auto stats = pool.getStats();
+  EXPECT_EQ(1010UL, stats.requestedBytes);
+  EXPECT_EQ(1024UL, stats.inUseBytes);
+  EXPECT_EQ(1024UL, stats.systemBytes);
+  pool.free(ptr2, 1010);
+
+  /* large blocks go to the global lists, at most sizeLimit bytes */
+  void* ptr3 = pool.alloc(kLargeSize);
+  void* ptr4 = pool.alloc(kLargeSize);
+  pool.free(ptr3, kLargeSize);
+  pool.free(ptr4, kLargeSize);
+  stats = pool.getStats();
+  EXPECT_EQ(0UL, stats.inUseBytes);
+  EXPECT_EQ(1024 + kLargeSize, stats.systemBytes);
+  EXPECT_EQ(1024 + 2 * kLargeSize, stats.peakSystemBytes);
+  EXPECT_EQ(stats.systemBytes, stats.cachedBytes);
+  EXPECT_EQ(ptr3, pool.alloc(kLargeSize));
+  pool.free(ptr3, kLargeSize);
+
+  /* blocks larger than sizeLimit are never pooled, nor rounded up */
+  const size_t kHugeSize = kLargeSize * 2 + 1;
+  void* ptr5 = pool.alloc(kHugeSize);
+  stats = pool.getStats();
+  EXPECT_EQ(kHugeSize, stats.inUseBytes);
+  EXPECT_EQ(1024 + kLargeSize + kHugeSize, stats.systemBytes);
+  pool.free(ptr5, kHugeSize);
+  stats = pool.getStats();
+  EXPECT_EQ(1024 + kLargeSize, stats.systemBytes);
+
+  /* the stats are counters of globalStat */
+  EXPECT_EQ(int64_t(1024 + kLargeSize),
+            globalStat.getCounter("pool_system_bytes"));
+  EXPECT_EQ(int64_t(stats.peakSystemBytes),
+            globalStat.getCounter("pool_peak_bytes"));
+  globalStat.printCounterStatus();
+}
+
+TEST(Allocator, SizeClassPoolThreads) {
+  SizeClassPoolAllocator pool(new CpuAllocator(), 1 << 24);
+  std::vector<std::thread> threads;
+  std::vector<void*> shared(8, nullptr);
+  for (size_t t = 0; t < shared.size(); ++t) {
+    threads.emplace_back([&pool, &shared, t]() {
+      std::vector<std::pair<void*, size_t>> blocks;
+      for (size_t i = 0; i < 2000; ++i) {
+        size_t size = (i * 7919 + t * 104729) % 100000 + 1;
+        void* ptr = pool.alloc(size);
+        memset(ptr, (int)t, size);
+        blocks.push_back({ptr, size});
+        if (i % 3 == 0) {
+          auto block = blocks[i / 2];
+          EXPECT_EQ((char)t, ((char*)block.first)[block.second - 1]);
+          pool.free(block.first, block.second);
+          blocks[i / 2].first = nullptr;
+        }
+      }
+      for (auto& block : blocks) {
+        if (block.first) {
+          pool.free(block.first, block.second);
+        }
+      }
+      /* freed by another thread */
+      shared[t] = pool.alloc(4096);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto ptr : shared) {
+    pool.free(ptr, 4096);
+  }
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(0UL, stats.inUseBytes);
+  EXPECT_EQ(0UL, stats.requestedBytes);
+  EXPECT_EQ(stats.systemBytes, stats.cachedBytes);
+  EXPECT_LE(stats.systemBytes, stats.peakSystemBytes);
+}
+
+TEST(Allocator, SizeClassPoolFork) {
+  /* large blocks go through the locked global lists */
+  const size_t kLargeSize = SizeClassPoolAllocator::kMaxThreadCacheSize * 2;
+  SizeClassPoolAllocator pool(new CpuAllocator(), 1 << 24);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&pool, &stop, kLargeSize]() {
+      for (size_t i = 0; !stop; ++i) {
+        size_t size = i % 2 ? 100 : kLargeSize;
+        pool.free(pool.alloc(size), size);
+      }
+    });
+  }
+  /* the child does not inherit a lock held by another thread */
+  for (size_t i = 0; i < 20; ++i) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      pool.free(pool.alloc(kLargeSize), kLargeSize);
+      pool.getStats();
+      _exit(0);
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 TEST(MemoryHandle, Cpu) {
   for (auto size : {10, 30, 50, 100, 200, 512, 1000, 1023, 1024, 1025, 8193}) {
     CpuMemoryHandle handle(size);
@@ -0,0 +1,198 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "paddle/math/Matrix.h"
+#include "paddle/math/MathThreadPool.h"
+#include "paddle/utils/Stat.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+P_DECLARE_int32(math_num_threads);
+P_DECLARE_int32(math_parallel_threshold);
+
+TEST(MathThreadPool, parallelFor) {
+  MathThreadPool pool(4);
+  for (size_t size : {0UL, 1UL, 7UL, 8UL, 100UL, 1023UL}) {
+    std::vector<std::atomic<int>> visited(size);
+    for (auto& v : visited) v = 0;
+    pool.parallelFor(size, 8, [&](size_t begin, size_t end) {
+      EXPECT_LT(begin, end);
+      EXPECT_EQ(0UL, begin % 8);
+      for (size_t i = begin; i < end; ++i) {
+        ++visited[i];
+      }
+    });
+    for (auto& v : visited) {
+      EXPECT_EQ(1, v);
+    }
+  }
+}
+
+TEST(MathThreadPool, concurrentCallers) {
+  MathThreadPool pool(3);
+  const size_t kSize = 10000;
+  std::vector<std::thread> threads;
+  std::vector<size_t> sums(8, 0);
+  for (size_t t = 0; t < sums.size(); ++t) {
+    threads.emplace_back([&, t]() {
+      for (int iter = 0; iter < 100; ++iter) {
+        std::atomic<size_t> sum(0);
+        pool.parallelFor(kSize, 1, [&](size_t begin, size_t end) {
+          size_t local = 0;
+          for (size_t i = begin; i < end; ++i) local += i;
+          sum += local;
+        });
+        sums[t] = sum;
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  for (auto sum : sums) {
+    EXPECT_EQ(kSize * (kSize - 1) / 2, sum);
+  }
+}
+
+typedef std::function<void(std::vector<MatrixPtr>&)> MatrixOp;
+
+/**
+ * Run op on copies of args serially and in parallel, and check that every
+ * argument is bit-for-bit identical afterwards.
+ */
+void testSerialVsParallel(const std::vector<MatrixPtr>& args, MatrixOp op) {
+  std::vector<MatrixPtr> serial, parallel;
+  for (auto& arg : args) {
+    serial.push_back(arg->clone(0, 0, false));
+    serial.back()->copyFrom(*arg);
+    parallel.push_back(arg->clone(0, 0, false));
+    parallel.back()->copyFrom(*arg);
+  }
+
+  int threshold = FLAGS_math_parallel_threshold;
+  FLAGS_math_parallel_threshold = 0;
+  op(serial);
+  FLAGS_math_parallel_threshold = 1;
+  op(parallel);
+  FLAGS_math_parallel_threshold = threshold;
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    size_t size = args[i]->getElementCnt() * sizeof(real);
+    EXPECT_EQ(0, memcmp(serial[i]->getData(), parallel[i]->getData(), size))
+        << "argument " << i << " differs";
+  }
+}
+
+MatrixPtr randomMatrix(size_t height, size_t width) {
+  MatrixPtr mat = Matrix::create(height, width, false, false);
+  mat->randomizeUniform();
+  mat->add(-0.5);
+  return mat;
+}
+
+TEST(BaseMatrix, parallelApply) {
+  for (auto height : {1, 3, 17, 128}) {
+    for (auto width : {1, 5, 16, 100, 1031}) {
+      auto a = randomMatrix(height, width);
+      auto b = randomMatrix(height, width);
+      auto c = randomMatrix(height, width);
+      auto d = randomMatrix(height, width);
+      auto row = randomMatrix(1, width);
+      auto col = randomMatrix(height, 1);
+
+      testSerialVsParallel({a, b}, [](std::vector<MatrixPtr>& m) {
+        m[0]->exp();
+        m[1]->sigmoid(*m[0]);
+      });
+      testSerialVsParallel({a, b, c}, [](std::vector<MatrixPtr>& m) {
+        m[0]->dotMul(*m[1], *m[2]);
+        m[1]->add(*m[0], 0.5, *m[2], 2.0);
+      });
+      testSerialVsParallel({a, b, c, d}, [](std::vector<MatrixPtr>& m) {
+        BaseMatrix& base = *m[0];
+        base.add3(*m[1], *m[2], *m[3], 1.0, 2.0, 3.0);
+      });
+      testSerialVsParallel({a, row}, [](std::vector<MatrixPtr>& m) {
+        m[0]->addBias(*m[1], 0.5);
+        m[0]->mulRowVector(*m[1]);
+      });
+      testSerialVsParallel({a, col}, [](std::vector<MatrixPtr>& m) {
+        m[0]->addColVector(*m[1]);
+      });
+      // accumulates into the column vector
+      testSerialVsParallel({col, a, b}, [](std::vector<MatrixPtr>& m) {
+        m[0]->binaryClassificationError2(0, *m[1], *m[2], 0.0);
+      });
+    }
+  }
+}
+
+TEST(BaseMatrix, parallelApplyOnSubMatrix) {
+  auto a = randomMatrix(64, 300);
+  auto b = randomMatrix(64, 300);
+  testSerialVsParallel({a, b}, [](std::vector<MatrixPtr>& m) {
+    auto sub = m[0]->subMatrix(3, 50);
+    sub->addAtOffset(*m[1]->subMatrix(10, 60, 0, 200), 17);
+    auto colsA = m[0]->subColMatrix(20, 200);
+    auto colsB = m[1]->subColMatrix(60, 240);
+    BaseMatrix& base = *colsA;
+    base.tanh(*colsB);
+  });
+}
+
+TEST(BaseMatrix, parallelApplyBenchmark) {
+  const size_t kHeight = 256;
+  const size_t kWidth = 4096;
+  const int kIterations = 20;
+  auto a = randomMatrix(kHeight, kWidth);
+  auto b = randomMatrix(kHeight, kWidth);
+  auto c = randomMatrix(kHeight, kWidth);
+
+  int threshold = FLAGS_math_parallel_threshold;
+  for (int parallel : {0, 1}) {
+    FLAGS_math_parallel_threshold = parallel ? threshold : 0;
+    Timer unary, binary, ternary;
+    for (int i = 0; i < kIterations; ++i) {
+      unary.start();
+      a->mulScalar(0.99);
+      unary.stop();
+      binary.start();
+      b->sigmoid(*a);
+      binary.stop();
+      ternary.start();
+      c->add(*a, 0.5, *b, 0.5);
+      ternary.stop();
+    }
+    LOG(INFO) << (parallel ? "parallel" : "serial") << " ("
+              << MathThreadPool::global().getNumThreads() << " threads) "
+              << kHeight << "x" << kWidth << ": "
+              << "mulScalar " << unary.get() / kIterations << "us, "
+              << "sigmoid " << binary.get() / kIterations << "us, "
+              << "add " << ternary.get() / kIterations << "us";
+  }
+  FLAGS_math_parallel_threshold = threshold;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  if (FLAGS_math_num_threads < 0) {
+    FLAGS_math_num_threads = 4;
+  }
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "paddle/math/CpuSparseMatrix.h"
+#include "paddle/math/QuantizedMatrix.h"
+#include "paddle/utils/Stat.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+static const QuantizedType kTypes[] = {QUANTIZED_INT8, QUANTIZED_FP16};
+
+static real tolerance(QuantizedType type) {
+  return type == QUANTIZED_INT8 ? 1e-2 : 1e-3;
+}
+
+static MatrixPtr randomMatrix(size_t height, size_t width) {
+  MatrixPtr mat = Matrix::create(height, width, false, false);
+  mat->randomizeUniform();
+  mat->add(-0.5);
+  return mat;
+}
+
+/// max |expected - actual| relative to max |expected|
+static real relativeError(Matrix& expected, Matrix& actual) {
+  EXPECT_EQ(expected.getHeight(), actual.getHeight());
+  EXPECT_EQ(expected.getWidth(), actual.getWidth());
+  real maxDiff = 0;
+  real maxAbs = 0;
+  for (size_t i = 0; i < expected.getHeight(); ++i) {
+    for (size_t j = 0; j < expected.getWidth(); ++j) {
+      real value = expected.getElement(i, j);
+      maxDiff = std::max(maxDiff, std::abs(value - actual.getElement(i, j)));
+      maxAbs = std::max(maxAbs, std::abs(value));
+    }
+  }
+  return maxAbs > 0 ? maxDiff / maxAbs : maxDiff;
+}
+
+TEST(QuantizedMatrix, quantize) {
+  for (auto type : kTypes) {
+    auto weight = randomMatrix(37, 100);
+    // an all-zero row must not produce nan
+    memset(weight->getData() + 3 * 100, 0, 100 * sizeof(real));
+    auto quantized = QuantizedMatrix::create(weight->getData(), 37, 100, type);
+    EXPECT_EQ(37UL * 100 * type, quantized->getDataSize());
+    auto dequantized = Matrix::create(37, 100, false, false);
+    quantized->dequantize(dequantized->getData());
+    EXPECT_LT(relativeError(*weight, *dequantized), tolerance(type)) << type;
+    for (size_t j = 0; j < 100; ++j) {
+      EXPECT_EQ(0, dequantized->getElement(3, j));
+    }
+  }
+
+  // values representable in half precision are exact
+  real values[] = {0, 1, -2, 0.5, 65504, -0.25, 6.103515625e-05, 1e-7};
+  QuantizedMatrix half(1, 8, QUANTIZED_FP16);
+  half.quantize(values);
+  real result[8];
+  half.dequantize(result);
+  for (size_t i = 0; i < 7; ++i) {
+    EXPECT_EQ(values[i], result[i]);
+  }
+  // subnormal
+  EXPECT_NEAR(values[7], result[7], 6e-8);
+}
+
+TEST(QuantizedMatrix, mul) {
+  for (auto type : kTypes) {
+    for (size_t batch : {1, 7, 32}) {
+      for (size_t width : {5, 64, 1500}) {
+        auto weight = randomMatrix(300, width);
+        auto quantized =
+            QuantizedMatrix::create(weight->getData(), 300, width, type);
+        auto input = randomMatrix(batch, 300);
+        auto expected = randomMatrix(batch, width);
+        auto actual = expected->clone(0, 0, false);
+        actual->copyFrom(*expected);
+
+        expected->mul(input, weight, 1, 1);
+        quantized->mul(*input, *actual, 1, 1);
+        EXPECT_LT(relativeError(*expected, *actual), tolerance(type));
+
+        expected->mul(input, weight, 0.5, 0);
+        quantized->mul(*input, *actual, 0.5, 0);
+        EXPECT_LT(relativeError(*expected, *actual), tolerance(type));
+      }
+    }
+  }
+}
+
+TEST(QuantizedMatrix, sparseMul) {
+  const size_t height = 1000;
+  const size_t width = 77;
+  for (auto type : kTypes) {
+    for (auto valueType : {FLOAT_VALUE, NO_VALUE}) {
+      auto weight = randomMatrix(height, width);
+      auto quantized =
+          QuantizedMatrix::create(weight->getData(), height, width, type);
+      auto dense = Matrix::create(16, height, false, false);
+      dense->zeroMem();
+      for (size_t i = 0; i < 16; ++i) {
+        for (size_t n = 0; n < 10; ++n) {
+          dense->getData()[i * height + rand() % height] =  // NOLINT
+              valueType == FLOAT_VALUE ? (rand() % 100 + 1) / 100.0 : 1;
+        }
+      }
+      CpuSparseMatrix sparse(16, height, 16 * 10, valueType, SPARSE_CSR);
+      sparse.copyFrom(*dynamic_cast<CpuMatrix*>(dense.get()));
+
+      auto expected = Matrix::create(16, width, false, false);
+      auto actual = Matrix::create(16, width, false, false);
+      expected->mul(dense, weight, 1, 0);
+      quantized->mul(sparse, *actual, 1, 0);
+      EXPECT_LT(relativeError(*expected, *actual), tolerance(type));
+    }
+  }
+}
+
+TEST(QuantizedMatrix, selectRows) {
+  for (auto type : kTypes) {
+    auto table = randomMatrix(500, 33);
+    auto quantized = QuantizedMatrix::create(table->getData(), 500, 33, type);
+    IVectorPtr ids = IVector::create(20, false);
+    ids->rand(500);
+    ids->getData()[5] = -1;
+    auto expected = randomMatrix(20, 33);
+    auto actual = expected->clone(0, 0, false);
+    actual->copyFrom(*expected);
+    expected->selectRows(*table, *ids);
+    quantized->selectRows(*actual, *ids);
+    EXPECT_LT(relativeError(*expected, *actual), tolerance(type));
+  }
+}
+
+TEST(QuantizedMatrix, throughput) {
+  const size_t kInputSize = 2048;
+  const size_t kOutputSize = 2048;
+  const int kIterations = 10;
+  auto weight = randomMatrix(kInputSize, kOutputSize);
+  auto int8 = QuantizedMatrix::create(weight->getData(), kInputSize,
+                                      kOutputSize, QUANTIZED_INT8);
+  auto fp16 = QuantizedMatrix::create(weight->getData(), kInputSize,
+                                      kOutputSize, QUANTIZED_FP16);
+  for (size_t batch : {1, 8, 64}) {
+    auto input = randomMatrix(batch, kInputSize);
+    auto output = Matrix::create(batch, kOutputSize, false, false);
+    Timer fp32Timer, int8Timer, fp16Timer;
+    for (int i = 0; i < kIterations; ++i) {
+      fp32Timer.start();
+      output->mul(input, weight, 1, 0);
+      fp32Timer.stop();
+      int8Timer.start();
+      int8->mul(*input, *output, 1, 0);
+      int8Timer.stop();
+      fp16Timer.start();
+      fp16->mul(*input, *output, 1, 0);
+      fp16Timer.stop();
+    }
+    LOG(INFO) << "batch " << batch << ", " << kInputSize << "x" << kOutputSize
+              << " weight: fp32 " << fp32Timer.get() / kIterations
+              << "us, int8 " << int8Timer.get() / kIterations << "us, fp16 "
+              << fp16Timer.get() / kIterations << "us";
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -23,6 +23,7 @@ limitations under the License. */
 #include <functional>
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <malloc.h>
 #include <time.h>
@@ -170,6 +171,68 @@ TEST(SIMDFunction, decayL1_WithoutLR) {
   }
 }
 
+TEST(SIMDFunction, addScaledTo) {
+  // odd length and offset pointers to cover the unaligned tails
+  const size_t len = VECTOR_LEN - 7;
+  auto A = NewRandomVector();
+  auto B = NewRandomVector();
+  auto ACopy = NewVector();
+  memcpy(ACopy.get(), A.get(), VECTOR_LEN * sizeof(float));
+
+  paddle::simd::naive::addScaledTo<float>(A.get() + 1, B.get() + 3, 0.37f,
+                                          len);
+  paddle::simd::addScaledTo<float>(ACopy.get() + 1, B.get() + 3, 0.37f, len);
+
+  for (size_t i = 0; i < VECTOR_LEN; ++i) {
+    ASSERT_NEAR(A[i], ACopy[i], EPSILON);
+  }
+}
+
+TEST(SIMDFunction, int8ToReal) {
+  const size_t len = VECTOR_LEN - 5;
+  std::vector<int8_t> src(VECTOR_LEN);
+  std::uniform_int_distribution<int> dist(-127, 127);
+  for (auto& value : src) value = dist(RandomEngine);
+  auto naiveResult = NewVector();
+  auto simdResult = NewVector();
+
+  paddle::simd::naive::int8ToReal<float>(naiveResult.get(), src.data() + 1,
+                                         0.013f, len);
+  paddle::simd::int8ToReal<float>(simdResult.get(), src.data() + 1, 0.013f,
+                                  len);
+
+  for (size_t i = 0; i < len; ++i) {
+    ASSERT_EQ(naiveResult[i], simdResult[i]);
+  }
+}
+
+TEST(SIMDFunction, argMax) {
+  // few distinct values so that the maximum is repeated
+  std::uniform_int_distribution<int> dist(-20, 20);
+  std::vector<float> data(VECTOR_LEN);
+  for (auto& value : data) value = dist(RandomEngine);
+  for (size_t len : {1UL, 7UL, 16UL, 33UL, VECTOR_LEN}) {
+    for (size_t offset : {0UL, 3UL}) {
+      size_t n = std::min(len, VECTOR_LEN - offset);
+      ASSERT_EQ(paddle::simd::naive::argMax<float>(data.data() + offset, n),
+                paddle::simd::argMax<float>(data.data() + offset, n));
+    }
+  }
+}
+
+TEST(SIMDFunction, findGreater) {
+  auto data = NewRandomVector();
+  for (float threshold : {-200.0f, 0.0f, 90.0f, 99.9f, 200.0f}) {
+    for (size_t offset : {0UL, 5UL}) {
+      size_t len = VECTOR_LEN - offset;
+      ASSERT_EQ(paddle::simd::naive::findGreater<float>(data.get() + offset,
+                                                        len, threshold),
+                paddle::simd::findGreater<float>(data.get() + offset, len,
+                                                 threshold));
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   paddle::initMain(argc, argv);
   testing::InitGoogleTest(&argc, argv);
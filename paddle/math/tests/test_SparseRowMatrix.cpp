@@ -0,0 +1,147 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "paddle/math/SparseRowMatrix.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+P_DECLARE_bool(sparse_row_hash_index);
+
+static const size_t kHeight = 100000;
+static const size_t kNumSamples = 3000;
+
+static IVectorPtr randomIds(size_t numSamples, size_t height) {
+  IVectorPtr ids = IVector::create(numSamples, false);
+  for (size_t i = 0; i < numSamples; ++i) {
+    // a few rows are used several times
+    ids->getData()[i] = rand() % (i % 2 ? height : 100);  // NOLINT
+  }
+  return ids;
+}
+
+static void checkEqual(CpuMatrix& expected, CpuMatrix& actual) {
+  ASSERT_EQ(expected.getElementCnt(), actual.getElementCnt());
+  for (size_t i = 0; i < expected.getElementCnt(); ++i) {
+    EXPECT_NEAR(expected.getData()[i], actual.getData()[i], 1e-5);
+  }
+}
+
+/**
+ * Accumulate several batches of embedding gradients into a sparse row
+ * matrix and add them to a dense matrix, in both index modes and for widths
+ * which are and are not a multiple of the simd vector length.
+ */
+TEST(SparseRowCpuMatrix, autoGrow) {
+  for (bool hashIndex : {false, true}) {
+    FLAGS_sparse_row_hash_index = hashIndex;
+    for (size_t width : {8, 10}) {
+      SparseAutoGrowRowCpuMatrix grad(kHeight, width);
+      for (int batch = 0; batch < 3; ++batch) {
+        grad.zeroMem();
+        EXPECT_EQ(0UL, grad.getLocalIndices().size());
+
+        IVectorPtr ids = randomIds(kNumSamples, kHeight);
+        CpuMatrix input(kNumSamples, width);
+        input.randomizeUniform();
+        input.addToRows(grad, *ids);
+        grad.checkIndices();
+
+        CpuMatrix expected(kHeight, width);
+        expected.zeroMem();
+        input.addToRows(expected, *ids);
+
+        CpuMatrix actual(kHeight, width);
+        actual.zeroMem();
+        const size_t numThreads = 3;
+        std::vector<uint32_t> usedIds;
+        for (size_t tid = 0; tid < numThreads; ++tid) {
+          grad.addTo(actual, usedIds, tid, numThreads);
+        }
+        EXPECT_EQ(grad.getLocalIndices().size(), usedIds.size());
+        checkEqual(expected, actual);
+      }
+    }
+  }
+  FLAGS_sparse_row_hash_index = false;
+}
+
+/**
+ * A gradient which shares the indices of a prefetched value matrix, as
+ * created by Parameter for MAT_SPARSE_ROW.
+ */
+TEST(SparseRowCpuMatrix, sharedIndex) {
+  for (bool hashIndex : {false, true}) {
+    FLAGS_sparse_row_hash_index = hashIndex;
+    const size_t width = 12;
+    SparsePrefetchRowCpuMatrix value(nullptr, kHeight, width);
+    SparseRowCpuMatrix grad(nullptr, kHeight, width,
+                            value.getIndexDictHandle());
+    SparseAutoGrowRowCpuMatrix localGrad(kHeight, width);
+    for (int batch = 0; batch < 2; ++batch) {
+      value.clearIndices();
+      localGrad.zeroMem();
+      IVectorPtr ids = randomIds(kNumSamples, kHeight);
+      CpuMatrix input(kNumSamples, width);
+      input.randomizeUniform();
+      input.addToRows(localGrad, *ids);
+
+      value.addRows(ids);
+      value.setupIndices();
+      value.checkIndices();
+      grad.reserveStore();
+      grad.zeroMemThread(0, 1);
+      localGrad.addTo(grad, 0, 1);
+
+      EXPECT_EQ(localGrad.getLocalIndices().size(),
+                grad.getLocalIndices().size());
+      for (auto id : localGrad.getLocalIndices()) {
+        for (size_t j = 0; j < width; ++j) {
+          EXPECT_NEAR(localGrad.getRow(id)[j], grad.getRow(id)[j], 1e-5);
+        }
+      }
+    }
+  }
+  FLAGS_sparse_row_hash_index = false;
+}
+
+TEST(SparseRowCpuMatrix, hugeHeight) {
+  // the hash index does not allocate anything proportional to the height
+  FLAGS_sparse_row_hash_index = true;
+  const size_t height = 2000000000UL;
+  const size_t width = 4;
+  SparseAutoGrowRowCpuMatrix grad(height, width);
+  for (int batch = 0; batch < 2; ++batch) {
+    grad.zeroMem();
+    for (size_t i = 0; i < 10000; ++i) {
+      size_t row = (i * 199999) % height;
+      real* data = grad.getRow(row);
+      data[0] += row;
+    }
+    EXPECT_EQ(10000UL, grad.getLocalIndices().size());
+    grad.checkIndices();
+    for (auto row : grad.getLocalIndices()) {
+      EXPECT_EQ(static_cast<real>(row), grad.getRow(row)[0]);
+    }
+  }
+  FLAGS_sparse_row_hash_index = false;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
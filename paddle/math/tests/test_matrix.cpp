@@ -508,6 +508,108 @@ TEST(Matrix, SparseMatrixCSCFormatTrimFrom) {
 #endif
 }
 
+void testConvExpandShrink(int imgSize, int channels, int block, int stride,
+                          int padding) {
+  int outSize = (imgSize - block + 2 * padding) / stride + 1;
+  int rows = channels * block * block;
+  int cols = outSize * outSize;
+  MatrixPtr image = Matrix::create(1, channels * imgSize * imgSize, false);
+  image->randomizeUniform();
+
+  // expand into the middle column block of a wider matrix
+  MatrixPtr wide = Matrix::create(rows, 3 * cols, false);
+  wide->zeroMem();
+  MatrixPtr expand = wide->subColMatrix(cols, 2 * cols);
+  expand->convExpand(*image, imgSize, imgSize, channels, block, block, stride,
+                     stride, padding, padding, outSize, outSize);
+
+  // reference: value of the padded image at the receptive field position
+  MatrixPtr shrinkRef = Matrix::create(1, image->getWidth(), false);
+  shrinkRef->zeroMem();
+  real* img = image->getData();
+  real* ref = shrinkRef->getData();
+  for (int c = 0; c < rows; ++c) {
+    int w0 = c % block;
+    int h0 = (c / block) % block;
+    int ch = c / block / block;
+    for (int h = 0; h < outSize; ++h) {
+      for (int w = 0; w < outSize; ++w) {
+        int y = h * stride + h0 - padding;
+        int x = w * stride + w0 - padding;
+        bool inside = y >= 0 && y < imgSize && x >= 0 && x < imgSize;
+        int idx = (ch * imgSize + y) * imgSize + x;
+        real expect = inside ? img[idx] : 0;
+        ASSERT_EQ(expect, expand->getElement(c, h * outSize + w));
+        if (inside) {
+          ref[idx] += expect;
+        }
+      }
+    }
+  }
+  // the columns around the block are untouched
+  for (int c = 0; c < rows; ++c) {
+    for (int w = 0; w < cols; ++w) {
+      ASSERT_EQ(0, wide->getElement(c, w));
+      ASSERT_EQ(0, wide->getElement(c, 2 * cols + w));
+    }
+  }
+
+  MatrixPtr shrink = Matrix::create(1, image->getWidth(), false);
+  shrink->zeroMem();
+  shrink->convShrink(*expand, imgSize, imgSize, channels, block, block, stride,
+                     stride, padding, padding, outSize, outSize, 1.0, 1.0);
+  for (size_t i = 0; i < shrink->getWidth(); ++i) {
+    ASSERT_FLOAT_EQ(ref[i], shrink->getData()[i]);
+  }
+}
+
+TEST(Matrix, convExpandShrink) {
+  for (int stride : {1, 2, 3}) {
+    for (int padding : {0, 1, 2}) {
+      testConvExpandShrink(9, 3, 3, stride, padding);
+      testConvExpandShrink(16, 2, 5, stride, padding);
+    }
+  }
+}
+
+void testRowMax(size_t samples, size_t dim, size_t beam, int numValues) {
+  CpuMatrix src(samples, dim);
+  // numValues > 0 gives many ties
+  for (size_t i = 0; i < samples * dim; ++i) {
+    src.getData()[i] = numValues > 0 ? rand() % numValues  // NOLINT
+                                     : rand() / (real)RAND_MAX;  // NOLINT
+  }
+  CpuMatrix maxVal(samples, beam);
+  CpuIVector maxIds(samples * beam);
+  src.rowMax(maxIds, maxVal);
+
+  for (size_t i = 0; i < samples; ++i) {
+    const real* row = src.getData() + i * dim;
+    std::vector<int> expected(dim);
+    for (size_t j = 0; j < dim; ++j) expected[j] = j;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [row](int x, int y) { return row[x] > row[y]; });
+    for (size_t k = 0; k < beam; ++k) {
+      ASSERT_EQ(expected[k], maxIds.getData()[i * beam + k]);
+      ASSERT_EQ(row[expected[k]], maxVal.getElement(i, k));
+    }
+  }
+}
+
+TEST(Matrix, rowMax) {
+  for (size_t dim : {1, 7, 64, 1000}) {
+    for (size_t beam : {1, 2, 5, 64}) {
+      if (beam > dim) continue;
+      for (int numValues : {0, 3, 100}) {
+        testRowMax(13, dim, beam, numValues);
+      }
+    }
+  }
+  // large enough to be split across MathThreadPool
+  testRowMax(64, 50000, 5, 0);
+  testRowMax(64, 50000, 1, 0);
+}
+
 int main(int argc, char** argv) {
   paddle::initMain(argc, argv);
   testing::InitGoogleTest(&argc, argv);
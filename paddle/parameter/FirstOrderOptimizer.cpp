@@ -24,6 +24,128 @@ P_DEFINE_bool(log_clipping, false, "enable log clipping or not");
 
 namespace paddle {
 
+namespace {
+
+/**
+ * The linear map of (value, mom) of one element over batches without
+ * gradient: {{a, b}, {c, d}} * (value, mom).
+ */
+struct CatchUpMatrix {
+  double a, b, c, d;
+
+  CatchUpMatrix operator*(const CatchUpMatrix& o) const {
+    return {a * o.a + b * o.c, a * o.b + b * o.d,
+            c * o.a + d * o.c, c * o.b + d * o.d};
+  }
+};
+
+/**
+ * One batch is mom = momentum * mom - decay * value, value += mom, so
+ * {{1 - decay, momentum}, {-decay, momentum}}. Raised to the power of
+ * numBatches by squaring.
+ */
+CatchUpMatrix catchUpMatrix(real momentum, double decay, int64_t numBatches) {
+  CatchUpMatrix step = {1 - decay, momentum, -decay, momentum};
+  CatchUpMatrix result = {1, 0, 0, 1};
+  for (; numBatches > 0; numBatches >>= 1) {
+    if (numBatches & 1) {
+      result = result * step;
+    }
+    step = step * step;
+  }
+  return result;
+}
+
+}  // namespace
+
+/**
+ * @brief move the value and the momentum of a sparse row for numBatches
+ * batches in which the row has no gradient, i.e.
+ * mom = momentum * mom - learningRate * decayRate * value, value += mom,
+ * numBatches times, which is what sgdUpdate() does with a zero gradient.
+ *
+ * learningRate is the learning rate of the current batch, the rates of the
+ * skipped batches are assumed to be the same. lrVec is the per-element
+ * learning rate of the adaptive optimizers, or nullptr.
+ */
+static void catchUpMomentum(const VectorPtr vecs[], real momentum,
+                            real learningRate, real decayRate,
+                            const VectorPtr& lrVec, int64_t numBatches) {
+  if (numBatches <= 0) {
+    return;
+  }
+  if (decayRate == 0) {
+    if (momentum == 0) {
+      return;
+    }
+    real decay = std::pow(momentum, numBatches);
+    real scale = momentum == 1 ? numBatches
+                               : momentum * (1 - decay) / (1 - momentum);
+    vecs[PARAMETER_VALUE]->add(*vecs[PARAMETER_MOMENTUM], scale);
+    vecs[PARAMETER_MOMENTUM]->mulScalar(decay);
+    return;
+  }
+
+  /// sparse rows are on cpu
+  CHECK(!vecs[PARAMETER_VALUE]->useGpu());
+  real* value = vecs[PARAMETER_VALUE]->getData();
+  real* mom = vecs[PARAMETER_MOMENTUM]->getData();
+  size_t size = vecs[PARAMETER_VALUE]->getSize();
+  double decay = (double)learningRate * decayRate;
+  CatchUpMatrix m = catchUpMatrix(momentum, decay, numBatches);
+  const real* lr = lrVec ? lrVec->getData() : nullptr;
+  for (size_t i = 0; i < size; ++i) {
+    if (lr) {
+      m = catchUpMatrix(momentum, decay * lr[i], numBatches);
+    }
+    double v = value[i];
+    value[i] = m.a * v + m.b * mom[i];
+    mom[i] = m.c * v + m.d * mom[i];
+  }
+}
+
+void SgdOptimizer::update(const VectorPtr vecs[],
+                          const ParameterConfig& paraConfig,
+                          size_t sparseId) const {
+  real torch_learningRate = optConfig_.learning_method() == "torch_momentum" ?
+                            1.0 - paraConfig.momentum() : 1.0;
+  real learningRate = learningRate_ * paraConfig.learning_rate() *
+                      (firstTime_ ? 1.0 : torch_learningRate);
+  real decayRate = applyDecay_ ? paraConfig.decay_rate() : 0;
+  if (sparseId != -1LU) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      catchUpMomentum(vecs, paraConfig.momentum(), learningRate, decayRate,
+                      nullptr, timer_ - t0Vec_[sparseId]);
+    }
+    t0Vec_[sparseId] = timer_ + 1;
+  }
+  vecs[PARAMETER_VALUE]->sgdUpdate(
+      *vecs[PARAMETER_GRADIENT], *vecs[PARAMETER_MOMENTUM], learningRate,
+      paraConfig.momentum(), decayRate);
+}
+
+ParameterOptimizer::TraverseCallback SgdOptimizer::startCatchUpWith() const {
+  if (t0Vec_.empty() || (momentum_ == 0 && (!applyDecay_ || decayRate_ == 0))) {
+    return nullptr;
+  }
+  return [this](const VectorPtr vecs[], const ParameterConfig& config,
+                size_t sparseId) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      real torch_learningRate =
+          optConfig_.learning_method() == "torch_momentum" ?
+          1.0 - config.momentum() : 1.0;
+      real learningRate = learningRate_ * config.learning_rate() *
+                          (firstTime_ ? 1.0 : torch_learningRate);
+      catchUpMomentum(vecs, config.momentum(), learningRate,
+                      applyDecay_ ? config.decay_rate() : 0, nullptr,
+                      timer_ - t0Vec_[sparseId]);
+      t0Vec_[sparseId] = timer_;
+    }
+  };
+}
+
 SparseMomentumParameterOptimizer::SparseMomentumParameterOptimizer(
     const OptimizationConfig& optConfig)
     : ParameterOptimizer(optConfig) {
@@ -113,6 +235,19 @@ void SparseMomentumParameterOptimizer::finishBatch() {
 void AdagradParameterOptimizer::update(const VectorPtr vecs[],
                                        const ParameterConfig& config,
                                        size_t sparseId) const {
+  if (sparseId != -1LU) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      /// the sums and so the learning rates of the row have not changed
+      /// since its last update
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      numUpdates_ - 1 - t0Vec_[sparseId]);
+    }
+    t0Vec_[sparseId] = numUpdates_;
+  }
   vecs[PARAMETER_GRADIENT_SQURESUM1]->addSquare(*vecs[PARAMETER_GRADIENT],
                                                 1.0f);
   vecs[PARAMETER_LEARNING_RATE]->add(*vecs[PARAMETER_GRADIENT_SQURESUM],
@@ -143,6 +278,25 @@ AdagradParameterOptimizer::needSpecialTraversal(
   }
 }
 
+ParameterOptimizer::TraverseCallback
+AdagradParameterOptimizer::startCatchUpWith() const {
+  if (t0Vec_.empty() || (momentum_ == 0 && (!applyDecay_ || decayRate_ == 0))) {
+    return nullptr;
+  }
+  return [this](const VectorPtr vecs[], const ParameterConfig& config,
+                size_t sparseId) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      numUpdates_ - t0Vec_[sparseId]);
+      t0Vec_[sparseId] = numUpdates_;
+    }
+  };
+}
+
 void AdaDeltaParameterOptimizer::update(const VectorPtr vecs[],
                                         const ParameterConfig& config,
                                         size_t sparseId) const {
@@ -178,6 +332,15 @@ void RMSPropParameterOptimizer::update(const VectorPtr vecs[],
     CHECK_LT(sparseId, t0Vec_.size());
     accumulatedRou = std::pow(rou_, timer_ + 1 - t0Vec_[sparseId]);
     firstTime = t0Vec_[sparseId] == 0;
+    if (!firstTime) {
+      /// the learning rates of the last update of the row stand for the
+      /// ones of the skipped batches
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      timer_ - t0Vec_[sparseId]);
+    }
     t0Vec_[sparseId] = timer_ + 1;
   }
 
@@ -207,6 +370,28 @@ void RMSPropParameterOptimizer::update(const VectorPtr vecs[],
       config.momentum(), applyDecay_ ? config.decay_rate() : 0);
 }
 
+ParameterOptimizer::TraverseCallback
+RMSPropParameterOptimizer::startCatchUpWith() const {
+  if (t0Vec_.empty() || (momentum_ == 0 && (!applyDecay_ || decayRate_ == 0))) {
+    return nullptr;
+  }
+  return [this](const VectorPtr vecs[], const ParameterConfig& config,
+                size_t sparseId) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      real accumulatedRou = std::pow(rou_, timer_ - t0Vec_[sparseId]);
+      vecs[PARAMETER_GRADIENT_SQURESUM]->mulScalar(accumulatedRou);
+      vecs[PARAMETER_GRADIENT_SQURESUM1]->mulScalar(accumulatedRou);
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      timer_ - t0Vec_[sparseId]);
+      t0Vec_[sparseId] = timer_;
+    }
+  };
+}
+
 void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
                                               const ParameterConfig& config,
                                               size_t sparseId) const {
@@ -217,6 +402,15 @@ void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
     CHECK_LT(sparseId, t0Vec_.size());
     accumulatedRou = std::pow(rou_, timer_ + 1 - t0Vec_[sparseId]);
     firstTime = t0Vec_[sparseId] == 0;
+    if (!firstTime) {
+      /// the learning rates of the last update of the row stand for the
+      /// ones of the skipped batches
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      timer_ - t0Vec_[sparseId]);
+    }
     t0Vec_[sparseId] = timer_ + 1;
   }
 
@@ -240,15 +434,46 @@ void DecayedAdagradParameterOptimizer::update(const VectorPtr vecs[],
       config.momentum(), applyDecay_ ? config.decay_rate() : 0);
 }
 
+ParameterOptimizer::TraverseCallback
+DecayedAdagradParameterOptimizer::startCatchUpWith() const {
+  if (t0Vec_.empty() || (momentum_ == 0 && (!applyDecay_ || decayRate_ == 0))) {
+    return nullptr;
+  }
+  return [this](const VectorPtr vecs[], const ParameterConfig& config,
+                size_t sparseId) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    if (t0Vec_[sparseId] > 0) {
+      real accumulatedRou = std::pow(rou_, timer_ - t0Vec_[sparseId]);
+      vecs[PARAMETER_GRADIENT_SQURESUM]->mulScalar(accumulatedRou);
+      catchUpMomentum(vecs, config.momentum(),
+                      learningRate_ * config.learning_rate(),
+                      applyDecay_ ? config.decay_rate() : 0,
+                      vecs[PARAMETER_LEARNING_RATE],
+                      timer_ - t0Vec_[sparseId]);
+      t0Vec_[sparseId] = timer_;
+    }
+  };
+}
+
 void AdamParameterOptimizer::update(const VectorPtr vecs[],
                                     const ParameterConfig& config,
                                     size_t sparseId) const {
-  CHECK(sparseId == -1UL) << "Sparse update is not supported";
   Vector* m = vecs[PARAMETER_MOMENTUM].get();
   Vector* g = vecs[PARAMETER_GRADIENT].get();
   Vector* v = vecs[PARAMETER_SECOND_MOMENTUM].get();
   Vector* theta = vecs[PARAMETER_VALUE].get();
 
+  if (sparseId != -1UL) {
+    CHECK_LT(sparseId, t0Vec_.size());
+    // decay the moments for the steps without gradient for this row.
+    int64_t numSkippedSteps = step_ - 1 - t0Vec_[sparseId];
+    if (t0Vec_[sparseId] > 0 && numSkippedSteps > 0) {
+      m->mulScalar(std::pow(beta1_, numSkippedSteps));
+      v->mulScalar(std::pow(beta2_, numSkippedSteps));
+    }
+    t0Vec_[sparseId] = step_;
+  }
+
   // m_t = \beta_1 * m_{t-1} + (1-\beta_1)* g_t;
   m->add(*g, beta1_, 1 - beta1_);
 
@@ -20,32 +20,50 @@ limitations under the License. */
 
 namespace paddle {
 
-// Plain SGD optimization.
+/**
+ * Plain SGD optimization.
+ *
+ * For sparse update, a row is only updated in the batches which have
+ * gradient for it. The moves of the momentum in the other batches are caught
+ * up with when the row is updated again, or in startCatchUpWith().
+ */
 class SgdOptimizer : public ParameterOptimizer {
 public:
   explicit SgdOptimizer(const OptimizationConfig& optConfig)
-      : ParameterOptimizer(optConfig) {
+      : ParameterOptimizer(optConfig), timer_(0), momentum_(0), decayRate_(0) {
     addParameterType(PARAMETER_MOMENTUM);
   }
 
+  virtual void init(size_t numRows, const ParameterConfig* config) {
+    t0Vec_.assign(numRows, 0);
+    timer_ = 0;
+    momentum_ = config ? config->momentum() : 0;
+    decayRate_ = config ? config->decay_rate() : 0;
+  }
+
   virtual void startBatch(int64_t numSamplesProcessed) {
     learningRate_ = calcLearningRate(numSamplesProcessed, pass_);
   }
   virtual void update(const VectorPtr vecs[], const ParameterConfig& paraConfig,
-                      size_t sparseId) const {
-    (void)sparseId;
-    real torch_learningRate = optConfig_.learning_method() == "torch_momentum" ?
-                              1.0 - paraConfig.momentum() : 1.0;
-    vecs[PARAMETER_VALUE]->sgdUpdate(
-        *vecs[PARAMETER_GRADIENT], *vecs[PARAMETER_MOMENTUM],
-        learningRate_ * paraConfig.learning_rate() *
-        (firstTime_ ? 1.0 : torch_learningRate),
-        paraConfig.momentum(),
-        applyDecay_ ? paraConfig.decay_rate() : 0);
-  }
+                      size_t sparseId) const;
   virtual void finishBatch() {
-        firstTime_ = false;
+    firstTime_ = false;
+    timer_++;
   }
+
+  virtual TraverseCallback startCatchUpWith() const;
+
+protected:
+  /**
+   *  counting batches,
+   *  t(timer_) is current time,
+   *  t0(t0Vec_) are the next batches of the last updates of i rows,
+   *  0 if never updated.
+   */
+  int64_t timer_;
+  mutable std::vector<int64_t> t0Vec_;
+  real momentum_;
+  real decayRate_;
 };
 
 // SGD optimization with sparse support.
@@ -95,11 +113,13 @@ protected:
 /*
  * AdaGrad optimization.
  * http://www.magicbroom.info/Papers/DuchiHaSi10.pdf
+ *
+ * Sparse rows are lazily updated as in SgdOptimizer.
  */
 class AdagradParameterOptimizer : public ParameterOptimizer {
 public:
   explicit AdagradParameterOptimizer(const OptimizationConfig& optConfig)
-      : ParameterOptimizer(optConfig) {
+      : ParameterOptimizer(optConfig), momentum_(0), decayRate_(0) {
     addParameterType(PARAMETER_MOMENTUM);
     addParameterType(PARAMETER_GRADIENT_SQURESUM);
     addParameterType(PARAMETER_GRADIENT_SQURESUM1);
@@ -107,6 +127,12 @@ public:
     numUpdates_ = 0;
   }
 
+  virtual void init(size_t numRows, const ParameterConfig* config) {
+    t0Vec_.assign(numRows, 0);
+    momentum_ = config ? config->momentum() : 0;
+    decayRate_ = config ? config->decay_rate() : 0;
+  }
+
   virtual void startBatch(int64_t numSamplesProcessed) {
     (void)numSamplesProcessed;
     ++numUpdates_;
@@ -115,10 +141,16 @@ public:
                       size_t sparseId) const;
   virtual TraverseCallback needSpecialTraversal(
       const ParameterConfig& config) const;
+  virtual TraverseCallback startCatchUpWith() const;
 
 protected:
   int64_t numUpdates_;
   static const int64_t kMaxNumAccumulates = 16384;
+
+  real momentum_;
+  real decayRate_;
+  /// t0(t0Vec_) are the batches of the last updates of i rows.
+  mutable std::vector<int64_t> t0Vec_;
 };
 
 /*
@@ -150,10 +182,11 @@ protected:
 };
 
 // RMSProp Parameter Optimization.
+// Sparse rows are lazily updated as in SgdOptimizer.
 class RMSPropParameterOptimizer : public ParameterOptimizer {
 public:
   explicit RMSPropParameterOptimizer(const OptimizationConfig& optConfig)
-      : ParameterOptimizer(optConfig) {
+      : ParameterOptimizer(optConfig), momentum_(0), decayRate_(0) {
     addParameterType(PARAMETER_MOMENTUM);
     addParameterType(PARAMETER_GRADIENT_SQURESUM1);
     addParameterType(PARAMETER_GRADIENT_SQURESUM);
@@ -166,6 +199,8 @@ public:
     t0Vec_.resize(numRows);
     t0Vec_.assign(t0Vec_.size(), 0);
     timer_ = 0;
+    momentum_ = config ? config->momentum() : 0;
+    decayRate_ = config ? config->decay_rate() : 0;
   }
 
   virtual void startBatch(int64_t numSamplesProcessed) {
@@ -176,12 +211,16 @@ public:
   virtual void update(const VectorPtr vecs[], const ParameterConfig& config,
                       size_t sparseId) const;
 
+  virtual TraverseCallback startCatchUpWith() const;
+
 protected:
   real rou_;
   real epsilon_;
+  real momentum_;
+  real decayRate_;
 
   /**
-   *  counting batches, donot need catch up with
+   *  counting batches,
    *  t(timer_) is current time,
    *  t0(t0Vec_) are last occur time of i rows.
    *  if one block is update by multi threads,
@@ -192,10 +231,11 @@ protected:
 };
 
 // Decayed AdaGrad Optimization.
+// Sparse rows are lazily updated as in SgdOptimizer.
 class DecayedAdagradParameterOptimizer : public ParameterOptimizer {
 public:
   explicit DecayedAdagradParameterOptimizer(const OptimizationConfig& optConfig)
-      : ParameterOptimizer(optConfig) {
+      : ParameterOptimizer(optConfig), momentum_(0), decayRate_(0) {
     addParameterType(PARAMETER_MOMENTUM);
     addParameterType(PARAMETER_GRADIENT_SQURESUM);
     addParameterType(PARAMETER_LEARNING_RATE);
@@ -207,6 +247,8 @@ public:
     t0Vec_.resize(numRows);
     t0Vec_.assign(t0Vec_.size(), 0);
     timer_ = 0;
+    momentum_ = config ? config->momentum() : 0;
+    decayRate_ = config ? config->decay_rate() : 0;
   }
 
   virtual void startBatch(int64_t numSamplesProcessed) {
@@ -217,12 +259,16 @@ public:
   virtual void update(const VectorPtr vecs[], const ParameterConfig& config,
                       size_t sparseId) const;
 
+  virtual TraverseCallback startCatchUpWith() const;
+
 protected:
   real rou_;
   real epsilon_;
+  real momentum_;
+  real decayRate_;
 
   /**
-   *  counting batches, donot need catch up with
+   *  counting batches,
    *  t(timer_) is current time,
    *  t0(t0Vec_) are last occur time of i rows.
    *  if one block is update by multi threads,
@@ -235,6 +281,10 @@ protected:
 /**
  * Adam Optimizer.
  * Reference Paper: http://arxiv.org/abs/1412.6980 Algorithm 1
+ *
+ * For sparse update, a row is only updated in the steps which have gradient
+ * for it, after its moments are decayed for the steps skipped. Unlike the
+ * dense update, the value does not move in the steps skipped.
  */
 class AdamParameterOptimizer : public ParameterOptimizer {
 public:
@@ -249,6 +299,10 @@ public:
     addParameterType(PARAMETER_SECOND_MOMENTUM);
   }
 
+  virtual void init(size_t numRows, const ParameterConfig* config) {
+    t0Vec_.assign(numRows, 0);
+  }
+
   virtual void finishBatch() { ++step_; }
 
   virtual void update(const VectorPtr vecs[], const ParameterConfig& config,
@@ -260,6 +314,8 @@ protected:
   real epsilon_;
   int64_t step_;
   real learningRate_;
+  /// t0(t0Vec_) are the steps of the last updates of i rows.
+  mutable std::vector<int64_t> t0Vec_;
 };
 
 /**
@@ -347,6 +403,11 @@ public:
   virtual void update(const VectorPtr vecs[], const ParameterConfig& config,
                       size_t sparseId) const;
 
+  virtual TraverseCallback startCatchUpWith() const {
+    return optimizer_->startCatchUpWith();
+  }
+  virtual void finishCatchUpWith() { optimizer_->finishCatchUpWith(); }
+
   virtual void setNoDecay() { optimizer_->setNoDecay(); }
 
 protected:
@@ -0,0 +1,212 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "MappedModel.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <streambuf>
+
+#include "paddle/math/MemoryHandle.h"
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+const char MappedModel::kMagic[8] = {'P', 'D', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t MappedModel::kVersion;
+const size_t MappedModel::kAlignment;
+
+namespace {
+
+/**
+ * Cpu memory inside a MappedModel. Keeps the mapping alive as long as a
+ * vector or matrix refers to it.
+ */
+class MappedMemoryHandle : public CpuMemoryHandle {
+public:
+  MappedMemoryHandle(const MappedModelPtr& model, void* buf, size_t size)
+      : CpuMemoryHandle(buf, size), model_(model) {}
+
+private:
+  MappedModelPtr model_;
+};
+
+/// Read-only std::streambuf over a block of memory.
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(char* begin, size_t size) {
+    setg(begin, begin, begin + size);
+  }
+};
+
+}  // namespace
+
+void MappedModel::write(const std::string& filename, const std::string& config,
+                        const std::vector<ParameterPtr>& parameters,
+                        QuantizedType quantizedType) {
+  std::ofstream os(filename, std::ios_base::binary);
+  CHECK(os) << "Fail to open " << filename;
+
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.alignment = kAlignment;
+  header.numParameters = parameters.size();
+  header.configOffset =
+      sizeof(FileHeader) + parameters.size() * sizeof(DirectoryEntry);
+  header.configSize = config.size();
+  std::vector<DirectoryEntry> directory(parameters.size());
+
+  os.write(reinterpret_cast<char*>(&header), sizeof(header));
+  // the directory is rewritten once all the offsets are known
+  os.write(reinterpret_cast<char*>(directory.data()),
+           directory.size() * sizeof(DirectoryEntry));
+  os.write(config.data(), config.size());
+  CHECK(os) << "Fail to write to " << filename;
+
+  std::vector<char> padding(kAlignment, 0);
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    CHECK_EQ(parameters[i]->getID(), i);
+    size_t pos = os.tellp();
+    size_t valueOffset =
+        (pos + sizeof(Parameter::Header) + kAlignment - 1) / kAlignment *
+        kAlignment;
+    directory[i].offset = valueOffset - sizeof(Parameter::Header);
+    os.write(padding.data(), directory[i].offset - pos);
+    parameters[i]->save(os, quantizedType);
+    CHECK(os) << "Fail to write to " << filename;
+    directory[i].size = (size_t)os.tellp() - directory[i].offset;
+  }
+
+  os.seekp(sizeof(FileHeader));
+  os.write(reinterpret_cast<char*>(directory.data()),
+           directory.size() * sizeof(DirectoryEntry));
+  CHECK(os) << "Fail to write to " << filename;
+}
+
+bool MappedModel::isMappedModel(const std::string& filename) {
+  std::ifstream is(filename, std::ios_base::binary);
+  char magic[sizeof(kMagic)];
+  return is.read(magic, sizeof(magic)) &&
+         memcmp(magic, kMagic, sizeof(magic)) == 0;
+}
+
+MappedModel::MappedModel(const std::string& filename)
+    : filename_(filename), data_(nullptr), size_(0), header_(nullptr) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Fail to open " << filename;
+  struct stat st;
+  PCHECK(fstat(fd, &st) == 0) << "Fail to stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(FileHeader)) << "Truncated model file " << filename;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  PCHECK(data != MAP_FAILED) << "Fail to mmap " << filename;
+  data_ = reinterpret_cast<char*>(data);
+
+  header_ = reinterpret_cast<const FileHeader*>(data_);
+  CHECK_EQ(0, memcmp(header_->magic, kMagic, sizeof(kMagic)))
+      << filename << " is not a mapped model file";
+  CHECK_EQ(header_->version, kVersion)
+      << "Incorrect format version: " << header_->version;
+  CHECK_LE(header_->configOffset + header_->configSize, size_)
+      << "Truncated model file " << filename;
+  CHECK_LE(sizeof(FileHeader) +
+               header_->numParameters * sizeof(DirectoryEntry),
+           header_->configOffset);
+
+  auto entries = reinterpret_cast<const DirectoryEntry*>(header_ + 1);
+  directory_.assign(entries, entries + header_->numParameters);
+  for (auto& entry : directory_) {
+    CHECK_LE(entry.offset + entry.size, size_)
+        << "Truncated model file " << filename;
+    CHECK_GE(entry.size, sizeof(Parameter::Header));
+  }
+}
+
+MappedModel::~MappedModel() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+std::string MappedModel::getConfig() const {
+  return std::string(data_ + header_->configOffset, header_->configSize);
+}
+
+const Parameter::Header& MappedModel::getHeader(size_t paraId) const {
+  CHECK_LT(paraId, directory_.size())
+      << "No parameter " << paraId << " in " << filename_;
+  return *reinterpret_cast<const Parameter::Header*>(data_ +
+                                                     directory_[paraId].offset);
+}
+
+bool MappedModel::bindParameter(Parameter* para) {
+  const Parameter::Header& header = getHeader(para->getID());
+  if (para->useGpu() || para->getConfig().is_sparse() ||
+      para->getBuf(PARAMETER_VALUE) ||
+      header.version != Parameter::kFormatVersion ||
+      header.size != para->getSize()) {
+    return false;
+  }
+  void* values = const_cast<char*>(reinterpret_cast<const char*>(&header + 1));
+  if ((header.valueSize == QUANTIZED_INT8 ||
+       header.valueSize == QUANTIZED_FP16) &&
+      para->canQuantize()) {
+    auto type = static_cast<QuantizedType>(header.valueSize);
+    size_t height = para->getConfig().dims(0);
+    size_t width = para->getConfig().dims(1);
+    size_t bytes = QuantizedMatrix::getMemorySize(height, width, type);
+    CHECK_LE(sizeof(header) + bytes, directory_[para->getID()].size);
+    auto handle =
+        std::make_shared<MappedMemoryHandle>(shared_from_this(), values, bytes);
+    para->enableType(PARAMETER_VALUE);
+    para->setQuantizedValue(
+        std::make_shared<QuantizedMatrix>(height, width, type, handle));
+    return true;
+  }
+  if (header.valueSize != sizeof(real)) {
+    return false;
+  }
+  size_t bytes = header.size * sizeof(real);
+  CHECK_LE(sizeof(header) + bytes, directory_[para->getID()].size);
+  if (bytes == 0) {
+    return false;
+  }
+
+  auto handle =
+      std::make_shared<MappedMemoryHandle>(shared_from_this(), values, bytes);
+  VectorPtr vec = Vector::create(header.size, handle);
+  if (para->getConfig().dims_size() == 2) {
+    para->enableSharedType(PARAMETER_VALUE, vec, Parameter::MAT_NORMAL);
+  } else {
+    para->enableSharedType(PARAMETER_VALUE, vec);
+  }
+  return true;
+}
+
+void MappedModel::loadParameter(Parameter* para) {
+  CHECK_LT(para->getID(), directory_.size())
+      << "No parameter " << para->getID() << " in " << filename_;
+  const DirectoryEntry& entry = directory_[para->getID()];
+  MemoryStreamBuf buf(data_ + entry.offset, entry.size);
+  std::istream is(&buf);
+  para->load(is);
+}
+
+}  // namespace paddle
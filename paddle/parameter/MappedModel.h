@@ -0,0 +1,118 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "paddle/parameter/Parameter.h"
+
+namespace paddle {
+
+/**
+ * @brief A merged model file that can be memory-mapped.
+ *
+ * The file contains the serialized TrainerConfig followed by every
+ * parameter written by Parameter::save(). Each parameter is padded so that
+ * its values start on a page boundary, and a directory at the head of the
+ * file gives the offset of every parameter:
+ *
+ * @code
+ * | FileHeader | DirectoryEntry * numParameters | config | pad |
+ * | Parameter::Header | values (page aligned) | rows/cols if sparse | pad |
+ * | ...
+ * @endcode
+ *
+ * The loader maps the whole file read-only. Dense cpu parameters are bound
+ * to the mapping without any copy, so several processes serving the same
+ * model share one physical copy of the weights through the page cache.
+ * Quantized cpu parameters are bound the same way. Bound values must never
+ * be written.
+ */
+class MappedModel : public std::enable_shared_from_this<MappedModel> {
+public:
+  static const char kMagic[8];
+  static const uint32_t kVersion = 0;
+  static const size_t kAlignment = 4096;
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    uint64_t numParameters;
+    uint64_t configOffset;
+    uint64_t configSize;
+  };
+
+  struct DirectoryEntry {
+    uint64_t offset;  // offset of the Parameter::Header
+    uint64_t size;    // number of bytes written by Parameter::save()
+  };
+
+  /**
+   * Write config and parameters to filename in the mapped format.
+   * The parameters are saved with Parameter::save(os, quantizedType).
+   */
+  static void write(const std::string& filename, const std::string& config,
+                    const std::vector<ParameterPtr>& parameters,
+                    QuantizedType quantizedType = QUANTIZED_NONE);
+
+  /**
+   * Whether filename starts with the magic of the mapped format.
+   */
+  static bool isMappedModel(const std::string& filename);
+
+  /**
+   * Map filename read-only. Use std::make_shared, the memory handles of
+   * the bound parameters keep the mapping alive.
+   */
+  explicit MappedModel(const std::string& filename);
+
+  ~MappedModel();
+
+  /// The serialized TrainerConfig.
+  std::string getConfig() const;
+
+  size_t getNumParameters() const { return directory_.size(); }
+
+  /**
+   * Bind PARAMETER_VALUE of para directly to the mapped values.
+   *
+   * Only dense cpu parameters whose value buffer is not enabled yet can be
+   * bound. Returns false (and does nothing) otherwise. A quantized value is
+   * bound as the quantized value of para, see Parameter::setQuantizedValue().
+   */
+  bool bindParameter(Parameter* para);
+
+  /**
+   * Copy the values of para out of the mapping like Parameter::load().
+   */
+  void loadParameter(Parameter* para);
+
+private:
+  const Parameter::Header& getHeader(size_t paraId) const;
+
+  std::string filename_;
+  char* data_;
+  size_t size_;
+  const FileHeader* header_;
+  std::vector<DirectoryEntry> directory_;
+};
+
+typedef std::shared_ptr<MappedModel> MappedModelPtr;
+
+}  // namespace paddle
@@ -161,6 +161,11 @@ ParameterOptimizer* OptimizerWithRegularizer::create(
                                                        regularizer);
   }
   if (isParameterSparse) {
+    if (paraConfig.momentum() != 0.0f && paraConfig.decay_rate_l1() == 0.0f) {
+      // the optimizer decays the sparse rows itself, and catches up the
+      // decay of the batches without gradient together with the momentum
+      return optimizer;
+    }
       CHECK(paraConfig.momentum() == 0.0f)
           << "Parameter cannot support momentum if it's sparse.";
     optimizer->setNoDecay();
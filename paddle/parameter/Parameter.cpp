@@ -13,6 +13,8 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 
+#include <sys/mman.h>
+#include <unistd.h>
 #include <fstream>
 #include "paddle/math/MathUtils.h"
 #include "AverageOptimizer.h"
@@ -44,6 +46,8 @@ Parameter::Parameter(const ParameterConfig& config, bool useGpu, bool doInit)
     : config_(config),
       useGpu_(useGpu),
       deviceId_(-1),
+      quantizedValue_(std::make_shared<QuantizedValue>()),
+      quantizedOnly_(false),
       sharedCount_(0),
       updateCounter_(0),
       updated_(false) {
@@ -306,8 +310,16 @@ bool Parameter::save(const std::string& filename) const {
   return save(fs);
 }
 
-bool Parameter::save(std::ostream& s) const {
-  CpuVector vec(*bufs_[PARAMETER_VALUE].get());
+bool Parameter::save(std::ostream& s, QuantizedType quantizedType) const {
+  CpuVectorPtr value;
+  if (isValueReleased()) {
+    // writing into PARAMETER_VALUE would bring back its released pages
+    value = std::make_shared<CpuVector>(getSize());
+    quantizedValue_->matrix->dequantize(value->getData());
+  } else {
+    value = std::make_shared<CpuVector>(*bufs_[PARAMETER_VALUE].get());
+  }
+  CpuVector& vec = *value;
   Header header;
   header.version = kFormatVersion;
   header.valueSize = sizeof(real);
@@ -315,6 +327,19 @@ bool Parameter::save(std::ostream& s) const {
 
   CHECK_EQ(header.size, vec.getSize());
 
+  if (quantizedType != QUANTIZED_NONE && canQuantize()) {
+    auto quantized = QuantizedMatrix::create(vec.getData(), config_.dims(0),
+                                             config_.dims(1), quantizedType);
+    header.valueSize = quantizedType;
+    CHECK(s.write(reinterpret_cast<char*>(&header), sizeof(header)))
+        << "Fail to write parameter " << getName();
+    auto& memory = quantized->getMemory();
+    CHECK(s.write(reinterpret_cast<char*>(memory->getBuf()),
+                  memory->getSize()))
+        << "Fail to write parameter " << getName();
+    return true;
+  }
+
   CHECK(s.write(reinterpret_cast<char*>(&header), sizeof(header)))
       << "Fail to write parameter " << getName();
 
@@ -377,8 +402,22 @@ bool Parameter::load(std::istream& s) {
   CHECK_EQ(header.size, getSize())
       << "The size (" << header.size << ") in the file does not match the size "
       << "(" << getSize() << ") of the parameter: " << getName();
+  if (header.valueSize == QUANTIZED_INT8 ||
+      header.valueSize == QUANTIZED_FP16) {
+    CHECK(canQuantize()) << "Parameter " << getName()
+                         << " can not be quantized";
+    auto quantized = std::make_shared<QuantizedMatrix>(
+        config_.dims(0), config_.dims(1), (QuantizedType)header.valueSize);
+    auto& memory = quantized->getMemory();
+    CHECK(s.read(reinterpret_cast<char*>(memory->getBuf()),
+                 memory->getSize()));
+    setQuantizedValue(quantized);
+    return true;
+  }
   CHECK_EQ(header.valueSize, sizeof(real))
       << "Unsupported valueSize " << header.valueSize << " at: " << getName();
+  quantizedValue_->matrix.reset();
+  quantizedValue_->valueReleased = false;
   CHECK(s.read(reinterpret_cast<char*>(vec.getData()),
                header.size * sizeof(real)));
 
@@ -438,6 +477,42 @@ bool Parameter::load(std::istream& s) {
   return true;
 }
 
+// Return the whole pages of [buf, buf + size) to the system. They read as
+// zeros afterwards, and take memory again only once they are written.
+static void releasePages(void* buf, size_t size) {
+  uintptr_t pageSize = getpagesize();
+  uintptr_t begin = (reinterpret_cast<uintptr_t>(buf) + pageSize - 1) &
+                    ~(pageSize - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(buf) + size) & ~(pageSize - 1);
+  if (begin < end) {
+    PCHECK(madvise(reinterpret_cast<void*>(begin), end - begin,
+                   MADV_DONTNEED) == 0);
+  }
+}
+
+void Parameter::setQuantizedValue(const QuantizedMatrixPtr& quantized) {
+  CHECK(canQuantize()) << "Parameter " << getName() << " can not be quantized";
+  CHECK_EQ(quantized->getHeight(), config_.dims(0));
+  CHECK_EQ(quantized->getWidth(), config_.dims(1));
+  quantizedValue_->matrix = useGpu_ ? nullptr : quantized;
+  // the layers may still compute on the value of a static parameter in
+  // PASS_TRAIN, so only the value of a network which is never trained is
+  // released
+  quantizedValue_->valueReleased = quantizedOnly_ && !useGpu_ &&
+                                   !bufs_[PARAMETER_GRADIENT] && !isStatic();
+  if (quantizedValue_->valueReleased) {
+    releasePages(bufs_[PARAMETER_VALUE]->getData(), getSize() * sizeof(real));
+  } else {
+    CpuVector vec(*bufs_[PARAMETER_VALUE].get());
+    quantized->dequantize(vec.getData());
+    auto& tmp = *bufs_[PARAMETER_VALUE].get();
+    if (typeid(tmp) == typeid(GpuVector)) {
+      bufs_[PARAMETER_VALUE]->copyFrom(vec);
+    }
+  }
+  setValueUpdated();
+}
+
 ThreadLocal<std::vector<VectorPtr>> Parameter::tlsTempBufs_;
 
 VectorPtr* Parameter::getTlsTempBufs() {
@@ -28,6 +28,7 @@ limitations under the License. */
 #include "paddle/utils/TypeDefs.h"
 #include "paddle/math/Vector.h"
 #include "paddle/math/Matrix.h"
+#include "paddle/math/QuantizedMatrix.h"
 #include "paddle/utils/Util.h"
 #include "paddle/utils/ThreadLocal.h"
 #include "ParameterUpdaterHook.h"
@@ -170,6 +171,17 @@ public:
     }
   }
 
+  /**
+   * Share the value of src, and the quantized value it was loaded from, to
+   * compute PASS_TEST with the parameters of another network, see
+   * NeuralNetwork::createInferenceReplica().
+   */
+  void shareValue(const Parameter& src) {
+    enableSharedType(PARAMETER_VALUE, src.getBuf(PARAMETER_VALUE),
+                     src.getMat(PARAMETER_VALUE));
+    quantizedValue_ = src.quantizedValue_;
+  }
+
   /// for batchGradientMachine: blockNum is number of partitions of the matrix.
   bool isGradShared(size_t* blockNum = NULL);
 
@@ -245,8 +257,20 @@ public:
 
   /**
    * Save parameter to ostream
+   *
+   * If quantizedType is not QUANTIZED_NONE and the parameter can be
+   * quantized (see canQuantize()), the value is saved in that format:
+   * Header::valueSize is the QuantizedType, followed by the scale of every
+   * row (QUANTIZED_INT8 only, float) and the quantized elements.
    */
-  bool save(std::ostream& s) const;
+  bool save(std::ostream& s,
+            QuantizedType quantizedType = QUANTIZED_NONE) const;
+
+  /// Only dense matrices (and not row vectors like biases) are quantized.
+  bool canQuantize() const {
+    return config_.dims_size() == 2 && !config_.is_sparse() &&
+           config_.dims(0) > 1;
+  }
 
   /**
    * Load parameter value from a file
@@ -255,9 +279,45 @@ public:
 
   /**
    * Load parameter from istream
+   *
+   * A quantized value is set by setQuantizedValue().
    */
   bool load(std::istream& is);
 
+  /**
+   * The quantized value this parameter was loaded from, used by the cpu
+   * layers to compute PASS_TEST directly on the quantized weights.
+   *
+   * It is not updated with the value, so it is null for parameters that
+   * can be trained, i.e. that have a gradient buffer.
+   */
+  QuantizedMatrixPtr getQuantizedValue() const {
+    return bufs_[PARAMETER_GRADIENT] ? nullptr : quantizedValue_->matrix;
+  }
+
+  /**
+   * Set the value to quantized.
+   *
+   * It is dequantized into PARAMETER_VALUE, and on cpu it is kept as well.
+   * If the parameter is quantized only and can not be trained, only the
+   * quantized value is kept: the memory of PARAMETER_VALUE is returned to
+   * the system, see isValueReleased().
+   */
+  void setQuantizedValue(const QuantizedMatrixPtr& quantized);
+
+  /**
+   * Set by NeuralNetwork::init() if all the layers reading this parameter
+   * can compute on its quantized value.
+   */
+  void setQuantizedOnly(bool quantizedOnly) { quantizedOnly_ = quantizedOnly; }
+
+  /**
+   * Whether PARAMETER_VALUE was released by setQuantizedValue(). Its memory
+   * must not be read then, the layers compute on getQuantizedValue() in
+   * every pass.
+   */
+  bool isValueReleased() const { return quantizedValue_->valueReleased; }
+
   std::vector<Segment>& getGradientSegments() { return gradSegments_; }
 
   void incShared() { sharedCount_++; }
@@ -364,6 +424,17 @@ protected:
   /// Int vectors, used in some User defined parameter types
   IVectorPtr intBufs_[NUM_PARAMETER_TYPES];
 
+  struct QuantizedValue {
+    QuantizedValue() : valueReleased(false) {}
+    /// the quantized value loaded from a file, see getQuantizedValue()
+    QuantizedMatrixPtr matrix;
+    /// see isValueReleased()
+    bool valueReleased;
+  };
+  /// shared with the parameters sharing the value, see shareValue()
+  std::shared_ptr<QuantizedValue> quantizedValue_;
+  bool quantizedOnly_;
+
   int sharedCount_;
   int updateCounter_;
   std::vector<Segment> gradSegments_;  // segments of non-zero gradient
@@ -0,0 +1,207 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+
+#include <cmath>
+#include <memory>
+
+#include <gtest/gtest.h>
+#include <paddle/utils/Util.h>
+#include <paddle/parameter/OptimizerFunctions.h>
+#include <paddle/parameter/Parameter.h>
+
+using namespace paddle;  // NOLINT
+
+const size_t kNumRows = 8;
+const size_t kWidth = 4;
+const int kNumBatches = 20;
+
+/// all rows have gradient in the first batch, then some of them.
+static bool hasGradient(int batch, size_t row) {
+  return batch == 0 || (batch * 3 + row) % 5 == 0 || row == 0;
+}
+
+static real gradient(int batch, size_t row, size_t col) {
+  return std::sin(batch * 7 + row * 3 + col);
+}
+
+class SparseOptimizerTester {
+public:
+  SparseOptimizerTester(const std::string& method, real momentum,
+                        bool isSparse, real decayRate = 0)
+      : isSparse_(isSparse) {
+    optConfig_.set_learning_method(method);
+    optConfig_.set_learning_rate(0.1);
+    paraConfig_.set_name("test");
+    paraConfig_.set_size(kNumRows * kWidth);
+    paraConfig_.add_dims(kNumRows);
+    paraConfig_.add_dims(kWidth);
+    paraConfig_.set_momentum(momentum);
+    paraConfig_.set_decay_rate(decayRate);
+    optimizer_.reset(sgdOptimizerCreate(optConfig_, paraConfig_, isSparse,
+                                        false /*inPserver*/));
+    optimizer_->init(isSparse ? kNumRows : 0, &paraConfig_);
+    for (size_t type = 0; type < NUM_PARAMETER_TYPES; ++type) {
+      bufs_[type] = std::make_shared<CpuVector>(kNumRows * kWidth);
+      bufs_[type]->zeroMem();
+    }
+    for (size_t i = 0; i < kNumRows * kWidth; ++i) {
+      bufs_[PARAMETER_VALUE]->getData()[i] = std::cos(i);
+    }
+  }
+
+  /**
+   * The dense optimizer updates all the rows, with zero gradient for the
+   * rows which have no gradient, while the sparse one only updates the rows
+   * which have gradient.
+   */
+  void runBatch(int batch) {
+    optimizer_->startBatch(batch + 1);
+    real* grad = bufs_[PARAMETER_GRADIENT]->getData();
+    for (size_t row = 0; row < kNumRows; ++row) {
+      for (size_t col = 0; col < kWidth; ++col) {
+        grad[row * kWidth + col] =
+            hasGradient(batch, row) ? gradient(batch, row, col) : 0;
+      }
+    }
+    VectorPtr* vecs = Parameter::getTlsTempBufs();
+    if (isSparse_) {
+      for (size_t row = 0; row < kNumRows; ++row) {
+        if (!hasGradient(batch, row)) continue;
+        setupRow(vecs, row);
+        optimizer_->update(vecs, paraConfig_, row);
+      }
+    } else {
+      optimizer_->update(bufs_, paraConfig_, -1LU);
+    }
+    if (auto callback = optimizer_->needSpecialTraversal(paraConfig_)) {
+      traverse(callback);
+    }
+    optimizer_->finishBatch();
+  }
+
+  void catchUp() {
+    if (auto callback = optimizer_->startCatchUpWith()) {
+      traverse(callback);
+      optimizer_->finishCatchUpWith();
+    }
+  }
+
+  const real* getBuf(ParameterType type) const {
+    return bufs_[type]->getData();
+  }
+
+private:
+  void setupRow(VectorPtr* vecs, size_t row) {
+    for (auto type : optimizer_->getParameterTypes()) {
+      vecs[type]->subVecFrom(*bufs_[type], row * kWidth, kWidth);
+    }
+  }
+
+  void traverse(const ParameterOptimizer::TraverseCallback& callback) {
+    if (isSparse_) {
+      VectorPtr* vecs = Parameter::getTlsTempBufs();
+      for (size_t row = 0; row < kNumRows; ++row) {
+        setupRow(vecs, row);
+        callback(vecs, paraConfig_, row);
+      }
+    } else {
+      callback(bufs_, paraConfig_, -1LU);
+    }
+  }
+
+  bool isSparse_;
+  OptimizationConfig optConfig_;
+  ParameterConfig paraConfig_;
+  std::unique_ptr<ParameterOptimizer> optimizer_;
+  VectorPtr bufs_[NUM_PARAMETER_TYPES];
+};
+
+/**
+ * The lazy sparse update should give the same values as the dense update
+ * once caught up. Without momentum, the decay of a sparse parameter is
+ * caught up by OptimizerWithRegularizerSparse, which only approximates it,
+ * so decayRate is only tested with momentum.
+ */
+void testLazyUpdate(const std::string& method, real decayRate = 0) {
+  for (real momentum : {0.0, 0.9}) {
+    if (decayRate != 0 && momentum == 0) continue;
+    SparseOptimizerTester dense(method, momentum, false, decayRate);
+    SparseOptimizerTester sparse(method, momentum, true, decayRate);
+    for (int batch = 0; batch < kNumBatches; ++batch) {
+      dense.runBatch(batch);
+      sparse.runBatch(batch);
+    }
+    dense.catchUp();
+    sparse.catchUp();
+    for (auto type : {PARAMETER_VALUE, PARAMETER_MOMENTUM}) {
+      // without momentum, the buffer only keeps the step of the last update
+      if (type == PARAMETER_MOMENTUM && momentum == 0) continue;
+      for (size_t i = 0; i < kNumRows * kWidth; ++i) {
+        EXPECT_NEAR(dense.getBuf(type)[i], sparse.getBuf(type)[i], 1e-5)
+            << method << " momentum=" << momentum << " decay=" << decayRate
+            << " type=" << type << " i=" << i;
+      }
+    }
+  }
+}
+
+TEST(SparseOptimizer, momentum) {
+  testLazyUpdate("momentum");
+  testLazyUpdate("momentum", 0.05);
+}
+
+/**
+ * The learning rates of Adagrad do not change without gradient, so the
+ * decay of the skipped batches is caught up exactly. For RMSProp and
+ * DecayedAdagrad the catch-up uses the learning rates of the last update.
+ */
+TEST(SparseOptimizer, adagrad) {
+  testLazyUpdate("adagrad");
+  testLazyUpdate("adagrad", 0.05);
+}
+
+TEST(SparseOptimizer, rmsprop) { testLazyUpdate("rmsprop"); }
+
+TEST(SparseOptimizer, decayedAdagrad) { testLazyUpdate("decayed_adagrad"); }
+
+/**
+ * The sparse Adam does not move the value of the rows without gradient, but
+ * their moments are decayed before the next update.
+ */
+TEST(SparseOptimizer, adam) {
+  SparseOptimizerTester dense("adam", 0, false);
+  SparseOptimizerTester sparse("adam", 0, true);
+  for (int batch = 0; batch < kNumBatches; ++batch) {
+    dense.runBatch(batch);
+    sparse.runBatch(batch);
+  }
+  int lastBatch = kNumBatches - 1;
+  for (size_t row = 0; row < kNumRows; ++row) {
+    if (!hasGradient(lastBatch, row)) continue;
+    for (auto type : {PARAMETER_MOMENTUM, PARAMETER_SECOND_MOMENTUM}) {
+      for (size_t col = 0; col < kWidth; ++col) {
+        size_t i = row * kWidth + col;
+        EXPECT_NEAR(dense.getBuf(type)[i], sparse.getBuf(type)[i], 1e-5)
+            << " type=" << type << " i=" << i;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  paddle::initMain(argc, argv);
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
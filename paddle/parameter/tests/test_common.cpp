@@ -147,6 +147,32 @@ TEST_F(CommonTest, sgdUpdate) {
   testStat_.printAllStatus();
 }
 
+TEST_F(CommonTest, statPercentiles) {
+  StatPtr stat = testStat_.getStat("percentiles");
+  EXPECT_EQ(std::vector<uint64_t>({0}), stat->getPercentiles({0.5}));
+
+  // samples of two threads: 1, 2, ..., 10000
+  SyncThreadPool pool(2);
+  pool.exec([&](int tid, size_t numThreads) {
+    for (uint64_t i = tid + 1; i <= 10000; i += numThreads) {
+      stat->addSample(i);
+    }
+  });
+  std::vector<double> ratios = {0, 0.001, 0.5, 0.9, 0.99, 1};
+  std::vector<uint64_t> percentiles = stat->getPercentiles(ratios);
+  ASSERT_EQ(ratios.size(), percentiles.size());
+  for (size_t i = 0; i < ratios.size(); ++i) {
+    double exact = std::max(1.0, ratios[i] * 10000);
+    EXPECT_NEAR(exact, percentiles[i], exact / 32 + 1) << ratios[i];
+  }
+  // the samples below 32 are exact.
+  EXPECT_EQ(10UL, percentiles[1]);
+
+  testStat_.printAllStatus();
+  stat->reset();
+  EXPECT_EQ(std::vector<uint64_t>({0}), stat->getPercentiles({0.99}));
+}
+
 TEST_F(CommonTest, syncThreadPool) {
   SyncThreadPool pool(10);
 
@@ -50,6 +50,10 @@ protected:
     SendRequest parallelRequests;
     /// store data, such as features for metric learning
     SendDataRequestVec parallelDataRequests;
+    /// store compressed gradient blocks referenced by parallelInputIovs
+    std::vector<std::vector<char>> compressedBlocks;
+    /// values of the SparseRows of the request to each server
+    std::vector<std::vector<real>> sparseRowsData;
   };
 
 public:
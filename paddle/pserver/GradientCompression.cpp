@@ -0,0 +1,128 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "GradientCompression.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "paddle/math/QuantizedMatrix.h"
+#include "paddle/math/SIMDFunctions.h"
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+// halves converted at a time by decompressAdd
+static const size_t kHalfBlock = 256;
+
+static size_t alignToReal(size_t size) {
+  return (size + sizeof(real) - 1) / sizeof(real) * sizeof(real);
+}
+
+GradientCompressor::GradientCompressor(GradientCompression type, double ratio,
+                                       size_t size)
+    : type_(type), ratio_(ratio) {
+  CHECK(type == GRADIENT_COMPRESSION_FP16 || type == GRADIENT_COMPRESSION_TOP_K)
+      << "Unsupported gradient compression " << type;
+  if (type == GRADIENT_COMPRESSION_TOP_K) {
+    CHECK(ratio > 0 && ratio <= 1) << "gradient_compression_ratio " << ratio
+                                   << " should be in (0, 1]";
+    residual_.resize(size, 0);
+  }
+}
+
+size_t GradientCompressor::getTopK(size_t len) const {
+  size_t k = static_cast<size_t>(std::round(ratio_ * len));
+  return std::max<size_t>(1, std::min(k, len));
+}
+
+size_t GradientCompressor::getCompressedSize(size_t len) const {
+  if (type_ == GRADIENT_COMPRESSION_FP16) {
+    return alignToReal(len * sizeof(uint16_t));
+  }
+  return alignToReal(getTopK(len) * (sizeof(real) + sizeof(uint32_t)));
+}
+
+void GradientCompressor::compress(const real* grad, size_t offset, size_t len,
+                                  char* out) {
+  size_t size = getCompressedSize(len);
+  if (type_ == GRADIENT_COMPRESSION_FP16) {
+    realToHalf(reinterpret_cast<uint16_t*>(out), grad, len);
+    memset(out + len * sizeof(uint16_t), 0, size - len * sizeof(uint16_t));
+    return;
+  }
+
+  CHECK_LE(offset + len, residual_.size());
+  real* residual = residual_.data() + offset;
+  simd::addScaledTo<real>(residual, grad, 1, len);
+
+  size_t k = getTopK(len);
+  indices_.resize(len);
+  for (size_t i = 0; i < len; ++i) {
+    indices_[i] = i;
+  }
+  if (k < len) {
+    std::nth_element(indices_.begin(), indices_.begin() + k, indices_.end(),
+                     [residual](uint32_t a, uint32_t b) {
+                       return std::abs(residual[a]) > std::abs(residual[b]);
+                     });
+    // ascending offsets for the pserver to add them in memory order
+    std::sort(indices_.begin(), indices_.begin() + k);
+  }
+
+  real* values = reinterpret_cast<real*>(out);
+  uint32_t* offsets = reinterpret_cast<uint32_t*>(values + k);
+  for (size_t i = 0; i < k; ++i) {
+    uint32_t index = indices_[i];
+    values[i] = residual[index];
+    offsets[i] = index;
+    residual[index] = 0;
+  }
+  char* end = reinterpret_cast<char*>(offsets + k);
+  memset(end, 0, out + size - end);
+}
+
+void GradientCompressor::decompressAdd(GradientCompression type,
+                                       const char* data, size_t size,
+                                       real* dst, size_t len) {
+  switch (type) {
+    case GRADIENT_COMPRESSION_FP16: {
+      CHECK_EQ(size, alignToReal(len * sizeof(uint16_t)));
+      const uint16_t* halves = reinterpret_cast<const uint16_t*>(data);
+      real buffer[kHalfBlock];
+      for (size_t begin = 0; begin < len; begin += kHalfBlock) {
+        size_t num = std::min(kHalfBlock, len - begin);
+        halfToReal(buffer, halves + begin, num);
+        simd::addScaledTo<real>(dst + begin, buffer, 1, num);
+      }
+      break;
+    }
+    case GRADIENT_COMPRESSION_TOP_K: {
+      size_t k = size / (sizeof(real) + sizeof(uint32_t));
+      CHECK_EQ(size, alignToReal(k * (sizeof(real) + sizeof(uint32_t))));
+      const real* values = reinterpret_cast<const real*>(data);
+      const uint32_t* offsets = reinterpret_cast<const uint32_t*>(values + k);
+      for (size_t i = 0; i < k; ++i) {
+        CHECK_LT(offsets[i], len);
+        dst[offsets[i]] += values[i];
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unsupported gradient compression " << type;
+  }
+}
+
+}  // namespace paddle
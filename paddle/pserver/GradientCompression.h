@@ -0,0 +1,78 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "paddle/utils/TypeDefs.h"
+#include "ParameterConfig.pb.h"
+
+namespace paddle {
+
+/**
+ * @brief Compresses the dense gradient blocks a trainer sends to the
+ * pservers, one instance per parameter.
+ *
+ * The compressed block is sent as the data of the ParameterBlock, whose
+ * compression field tells the pserver how to decode it. The data is padded
+ * to a multiple of sizeof(real) because the pserver sees it as reals:
+ *
+ * - GRADIENT_COMPRESSION_FP16: the block_size values in half precision.
+ * - GRADIENT_COMPRESSION_TOP_K: k values followed by their k uint32 offsets
+ *   in the block. The gradient is first added to a residual, the k elements
+ *   with the largest magnitude are sent and cleared from the residual, the
+ *   others stay in it and are sent by a later batch (error feedback).
+ */
+class GradientCompressor {
+public:
+  /**
+   * @param type   compression scheme, not GRADIENT_COMPRESSION_NONE.
+   * @param ratio  fraction of the elements sent by GRADIENT_COMPRESSION_TOP_K.
+   * @param size   size of the parameter, i.e. of the top-k residual.
+   */
+  GradientCompressor(GradientCompression type, double ratio, size_t size);
+
+  GradientCompression getType() const { return type_; }
+
+  /// bytes of the compressed data of a block of len elements
+  size_t getCompressedSize(size_t len) const;
+
+  /**
+   * Compress the gradient grad[0, len) of the elements
+   * [offset, offset + len) of the parameter into out, which must hold
+   * getCompressedSize(len) bytes.
+   */
+  void compress(const real* grad, size_t offset, size_t len, char* out);
+
+  /**
+   * Add the block compressed by type in data[0, size) to dst[0, len).
+   */
+  static void decompressAdd(GradientCompression type, const char* data,
+                            size_t size, real* dst, size_t len);
+
+private:
+  /// number of elements sent by top-k for a block of len elements
+  size_t getTopK(size_t len) const;
+
+  GradientCompression type_;
+  double ratio_;
+  /// gradients not sent yet by top-k
+  std::vector<real> residual_;
+  /// scratch for the top-k selection
+  std::vector<uint32_t> indices_;
+};
+
+}  // namespace paddle
@@ -15,6 +15,8 @@ limitations under the License. */
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <fcntl.h>
@@ -29,6 +31,7 @@ limitations under the License. */
 #include "LightNetwork.h"
 #include "paddle/utils/Util.h"
 #include "paddle/utils/StringUtil.h"
+#include "paddle/utils/Timeline.h"
 #include "RDMANetwork.h"
 
 /// quick ack can reduce the latency of small message
@@ -47,6 +50,18 @@ P_DEFINE_int32(sock_send_buf_size, 1024 * 1024 * 40,
 P_DEFINE_int32(sock_recv_buf_size, 1024 * 1024 * 40,
                "restrict sock recv buff size");
 
+/// with thousands of trainer connections, one blocking thread per connection
+/// costs too much memory and context switches
+P_DEFINE_int32(socket_io_threads, 0,
+               "number of epoll threads of a tcp socket server. 0 serves each "
+               "connection with its own blocking thread");
+P_DEFINE_int32(socket_compute_threads, 8,
+               "number of threads handling the requests of a tcp socket "
+               "server when socket_io_threads > 0. At least "
+               "num_gradient_servers threads are started, since the requests "
+               "of all the trainers can block on the barriers of synchronous "
+               "sgd at the same time");
+
 namespace paddle {
 
 /**
@@ -137,8 +152,12 @@ SocketServer::SocketServer(const std::string &addr, int port, int rdmaCpu)
   PCHECK(RdmaClientDaemons::get()) << "initilizate RDMA failed\n";
 }
 
-SocketServer::~SocketServer() {
-  stopping_ = true;
+SocketServer::~SocketServer() { stop(); }
+
+void SocketServer::stop() {
+  if (stopping_.exchange(true)) {
+    return;
+  }
   /// trigger accept thread to stop
   {
     SocketClient trigger(addr_.empty() ? "127.0.0.1" : addr_, port_, tcpRdma_);
@@ -150,9 +169,20 @@ SocketServer::~SocketServer() {
  * @brief start one tcp server which hosts parameter server
  *
  * @note do tcp socket bind and listen. it will spawn one thread
- *       for each connection
+ *       for each connection, or hand the connections to a SocketReactor
+ *       if --socket_io_threads > 0
  */
 void SocketServer::tcpServer() {
+  std::unique_ptr<SocketReactor> reactor;
+  if (FLAGS_socket_io_threads > 0) {
+    /// a request of each trainer can wait on a barrier of the pserver, and
+    /// a waiting request holds its compute thread
+    int numComputeThreads =
+        std::max(FLAGS_socket_compute_threads, FLAGS_num_gradient_servers);
+    reactor.reset(new SocketReactor(this, FLAGS_socket_io_threads,
+                                    numComputeThreads));
+  }
+
   int newsockfd;
   socklen_t clilen;
   struct sockaddr_in serv_addr, cli_addr;
@@ -197,11 +227,15 @@ void SocketServer::tcpServer() {
     char peerName[kPeerNameLen];
     CHECK(inet_ntop(AF_INET, &cli_addr.sin_addr, peerName, kPeerNameLen));
 
+    if (reactor) {
+      reactor->addConnection(createChannel(newsockfd, std::string(peerName)));
+      continue;
+    }
     SocketWorker *worker =
         new SocketWorker(createChannel(newsockfd, std::string(peerName)), this);
-    worker->start();
-    worker->detach();
+    worker->startDetached();
   }
+  reactor.reset();
   close(socket_);
   LOG(INFO) << "pserver accept thread finish, addr=" << addr_
             << " port=" << port_;
@@ -243,8 +277,7 @@ void SocketServer::rdmaServer() {
 
     SocketWorker *worker =
         new SocketWorker(createChannel(newsock, std::string(peerName)), this);
-    worker->start();
-    worker->detach();
+    worker->startDetached();
   }
   rdma::close(rdmaSocket_);
   LOG(INFO) << "pserver accept thread finish, rdma uri=" << rdmaUri_;
@@ -311,6 +344,7 @@ RdmaClientDaemons::~RdmaClientDaemons() {
  */
 void SocketWorker::run() {
   LOG(INFO) << "worker started, peer = " << channel_->getPeerName();
+  Timeline::setThreadName("SocketWorker " + channel_->getPeerName());
 
   std::vector<iovec> inputIovs;
 
@@ -328,9 +362,151 @@ void SocketWorker::run() {
   }
 
   LOG(INFO) << "worker begin to finish, peer = " << channel_->getPeerName();
+  server_->onChannelClosed(channel_.get());
+  detached_.wait();
   delete this;
 }
 
+/**
+ * @brief class constructor for SocketReactor
+ * @param[in] server the server whose handleRequest() serves the requests
+ * @param[in] numIoThreads number of epoll threads
+ * @param[in] numComputeThreads number of compute threads
+ */
+SocketReactor::SocketReactor(SocketServer *server, int numIoThreads,
+                             int numComputeThreads)
+    : server_(server), nextEpoll_(0) {
+  CHECK_GT(numIoThreads, 0);
+  CHECK_GT(numComputeThreads, 0);
+  stopFd_ = eventfd(0, 0);
+  PCHECK(stopFd_ >= 0) << "ERROR creating eventfd";
+  for (int i = 0; i < numIoThreads; ++i) {
+    int epollFd = epoll_create1(0);
+    PCHECK(epollFd >= 0) << "ERROR creating epoll";
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    PCHECK(epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd_, &event) == 0);
+    epollFds_.push_back(epollFd);
+    ioThreads_.emplace_back(new std::thread([this, epollFd]() {
+      ioLoop(epollFd);
+    }));
+  }
+  for (int i = 0; i < numComputeThreads; ++i) {
+    computeThreads_.emplace_back(new std::thread([this]() { computeLoop(); }));
+  }
+  LOG(INFO) << "socket reactor started, io threads=" << numIoThreads
+            << " compute threads=" << numComputeThreads;
+}
+
+SocketReactor::~SocketReactor() {
+  /// the eventfd stays readable, which wakes up all the io threads
+  uint64_t one = 1;
+  PCHECK(write(stopFd_, &one, sizeof(one)) == sizeof(one));
+  for (auto &thread : ioThreads_) {
+    thread->join();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    /// wake up the requests waiting for data, their connections are closed
+    /// once the requests finish
+    for (Connection *conn : connections_) {
+      shutdown(conn->channel->getTcpSocket(), SHUT_RDWR);
+    }
+  }
+  /// the queued connections are handled before the compute threads stop,
+  /// they fail to read and are closed
+  for (size_t i = 0; i < computeThreads_.size(); ++i) {
+    jobs_.enqueue(nullptr);
+  }
+  for (auto &thread : computeThreads_) {
+    thread->join();
+  }
+  for (Connection *conn : connections_) {
+    server_->onChannelClosed(conn->channel.get());
+    delete conn;
+  }
+  for (int epollFd : epollFds_) {
+    close(epollFd);
+  }
+  close(stopFd_);
+}
+
+void SocketReactor::addConnection(std::unique_ptr<SocketChannel> channel) {
+  CHECK_EQ(channel->getChannelType(), F_TCP);
+  LOG(INFO) << "connection added, peer = " << channel->getPeerName();
+  Connection *conn = new Connection;
+  conn->channel = std::move(channel);
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    conn->epollFd = epollFds_[nextEpoll_++ % epollFds_.size()];
+    connections_.insert(conn);
+  }
+  /// one shot: the connection is disabled while one of its messages is
+  /// being handled
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = conn;
+  PCHECK(epoll_ctl(conn->epollFd, EPOLL_CTL_ADD,
+                   conn->channel->getTcpSocket(), &event) == 0);
+}
+
+void SocketReactor::ioLoop(int epollFd) {
+  constexpr int kMaxEvents = 64;
+  epoll_event events[kMaxEvents];
+  while (true) {
+    int num = epoll_wait(epollFd, events, kMaxEvents, -1);
+    if (num < 0 && errno == EINTR) {
+      continue;
+    }
+    PCHECK(num >= 0) << "ERROR on epoll_wait";
+    for (int i = 0; i < num; ++i) {
+      Connection *conn = reinterpret_cast<Connection *>(events[i].data.ptr);
+      if (!conn) {
+        return;
+      }
+      jobs_.enqueue(conn);
+    }
+  }
+}
+
+void SocketReactor::computeLoop() {
+  while (Connection *conn = jobs_.dequeue()) {
+    handleConnection(conn);
+  }
+}
+
+void SocketReactor::handleConnection(Connection *conn) {
+  SocketChannel *channel = conn->channel.get();
+  std::unique_ptr<MsgReader> msgReader = channel->readMessage();
+  if (!msgReader) {
+    closeConnection(conn);
+    return;
+  }
+
+  auto callback = [channel](const std::vector<iovec> &outputIovs) {
+    channel->writeMessage(outputIovs);
+  };
+  server_->handleRequest(std::move(msgReader), callback);
+
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = conn;
+  PCHECK(epoll_ctl(conn->epollFd, EPOLL_CTL_MOD, channel->getTcpSocket(),
+                   &event) == 0)
+      << "ERROR re-arming connection, peer = " << channel->getPeerName();
+}
+
+void SocketReactor::closeConnection(Connection *conn) {
+  LOG(INFO) << "connection closed, peer = " << conn->channel->getPeerName();
+  server_->onChannelClosed(conn->channel.get());
+  std::lock_guard<std::mutex> guard(mutex_);
+  connections_.erase(conn);
+  /// closing the socket also removes it from epoll
+  delete conn;
+}
+
 /**
  * @brief start one tcp connection to tcp server
  * @param[in] serverAddr  tcp server ip
@@ -18,10 +18,14 @@ limitations under the License. */
 #include "SocketChannel.h"
 
 #include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
 #include <vector>
 #include <atomic>
 
+#include "paddle/utils/Locks.h"
+#include "paddle/utils/Queue.h"
 #include "paddle/utils/Thread.h"
 
 struct sxi_socket;
@@ -29,6 +33,7 @@ struct sxi_socket;
 namespace paddle {
 
 class SocketWorker;
+class SocketReactor;
 
 /**
  * @brief class for holding all parameters processing for current port
@@ -48,6 +53,14 @@ public:
 
   virtual void run();
 
+  /**
+   * Stop accepting connections, and with --socket_io_threads > 0 also close
+   * the connections and join the reactor threads. The derived class must be
+   * stopped before it is destroyed, since the reactor threads call
+   * handleRequest(). Calling it again does nothing.
+   */
+  void stop();
+
   typedef std::function<void(const std::vector<iovec>& outputIovs)>
       ResponseCallback;
 
@@ -60,6 +73,9 @@ protected:
   virtual void handleRequest(std::unique_ptr<MsgReader> msgReader,
                              ResponseCallback callback) = 0;
 
+  /// called when a connection is closed, after its last request is handled
+  virtual void onChannelClosed(SocketChannel* channel) { (void)channel; }
+
   std::unique_ptr<SocketChannel> createChannel(int sock,
                                                const std::string& peerName) {
     return std::unique_ptr<SocketChannel>(new SocketChannel(sock, peerName));
@@ -70,6 +86,7 @@ protected:
   }
 
   friend class SocketWorker;
+  friend class SocketReactor;
 
 private:
   void rdmaServer();
@@ -88,7 +105,7 @@ protected:
   std::string addr_;
   int socket_;
   int maxPendingConnections_;
-  bool stopping_;
+  std::atomic<bool> stopping_;
 };
 
 
@@ -104,12 +121,83 @@ public:
 
   virtual ~SocketWorker() {}
 
+  /**
+   * Start the worker thread and detach it. The worker deletes itself when
+   * the connection is closed.
+   */
+  void startDetached() {
+    start();
+    detach();
+    detached_.post();
+  }
+
   virtual void run();
 
 protected:
   std::unique_ptr<SocketChannel> channel_;
   SocketServer* server_;
   enum ChannelType tcpRdma_;
+  /// the thread must not delete the worker before start() and detach()
+  /// return
+  Semaphore detached_;
+};
+
+/**
+ * @brief event driven alternative to SocketWorker for tcp connections
+ *
+ * @note  --socket_io_threads threads wait with epoll until a connection is
+ *        readable, and then hand it to a compute thread. The compute thread
+ *        reads one message with SocketChannel::readMessage(), calls
+ *        SocketServer::handleRequest() like SocketWorker does, and re-arms
+ *        the connection. So an idle connection costs no thread, the
+ *        messages of one connection are still handled one by one, and the
+ *        wire format is unchanged.
+ *
+ *        There are numComputeThreads compute threads, the readable
+ *        connections beyond that wait in a queue. Request handlers may
+ *        block, e.g. on the barriers of synchronous sgd, so there have to be
+ *        at least as many compute threads as connections which can block at
+ *        the same time. SocketServer starts max(--socket_compute_threads,
+ *        --num_gradient_servers) of them.
+ */
+class SocketReactor {
+public:
+  SocketReactor(SocketServer* server, int numIoThreads, int numComputeThreads);
+
+  /// close all connections, waits for running requests
+  ~SocketReactor();
+
+  /// take the ownership of a new F_TCP channel and start serving it
+  void addConnection(std::unique_ptr<SocketChannel> channel);
+
+  size_t getNumComputeThreads() const { return computeThreads_.size(); }
+
+protected:
+  struct Connection {
+    std::unique_ptr<SocketChannel> channel;
+    int epollFd;
+  };
+
+  void ioLoop(int epollFd);
+  void computeLoop();
+  /// read and handle one message of conn, then re-arm it
+  void handleConnection(Connection* conn);
+  void closeConnection(Connection* conn);
+
+  SocketServer* server_;
+  /// written to stop the io threads
+  int stopFd_;
+  std::vector<int> epollFds_;
+  std::vector<std::unique_ptr<std::thread>> ioThreads_;
+  size_t nextEpoll_;
+  /// nullptr stops a compute thread
+  Queue<Connection*> jobs_;
+
+  std::vector<std::unique_ptr<std::thread>> computeThreads_;
+
+  /// guards connections_
+  std::mutex mutex_;
+  std::set<Connection*> connections_;
 };
 
 /**
@@ -23,6 +23,10 @@ limitations under the License. */
 
 P_DEFINE_string(pservers, "127.0.0.1", "Comma separated addresses of pservers");
 P_DEFINE_int32(parallel_thread_num, 1, "Thread number for parameter send");
+P_DEFINE_bool(compact_sparse_rpc, true,
+              "Send the row ids of the sparse prefetch and gradient push as "
+              "packed arrays, with the values of all the rows of a pserver "
+              "in one data block, instead of one ParameterBlock per row");
 
 namespace paddle {
 
@@ -96,6 +100,13 @@ bool ParameterClient2::init(const std::vector<ParameterPtr>& parameters) {
   for (auto& para : parameters) {
     CHECK_NE(-1UL, para->getID()) << "id in parameter is not initialized";
     parameterMap_[para->getID()] = para;
+    const ParameterConfig& config = para->getConfig();
+    if (config.gradient_compression() != GRADIENT_COMPRESSION_NONE &&
+        !config.sparse_remote_update()) {
+      compressors_[para->getID()].reset(new GradientCompressor(
+          config.gradient_compression(), config.gradient_compression_ratio(),
+          para->getSize()));
+    }
   }
 
   allSegments_.reserve(parameters.size());
@@ -148,6 +159,7 @@ void ParameterClient2::destroy() {
   finishThreads();
 
   parameterMap_.clear();
+  compressors_.clear();
   allSegments_.clear();
   clients_.clear();
 }
@@ -172,15 +184,18 @@ void ParameterClient2::sendParallel(int tid, size_t numThreads,
   }
 
   std::vector<void*> bufs;
+  std::vector<real> sparseRowsData;
   SendParameterResponse response;
   for (int j = 0; j < numMyClients; ++j) {
     REGISTER_TIMER("client_sendAndRecv_recv");
     int i = numThreads * j + tid;
     i = calcClientId(i, serviceNum_);
     auto msgReader = clients_[i].recv(&response);
-    CHECK_EQ(msgReader->getNumBlocks(), (size_t)response.blocks_size());
+    bool hasSparseRows = response.sparse_rows_size() > 0;
+    CHECK_EQ(msgReader->getNumBlocks(),
+             (size_t)response.blocks_size() + (hasSparseRows ? 1 : 0));
     bufs.clear();
-    bufs.reserve(response.blocks_size());
+    bufs.reserve(response.blocks_size() + 1);
     for (auto& block : response.blocks()) {
       auto it = parameterMap_.find(block.para_id());
       CHECK(it != parameterMap_.end());
@@ -199,8 +214,40 @@ void ParameterClient2::sendParallel(int tid, size_t numThreads,
       /// storage is continuous, do commit recieved data as that of dense.
       bufs.push_back(buf);
     }
+    if (hasSparseRows) {
+      sparseRowsData.resize(
+          msgReader->getBlockLength(response.blocks_size()) / sizeof(real));
+      bufs.push_back(sparseRowsData.data());
+    }
     msgReader->readBlocks(bufs);
+    if (hasSparseRows) {
+      scatterSparseRows(response, recvParameterType, sparseRowsData);
+    }
+  }
+}
+
+void ParameterClient2::scatterSparseRows(const SendParameterResponse& response,
+                                         ParameterType recvParameterType,
+                                         const std::vector<real>& data) {
+  size_t offset = 0;
+  for (auto& rows : response.sparse_rows()) {
+    auto it = parameterMap_.find(rows.para_id());
+    CHECK(it != parameterMap_.end());
+    Parameter* parameter = it->second.get();
+    size_t width = parameter->getConfig().dims(1);
+    CHECK_LE(offset + rows.local_rows_size() * width, data.size());
+    const auto& buf = parameter->getBuf(recvParameterType);
+    auto recvMat = buf ? nullptr : dynamic_cast<SparseRowCpuMatrix*>(
+        parameter->getMat(recvParameterType).get());
+    CHECK(buf || recvMat);
+    for (auto localRow : rows.local_rows()) {
+      real* row = buf ? buf->getPoint(localRow * width)
+                      : recvMat->getLocalRow(localRow);
+      memcpy(row, data.data() + offset, sizeof(real) * width);
+      offset += width;
+    }
   }
+  CHECK_EQ(offset, data.size());
 }
 
 void ParameterClient2::prepareSendData(
@@ -210,6 +257,11 @@ void ParameterClient2::prepareSendData(
     BatchStatus batchStatus, SendJob* sendJob) {
   sendJob->parallelRequests.resize(serviceNum_);
   sendJob->parallelInputIovs.resize(serviceNum_);
+  sendJob->compressedBlocks.clear();
+  sendJob->sparseRowsData.resize(serviceNum_);
+  for (auto& data : sendJob->sparseRowsData) {
+    data.clear();
+  }
 
   for (auto& request : sendJob->parallelRequests) {
 #ifndef PADDLE_DISABLE_TIMER
@@ -250,12 +302,23 @@ void ParameterClient2::prepareSendData(
         parameter->getMat(parameterType).get());
       CHECK(sendMat != nullptr) << "sendMat is nullptr";
 
+      /// the send back of ADD_GRADIENT is only for the ParameterBlocks
+      bool compact = FLAGS_compact_sparse_rpc &&
+                     (updateMode == PSERVER_UPDATE_MODE_GET_PARAM_SPARSE ||
+                      (updateMode == PSERVER_UPDATE_MODE_ADD_GRADIENT &&
+                       !sendBackParameter));
+
       syncThreadPool_->exec([&](int tid, size_t numThreads) {
         const auto &localIndices = prefetchMat->getLocalIndices();
         /// num of sparse rows
         size_t nLocalBlocks = localIndices.size();
         uint64_t beginDim = 0;
         uint64_t endDim = 0;
+        /// SparseRows of this parameter for each server of this thread
+        std::vector<SparseRows*> sparseRows;
+        if (compact) {
+          sparseRows.resize(serviceNum_, nullptr);
+        }
         for (size_t row = 0; row < nLocalBlocks; ++row) {
           int64_t blockId = localIndices[row];  // local row -> sparse row
           int serverId = std::abs((blockId + nameHash) % serviceNum_);
@@ -263,6 +326,25 @@ void ParameterClient2::prepareSendData(
             continue;
           }
 
+          if (compact) {
+            SparseRows*& rows = sparseRows[serverId];
+            if (!rows) {
+              rows = sendJob->parallelRequests[serverId].add_sparse_rows();
+              rows->set_para_id(segments.id);
+            }
+            CHECK_LE(blockId, UINT32_MAX);
+            rows->add_row_ids(blockId);
+            rows->add_local_rows(row);
+            if (sendingPara) {
+              const real* value = sendMat->getLocalRow(row);
+              auto& data = sendJob->sparseRowsData[serverId];
+              data.insert(data.end(), value, value + blockSize);
+              sparseDistribution_->probeDistribution(serverId,
+                      sizeof(real) * blockSize);
+            }
+            continue;
+          }
+
           beginDim = blockId * blockSize;
           endDim = std::min<int64_t>(beginDim + blockSize, paraSize);
 
@@ -289,6 +371,15 @@ void ParameterClient2::prepareSendData(
     } else {  /// parameter set for dense and sparse
       real* buf = sendingPara ?
           parameter->getBuf(parameterType)->getPoint(0) : nullptr;
+      /// only the gradients of sync sgd are compressed
+      GradientCompressor* compressor = nullptr;
+      if (buf && updateMode == PSERVER_UPDATE_MODE_ADD_GRADIENT &&
+          parameterType == PARAMETER_GRADIENT) {
+        auto compressorIt = compressors_.find(segments.id);
+        if (compressorIt != compressors_.end()) {
+          compressor = compressorIt->second.get();
+        }
+      }
       uint64_t endDim = 0;
       for (uint64_t beginDim = 0; beginDim < paraSize; beginDim = endDim) {
         endDim = std::min<int64_t>(beginDim + blockSize, paraSize);
@@ -301,7 +392,16 @@ void ParameterClient2::prepareSendData(
         block->set_block_id(blockId);
         block->set_begin_pos(beginDim);
         block->set_block_size(endDim - beginDim);
-        if (buf) {
+        if (compressor) {
+          size_t len = endDim - beginDim;
+          sendJob->compressedBlocks.emplace_back(
+              compressor->getCompressedSize(len));
+          auto& data = sendJob->compressedBlocks.back();
+          compressor->compress(buf + beginDim, beginDim, len, data.data());
+          block->set_compression(compressor->getType());
+          sendJob->parallelInputIovs[serverId].push_back(
+              {data.data(), data.size()});
+        } else if (buf) {
             sendJob->parallelInputIovs[serverId].push_back({buf + beginDim,
                      sizeof(real) * ((size_t) (endDim - beginDim))});
         }
@@ -309,6 +409,15 @@ void ParameterClient2::prepareSendData(
     }
   }  // parameterSegments
 
+  /// the values of the sparse rows follow the blocks
+  for (int serverId = 0; serverId < serviceNum_; ++serverId) {
+    auto& data = sendJob->sparseRowsData[serverId];
+    if (!data.empty()) {
+      sendJob->parallelInputIovs[serverId].push_back(
+          {data.data(), sizeof(real) * data.size()});
+    }
+  }
+
   sparseDistribution_->checkAndResetDistribution();
 }
 
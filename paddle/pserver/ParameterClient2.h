@@ -32,6 +32,7 @@ limitations under the License. */
 
 #include "ParameterService.pb.h"
 
+#include "GradientCompression.h"
 #include "SparseParameterDistribution.h"
 #include "ProtoServer.h"
 
@@ -516,6 +517,10 @@ private:
    */
   void sendParallel(int tid, size_t numThreads,
                     ParameterType recvParameterType);
+  /// copy the values of the SparseRows of a response to their local rows
+  void scatterSparseRows(const SendParameterResponse& response,
+                         ParameterType recvParameterType,
+                         const std::vector<real>& data);
   /// sending thread routine for asynchronously send data
   void send(int threadId);
   /// receiving thread routing for asynchronously receive data
@@ -557,6 +562,10 @@ protected:
   std::unordered_map<size_t, ParameterPtr> parameterMap_;
   /// segments for all parameters that needed to sync
   std::vector<ParameterSegments> allSegments_;
+  /// compressors of the gradients of the parameters configured with
+  /// gradient_compression, by parameter id
+  std::unordered_map<size_t, std::unique_ptr<GradientCompressor>>
+      compressors_;
 
   /// module for sensing sparse parameters distribution on all pservers
   std::unique_ptr<SparseParameterDistribution> sparseDistribution_;
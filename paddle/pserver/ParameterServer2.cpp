@@ -17,6 +17,8 @@ limitations under the License. */
 #include <algorithm>
 #include <fstream>
 
+#include "GradientCompression.h"
+#include "paddle/math/MathThreadPool.h"
 #include "paddle/math/SIMDFunctions.h"
 
 #include "paddle/parameter/AverageOptimizer.h"
@@ -31,6 +33,16 @@ limitations under the License. */
 #include "paddle/utils/GlobalConstants.h"
 
 P_DEFINE_int32(pserver_num_threads, 1, "number of threads for sync op exec");
+P_DEFINE_bool(pserver_sparse_table, false,
+              "Store the rows of the sparse_remote_update parameters in hash "
+              "tables, allocating them on their first pull or push, instead "
+              "of allocating all the rows in dense vectors");
+P_DEFINE_int64(pserver_sparse_table_max_rows, 0,
+               "With --pserver_sparse_table, the maximum number of rows of a "
+               "parameter in memory, the least recently used rows being "
+               "spilled to a file in --pserver_spill_dir. 0 for no limit");
+P_DEFINE_string(pserver_spill_dir, "/tmp",
+                "Directory of the spill files of the sparse tables");
 P_DEFINE_double(async_lagged_ratio_min, 1.0,
                 "control config_.async_lagged_grad_discard_ratio() min value");
 P_DEFINE_double(
@@ -58,7 +70,9 @@ ParameterServer2::ParameterServer2(const std::string& addr, int port,
       numPassFinishClients_(0),
       allClientPassFinish_(false),
       serverId_(-1),
-      batchId_(-1) {
+      batchId_(-1),
+      useSparseTable_(false),
+      randomizeSparseRows_(false) {
  /**
   * register function for remote client calling, these functions
   * will be mapped to a data structure for quick looking up. each
@@ -145,6 +159,7 @@ void ParameterServer2::setConfig(const SetConfigRequest& request,
 
     serverId_ = request.server_id();
     isSparseServer_ = request.is_sparse_server();
+    useSparseTable_ = FLAGS_pserver_sparse_table && isSparseServer_;
 
     if (!request.save_dir().empty()) {
       mkDir(request.save_dir().c_str());
@@ -254,6 +269,10 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
   (void)outputBuffers;
   LOG(INFO) << "pserver: setParameter";
   std::lock_guard<RWLock> guard(parameterMutex_);
+  if (useSparseTable_) {
+    setSparseTables(request, inputBuffers);
+    return;
+  }
 
   int64_t numBlocks = blockIdMap_.size();
   CHECK_EQ(blockIdMap_.size(), blockOffsetMap_.size());
@@ -289,11 +308,10 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
   }
 
   size_ = totalSize;
-  LOG(INFO) << "pserver: new cpuvector: size=" << size_;
-  if (!vectors_[PARAMETER_VALUE]) {
+  if (blockInfos_.empty()) {
+    LOG(INFO) << "pserver: new cpuvector: size=" << size_;
     /// vectors_
-    const auto types = sgdOptimizerGetTypes(config_, true /*inPserver*/);
-    for (const auto type : types) {
+    for (const auto type : sgdOptimizerGetTypes(config_, true /*inPserver*/)) {
       vectors_[type].reset(new CpuVector(size_));
       vectors_[type]->zeroMem();
     }
@@ -303,12 +321,11 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
       info.lock.reset(new std::mutex());
     }
   } else {
-    CHECK_EQ((size_t)size_, vectors_[PARAMETER_VALUE]->getSize())
+    CHECK_EQ((size_t)numBlocks, blockInfos_.size())
         << "Currently adding new blocks is not supported. "
         << "All blocks must be added in one setParameter call";
   }
 
-  VectorPtr buf = vectors_[PARAMETER_VALUE];
   usedSegments_.reserve(offsets.size());
   /// if offsets is empty, means parameter_block_size is too big or too many
   /// nodes.
@@ -328,8 +345,14 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
       CHECK_EQ(config.parameter_block_size(), width)
           << "block size: " << config.parameter_block_size()
           << "width : " << width;
+      auto& rowBlocks = sparseRowBlocks_[config.para_id()];
+      rowBlocks.resize(config.dims(0), -1);
+      CHECK_LT(request.blocks(i).block_id(), rowBlocks.size());
+      CHECK_LE(blockId, (size_t)INT32_MAX);
+      rowBlocks[request.blocks(i).block_id()] = blockId;
     }
-    info.optimizer->init(1, info.config);
+    info.optimizer->init(config.sparse_remote_update() ? 1 : 0, info.config);
+    info.updated = false;
     usedSegments_.push_back(std::make_pair(offsets[i],
                 offsets[i] + request.blocks(i).block_size()));
   }
@@ -339,8 +362,8 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
     /// copy param from trainer
     for (size_t i = 0; i < offsets.size(); ++i) {
       Buffer buffer = inputBuffers[i];
-      real* start = buf->getPoint(offsets[i]);
-      CHECK_LE(offsets[i] + buffer.size, buf->getSize());
+      CHECK_LE(offsets[i] + buffer.size, vectors_[PARAMETER_VALUE]->getSize());
+      real* start = getBlockBuf(blockInfos_[blockIds[i]], PARAMETER_VALUE);
       memcpy(start, buffer.base, sizeof(real) * buffer.size);
     }
   } else {
@@ -349,6 +372,91 @@ void ParameterServer2::setParameter(const SendParameterRequest& request,
   }
 }
 
+void ParameterServer2::setSparseTables(const SendParameterRequest& request,
+                                       std::vector<Buffer>& inputBuffers) {
+  bool first = sparseTables_.empty();
+  if (first) {
+    const auto types = sgdOptimizerGetTypes(config_, true /*inPserver*/);
+    sparseTableTypeIndex_.assign(NUM_PARAMETER_TYPES, -1);
+    for (size_t i = 0; i < types.size(); ++i) {
+      sparseTableTypeIndex_[types[i]] = i;
+    }
+  }
+  /// the rows of a parameter follow each other in the saved layout
+  SparseTableInfo* lastInfo = nullptr;
+  for (int i = 0; i < request.blocks_size(); ++i) {
+    const ParameterBlock& block = request.blocks(i);
+    const ParameterConfig& config = getParameterConfig(block);
+    CHECK(config.sparse_remote_update())
+        << "--pserver_sparse_table only stores sparse_remote_update "
+        << "parameters, but got " << config.name();
+    size_t width = config.dims(1);
+    CHECK_EQ(config.parameter_block_size(), width)
+        << "block size: " << config.parameter_block_size()
+        << "width : " << width;
+    if (inputBuffers.size()) {  // if !=PSERVER_UPDATE_MODE_SET_PARAM_ZERO
+      CHECK_EQ(inputBuffers[i].size, block.block_size())
+          << "data size is too big:"
+          << " block_size=" << block.block_size()
+          << " data_size=" << inputBuffers[i].size;
+    }
+
+    auto& info = sparseTables_[config.para_id()];
+    if (!info) {
+      CHECK(first) << "Currently adding new blocks is not supported. "
+                   << "All blocks must be added in one setParameter call";
+      info.reset(new SparseTableInfo);
+      info->config = &config;
+      info->offset = size_;
+      size_t rowSize = width * (NUM_PARAMETER_TYPES -
+                                std::count(sparseTableTypeIndex_.begin(),
+                                           sparseTableTypeIndex_.end(), -1));
+      /// rows start from zero like the vectors_, and from the random
+      /// value of op_randomize() once it was called
+      auto initializer = [this, &config, rowSize](uint64_t row, real* data) {
+        memset(data, 0, sizeof(real) * rowSize);
+        if (randomizeSparseRows_) {
+          size_t valueOffset = getRowTypeOffset(config, PARAMETER_VALUE);
+          randomizeSparseRow(config, row, data + valueOffset);
+        }
+      };
+      info->table.reset(
+          new SparseRowTable(rowSize, initializer, FLAGS_pserver_spill_dir));
+      info->optimizer.reset(sgdOptimizerCreate(config_, config,
+                                               true /*isParameterSparse*/,
+                                               true /*inPserver*/));
+      info->optimizer->init(config.dims(0), &config);
+      info->owned.resize(config.dims(0), false);
+      info->updated.resize((config.dims(0) + 63) / 64, 0);
+      info->rowLocks.reset(new std::mutex[kNumSparseRowLocks]);
+    }
+    uint64_t row = block.block_id();
+    CHECK_LT(row, info->owned.size());
+    if (!info->owned[row]) {
+      CHECK(first) << "Currently adding new blocks is not supported. "
+                   << "All blocks must be added in one setParameter call";
+      CHECK(info.get() == lastInfo || info->rows.empty())
+          << "the rows of parameter " << config.name()
+          << " are not contiguous in setParameter";
+      info->owned[row] = true;
+      info->rows.push_back(row);
+      size_ += width;
+    }
+    lastInfo = info.get();
+
+    if (request.update_mode() == PSERVER_UPDATE_MODE_SET_PARAM) {
+      /// copy param from trainer
+      memcpy(getSparseRowBuf(*info, row, PARAMETER_VALUE),
+             inputBuffers[i].base, sizeof(real) * inputBuffers[i].size);
+    } else {
+      CHECK(request.update_mode() == PSERVER_UPDATE_MODE_SET_PARAM_ZERO);
+    }
+  }
+  if (first) {
+    LOG(INFO) << "pserver: new sparse tables: size=" << size_;
+  }
+}
+
 void ParameterServer2::addGradient(const SendParameterRequest& request,
                                    std::vector<Buffer>& inputBuffers,
                                    SendParameterResponse* response,
@@ -375,7 +483,7 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
   }
 
 #ifndef PADDLE_DISABLE_TIMER
-  gettimeofday(&(*addGradBegin_), nullptr);
+  nowInTimeval(&(*addGradBegin_));
 #endif
 
   /// barrier fluctuation caused by network and previous forwardbackward
@@ -398,6 +506,15 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
     ReadLockGuard guard(parameterMutex_);
     int bufferIndex = 0;
     for (const auto& block : request.blocks()) {
+      if (useSparseTable_) {
+        SparseTableInfo& info =
+            getSparseTable(block.para_id(), block.block_id());
+        Buffer buffer = inputBuffers[bufferIndex];
+        ++bufferIndex;
+        CHECK_EQ(buffer.size, info.config->parameter_block_size());
+        addSparseRowGradient(info, block.block_id(), buffer.base);
+        continue;
+      }
       int64_t offset = getBlockOffset(block);
       CHECK_GE(offset, 0) << "Only existing parameter block is allowed: "
                           << " id=" << block.para_id()
@@ -412,12 +529,20 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
       ++bufferIndex;
 
       const real* gradientBuffer = buffer.base;
-      real* gradientSumBuffer = vectors_[PARAMETER_GRADIENT]->getPoint(offset);
-
       size_t size = buffer.size;
 
       BlockInfo& info = blockInfos_[blockId];
+      real* gradientSumBuffer = getBlockBuf(info, PARAMETER_GRADIENT);
       const ParameterConfig& config = getParameterConfig(blockId);
+      if (block.compression() != GRADIENT_COMPRESSION_NONE) {
+        /// dense block compressed by the trainer, see GradientCompressor
+        CHECK_LE(block.block_size(), config.parameter_block_size());
+        std::lock_guard<std::mutex> guard(*info.lock);
+        GradientCompressor::decompressAdd(
+            block.compression(), reinterpret_cast<const char*>(gradientBuffer),
+            size * sizeof(real), gradientSumBuffer, block.block_size());
+        continue;
+      }
       if (config.sparse_remote_update()) {
         CHECK_EQ(size, config.parameter_block_size());
       } else {  // dense
@@ -425,6 +550,11 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
       }
       std::lock_guard<std::mutex> guard(*info.lock);
       simd::addTo(gradientSumBuffer, gradientBuffer, size);
+      info.updated = true;
+    }
+    if (request.sparse_rows_size()) {
+      CHECK_EQ(inputBuffers.size(), (size_t)request.blocks_size() + 1);
+      addSparseRowsGradient(request, inputBuffers.back());
     }
 
     if (!numPassFinishClients_) {
@@ -478,6 +608,98 @@ void ParameterServer2::addGradient(const SendParameterRequest& request,
   }
 }
 
+void ParameterServer2::addSparseRowGradient(SparseTableInfo& info,
+                                            uint64_t row,
+                                            const real* gradient) {
+  real* gradientSumBuffer = getSparseRowBuf(info, row, PARAMETER_GRADIENT);
+  std::lock_guard<std::mutex> guard(getRowLock(info, row));
+  simd::addTo(gradientSumBuffer, gradient, info.config->dims(1));
+  info.updated[row >> 6] |= 1ULL << (row & 63);
+}
+
+void ParameterServer2::addSparseRowsGradient(
+    const SendParameterRequest& request, const Buffer& buffer) {
+  size_t offset = 0;
+  for (const auto& rows : request.sparse_rows()) {
+    size_t width = configMap_.at(rows.para_id()).dims(1);
+    size_t numRows = rows.row_ids_size();
+    CHECK_LE(offset + numRows * width, buffer.size);
+    const real* gradients = buffer.base + offset;
+    auto addRows = [&](size_t begin, size_t end) {
+      if (useSparseTable_) {
+        for (size_t i = begin; i < end; ++i) {
+          uint32_t row = rows.row_ids(i);
+          addSparseRowGradient(getSparseTable(rows.para_id(), row), row,
+                               gradients + i * width);
+        }
+        return;
+      }
+      const auto& rowBlocks = getSparseRowBlocks(rows);
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t row = rows.row_ids(i);
+        CHECK_LT(row, rowBlocks.size());
+        int32_t blockId = rowBlocks[row];
+        CHECK_GE(blockId, 0) << "Only existing parameter block is allowed: "
+                             << " id=" << rows.para_id()
+                             << " block id=" << row;
+        BlockInfo& info = blockInfos_[blockId];
+        real* gradientSumBuffer = getBlockBuf(info, PARAMETER_GRADIENT);
+        std::lock_guard<std::mutex> guard(*info.lock);
+        simd::addTo(gradientSumBuffer, gradients + i * width, width);
+        info.updated = true;
+      }
+    };
+    if (MathThreadPool::isEnabled(numRows * width)) {
+      MathThreadPool::global().parallelFor(numRows, 1, addRows);
+    } else {
+      addRows(0, numRows);
+    }
+    offset += numRows * width;
+  }
+  CHECK_EQ(offset, buffer.size);
+}
+
+void ParameterServer2::getSparseRows(const SendParameterRequest& request,
+                                     int parameterType, Buffer* buffer) {
+  size_t offset = 0;
+  for (const auto& rows : request.sparse_rows()) {
+    size_t width = configMap_.at(rows.para_id()).dims(1);
+    size_t numRows = rows.row_ids_size();
+    CHECK_LE(offset + numRows * width, buffer->size);
+    real* values = buffer->base + offset;
+    auto getRows = [&](size_t begin, size_t end) {
+      if (useSparseTable_) {
+        for (size_t i = begin; i < end; ++i) {
+          uint32_t row = rows.row_ids(i);
+          const real* valueBuffer = getSparseRowBuf(
+              getSparseTable(rows.para_id(), row), row, parameterType);
+          memcpy(values + i * width, valueBuffer, width * sizeof(real));
+        }
+        return;
+      }
+      const auto& rowBlocks = getSparseRowBlocks(rows);
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t row = rows.row_ids(i);
+        CHECK_LT(row, rowBlocks.size());
+        int32_t blockId = rowBlocks[row];
+        CHECK_GE(blockId, 0) << "Only existing parameter block is allowed: "
+                             << " id=" << rows.para_id()
+                             << " block id=" << row;
+        const real* valueBuffer =
+            getBlockBuf(blockInfos_[blockId], parameterType);
+        memcpy(values + i * width, valueBuffer, width * sizeof(real));
+      }
+    };
+    if (MathThreadPool::isEnabled(numRows * width)) {
+      MathThreadPool::global().parallelFor(numRows, 1, getRows);
+    } else {
+      getRows(0, numRows);
+    }
+    offset += numRows * width;
+  }
+  CHECK_EQ(offset, buffer->size);
+}
+
 bool ParameterServer2::asyncGrdientCommitCheckAndStat(
     const SendParameterRequest& request) {
   const auto trainerId = request.trainer_id();
@@ -592,49 +814,53 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
   bool commitGradient = asyncGrdientCommitCheckAndStat(request);
 
   VectorPtr* vecs = Parameter::getTlsTempBufs();
-  size_t bufferIndex = 0;
-  for (const auto& block : request.blocks()) {
-    int64_t offset = getBlockOffset(block);
-    CHECK_GE(offset, 0) << "Only existing parameter block is allowed: "
-                        << " id=" << block.para_id()
-                        << " block id=" << block.block_id();
-    int64_t blockId = getBlockId(block);
-    CHECK_GE(blockId, 0) << "Only existing parameter block is allowed: "
-        << " id=" << block.para_id() << " block id=" << block.block_id();
-    Buffer buffer = inputBuffers[bufferIndex];
-    ++bufferIndex;
+  if (useSparseTable_) {
+    if (commitGradient) {
+      asyncSGDSparseTables(request, inputBuffers);
+    }
+  } else {
+    size_t bufferIndex = 0;
+    for (const auto& block : request.blocks()) {
+      int64_t offset = getBlockOffset(block);
+      CHECK_GE(offset, 0) << "Only existing parameter block is allowed: "
+                          << " id=" << block.para_id()
+                          << " block id=" << block.block_id();
+      int64_t blockId = getBlockId(block);
+      CHECK_GE(blockId, 0) << "Only existing parameter block is allowed: "
+          << " id=" << block.para_id() << " block id=" << block.block_id();
+      Buffer buffer = inputBuffers[bufferIndex];
+      ++bufferIndex;
 
-    size_t size = buffer.size;
+      size_t size = buffer.size;
 
-    BlockInfo& info = blockInfos_[blockId];
-    const ParameterConfig& config = getParameterConfig(blockId);
+      BlockInfo& info = blockInfos_[blockId];
+      const ParameterConfig& config = getParameterConfig(blockId);
 
-    std::lock_guard<std::mutex> guard(*info.lock);
-    /// gradients are too obsolete, will be discarded
-    if (commitGradient) {
-      info.optimizer->startBatch(numSamplesProcessed_);
+      std::lock_guard<std::mutex> guard(*info.lock);
+      /// gradients are too obsolete, will be discarded
+      if (commitGradient) {
+        info.optimizer->startBatch(numSamplesProcessed_);
 
-      for (const auto type : info.optimizer->getParameterTypes()) {
-        vecs[type]->subVecFrom(*vectors_[type], offset, size);
-      }
-      vecs[PARAMETER_GRADIENT]->subVecFrom(buffer.base, 0, size);
-      info.optimizer->update(vecs, config, isSparseServer_ ? 0 : -1);
+        getBlockVecs(info, size, vecs);
+        vecs[PARAMETER_GRADIENT]->subVecFrom(buffer.base, 0, size);
+        info.optimizer->update(vecs, config, isSparseServer_ ? 0 : -1);
 
-      if (auto callback = info.optimizer->needSpecialTraversal(config)) {
-        blockTraverse(info, config, offset, size, vecs, callback);
+        if (auto callback = info.optimizer->needSpecialTraversal(config)) {
+          blockTraverse(info, config, offset, size, vecs, callback);
+        }
+        info.optimizer->finishBatch();
       }
-      info.optimizer->finishBatch();
-    }
 
-    if (commitGradient && isSparseServer_) {
-      localBlockBitset[blockId] = true;
-    }
+      if (commitGradient && isSparseServer_) {
+        localBlockBitset[blockId] = true;
+      }
 
-    if (!isSparseServer_ && request.send_back_parameter()) {  // dense
-      int type = request.send_back_parameter_type();
-      sendBackParameter(block, type, response, &buffer, outputBuffers);
-    }
-  }  /// foreach block
+      if (!isSparseServer_ && request.send_back_parameter()) {  // dense
+        int type = request.send_back_parameter_type();
+        sendBackParameter(block, type, response, &buffer, outputBuffers);
+      }
+    }  /// foreach block
+  }
 
   asyncTrainerSteps_[request.trainer_id()] = asyncUpdateSteps_;
 
@@ -671,6 +897,46 @@ void ParameterServer2::asyncSGD(const SendParameterRequest& request,
   }
 }
 
+void ParameterServer2::asyncSGDSparseTables(
+    const SendParameterRequest& request, std::vector<Buffer>& inputBuffers) {
+  /// one batch of the optimizer of each table with blocks in the request
+  std::vector<SparseTableInfo*> tables;
+  for (const auto& block : request.blocks()) {
+    SparseTableInfo* info = &getSparseTable(block.para_id(), block.block_id());
+    if (std::find(tables.begin(), tables.end(), info) == tables.end()) {
+      tables.push_back(info);
+    }
+  }
+  for (auto info : tables) {
+    std::lock_guard<RWLock> guard(info->optimizerLock);
+    info->optimizer->startBatch(numSamplesProcessed_);
+  }
+
+  VectorPtr* vecs = Parameter::getTlsTempBufs();
+  size_t bufferIndex = 0;
+  for (const auto& block : request.blocks()) {
+    SparseTableInfo& info = getSparseTable(block.para_id(), block.block_id());
+    uint64_t row = block.block_id();
+    Buffer buffer = inputBuffers[bufferIndex];
+    ++bufferIndex;
+    CHECK_EQ(buffer.size, info.config->parameter_block_size());
+
+    ReadLockGuard optimizerGuard(info.optimizerLock);
+    std::lock_guard<std::mutex> guard(getRowLock(info, row));
+    getSparseRowVecs(info, row, vecs);
+    vecs[PARAMETER_GRADIENT]->subVecFrom(buffer.base, 0, buffer.size);
+    info.optimizer->update(vecs, *info.config, row);
+  }
+
+  for (auto info : tables) {
+    std::lock_guard<RWLock> guard(info->optimizerLock);
+    if (auto callback = info->optimizer->needSpecialTraversal(*info->config)) {
+      sparseTableTraverse(*info, callback);
+    }
+    info->optimizer->finishBatch();
+  }
+}
+
 void ParameterServer2::getParameter(const SendParameterRequest& request,
                                     std::vector<Buffer>& inputBuffers,
                                     SendParameterResponse* response,
@@ -678,9 +944,25 @@ void ParameterServer2::getParameter(const SendParameterRequest& request,
   (void)inputBuffers;
   LOG(INFO) << "pserver: getParameter";
   ReadLockGuard guard(parameterMutex_);
+  int type = request.send_back_parameter_type();
+  if (!useSparseTable_) {
+    for (const auto& block : request.blocks()) {
+      sendBackParameter(block, type, response, outputBuffers);
+    }
+    return;
+  }
+  /// the rows of the sparse tables may move, so they are copied
+  auto& buffer = *readWriteBuffer_;
+  size_t numReals = 0;
+  for (const auto& block : request.blocks()) {
+    numReals += block.block_size();
+  }
+  buffer.resize(numReals);
+  size_t offset = 0;
   for (const auto& block : request.blocks()) {
-    int type = request.send_back_parameter_type();
-    sendBackParameter(block, type, response, outputBuffers);
+    Buffer buf = {buffer.data() + offset, (size_t)block.block_size()};
+    sendBackParameter(block, type, response, &buf, outputBuffers);
+    offset += block.block_size();
   }
 }
 
@@ -694,19 +976,35 @@ void ParameterServer2::getParameterSparse(const SendParameterRequest& request,
   for (const auto& block : request.blocks()) {
     numReals += getParameterConfig(block).dims(1);
   }
-  buffer.resize(numReals);
+  size_t numSparseRowsReals = 0;
+  for (const auto& rows : request.sparse_rows()) {
+    numSparseRowsReals +=
+        rows.row_ids_size() * configMap_.at(rows.para_id()).dims(1);
+  }
+  buffer.resize(numReals + numSparseRowsReals);
 
-  VLOG(3) << "pserver: getParameterSparse, numReals=" << numReals;
+  VLOG(3) << "pserver: getParameterSparse, numReals=" << numReals
+          << " numSparseRowsReals=" << numSparseRowsReals;
 
   ReadLockGuard guard(parameterMutex_);
   size_t offset = 0;
+  int type = request.send_back_parameter_type();
   for (const auto& block : request.blocks()) {
     size_t width = getParameterConfig(block).dims(1);
     Buffer buf = {buffer.data() + offset, width};
-    int type = request.send_back_parameter_type();
     sendBackParameterSparse(block, type, response, &buf, width, outputBuffers);
     offset += width;
   }
+  if (numSparseRowsReals) {
+    Buffer buf = {buffer.data() + offset, numSparseRowsReals};
+    getSparseRows(request, type, &buf);
+    for (const auto& rows : request.sparse_rows()) {
+      SparseRows* returnRows = response->add_sparse_rows();
+      returnRows->set_para_id(rows.para_id());
+      *returnRows->mutable_local_rows() = rows.local_rows();
+    }
+    outputBuffers->push_back(buf);
+  }
 }
 
 void ParameterServer2::sendBackParameter(const ParameterBlock& block,
@@ -738,11 +1036,20 @@ void ParameterServer2::sendBackParameter(const ParameterBlock& block,
   returnBlock->set_begin_pos(block.begin_pos());
   returnBlock->set_block_size(block.block_size());
 
+  size_t size = buffer->size;
+  if (useSparseTable_) {
+    /// the row is not allocated if it is not yet
+    SparseTableInfo& info = getSparseTable(block.para_id(), block.block_id());
+    CHECK_EQ(size, info.config->parameter_block_size());
+    readSparseRow(info, block.block_id(), parameterType, buffer->base);
+    outputBuffers->push_back({buffer->base, size});
+    return;
+  }
+
   int64_t offset = getBlockOffset(block);
   CHECK_GE(offset, 0) << "Only existing parameter block is allowed: "
       << " id=" << block.para_id() << " block id=" << block.block_id();
 
-  size_t size = buffer->size;
   real* valueBuffer = vectors_[parameterType]->getPoint(offset);
   /// copy to second buffer to avoid to be polluted by other request
   memcpy(buffer->base, valueBuffer, sizeof(real) * size);
@@ -758,11 +1065,17 @@ void ParameterServer2::sendBackParameterSparse(
   returnBlock->set_block_id(block.block_id());
   returnBlock->set_begin_pos(block.begin_pos());
   returnBlock->set_block_size(block.block_size());
-  int64_t offset = getBlockOffset(block);
-  CHECK_GE(offset, 0) << "Only existing parameter block is allowed: "
-      << " id=" << block.para_id() << " block id=" << block.block_id();
-
-  real* valueBuffer = vectors_[parameterType]->getPoint(offset);
+  real* valueBuffer;
+  if (useSparseTable_) {
+    valueBuffer = getSparseRowBuf(
+        getSparseTable(block.para_id(), block.block_id()), block.block_id(),
+        parameterType);
+  } else {
+    int64_t blockId = getBlockId(block);
+    CHECK_GE(blockId, 0) << "Only existing parameter block is allowed: "
+        << " id=" << block.para_id() << " block id=" << block.block_id();
+    valueBuffer = getBlockBuf(blockInfos_[blockId], parameterType);
+  }
   CHECK_EQ(buffer->size, width);
   memcpy(buffer->base, valueBuffer, width * sizeof(real));
   outputBuffers->push_back(*buffer);
@@ -788,12 +1101,18 @@ void ParameterServer2::readAllBlocks(
   msgReader->readBlocks(bufs);
 }
 
+void ParameterServer2::onChannelClosed(SocketChannel* channel) {
+  std::lock_guard<std::mutex> guard(pendingBatchesMutex_);
+  pendingBatches_.erase(channel->getId());
+}
+
 void ParameterServer2::sendParameter(const SendParameterRequest& request,
                                      std::unique_ptr<MsgReader> msgReader,
                                      ProtoResponseCallbackEx callback) {
   SendParameterResponse response;
   std::vector<Buffer> inputBuffers;
   std::vector<Buffer> outputBuffers;
+  uint64_t channelId = msgReader->getChannel()->getId();
   readAllBlocks(msgReader.get(), &inputBuffers);
   msgReader.reset();
 
@@ -810,6 +1129,7 @@ void ParameterServer2::sendParameter(const SendParameterRequest& request,
       break;
     case PSERVER_UPDATE_MODE_ASYNC_SGD:
       asyncSGD(request, inputBuffers, &response, &outputBuffers);
+      spillSparseTables();
       break;
     case PSERVER_UPDATE_MODE_ADD_GRADIENT:
       addGradient(request, inputBuffers, &response, &outputBuffers);
@@ -818,14 +1138,24 @@ void ParameterServer2::sendParameter(const SendParameterRequest& request,
       break;
   }
   switch (request.update_mode()) {
-    case PSERVER_UPDATE_MODE_ADD_GRADIENT:
-      (*requestVec_).push_back(request);
-      (*callbackVec_).push_back(callback);
-      if (request.batch_status() == BATCH_FINISH ||
-          request.batch_status() == BATCH_START_AND_FINISH) {
-        for (size_t i = 0; i < (*requestVec_).size(); i++) {
+    case PSERVER_UPDATE_MODE_ADD_GRADIENT: {
+      bool batchFinished = request.batch_status() == BATCH_FINISH ||
+                           request.batch_status() == BATCH_START_AND_FINISH;
+      PendingBatch batch;
+      {
+        std::lock_guard<std::mutex> guard(pendingBatchesMutex_);
+        PendingBatch& pending = pendingBatches_[channelId];
+        pending.requests.push_back(request);
+        pending.callbacks.push_back(callback);
+        if (batchFinished) {
+          batch = std::move(pending);
+          pendingBatches_.erase(channelId);
+        }
+      }
+      if (batchFinished) {
+        for (size_t i = 0; i < batch.requests.size(); i++) {
           ReadLockGuard guard(parameterMutex_);
-          SendParameterRequest& request = (*requestVec_)[i];
+          SendParameterRequest& request = batch.requests[i];
           SendParameterResponse responseTemp;
 
           std::vector<iovec> outputIovs;
@@ -842,11 +1172,9 @@ void ParameterServer2::sendParameter(const SendParameterRequest& request,
             }
           }
 
-          ProtoResponseCallbackEx& callbackTemp = (*callbackVec_)[i];
+          ProtoResponseCallbackEx& callbackTemp = batch.callbacks[i];
           callbackTemp(responseTemp, outputIovs);
         }
-        (*requestVec_).clear();
-        (*callbackVec_).clear();
 
         /// barrier perfromance while all data are send finished.
         /// indicates network flucatuation for big message.
@@ -873,6 +1201,7 @@ void ParameterServer2::sendParameter(const SendParameterRequest& request,
         }
       }
       break;
+    }
     case PSERVER_UPDATE_MODE_SET_PARAM:
     case PSERVER_UPDATE_MODE_SET_PARAM_ZERO:
     case PSERVER_UPDATE_MODE_GET_PARAM:
@@ -1027,11 +1356,126 @@ void ParameterServer2::blockTraverse(
     const ParameterOptimizer::TraverseCallback& callback) {
   /// setup sub bufs
   for (const auto type : info.optimizer->getParameterTypes()) {
-      vecs[type]->subVecFrom(*vectors_[type], offset, size);
+    vecs[type]->subVecFrom(*vectors_[type], offset, size);
   }
   callback(vecs, config, config.sparse_remote_update() ? 0 : -1LU);
 }
 
+void ParameterServer2::getBlockVecs(const BlockInfo& info, size_t size,
+                                    const VectorPtr vecs[]) {
+  for (const auto type : info.optimizer->getParameterTypes()) {
+    vecs[type]->subVecFrom(*vectors_[type], info.offset, size);
+  }
+}
+
+void ParameterServer2::parallelExecForEachSparseRow(SparseTableInfo& info,
+                                                    SparseRowExecFunc func) {
+  SyncThreadPool::execHelper(syncThreadPool_.get(), [&](int tid,
+                                                        size_t numThreads) {
+    VectorPtr* vecs = Parameter::getTlsTempBufs();
+    for (size_t i = tid; i < info.rows.size(); i += numThreads) {
+      uint64_t row = info.rows[i];
+      if (real* data = info.table->findRow(row)) {
+        func(row, data, vecs);
+      }
+    }
+  });
+}
+
+void ParameterServer2::sparseTableTraverse(
+    SparseTableInfo& info,
+    const ParameterOptimizer::TraverseCallback& callback) {
+  const ParameterConfig& config = *info.config;
+  size_t width = config.dims(1);
+  parallelExecForEachSparseRow(info, [&](uint64_t row, real* data,
+                                         const VectorPtr vecs[]) {
+    for (const auto type : info.optimizer->getParameterTypes()) {
+      vecs[type]->subVecFrom(data + getRowTypeOffset(config, type), 0, width);
+    }
+    callback(vecs, config, row);
+  });
+}
+
+void ParameterServer2::getSparseRowVecs(const SparseTableInfo& info,
+                                        uint64_t row, const VectorPtr vecs[]) {
+  real* data = info.table->getRow(row);
+  size_t width = info.config->dims(1);
+  for (const auto type : info.optimizer->getParameterTypes()) {
+    vecs[type]->subVecFrom(data + getRowTypeOffset(*info.config, type), 0,
+                           width);
+  }
+}
+
+static ThreadLocal<std::vector<real>> localRowBuffer_;
+
+void ParameterServer2::readSparseRow(const SparseTableInfo& info,
+                                     uint64_t row, int parameterType,
+                                     real* dest) {
+  auto& data = *localRowBuffer_;
+  data.resize(info.table->getRowSize());
+  info.table->readRow(row, data.data());
+  memcpy(dest, data.data() + getRowTypeOffset(*info.config, parameterType),
+         sizeof(real) * info.config->dims(1));
+}
+
+void ParameterServer2::sgdSparseTable(SparseTableInfo& info) {
+  const ParameterConfig& config = *info.config;
+  info.optimizer->startBatch(numSamplesProcessed_);
+
+  // the rows without gradient in this batch are lazily updated by the
+  // optimizer, when they get gradient again or in op_finish_pass.
+  SyncThreadPool::execHelper(syncThreadPool_.get(), [&](int tid,
+                                                        size_t numThreads) {
+    VectorPtr* vecs = Parameter::getTlsTempBufs();
+    for (size_t i = tid; i < info.updated.size(); i += numThreads) {
+      for (uint64_t bits = info.updated[i]; bits; bits &= bits - 1) {
+        uint64_t row = i * 64 + __builtin_ctzll(bits);
+        getSparseRowVecs(info, row, vecs);
+        info.optimizer->update(vecs, config, row);
+        vecs[PARAMETER_GRADIENT]->zeroMem();
+      }
+      info.updated[i] = 0;
+    }
+  });
+
+  if (auto callback = info.optimizer->needSpecialTraversal(config)) {
+    sparseTableTraverse(info, callback);
+  }
+  info.optimizer->finishBatch();
+}
+
+void ParameterServer2::randomizeSparseRow(const ParameterConfig& config,
+                                          uint64_t row, real* value) {
+  /// splitmix64 of <para_id, row>
+  uint64_t seed = config.para_id() * 0x9E3779B97F4A7C15ULL + row;
+  seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+  seed ^= seed >> 31;
+
+  unsigned int& randSeed = *ThreadLocalRand::getSeed();
+  unsigned int savedSeed = randSeed;
+  randSeed = static_cast<unsigned int>(seed);
+  Parameter::randomize(std::make_shared<CpuVector>(config.dims(1), value),
+                       config);
+  randSeed = savedSeed;
+}
+
+void ParameterServer2::spillSparseTables() {
+  if (!useSparseTable_ || FLAGS_pserver_sparse_table_max_rows <= 0) {
+    return;
+  }
+  size_t maxRows = FLAGS_pserver_sparse_table_max_rows;
+  std::lock_guard<RWLock> guard(parameterMutex_);
+  for (auto& it : sparseTables_) {
+    SparseRowTable& table = *it.second->table;
+    table.tick();
+    if (table.getNumResidentRows() > maxRows) {
+      /// spill a bit more than needed so that it does not run every batch
+      table.spill(maxRows - maxRows / 8);
+    }
+  }
+}
+
 void ParameterServer2::op_SGD(const Operation& operation,
                               OperationResult* result) {
   (void)operation;
@@ -1046,6 +1490,9 @@ void ParameterServer2::op_SGD(const Operation& operation,
   {
     REGISTER_TIMER_DYNAMIC("op_SGD", -1, *statSet_);
 
+    for (auto& it : sparseTables_) {
+      sgdSparseTable(*it.second);
+    }
     parallelExecForEachBlock([&](int64_t blockId, const VectorPtr vecs[]) {
       BlockInfo& info = blockInfos_[blockId];
       const ParameterConfig& config = getParameterConfig(blockId);
@@ -1054,12 +1501,15 @@ void ParameterServer2::op_SGD(const Operation& operation,
 
       info.optimizer->startBatch(numSamplesProcessed_);
 
-      for (const auto type : info.optimizer->getParameterTypes()) {
-          vecs[type]->subVecFrom(*vectors_[type], offset, size);
+      // the rows without gradient in this batch are lazily updated by the
+      // optimizer, when they get gradient again or in op_finish_pass.
+      if (!config.sparse_remote_update() || info.updated) {
+        getBlockVecs(info, size, vecs);
+        info.optimizer->update(vecs, config,
+                config.sparse_remote_update() ? 0 : -1LU);
+        vecs[PARAMETER_GRADIENT]->zeroMem();
+        info.updated = false;
       }
-      info.optimizer->update(vecs, config,
-              config.sparse_remote_update() ? 0 : -1LU);
-      vecs[PARAMETER_GRADIENT]->zeroMem();
 
       if (auto callback = info.optimizer->needSpecialTraversal(config)) {
         blockTraverse(info, config, offset, size, vecs, callback);
@@ -1077,6 +1527,9 @@ void ParameterServer2::op_start_pass(const Operation& operation,
   (void)operation;
   (void)result;
 
+  for (auto& it : sparseTables_) {
+    it.second->optimizer->startPass();
+  }
   parallelExecForEachBlock([&](int64_t blockId, const VectorPtr vecs[]) {
     BlockInfo& info = blockInfos_[blockId];
     info.optimizer->startPass();
@@ -1088,6 +1541,14 @@ void ParameterServer2::op_finish_pass(const Operation& operation,
   (void)operation;
   (void)result;
 
+  for (auto& it : sparseTables_) {
+    SparseTableInfo& info = *it.second;
+    if (auto callback = info.optimizer->startCatchUpWith()) {
+      sparseTableTraverse(info, callback);
+      info.optimizer->finishCatchUpWith();
+    }
+    info.optimizer->finishPass();
+  }
   parallelExecForEachBlock([&](int64_t blockId, const VectorPtr vecs[]) {
     BlockInfo& info = blockInfos_[blockId];
     const ParameterConfig& config = getParameterConfig(blockId);
@@ -1112,6 +1573,16 @@ void ParameterServer2::op_apply(const Operation& operation,
   (void)operation;
   (void)result;
 
+  for (auto& it : sparseTables_) {
+    SparseTableInfo& info = *it.second;
+    if (auto callback = info.optimizer->startCatchUpWith()) {
+      sparseTableTraverse(info, callback);
+      info.optimizer->finishCatchUpWith();
+    }
+    if (auto callback = info.optimizer->apply()) {
+      sparseTableTraverse(info, callback);
+    }
+  }
   parallelExecForEachBlock([&](int64_t blockId, const VectorPtr vecs[]) {
     BlockInfo& info = blockInfos_[blockId];
     const ParameterConfig& config = getParameterConfig(blockId);
@@ -1135,6 +1606,20 @@ void ParameterServer2::op_randomize(const Operation& operation,
                                     OperationResult* result) {
   LOG(INFO) << "ParameterServer2::op_randomize: serverId=" << serverId_;
 
+  if (useSparseTable_) {
+    /// the new rows are randomized when they are allocated
+    randomizeSparseRows_ = true;
+    for (auto& it : sparseTables_) {
+      SparseTableInfo& info = *it.second;
+      size_t valueOffset = getRowTypeOffset(*info.config, PARAMETER_VALUE);
+      parallelExecForEachSparseRow(info, [&](uint64_t row, real* data,
+                                             const VectorPtr vecs[]) {
+        randomizeSparseRow(*info.config, row, data + valueOffset);
+      });
+    }
+    return;
+  }
+
   CpuVector& valueVec = *vectors_[PARAMETER_VALUE];
 
   parallelExecForEachBlock([&](int64_t blockId, const VectorPtr vecs[]) {
@@ -1160,7 +1645,6 @@ void ParameterServer2::loadValueVector(const LoadValueRequest& request,
   std::ifstream fs(filename, std::ios_base::binary);
   CHECK(fs) << "Fail to open " << filename;
 
-  CpuVector& vec = *vectors_[PARAMETER_VALUE];
   Parameter::Header header;
   CHECK(fs.read(reinterpret_cast<char*>(&header), sizeof(header)))
       << "Fail to read parameters in pserver";
@@ -1171,12 +1655,63 @@ void ParameterServer2::loadValueVector(const LoadValueRequest& request,
       << "(" << size_ << ") of the pserver: " << serverId_;
   CHECK_EQ(header.valueSize, sizeof(real)) << "Unsupported valueSize "
                                            << header.valueSize;
-  CHECK(fs.read(reinterpret_cast<char*>(vec.getData()),
-                header.size * sizeof(real)));
+  if (useSparseTable_) {
+    loadSparseTables(fs);
+  } else {
+    CpuVector& vec = *vectors_[PARAMETER_VALUE];
+    CHECK(fs.read(reinterpret_cast<char*>(vec.getData()),
+                  header.size * sizeof(real)));
+  }
 
   callback(response);
 }
 
+void ParameterServer2::loadSparseTables(std::istream& is) {
+  std::lock_guard<RWLock> guard(parameterMutex_);
+  size_t maxRows = FLAGS_pserver_sparse_table_max_rows;
+  std::vector<real> value;
+  std::vector<real> initialRow;
+  for (SparseTableInfo* info : getSortedSparseTables()) {
+    SparseRowTable& table = *info->table;
+    size_t size = info->config->parameter_block_size();
+    size_t valueOffset = getRowTypeOffset(*info->config, PARAMETER_VALUE);
+    value.resize(size);
+    for (uint64_t row : info->rows) {
+      CHECK(is.read(reinterpret_cast<char*>(value.data()),
+                    size * sizeof(real)))
+          << "Fail to read parameters in pserver";
+
+      /// the rows which still have their initial value stay unallocated
+      if (!table.findRow(row)) {
+        initialRow.resize(table.getRowSize());
+        table.readRow(row, initialRow.data());
+        if (memcmp(initialRow.data() + valueOffset, value.data(),
+                   size * sizeof(real)) == 0) {
+          continue;
+        }
+      }
+      memcpy(table.getRow(row) + valueOffset, value.data(),
+             size * sizeof(real));
+      if (maxRows > 0 && table.getNumResidentRows() > maxRows) {
+        table.spill(maxRows - maxRows / 8);
+      }
+    }
+  }
+}
+
+std::vector<ParameterServer2::SparseTableInfo*>
+ParameterServer2::getSortedSparseTables() {
+  std::vector<SparseTableInfo*> tables;
+  for (auto& it : sparseTables_) {
+    tables.push_back(it.second.get());
+  }
+  std::sort(tables.begin(), tables.end(),
+            [](const SparseTableInfo* a, const SparseTableInfo* b) {
+              return a->offset < b->offset;
+            });
+  return tables;
+}
+
 void ParameterServer2::saveValueVector(const SaveValueRequest& request,
                                        ProtoResponseCallback callback) {
   SaveValueResponse response;
@@ -1192,13 +1727,21 @@ void ParameterServer2::saveValueVector(const SaveValueRequest& request,
   std::ofstream fs(filename, std::ios_base::binary);
   CHECK(fs) << "Fail to open " << filename;
 
-  CpuVector& vec = vectors_[PARAMETER_APPLY] ? *vectors_[PARAMETER_APPLY]
-                                             : *vectors_[PARAMETER_VALUE];
   Parameter::Header header;
   header.version = Parameter::kFormatVersion;
   header.valueSize = sizeof(real);
   header.size = size_;
 
+  if (useSparseTable_) {
+    CHECK(fs.write(reinterpret_cast<char*>(&header), sizeof(header)))
+        << "Fail to write parameter in pserver: " << serverId_;
+    saveSparseTables(fs);
+    callback(response);
+    return;
+  }
+
+  CpuVector& vec = vectors_[PARAMETER_APPLY] ? *vectors_[PARAMETER_APPLY]
+                                             : *vectors_[PARAMETER_VALUE];
   CHECK_EQ(header.size, vec.getSize());
 
   CHECK(fs.write(reinterpret_cast<char*>(&header), sizeof(header)))
@@ -1211,6 +1754,27 @@ void ParameterServer2::saveValueVector(const SaveValueRequest& request,
   callback(response);
 }
 
+void ParameterServer2::saveSparseTables(std::ostream& os) {
+  ReadLockGuard guard(parameterMutex_);
+  /// the blocks are in the order of their offsets, as in vectors_
+  int applyType = sparseTableTypeIndex_[PARAMETER_APPLY] >= 0
+                      ? PARAMETER_APPLY : PARAMETER_VALUE;
+  std::vector<real> value;
+  for (SparseTableInfo* info : getSortedSparseTables()) {
+    size_t size = info->config->parameter_block_size();
+    value.resize(size);
+    for (uint64_t row : info->rows) {
+      /// a row which is not allocated has no apply value yet
+      bool allocated = info->table->findRow(row) != nullptr;
+      readSparseRow(*info, row, allocated ? applyType : PARAMETER_VALUE,
+                    value.data());
+      CHECK(os.write(reinterpret_cast<char*>(value.data()),
+                     size * sizeof(real)))
+          << "Fail to write parameter in pserver: " << serverId_;
+    }
+  }
+}
+
 void ParameterServer2::op_RESET(const Operation& operation,
                                 OperationResult* result) {
   (void)result;
@@ -1421,6 +1985,8 @@ void ParameterServer2::doOperation(const DoOperationRequest& request,
     }
     (this->*opFunc)(op, opResult);
   }
+  /// the trainers are waiting for the parameters, no request holds a row
+  spillSparseTables();
 
   if (request.send_back_parameter()) {
     /// clean current cost
@@ -1553,6 +2119,7 @@ void ParameterServer2::tuningSgdFinished() {
    * tuning
    */
   statSet_->reset();
+  Timeline::dump();
 }
 
 void ParameterServer2::tuningAsyncsgdMidOutput() {
@@ -1568,6 +2135,7 @@ void ParameterServer2::tuningAsyncsgdFinished() {
   LOG(INFO) << "======== [not accurate] Batch=" << batchId_ << " pass END"
             << "=======";
   printAsyncGradientCommitStatAndReset();
+  Timeline::dump();
 }
 
 }  // namespace paddle
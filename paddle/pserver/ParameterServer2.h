@@ -38,6 +38,7 @@ limitations under the License. */
 #include "ParameterService.pb.h"
 
 #include "ProtoServer.h"
+#include "SparseRowTable.h"
 
 P_DECLARE_int32(port);
 
@@ -143,8 +144,51 @@ protected:
      * with multithreads.
      */
     std::unique_ptr<ParameterOptimizer> optimizer;
+    /// whether a sparse block has gradient in the current batch.
+    bool updated;
   };
   std::vector<BlockInfo> blockInfos_;
+  /**
+   * <para_id, index in blockInfos_ of each row> for the sparse remote
+   * update parameters, -1 for the rows owned by the other pservers.
+   * The rows of SparseRows are resolved with it instead of blockIdMap_.
+   */
+  std::unordered_map<size_t, std::vector<int32_t>> sparseRowBlocks_;
+
+  /**
+   * with --pserver_sparse_table, the rows of a sparse parameter are in a
+   * SparseRowTable instead of vectors_, and have no BlockInfo: the
+   * optimizer, the locks and the record of the updated rows are shared by
+   * all the rows of the parameter, so that a row which is never pulled or
+   * pushed costs a few bits. A row of a table holds the data of the
+   * parameter types of the optimizer in this order.
+   */
+  struct SparseTableInfo {
+    const ParameterConfig* config;
+    /// global offset of the first row, only used for the saved layout
+    uint64_t offset;
+    std::unique_ptr<SparseRowTable> table;
+    /// optimizer of all the rows, the sparse id of a row is its row id
+    std::unique_ptr<ParameterOptimizer> optimizer;
+    /// the startBatch() and finishBatch() of asyncSGD hold it exclusively,
+    /// the updates of the rows hold it shared
+    RWLock optimizerLock;
+    /// the rows owned by this pserver, in the order of their offsets
+    std::vector<uint64_t> rows;
+    /// whether each row of the parameter is owned by this pserver
+    std::vector<bool> owned;
+    /// one bit per row, whether it has gradient in the current batch
+    std::vector<uint64_t> updated;
+    /// the locks of the rows and of their bits in updated, see getRowLock()
+    std::unique_ptr<std::mutex[]> rowLocks;
+  };
+  static const size_t kNumSparseRowLocks = 256;
+  bool useSparseTable_;
+  std::unordered_map<size_t, std::unique_ptr<SparseTableInfo>> sparseTables_;
+  /// index in the rows of the tables of each parameter type, -1 if absent
+  std::vector<int> sparseTableTypeIndex_;
+  /// whether the new rows are randomized, after op_randomize
+  bool randomizeSparseRows_;
 
   typedef std::vector<std::pair<int64_t, int64_t>> BlockSegments;
   /// Because some blocks might not be fully used. We keep a
@@ -246,8 +290,22 @@ protected:
   ThreadBarrier gradientReadyBarrier_;
   ThreadBarrier parameterReadyBarrier_;
   ThreadBarrier passBarrier_;
-  ThreadLocal<std::vector<SendParameterRequest>> requestVec_;
-  ThreadLocal<std::vector<ProtoResponseCallbackEx>> callbackVec_;
+
+  /**
+   * The ADD_GRADIENT requests of the current batch of a connection, which
+   * are answered together when the last one (BATCH_FINISH) comes. Keyed by
+   * SocketChannel::getId(), since the requests of one connection may be
+   * handled by different threads, see SocketReactor.
+   */
+  struct PendingBatch {
+    std::vector<SendParameterRequest> requests;
+    std::vector<ProtoResponseCallbackEx> callbacks;
+  };
+  std::mutex pendingBatchesMutex_;
+  std::unordered_map<uint64_t, PendingBatch> pendingBatches_;
+
+  /// drop the pending batch of a connection closed in the middle of a batch
+  virtual void onChannelClosed(SocketChannel* channel);
 
   std::atomic<int> numPassFinishClients_;
   bool allClientPassFinish_;
@@ -334,7 +392,9 @@ public:
   /// -1 means using TCP transport instead of RDMA
   ParameterServer2(const std::string& addr, int port, int rdmaCpu = -1);
 
-  ~ParameterServer2() {}
+  /// the connections are served by the threads of SocketServer, which have
+  /// to stop before the members of this class are destroyed
+  ~ParameterServer2() { stop(); }
 
   static const std::string kRetMsgInvalidMatrixHandle;
   static const std::string kRetMsgInvalidVectorHandle;
@@ -553,6 +613,123 @@ protected:
     return it->second;
   }
 
+  /// offset of the data of parameterType in the row of a sparse table
+  size_t getRowTypeOffset(const ParameterConfig& config,
+                          int parameterType) const {
+    int index = sparseTableTypeIndex_[parameterType];
+    CHECK_GE(index, 0) << "no parameter type " << parameterType
+                       << " in the sparse table";
+    return index * config.parameter_block_size();
+  }
+
+  /// the data of parameterType of a block
+  real* getBlockBuf(const BlockInfo& info, int parameterType) {
+    return vectors_[parameterType]->getPoint(info.offset);
+  }
+
+  /// set vecs to the data of the parameter types of the optimizer of a block
+  void getBlockVecs(const BlockInfo& info, size_t size,
+                    const VectorPtr vecs[]);
+
+  /// the sparse table of paraId, which must own row
+  SparseTableInfo& getSparseTable(size_t paraId, uint64_t row) {
+    auto it = sparseTables_.find(paraId);
+    CHECK(it != sparseTables_.end())
+        << "not a sparse parameter id: " << paraId;
+    SparseTableInfo& info = *it->second;
+    CHECK(row < info.owned.size() && info.owned[row])
+        << "Only existing parameter block is allowed: "
+        << " id=" << paraId << " block id=" << row;
+    return info;
+  }
+
+  /// the 64 rows which share a word of updated share a lock
+  std::mutex& getRowLock(const SparseTableInfo& info, uint64_t row) {
+    return info.rowLocks[(row >> 6) % kNumSparseRowLocks];
+  }
+
+  /**
+   * @brief the data of parameterType of a row of a sparse table, allocated
+   *        or loaded back if needed.
+   */
+  real* getSparseRowBuf(const SparseTableInfo& info, uint64_t row,
+                        int parameterType) {
+    return info.table->getRow(row) +
+           getRowTypeOffset(*info.config, parameterType);
+  }
+
+  /// set vecs to the data of the parameter types of the optimizer of a row
+  void getSparseRowVecs(const SparseTableInfo& info, uint64_t row,
+                        const VectorPtr vecs[]);
+
+  /**
+   * @brief copy parameterType of a row of a sparse table to dest, without
+   *        allocating the row.
+   */
+  void readSparseRow(const SparseTableInfo& info, uint64_t row,
+                     int parameterType, real* dest);
+
+  /// add the gradient of a row of a sparse table and mark it updated
+  void addSparseRowGradient(SparseTableInfo& info, uint64_t row,
+                            const real* gradient);
+
+  /// setParameter() with --pserver_sparse_table
+  void setSparseTables(const SendParameterRequest& request,
+                       std::vector<Buffer>& inputBuffers);
+
+  /// op_SGD() of a sparse table, which updates the rows with gradient
+  void sgdSparseTable(SparseTableInfo& info);
+
+  /// asyncSGD() with --pserver_sparse_table
+  void asyncSGDSparseTables(const SendParameterRequest& request,
+                            std::vector<Buffer>& inputBuffers);
+
+  /// the sparse tables in the order of their offsets
+  std::vector<SparseTableInfo*> getSortedSparseTables();
+
+  /**
+   * @brief randomize the value of a new row of a sparse table. The values
+   *        only depend on the row id, so that the rows which are never
+   *        allocated have the same value in all the runs.
+   */
+  void randomizeSparseRow(const ParameterConfig& config, uint64_t row,
+                          real* value);
+
+  /**
+   * @brief spill the least recently used rows of the sparse tables beyond
+   *        --pserver_sparse_table_max_rows. It waits for the requests which
+   *        hold the pointers to the rows.
+   */
+  void spillSparseTables();
+
+  /// read the values of the blocks of the sparse tables, in the saved layout
+  void loadSparseTables(std::istream& is);
+
+  /// write the values of the blocks of the sparse tables, as saveValueVector
+  void saveSparseTables(std::ostream& os);
+
+  /// index in blockInfos_ of each row of the parameter of rows
+  const std::vector<int32_t>& getSparseRowBlocks(const SparseRows& rows) const {
+    auto it = sparseRowBlocks_.find(rows.para_id());
+    CHECK(it != sparseRowBlocks_.end())
+        << "not a sparse parameter id: " << rows.para_id();
+    return it->second;
+  }
+
+  /**
+   * @brief add the gradients of the SparseRows of request, which are in the
+   *        last input buffer, in parallel over the rows.
+   */
+  void addSparseRowsGradient(const SendParameterRequest& request,
+                             const Buffer& buffer);
+
+  /**
+   * @brief gather the values of the SparseRows of request into buffer,
+   *        in parallel over the rows.
+   */
+  void getSparseRows(const SendParameterRequest& request, int parameterType,
+                     Buffer* buffer);
+
   /// it implictly check blockOffsetMap_ while retrieving blockId
   const ParameterConfig& getParameterConfig(int64_t blockId) const {
     CHECK(blockId >= 0 && blockId < (int64_t) blockInfos_.size())
@@ -652,6 +829,20 @@ protected:
                      int64_t offset, size_t size, const VectorPtr vecs[],
                      const ParameterOptimizer::TraverseCallback& callback);
 
+  /**
+   * call func with multithreads for each row of a sparse table which is
+   * allocated. The rows which are not allocated keep their initial value,
+   * and a spilled row is passed in the spill file instead of being loaded
+   * back.
+   */
+  typedef std::function<void(uint64_t row, real* data, const VectorPtr vecs[])>
+      SparseRowExecFunc;
+  void parallelExecForEachSparseRow(SparseTableInfo& info,
+                                    SparseRowExecFunc func);
+  void sparseTableTraverse(
+      SparseTableInfo& info,
+      const ParameterOptimizer::TraverseCallback& callback);
+
 public:
   typedef void (ParameterServer2::*OperatorFunction)(const Operation& operation,
                                                      OperationResult* result);
@@ -14,6 +14,7 @@ limitations under the License. */
 
 
 #include "ProtoServer.h"
+#include "paddle/utils/Stat.h"
 
 namespace paddle {
 
@@ -30,7 +31,7 @@ void ProtoServer::handleRequest(std::unique_ptr<MsgReader> msgReader,
   auto it = nameToFuncMap_.find(funcName);
   if (it != nameToFuncMap_.end()) {
 #ifndef PADDLE_DISABLE_TIMER
-    gettimeofday(&(*(handleRequestBegin_)), nullptr);
+    nowInTimeval(&(*(handleRequestBegin_)));
 #endif
     it->second(std::move(msgReader), callback);
   } else {
@@ -27,6 +27,8 @@ limitations under the License. */
 
 namespace paddle {
 
+std::atomic<uint64_t> SocketChannel::nextId_(0);
+
 SocketChannel::~SocketChannel() {
   if (tcpRdma_ == F_TCP)
     close(tcpSocket_);
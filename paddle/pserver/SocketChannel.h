@@ -19,6 +19,7 @@ limitations under the License. */
 
 #include <sys/uio.h>
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -76,6 +77,11 @@ public:
   void readBlocks(const std::vector<void*>& bufs);
   void readNextBlock(void* buf);
 
+  /**
+   * @brief the channel the message is read from
+   */
+  SocketChannel* getChannel() const { return channel_; }
+
 protected:
   SocketChannel* channel_;
   std::vector<size_t> blockLengths_;
@@ -87,11 +93,11 @@ protected:
 class SocketChannel {
 public:
   SocketChannel(int socket, const std::string& peerName)
-      : tcpSocket_(socket), peerName_(peerName) {
+      : tcpSocket_(socket), peerName_(peerName), id_(nextId_++) {
     tcpRdma_ = F_TCP;
   }
   SocketChannel(struct sxi_sock* socket, const std::string& peerName)
-      : rdmaSocket_(socket), peerName_(peerName) {
+      : rdmaSocket_(socket), peerName_(peerName), id_(nextId_++) {
     tcpRdma_ = F_RDMA;
   }
 
@@ -99,6 +105,17 @@ public:
 
   const std::string& getPeerName() const { return peerName_; }
 
+  /**
+   * @brief an id which is unique among all the channels of the process,
+   *        unlike the address of the channel, it is never reused.
+   */
+  uint64_t getId() const { return id_; }
+
+  enum ChannelType getChannelType() const { return tcpRdma_; }
+
+  /// socket file descriptor of a F_TCP channel
+  int getTcpSocket() const { return tcpSocket_; }
+
   /**
    * @brief read size bytes.
    *
@@ -149,6 +166,9 @@ protected:
   struct sxi_sock* rdmaSocket_;
   const std::string peerName_;
   enum ChannelType tcpRdma_;
+  const uint64_t id_;
+
+  static std::atomic<uint64_t> nextId_;
 };
 
 }  // namespace paddle
@@ -0,0 +1,235 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "SparseRowTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "paddle/utils/Logging.h"
+
+namespace paddle {
+
+SparseRowTable::SparseRowTable(size_t rowSize, RowInitializer initializer,
+                               const std::string& spillDir)
+    : rowSize_(rowSize),
+      initializer_(initializer),
+      spillDir_(spillDir),
+      shards_(new Shard[kNumShards]),
+      clock_(0),
+      numResidentRows_(0),
+      fd_(-1),
+      fileData_(nullptr),
+      fileRows_(0) {
+  CHECK_GT(rowSize_, 0UL);
+}
+
+SparseRowTable::~SparseRowTable() {
+  for (size_t i = 0; i < kNumShards; ++i) {
+    for (auto chunk : shards_[i].chunks) {
+      chunkAllocator_.free(chunk);
+    }
+  }
+  if (fileData_) {
+    munmap(fileData_, fileRows_ * rowSize_ * sizeof(real));
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+real* SparseRowTable::allocateRow(Shard& shard) {
+  if (shard.freeRows.empty()) {
+    size_t bytes = kChunkRows * rowSize_ * sizeof(real);
+    real* chunk = reinterpret_cast<real*>(chunkAllocator_.alloc(bytes));
+    shard.chunks.push_back(chunk);
+    for (size_t i = kChunkRows; i-- > 0;) {
+      shard.freeRows.push_back(chunk + i * rowSize_);
+    }
+  }
+  real* data = shard.freeRows.back();
+  shard.freeRows.pop_back();
+  numResidentRows_.fetch_add(1, std::memory_order_relaxed);
+  return data;
+}
+
+void SparseRowTable::loadRow(Shard& shard, Slot* slot) {
+  real* data = allocateRow(shard);
+  memcpy(data, getFileRow(slot->fileRow), rowSize_ * sizeof(real));
+  {
+    std::lock_guard<std::mutex> guard(fileLock_);
+    freeFileRows_.push_back(slot->fileRow);
+  }
+  slot->data = data;
+}
+
+void SparseRowTable::freeChunks(Shard& shard) {
+  if (shard.freeRows.size() < kChunkRows) {
+    return;
+  }
+  std::sort(shard.chunks.begin(), shard.chunks.end());
+  auto chunkOf = [&shard](real* row) {
+    return std::upper_bound(shard.chunks.begin(), shard.chunks.end(), row) -
+           shard.chunks.begin() - 1;
+  };
+  std::vector<size_t> numFreeRows(shard.chunks.size(), 0);
+  for (auto row : shard.freeRows) {
+    ++numFreeRows[chunkOf(row)];
+  }
+  auto isUnused = [&](real* row) {
+    return numFreeRows[chunkOf(row)] == kChunkRows;
+  };
+  shard.freeRows.erase(
+      std::remove_if(shard.freeRows.begin(), shard.freeRows.end(), isUnused),
+      shard.freeRows.end());
+  size_t numChunks = 0;
+  for (size_t i = 0; i < shard.chunks.size(); ++i) {
+    if (numFreeRows[i] == kChunkRows) {
+      chunkAllocator_.free(shard.chunks[i]);
+    } else {
+      shard.chunks[numChunks++] = shard.chunks[i];
+    }
+  }
+  shard.chunks.resize(numChunks);
+}
+
+real* SparseRowTable::getRow(uint64_t row) {
+  Shard& shard = getShard(row);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto ret = shard.slots.insert(std::make_pair(row, Slot{nullptr, 0, 0}));
+  Slot& slot = ret.first->second;
+  slot.lastAccess = clock_.load(std::memory_order_relaxed);
+  if (ret.second) {
+    slot.data = allocateRow(shard);
+    initializer_(row, slot.data);
+  } else if (!slot.data) {
+    loadRow(shard, &slot);
+  }
+  return slot.data;
+}
+
+real* SparseRowTable::findRow(uint64_t row) {
+  Shard& shard = getShard(row);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto it = shard.slots.find(row);
+  if (it == shard.slots.end()) {
+    return nullptr;
+  }
+  const Slot& slot = it->second;
+  return slot.data ? slot.data : getFileRow(slot.fileRow);
+}
+
+void SparseRowTable::readRow(uint64_t row, real* data) {
+  Shard& shard = getShard(row);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto it = shard.slots.find(row);
+  if (it == shard.slots.end()) {
+    initializer_(row, data);
+    return;
+  }
+  const Slot& slot = it->second;
+  memcpy(data, slot.data ? slot.data : getFileRow(slot.fileRow),
+         rowSize_ * sizeof(real));
+}
+
+size_t SparseRowTable::getNumRows() const {
+  size_t numRows = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    std::lock_guard<std::mutex> guard(shards_[i].lock);
+    numRows += shards_[i].slots.size();
+  }
+  return numRows;
+}
+
+size_t SparseRowTable::getMemorySize() const {
+  size_t numChunks = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    std::lock_guard<std::mutex> guard(shards_[i].lock);
+    numChunks += shards_[i].chunks.size();
+  }
+  return numChunks * kChunkRows * rowSize_ * sizeof(real);
+}
+
+void SparseRowTable::growFile(size_t numRows) {
+  if (fd_ < 0) {
+    std::string path = spillDir_ + "/paddle_sparse_rows.XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd_ = mkstemp(name.data());
+    PCHECK(fd_ >= 0) << "Fail to create a spill file in " << spillDir_;
+    /// the file is removed when it is closed
+    unlink(name.data());
+  }
+  numRows = std::max(numRows, 2 * fileRows_);
+  size_t bytes = numRows * rowSize_ * sizeof(real);
+  PCHECK(ftruncate(fd_, bytes) == 0) << "Fail to grow the spill file to "
+                                     << bytes << " bytes";
+  if (fileData_) {
+    munmap(fileData_, fileRows_ * rowSize_ * sizeof(real));
+  }
+  void* data =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  PCHECK(data != MAP_FAILED) << "Fail to map the spill file";
+  fileData_ = reinterpret_cast<real*>(data);
+  for (size_t fileRow = numRows; fileRow-- > fileRows_;) {
+    freeFileRows_.push_back(fileRow);
+  }
+  fileRows_ = numRows;
+}
+
+void SparseRowTable::spill(size_t maxResidentRows) {
+  size_t numResidentRows = getNumResidentRows();
+  if (numResidentRows <= maxResidentRows) {
+    return;
+  }
+  size_t numSpilled = numResidentRows - maxResidentRows;
+
+  /// <last access, row> of the rows in memory
+  std::vector<std::pair<uint64_t, uint64_t>> rows;
+  rows.reserve(numResidentRows);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    for (const auto& it : shards_[i].slots) {
+      if (it.second.data) {
+        rows.push_back(std::make_pair(it.second.lastAccess, it.first));
+      }
+    }
+  }
+  CHECK_EQ(numResidentRows, rows.size());
+  std::nth_element(rows.begin(), rows.begin() + numSpilled, rows.end());
+  rows.resize(numSpilled);
+
+  if (freeFileRows_.size() < numSpilled) {
+    growFile(fileRows_ + numSpilled - freeFileRows_.size());
+  }
+  for (const auto& it : rows) {
+    Shard& shard = getShard(it.second);
+    Slot& slot = shard.slots[it.second];
+    slot.fileRow = freeFileRows_.back();
+    freeFileRows_.pop_back();
+    memcpy(getFileRow(slot.fileRow), slot.data, rowSize_ * sizeof(real));
+    shard.freeRows.push_back(slot.data);
+    slot.data = nullptr;
+  }
+  for (size_t i = 0; i < kNumShards; ++i) {
+    freeChunks(shards_[i]);
+  }
+  numResidentRows_.fetch_sub(numSpilled, std::memory_order_relaxed);
+  VLOG(1) << "spilled " << numSpilled << " sparse rows, "
+          << getNumResidentRows() << " rows in memory";
+}
+
+}  // namespace paddle
@@ -0,0 +1,166 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "paddle/math/Allocator.h"
+#include "paddle/utils/TypeDefs.h"
+
+namespace paddle {
+
+/**
+ * @brief Storage of the rows of a sparse_remote_update parameter in a
+ * pserver, see --pserver_sparse_table.
+ *
+ * A row holds rowSize reals, i.e. the values of all the parameter types
+ * (value, gradient and optimizer states) of the row. It is allocated and
+ * filled by the initializer on its first getRow(), so the rows which are
+ * never pulled or pushed take no memory.
+ *
+ * spill() moves the least recently used rows to a file mapped in memory,
+ * whose next getRow() loads them back, and returns the memory of the chunks
+ * of rows which are left unused to the system.
+ *
+ * getRow() and findRow() may be called concurrently. The pointers they
+ * return are valid until the next spill(), which must not run concurrently
+ * with any other call.
+ */
+class SparseRowTable {
+public:
+  /// fill the data of a new row
+  typedef std::function<void(uint64_t row, real* data)> RowInitializer;
+
+  /**
+   * @param rowSize      number of reals of a row.
+   * @param initializer  filling the new rows.
+   * @param spillDir     directory of the spill file.
+   */
+  SparseRowTable(size_t rowSize, RowInitializer initializer,
+                 const std::string& spillDir);
+
+  ~SparseRowTable();
+
+  size_t getRowSize() const { return rowSize_; }
+
+  /**
+   * @brief the data of the row, allocated if it is new and loaded back if
+   *        it was spilled.
+   */
+  real* getRow(uint64_t row);
+
+  /**
+   * @brief the data of the row without changing where it is stored, i.e.
+   *        in the spill file if it was spilled. nullptr if it is new.
+   */
+  real* findRow(uint64_t row);
+
+  /**
+   * @brief copy the data of the row to data, or the initial data of the
+   *        row if it is new, without allocating it.
+   */
+  void readRow(uint64_t row, real* data);
+
+  /// start a new period of the least recently used policy of spill()
+  void tick() { clock_.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   * @brief spill the least recently used rows to the spill file until at
+   *        most maxResidentRows rows are in memory.
+   */
+  void spill(size_t maxResidentRows);
+
+  /// number of the allocated rows, in memory or spilled
+  size_t getNumRows() const;
+
+  /// number of the rows in memory
+  size_t getNumResidentRows() const {
+    return numResidentRows_.load(std::memory_order_relaxed);
+  }
+
+  /// bytes of the chunks of memory holding the rows in memory
+  size_t getMemorySize() const;
+
+private:
+  struct Slot {
+    /// nullptr if spilled
+    real* data;
+    /// index of the row in the spill file if spilled
+    uint64_t fileRow;
+    /// clock_ of the last getRow()
+    uint64_t lastAccess;
+  };
+
+  /// the rows are split to the shards by their hash, one lock per shard
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<uint64_t, Slot> slots;
+    /// memory of the rows in memory, allocated by chunks of kChunkRows rows
+    /// aligned as the vectors for the simd functions
+    std::vector<real*> chunks;
+    std::vector<real*> freeRows;
+  };
+
+  static const size_t kNumShardBits = 6;
+  static const size_t kNumShards = 1 << kNumShardBits;
+  static const size_t kChunkRows = 256;
+
+  Shard& getShard(uint64_t row) {
+    return shards_[(row * 0x9E3779B97F4A7C15ULL) >> (64 - kNumShardBits)];
+  }
+
+  /// memory of a row in shard, whose lock must be held
+  real* allocateRow(Shard& shard);
+
+  /// load the spilled row of slot back in shard, whose lock must be held
+  void loadRow(Shard& shard, Slot* slot);
+
+  /// free the chunks of shard whose rows are all free
+  void freeChunks(Shard& shard);
+
+  real* getFileRow(uint64_t fileRow) {
+    return fileData_ + fileRow * rowSize_;
+  }
+
+  /// make the spill file hold at least numRows rows
+  void growFile(size_t numRows);
+
+  size_t rowSize_;
+  RowInitializer initializer_;
+  std::string spillDir_;
+
+  /// allocating the chunks directly, a pool would keep the freed ones
+  CpuAllocator chunkAllocator_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<uint64_t> clock_;
+  std::atomic<size_t> numResidentRows_;
+
+  /// the spill file, mapped at fileData_ for fileRows_ rows
+  int fd_;
+  real* fileData_;
+  size_t fileRows_;
+  /// rows of the spill file not used by a spilled row
+  std::mutex fileLock_;
+  std::vector<uint64_t> freeFileRows_;
+};
+
+}  // namespace paddle
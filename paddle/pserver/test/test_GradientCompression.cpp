@@ -0,0 +1,148 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "paddle/pserver/GradientCompression.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+static std::vector<real> randomGradient(size_t size) {
+  std::vector<real> grad(size);
+  for (auto& value : grad) {
+    value = (rand() % 20001 - 10000) / 10000.0;  // NOLINT
+  }
+  return grad;
+}
+
+/// compress grad as the block [offset, offset + len) and add it to sum
+static size_t compressAdd(GradientCompressor& compressor, const real* grad,
+                          size_t offset, size_t len, real* sum) {
+  std::vector<char> data(compressor.getCompressedSize(len));
+  EXPECT_EQ(0UL, data.size() % sizeof(real));
+  compressor.compress(grad, offset, len, data.data());
+  GradientCompressor::decompressAdd(compressor.getType(), data.data(),
+                                    data.size(), sum, len);
+  return data.size();
+}
+
+TEST(GradientCompression, fp16) {
+  for (size_t len : {1, 7, 8, 300, 1001}) {
+    GradientCompressor compressor(GRADIENT_COMPRESSION_FP16, 0, len);
+    EXPECT_EQ((len * 2 + sizeof(real) - 1) / sizeof(real) * sizeof(real),
+              compressor.getCompressedSize(len));
+    auto grad = randomGradient(len);
+    std::vector<real> sum(len, 1);
+    compressAdd(compressor, grad.data(), 0, len, sum.data());
+    for (size_t i = 0; i < len; ++i) {
+      EXPECT_NEAR(1 + grad[i], sum[i], 1e-3);
+    }
+  }
+}
+
+TEST(GradientCompression, topK) {
+  const size_t len = 1000;
+  GradientCompressor compressor(GRADIENT_COMPRESSION_TOP_K, 0.01, len);
+  EXPECT_EQ(10 * (sizeof(real) + sizeof(uint32_t)),
+            compressor.getCompressedSize(len));
+  // at least one element is sent
+  EXPECT_EQ((sizeof(real) + sizeof(uint32_t) + sizeof(real) - 1) /
+                sizeof(real) * sizeof(real),
+            compressor.getCompressedSize(10));
+
+  auto grad = randomGradient(len);
+  std::vector<real> sum(len, 0);
+  compressAdd(compressor, grad.data(), 0, len, sum.data());
+
+  // exactly the 10 largest elements are sent
+  std::vector<real> magnitudes(len);
+  for (size_t i = 0; i < len; ++i) {
+    magnitudes[i] = std::abs(grad[i]);
+  }
+  std::sort(magnitudes.begin(), magnitudes.end());
+  real threshold = magnitudes[len - 10];
+  size_t numSent = 0;
+  for (size_t i = 0; i < len; ++i) {
+    if (sum[i] != 0) {
+      ++numSent;
+      EXPECT_EQ(grad[i], sum[i]);
+      EXPECT_GE(std::abs(grad[i]), threshold);
+    }
+  }
+  EXPECT_EQ(10UL, numSent);
+}
+
+TEST(GradientCompression, errorFeedback) {
+  const size_t len = 100;
+  const size_t offset = 37;
+  GradientCompressor compressor(GRADIENT_COMPRESSION_TOP_K, 0.1, 300);
+  std::vector<real> grad(len, 0);
+  for (size_t i = 0; i < 10; ++i) {
+    grad[i] = 1;
+  }
+  grad[50] = 0.3;
+  std::vector<real> sum(len, 0);
+
+  // the small gradient is accumulated by the residual until it gets larger
+  // than the others
+  for (int batch = 0; batch < 3; ++batch) {
+    compressAdd(compressor, grad.data(), offset, len, sum.data());
+    EXPECT_EQ(0, sum[50]);
+  }
+  compressAdd(compressor, grad.data(), offset, len, sum.data());
+  EXPECT_NEAR(1.2, sum[50], 1e-5);
+
+  // nothing is lost: sending zero gradients flushes the residual
+  std::vector<real> zero(len, 0);
+  for (int batch = 0; batch < 10; ++batch) {
+    compressAdd(compressor, zero.data(), offset, len, sum.data());
+  }
+  for (size_t i = 0; i < len; ++i) {
+    EXPECT_NEAR(4 * grad[i], sum[i], 1e-5);
+  }
+
+  // the residual of the other blocks is untouched
+  std::vector<real> other(len, 0);
+  compressAdd(compressor, zero.data(), 200, len, other.data());
+  for (auto value : other) {
+    EXPECT_EQ(0, value);
+  }
+}
+
+TEST(GradientCompression, sendAll) {
+  // with ratio 1 the residual is always empty and the sum is exact
+  const size_t len = 513;
+  GradientCompressor compressor(GRADIENT_COMPRESSION_TOP_K, 1, len);
+  std::vector<real> sum(len, 0);
+  std::vector<real> expected(len, 0);
+  for (int batch = 0; batch < 3; ++batch) {
+    auto grad = randomGradient(len);
+    compressAdd(compressor, grad.data(), 0, len, sum.data());
+    for (size_t i = 0; i < len; ++i) {
+      expected[i] += grad[i];
+    }
+  }
+  for (size_t i = 0; i < len; ++i) {
+    EXPECT_FLOAT_EQ(expected[i], sum[i]);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -12,6 +12,10 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include <algorithm>
+#include <fstream>
+#include <set>
+
 #include <paddle/pserver/ParameterClient2.h>
 #include <paddle/pserver/ParameterServer2.h>
 #include <gtest/gtest.h>
@@ -22,6 +26,10 @@ using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
 
 P_DECLARE_int32(num_gradient_servers);
+P_DECLARE_int32(math_num_threads);
+P_DECLARE_int32(math_parallel_threshold);
+P_DECLARE_bool(pserver_sparse_table);
+P_DECLARE_int64(pserver_sparse_table_max_rows);
 P_DEFINE_string(server_addr, "127.0.0.1", "assign server address");
 P_DEFINE_int32(server_cpu, 0, "assign server cpu");
 
@@ -85,6 +93,13 @@ public:
   void checkSegments(const BlockSegments& expected, const BlockSegments& segs);
   void waitPassFinishTest();
   void synchronizeTest();
+  void sparseRowsTest(bool parallel);
+  void sparseTableTest();
+  void closedConnectionTest();
+  size_t getNumPendingBatches() {
+    std::lock_guard<std::mutex> guard(pendingBatchesMutex_);
+    return pendingBatches_.size();
+  }
 
 protected:
   ParameterClient2 client_;
@@ -534,6 +549,347 @@ void ParameterServer2Tester::synchronizeTest() {
   LOG(INFO) << "Pass 2 finished";
 }
 
+/**
+ * The SparseRows of a request must get and add the same rows as one
+ * ParameterBlock per row.
+ */
+/// config a sparse pserver with a sparse_remote_update parameter of para_id 0
+static void setSparseConfig(ParameterServer2Tester& server, size_t height,
+                            size_t width, real momentum = 0) {
+  SetConfigRequest configRequest;
+  configRequest.set_is_sparse_server(true);
+  configRequest.set_server_id(0);
+  ParameterConfig& config = *configRequest.add_param_configs();
+  config.set_name("sparse");
+  config.set_para_id(0);
+  config.set_size(height * width);
+  config.add_dims(height);
+  config.add_dims(width);
+  config.set_parameter_block_size(width);
+  config.set_sparse_remote_update(true);
+  config.set_device(-1);
+  config.set_learning_rate(1.0);
+  config.set_momentum(momentum);
+  OptimizationConfig& optConfig = *configRequest.mutable_opt_config();
+  optConfig.set_algorithm("sgd");
+  optConfig.set_batch_size(100);
+  optConfig.set_learning_rate(0.1);
+  server.setConfig(configRequest,
+                   [](const google::protobuf::MessageLite&) {});
+}
+
+void ParameterServer2Tester::sparseRowsTest(bool parallel) {
+  const size_t height = 1000;
+  const size_t width = 32;
+  /// a new pserver, since the parameters of g_server can not be changed
+  ParameterServer2Tester server(FLAGS_server_addr, FLAGS_port + 100);
+  CHECK(server.init());
+  server.start();
+  /// the server starts listening in its own thread
+  sleep(1);
+  setSparseConfig(server, height, width);
+
+  /// the pserver owns the even rows
+  vector<size_t> ownedRows;
+  for (size_t row = 0; row < height; row += 2) {
+    ownedRows.push_back(row);
+  }
+  vector<real> values(ownedRows.size() * width);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i;
+  }
+  SendParameterRequest setRequest;
+  setRequest.set_update_mode(PSERVER_UPDATE_MODE_SET_PARAM);
+  setRequest.set_send_back_parameter(false);
+  setRequest.set_batch_status(BATCH_START_AND_FINISH);
+  vector<Buffer> setBuffers;
+  for (size_t i = 0; i < ownedRows.size(); ++i) {
+    ParameterBlock* block = setRequest.add_blocks();
+    block->set_para_id(0);
+    block->set_block_id(ownedRows[i]);
+    block->set_begin_pos(ownedRows[i] * width);
+    block->set_block_size(width);
+    setBuffers.push_back({values.data() + i * width, width});
+  }
+  SendParameterResponse response;
+  vector<Buffer> outputBuffers;
+  server.setParameter(setRequest, setBuffers, &response, &outputBuffers);
+
+  /// the trainer prefetches some owned rows in random order
+  vector<size_t> rows;
+  for (size_t i = 0; i < ownedRows.size(); ++i) {
+    if (rand() % 3) {  // NOLINT
+      rows.push_back(ownedRows[i]);
+    }
+  }
+  std::random_shuffle(rows.begin(), rows.end());
+
+  SendParameterRequest blocksRequest;
+  SendParameterRequest rowsRequest;
+  for (auto request : {&blocksRequest, &rowsRequest}) {
+    request->set_update_mode(PSERVER_UPDATE_MODE_GET_PARAM_SPARSE);
+    request->set_send_back_parameter(false);
+    request->set_batch_status(BATCH_START);
+    request->set_trainer_id(0);
+  }
+  SparseRows& sparseRows = *rowsRequest.add_sparse_rows();
+  sparseRows.set_para_id(0);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    ParameterBlock* block = blocksRequest.add_blocks();
+    block->set_para_id(0);
+    block->set_block_id(rows[i]);
+    block->set_begin_pos(i * width);
+    block->set_block_size(width);
+    sparseRows.add_row_ids(rows[i]);
+    sparseRows.add_local_rows(i);
+  }
+
+  int threshold = FLAGS_math_parallel_threshold;
+  FLAGS_math_parallel_threshold = parallel ? 1 : 0;
+
+  vector<Buffer> noBuffers;
+  SendParameterResponse blocksResponse;
+  vector<Buffer> blocksOutput;
+  server.getParameterSparse(blocksRequest, noBuffers, &blocksResponse,
+                            &blocksOutput);
+  vector<real> expected;
+  for (auto& buffer : blocksOutput) {
+    expected.insert(expected.end(), buffer.base, buffer.base + buffer.size);
+  }
+  SendParameterResponse rowsResponse;
+  vector<Buffer> rowsOutput;
+  server.getParameterSparse(rowsRequest, noBuffers, &rowsResponse,
+                            &rowsOutput);
+  EXPECT_EQ(0, rowsResponse.blocks_size());
+  ASSERT_EQ(1, rowsResponse.sparse_rows_size());
+  EXPECT_EQ(rows.size(), (size_t)rowsResponse.sparse_rows(0).local_rows_size());
+  EXPECT_EQ(rows.size() - 1, rowsResponse.sparse_rows(0).local_rows(
+                                 rows.size() - 1));
+  ASSERT_EQ(1UL, rowsOutput.size());
+  ASSERT_EQ(expected.size(), rowsOutput[0].size);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], rowsOutput[0].base[i]);
+  }
+
+  /// the gradients of the rows are added once as blocks and once as rows
+  vector<real> gradients(rows.size() * width);
+  for (size_t i = 0; i < gradients.size(); ++i) {
+    gradients[i] = rand() % 100;  // NOLINT
+  }
+  vector<Buffer> blocksBuffers;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    blocksBuffers.push_back({gradients.data() + i * width, width});
+  }
+  vector<Buffer> rowsBuffers = {{gradients.data(), gradients.size()}};
+  blocksRequest.set_update_mode(PSERVER_UPDATE_MODE_ADD_GRADIENT);
+  rowsRequest.set_update_mode(PSERVER_UPDATE_MODE_ADD_GRADIENT);
+  server.addGradient(blocksRequest, blocksBuffers, &blocksResponse,
+                     &blocksOutput);
+  server.addGradient(rowsRequest, rowsBuffers, &rowsResponse, &rowsOutput);
+  FLAGS_math_parallel_threshold = threshold;
+
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const real* gradientSum;
+    if (server.useSparseTable_) {
+      const SparseTableInfo& info = *server.sparseTables_[0];
+      EXPECT_TRUE(info.updated[rows[i] / 64] >> (rows[i] % 64) & 1);
+      gradientSum =
+          server.getSparseRowBuf(info, rows[i], PARAMETER_GRADIENT);
+    } else {
+      int64_t blockId = server.sparseRowBlocks_[0][rows[i]];
+      const BlockInfo& info = server.blockInfos_[blockId];
+      EXPECT_TRUE(info.updated);
+      gradientSum = server.getBlockBuf(info, PARAMETER_GRADIENT);
+    }
+    for (size_t j = 0; j < width; ++j) {
+      EXPECT_EQ(2 * gradients[i * width + j], gradientSum[j]);
+    }
+  }
+}
+
+/// the values of the rows of para_id 0 pulled from server as SparseRows
+static vector<real> pullSparseRows(ParameterServer2Tester& server,
+                                   const vector<size_t>& rows) {
+  SendParameterRequest request;
+  request.set_update_mode(PSERVER_UPDATE_MODE_GET_PARAM_SPARSE);
+  request.set_send_back_parameter(false);
+  request.set_batch_status(BATCH_START);
+  SparseRows& sparseRows = *request.add_sparse_rows();
+  sparseRows.set_para_id(0);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    sparseRows.add_row_ids(rows[i]);
+    sparseRows.add_local_rows(i);
+  }
+  vector<ParameterServer2::Buffer> noBuffers;
+  vector<ParameterServer2::Buffer> output;
+  SendParameterResponse response;
+  server.getParameterSparse(request, noBuffers, &response, &output);
+  CHECK_EQ(1UL, output.size());
+  return vector<real>(output[0].base, output[0].base + output[0].size);
+}
+
+static string readBinaryFile(const string& filename) {
+  std::ifstream fs(filename, std::ios_base::binary);
+  CHECK(fs) << "Fail to open " << filename;
+  return string(std::istreambuf_iterator<char>(fs),
+                std::istreambuf_iterator<char>());
+}
+
+void ParameterServer2Tester::sparseTableTest() {
+  const size_t height = 1000;
+  const size_t width = 8;
+  auto noCallback = [](const google::protobuf::MessageLite&) {};
+
+  /// the same training on a pserver with vectors_ and one with sparse
+  /// tables, whose rows are spilled beyond 50 rows
+  int64_t maxRows = FLAGS_pserver_sparse_table_max_rows;
+  FLAGS_pserver_sparse_table_max_rows = 50;
+  std::unique_ptr<ParameterServer2Tester> servers[3];
+  for (int i = 0; i < 3; ++i) {
+    servers[i].reset(
+        new ParameterServer2Tester(FLAGS_server_addr, FLAGS_port + 101 + i));
+    CHECK(servers[i]->init());
+    servers[i]->start();
+  }
+  /// the servers start listening in their own threads
+  sleep(1);
+  for (int i = 0; i < 3; ++i) {
+    FLAGS_pserver_sparse_table = i > 0;
+    /// the momentum of the rows without gradient is caught up lazily
+    setSparseConfig(*servers[i], height, width, 0.9);
+  }
+  FLAGS_pserver_sparse_table = false;
+  ParameterServer2Tester& dense = *servers[0];
+  ParameterServer2Tester& table = *servers[1];
+  ParameterServer2Tester& loaded = *servers[2];
+
+  /// the pserver owns the even rows
+  vector<size_t> ownedRows;
+  SendParameterRequest setRequest;
+  setRequest.set_update_mode(PSERVER_UPDATE_MODE_SET_PARAM_ZERO);
+  for (size_t row = 0; row < height; row += 2) {
+    ownedRows.push_back(row);
+    ParameterBlock* block = setRequest.add_blocks();
+    block->set_para_id(0);
+    block->set_block_id(row);
+    block->set_begin_pos(row * width);
+    block->set_block_size(width);
+  }
+  vector<Buffer> noBuffers;
+  for (auto& server : servers) {
+    SendParameterResponse response;
+    vector<Buffer> output;
+    server->setParameter(setRequest, noBuffers, &response, &output);
+  }
+  EXPECT_EQ(0UL, table.sparseTables_[0]->table->getNumRows());
+  /// the rows of the tables have no block infos
+  EXPECT_TRUE(table.blockInfos_.empty());
+  EXPECT_TRUE(table.blockIdMap_.empty());
+  EXPECT_EQ(1UL, table.sparseTables_.size());
+
+  std::set<size_t> usedRows;
+  for (int batch = 0; batch < 5; ++batch) {
+    vector<size_t> rows;
+    for (size_t row : ownedRows) {
+      if (rand() % 5 == 0) {  // NOLINT
+        rows.push_back(row);
+      }
+    }
+    usedRows.insert(rows.begin(), rows.end());
+    EXPECT_EQ(pullSparseRows(dense, rows), pullSparseRows(table, rows));
+
+    SendParameterRequest request;
+    request.set_update_mode(PSERVER_UPDATE_MODE_ADD_GRADIENT);
+    request.set_send_back_parameter(false);
+    request.set_batch_status(BATCH_START);
+    SparseRows& sparseRows = *request.add_sparse_rows();
+    sparseRows.set_para_id(0);
+    for (size_t row : rows) {
+      sparseRows.add_row_ids(row);
+    }
+    vector<real> gradients(rows.size() * width);
+    for (auto& gradient : gradients) {
+      gradient = rand() % 100 - 50;  // NOLINT
+    }
+    for (ParameterServer2Tester* server : {&dense, &table}) {
+      vector<Buffer> buffers = {{gradients.data(), gradients.size()}};
+      SendParameterResponse response;
+      vector<Buffer> output;
+      server->addGradient(request, buffers, &response, &output);
+      server->op_SGD(Operation(), nullptr);
+      server->spillSparseTables();
+    }
+    EXPECT_EQ(usedRows.size(), table.sparseTables_[0]->table->getNumRows());
+    EXPECT_GE(50UL, table.sparseTables_[0]->table->getNumResidentRows());
+  }
+  for (ParameterServer2Tester* server : {&dense, &table}) {
+    server->op_finish_pass(Operation(), nullptr);
+  }
+  EXPECT_EQ(pullSparseRows(dense, ownedRows), pullSparseRows(table, ownedRows));
+  /// pulling all the rows allocated them
+  EXPECT_EQ(ownedRows.size(), table.sparseTables_[0]->table->getNumRows());
+
+  /// the saved parameters are the same, and loaded in a table
+  char denseDir[] = "/tmp/paddle_test_pserver.XXXXXX";
+  char tableDir[] = "/tmp/paddle_test_pserver.XXXXXX";
+  CHECK(mkdtemp(denseDir));
+  CHECK(mkdtemp(tableDir));
+  SaveValueRequest saveRequest;
+  saveRequest.set_dir_name(denseDir);
+  dense.saveValueVector(saveRequest, noCallback);
+  saveRequest.set_dir_name(tableDir);
+  table.saveValueVector(saveRequest, noCallback);
+  string denseFile = string(denseDir) + "/pserver.0000";
+  string tableFile = string(tableDir) + "/pserver.0000";
+  EXPECT_EQ(readBinaryFile(denseFile), readBinaryFile(tableFile));
+
+  LoadValueRequest loadRequest;
+  loadRequest.set_dir_name(tableDir);
+  loaded.loadValueVector(loadRequest, noCallback);
+  /// the rows which still have their initial value are not allocated
+  EXPECT_EQ(usedRows.size(), loaded.sparseTables_[0]->table->getNumRows());
+  EXPECT_EQ(pullSparseRows(dense, ownedRows),
+            pullSparseRows(loaded, ownedRows));
+
+  unlink(denseFile.c_str());
+  unlink(tableFile.c_str());
+  rmdir(denseDir);
+  rmdir(tableDir);
+  FLAGS_pserver_sparse_table_max_rows = maxRows;
+}
+
+void ParameterServer2Tester::closedConnectionTest() {
+  setup();
+  {
+    ProtoClient client(FLAGS_server_addr, FLAGS_port);
+    SendParameterRequest request;
+    request.set_update_mode(PSERVER_UPDATE_MODE_ADD_GRADIENT);
+    request.set_send_back_parameter(false);
+    request.set_batch_status(BATCH_START);
+    request.set_trainer_id(0);
+    /// the response is deferred until BATCH_FINISH, which never comes
+    client.send("sendParameter", request);
+    for (int i = 0; i < 1000 && getNumPendingBatches() == 0; ++i) {
+      usleep(10000);
+    }
+    EXPECT_EQ(1UL, getNumPendingBatches());
+  }
+  for (int i = 0; i < 1000 && getNumPendingBatches() != 0; ++i) {
+    usleep(10000);
+  }
+  EXPECT_EQ(0UL, getNumPendingBatches());
+}
+
+TEST(ParameterServer2, sparseRows) {
+  g_server->sparseRowsTest(/* parallel= */ false);
+  g_server->sparseRowsTest(/* parallel= */ true);
+  FLAGS_pserver_sparse_table = true;
+  g_server->sparseRowsTest(/* parallel= */ true);
+  FLAGS_pserver_sparse_table = false;
+}
+
+TEST(ParameterServer2, sparseTable) { g_server->sparseTableTest(); }
+
 TEST(ParameterServer2, sendParameter) { g_server->sendParameterTest(); }
 
 TEST(ParameterServer2, setConfig) { g_server->setConfigTest(); }
@@ -548,6 +904,8 @@ TEST(ParameterServer2, waitPassFinish) { g_server->waitPassFinishTest(); }
 
 TEST(ParameterServer2, synchronize) { g_server->synchronizeTest(); }
 
+TEST(ParameterServer2, closedConnection) { g_server->closedConnectionTest(); }
+
 TEST(ParameterServer2, sendData) {
   // Set gserver and pserver all 3, so that the test is sufficient.
   int oldFlagsPortsNUm = FLAGS_ports_num;
@@ -602,6 +960,9 @@ int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
   FLAGS_num_gradient_servers = 2;
+  if (FLAGS_math_num_threads < 0) {
+    FLAGS_math_num_threads = 4;
+  }
 
   if (FLAGS_rdma_tcp == "rdma") {
     g_server.reset(new ParameterServer2Tester(FLAGS_server_addr, FLAGS_port,
@@ -15,6 +15,9 @@ limitations under the License. */
 #include "paddle/utils/Util.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "paddle/utils/Stat.h"
 #include "paddle/math/Vector.h"
@@ -51,9 +54,10 @@ public:
     (void)request;
     GetStatusResponse response;
     response.set_status(status_);
-    buffer_.resize(msgReader->getNextBlockLength());
-    msgReader->readNextBlock(&buffer_[0]);
-    callback(response, {{&buffer_[0], buffer_.size()}});
+    /// local, requests of several connections may run at the same time
+    std::string buffer(msgReader->getNextBlockLength(), 0);
+    msgReader->readNextBlock(&buffer[0]);
+    callback(response, {{&buffer[0], buffer.size()}});
   }
 
   void setStatus(const SetStatusRequest& request,
@@ -65,7 +69,6 @@ public:
 
 protected:
   PServerStatus status_;
-  std::string buffer_;
 };
 
 TEST(ProtoServer, regular) {
@@ -99,6 +102,41 @@ TEST(ProtoServer, regular) {
   delete client;
 }
 
+TEST(ProtoServer, concurrentClients) {
+  const int kNumClients = 32;
+  const int kNumRequests = 20;
+  std::vector<std::thread> threads;
+  std::atomic<int> numErrors(0);
+  for (int i = 0; i < kNumClients; ++i) {
+    threads.emplace_back([i, &numErrors]() {
+      ProtoClient client(FLAGS_server_addr, FLAGS_port,
+                         FLAGS_rdma_tcp == "rdma" ? F_RDMA : F_TCP);
+      for (int k = 0; k < kNumRequests; ++k) {
+        std::vector<int> data(1000 + i, i * kNumRequests + k);
+        std::vector<int> echo(data.size());
+        GetStatusRequest request;
+        GetStatusResponse response;
+        auto msgReader = client.sendAndRecv(
+            "getStatusEx", request,
+            {{data.data(), data.size() * sizeof(int)}}, &response);
+        if (msgReader->getNumBlocks() != 1 ||
+            msgReader->getNextBlockLength() != data.size() * sizeof(int)) {
+          ++numErrors;
+          return;
+        }
+        msgReader->readNextBlock(echo.data());
+        if (echo != data) {
+          ++numErrors;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, numErrors);
+}
+
 TEST(ProtoServer, extended) {
 #ifndef PADDLE_ONLY_CPU
   ProtoClient* client;
@@ -173,5 +211,9 @@ int main(int argc, char** argv) {
 
   int ret = RUN_ALL_TESTS();
 
+  /// join the server threads before the static objects are destroyed
+  server->stop();
+  delete server;
+
   exit(ret);
 }
@@ -0,0 +1,146 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "paddle/pserver/SparseRowTable.h"
+#include "paddle/utils/Util.h"
+
+using namespace paddle;  // NOLINT
+
+static const size_t kRowSize = 5;
+
+/// the initial data of a row only depends on the row id
+static void initRow(uint64_t row, real* data) {
+  for (size_t i = 0; i < kRowSize; ++i) {
+    data[i] = row * 10 + i;
+  }
+}
+
+static void setRow(SparseRowTable& table, uint64_t row, real value) {
+  real* data = table.getRow(row);
+  for (size_t i = 0; i < kRowSize; ++i) {
+    data[i] = value + i;
+  }
+}
+
+static void checkRow(SparseRowTable& table, uint64_t row, real value) {
+  std::vector<real> data(kRowSize);
+  table.readRow(row, data.data());
+  for (size_t i = 0; i < kRowSize; ++i) {
+    EXPECT_EQ(value + i, data[i]) << "row " << row;
+  }
+}
+
+TEST(SparseRowTable, lazyAllocation) {
+  SparseRowTable table(kRowSize, initRow, "/tmp");
+  EXPECT_EQ(0UL, table.getNumRows());
+  EXPECT_EQ(nullptr, table.findRow(7));
+
+  /// readRow gives the initial data without allocating the row
+  checkRow(table, 7, 70);
+  EXPECT_EQ(0UL, table.getNumRows());
+
+  real* data = table.getRow(7);
+  EXPECT_EQ(70, data[0]);
+  EXPECT_EQ(1UL, table.getNumRows());
+  EXPECT_EQ(data, table.findRow(7));
+  EXPECT_EQ(data, table.getRow(7));
+
+  setRow(table, 1ULL << 40, -3);
+  checkRow(table, 1ULL << 40, -3);
+  EXPECT_EQ(2UL, table.getNumRows());
+  EXPECT_EQ(2UL, table.getNumResidentRows());
+}
+
+TEST(SparseRowTable, spill) {
+  const size_t numRows = 1000;
+  SparseRowTable table(kRowSize, initRow, "/tmp");
+  for (size_t row = 0; row < numRows; ++row) {
+    setRow(table, row, -real(row));
+  }
+  /// the last rows are the most recently used
+  table.tick();
+  for (size_t row = numRows - 100; row < numRows; ++row) {
+    table.getRow(row);
+  }
+
+  size_t memorySize = table.getMemorySize();
+  EXPECT_LE(numRows * kRowSize * sizeof(real), memorySize);
+  table.spill(100);
+  EXPECT_EQ(100UL, table.getNumResidentRows());
+  EXPECT_EQ(numRows, table.getNumRows());
+  for (size_t row = numRows - 100; row < numRows; ++row) {
+    real* data = table.findRow(row);
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(-real(row), data[0]);
+  }
+  /// the spilled rows are read and changed in the spill file
+  for (size_t row = 0; row < numRows; ++row) {
+    checkRow(table, row, -real(row));
+  }
+  table.findRow(3)[0] = 33;
+  EXPECT_EQ(100UL, table.getNumResidentRows());
+
+  /// and loaded back by getRow
+  EXPECT_EQ(33, table.getRow(3)[0]);
+  EXPECT_EQ(101UL, table.getNumResidentRows());
+
+  /// the file grows and its rows are reused
+  table.spill(0);
+  EXPECT_EQ(0UL, table.getNumResidentRows());
+  /// the chunks left unused are freed
+  EXPECT_EQ(0UL, table.getMemorySize());
+  for (size_t row = 0; row < numRows; row += 2) {
+    table.getRow(row);
+  }
+  table.spill(10);
+  for (size_t row = numRows; row < 2 * numRows; ++row) {
+    setRow(table, row, row);
+  }
+  table.spill(0);
+  EXPECT_EQ(2 * numRows, table.getNumRows());
+  EXPECT_EQ(33, table.getRow(3)[0]);
+  for (size_t row = 4; row < numRows; ++row) {
+    checkRow(table, row, -real(row));
+    checkRow(table, numRows + row, numRows + row);
+  }
+}
+
+TEST(SparseRowTable, concurrentGetRow) {
+  const size_t numThreads = 4;
+  const size_t numRows = 5000;
+  SparseRowTable table(kRowSize, initRow, "/tmp");
+  std::vector<std::thread> threads;
+  for (size_t tid = 0; tid < numThreads; ++tid) {
+    threads.emplace_back([&table, tid]() {
+      for (size_t row = tid; row < numRows; ++row) {
+        real* data = table.getRow(row);
+        EXPECT_EQ(row * 10, data[0]);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(numRows, table.getNumRows());
+  EXPECT_EQ(numRows, table.getNumResidentRows());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  initMain(argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -16,11 +16,19 @@ limitations under the License. */
 
 #include "paddle/utils/PythonUtil.h"
 #include "paddle/pserver/ParameterServer2.h"
+#include "paddle/parameter/MappedModel.h"
 #include "ParamUtil.h"
 #include "Trainer.h"
 
 P_DEFINE_string(model_dir, "", "Directory for separated model files");
 P_DEFINE_string(model_file, "", "File for merged model file");
+P_DEFINE_bool(mmap_model_format, false,
+              "Write the page-aligned merged model format, whose parameters "
+              "can be memory-mapped by the predictor without being copied");
+P_DEFINE_string(quantize_parameters, "",
+                "Save the weight matrices of the merged model quantized, "
+                "int8 (with a scale per row) or fp16. The cpu fc and table "
+                "layers then compute the test pass on the quantized weights");
 
 using namespace paddle;  // NOLINT
 using namespace std;     // NOLINT
@@ -36,17 +44,32 @@ int main(int argc, char** argv) {
   unique_ptr<GradientMachine> gradientMachine(GradientMachine::create(*config));
   gradientMachine->loadParameters(FLAGS_model_dir);
 
-  ofstream os(FLAGS_model_file);
+  QuantizedType quantizedType = QUANTIZED_NONE;
+  if (FLAGS_quantize_parameters == "int8") {
+    quantizedType = QUANTIZED_INT8;
+  } else if (FLAGS_quantize_parameters == "fp16") {
+    quantizedType = QUANTIZED_FP16;
+  } else {
+    CHECK(FLAGS_quantize_parameters.empty())
+        << "Unknown quantize_parameters: " << FLAGS_quantize_parameters;
+  }
 
   string buf;
   config->getConfig().SerializeToString(&buf);
+  if (FLAGS_mmap_model_format) {
+    MappedModel::write(FLAGS_model_file, buf,
+                       gradientMachine->getParameters(), quantizedType);
+    return 0;
+  }
+
+  ofstream os(FLAGS_model_file);
   int64_t size = buf.size();
   os.write((char*)&size, sizeof(size));
   CHECK(os) << "Fail to write to " << FLAGS_model_file;
   os.write(buf.data(), buf.size());
   vector<ParameterPtr>& parameters = gradientMachine->getParameters();
   for (auto& para : parameters) {
-    para->save(os);
+    para->save(os, quantizedType);
     CHECK(os) << "Fail to write to " << FLAGS_model_file;
   }
   os.close();
@@ -479,6 +479,7 @@ void Trainer::trainOnePass(int passId) {
   FOR_TIMING(globalStat.setThreadInfo(true));
   FOR_TIMING(globalStat.printAllStatus());
   FOR_TIMING(globalStat.reset());
+  Timeline::dump();
 
   if (testDataProvider_) {
     tester_->testOnePeriod();
@@ -513,6 +514,7 @@ void Trainer::trainOnePassBatch(int passId) {
   globalStat.setThreadInfo(true);
   globalStat.printAllStatus();
   globalStat.reset();
+  Timeline::dump();
 
   LOG(INFO) << " Pass=" << passId
             << " AcceptedPass=" << (accepted ? acceptedPassId_ : -1)
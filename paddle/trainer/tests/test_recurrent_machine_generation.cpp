@@ -103,6 +103,12 @@ TEST(RecurrentGradientMachine, test_generation) {
   for (auto useGpu : useGpuConfs) {
     testGeneration(useGpu, expectRetFileBeam);
   }
+  // beam search which only outputs the best result of every sample
+  FLAGS_config_args = "beam_search=1,num_results_per_sample=1";
+  string expectRetFileBeamOneResult = expectFile + ".beam1";
+  for (auto useGpu : useGpuConfs) {
+    testGeneration(useGpu, expectRetFileBeamOneResult);
+  }
 }
 #endif
 
@@ -40,7 +40,10 @@ std::ostream &operator<<(std::ostream &output, BarrierStatBase &stat) {
 
 BarrierStatBase::BarrierStatBase(uint16_t numConnThreads,
                                  const std::string &name)
-    : totSamples_(0), numConnThreads_(numConnThreads), name_(name) {
+    : totSamples_(0),
+      numConnThreads_(numConnThreads),
+      name_(name),
+      timelineId_(Timeline::getNameId(name)) {
   abstract_.resize(numConnThreads_);
   if (FLAGS_log_barrier_show_log) {
     rateThreshold_ = 0.0;
@@ -71,6 +74,9 @@ BarrierEndStat::BarrierEndStat(uint16_t numConnThreads, const std::string &name)
  */
 void BarrierEndStat::updateStat(struct timeval &cur, int32_t trainerId) {
   CHECK_LT(trainerId, numConnThreads_) << "trainerId is invalid in barrier";
+  if (Timeline::enabled()) {
+    Timeline::addBarrier(timelineId_, timeToMicroSecond(cur), trainerId, 0);
+  }
 
   std::lock_guard<std::mutex> guard(lock_);
   timeVector_->addTimeval(cur, trainerId);
@@ -216,6 +222,9 @@ BarrierDeltaStat::BarrierDeltaStat(uint16_t numConnThreads,
 
 void BarrierDeltaStat::updateStat(uint64_t delta, int32_t trainerId) {
   CHECK_LT(trainerId, numConnThreads_) << "trainerId is invalid in barrier";
+  if (Timeline::enabled()) {
+    Timeline::addBarrier(timelineId_, nowInMicroSec(), trainerId, delta);
+  }
 
   std::lock_guard<std::mutex> guard(lock_);
   timeVector_->addTimeval(delta, trainerId);
@@ -235,6 +235,7 @@ protected:
   uint16_t numConnThreads_;  // total updates needed
   float rateThreshold_;
   std::string name_;
+  uint32_t timelineId_;  // id of name_ in Timeline
 };
 
 // the end-time of arriving real/forged barrier position
@@ -313,7 +314,7 @@ private:
       BarrierStatPtr __stat =                                          \
           (set).getStat(numConnThreads, internalName, BARRIER_END);    \
       struct timeval cur;                                              \
-      gettimeofday(&cur, nullptr);                                     \
+      nowInTimeval(&cur);                                              \
       __stat->updateStat(cur, trainerId);                              \
     }                                                                  \
   } while (0);
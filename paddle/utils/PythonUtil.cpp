@@ -76,6 +76,11 @@ static std::recursive_mutex g_pyMutex;
 
 PyGuard::PyGuard() : guard_(g_pyMutex) {}
 
+void reinitPythonAfterFork() {
+  new (&g_pyMutex) std::recursive_mutex();
+  PyOS_AfterFork();
+}
+
 
 static void printPyErrorStack(std::ostream& os, bool withEndl = false) {
   PyObject * ptype, *pvalue, *ptraceback;
@@ -63,6 +63,14 @@ private:
   std::lock_guard<std::recursive_mutex> guard_;
 };
 
+/**
+ * Call in a child process forked while holding a PyGuard, before calling
+ * python. The lock is owned by a thread of the parent process, so it is
+ * created again, and the child process must exit without releasing the
+ * PyGuard held at fork.
+ */
+void reinitPythonAfterFork();
+
 struct PyObjectDeleter {
   void operator()(PyObject* obj) {
     if (obj) {
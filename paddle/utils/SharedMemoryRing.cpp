@@ -0,0 +1,177 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "SharedMemoryRing.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+
+#include "Logging.h"
+
+namespace paddle {
+
+namespace {
+
+/**
+ * Sleep between two checks of a waiting side: spin a little first, then
+ * sleep longer and longer up to 1ms.
+ */
+class Backoff {
+public:
+  Backoff() : count_(0) {}
+
+  void wait() {
+    if (count_ < 64) {
+      ++count_;
+      sched_yield();
+    } else {
+      usleep(std::min<size_t>(1000, (count_ - 63) * 50));
+      ++count_;
+    }
+  }
+
+  /// whether it waited long enough to check if the other side is alive
+  bool shouldCheck() const { return count_ > 64 && count_ % 100 == 0; }
+
+private:
+  size_t count_;
+};
+
+}  // namespace
+
+SharedMemoryRing::SharedMemoryRing(size_t capacity) : capacity_(capacity) {
+  CHECK_GT(capacity, 0UL);
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  mapSize_ = (sizeof(Header) + capacity + pageSize - 1) / pageSize * pageSize;
+  void* addr = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  PCHECK(addr != MAP_FAILED) << "mmap " << mapSize_ << " bytes";
+  header_ = new (addr) Header();
+  header_->readBytes = 0;
+  header_->writtenBytes = 0;
+  header_->closed = false;
+  header_->stopped = false;
+  buffer_ = reinterpret_cast<char*>(addr) + sizeof(Header);
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  header_->~Header();
+  munmap(header_, mapSize_);
+}
+
+bool SharedMemoryRing::write(const void* data, size_t size,
+                             const AliveCallback& isReaderAlive) {
+  const char* src = reinterpret_cast<const char*>(data);
+  size_t written = header_->writtenBytes.load(std::memory_order_relaxed);
+  Backoff backoff;
+  while (size > 0) {
+    if (header_->stopped.load(std::memory_order_acquire)) {
+      return false;
+    }
+    size_t read = header_->readBytes.load(std::memory_order_acquire);
+    size_t room = capacity_ - (written - read);
+    if (room == 0) {
+      if (backoff.shouldCheck() && isReaderAlive && !isReaderAlive()) {
+        return false;
+      }
+      backoff.wait();
+      continue;
+    }
+    backoff = Backoff();
+    size_t offset = written % capacity_;
+    size_t len = std::min(std::min(room, size), capacity_ - offset);
+    memcpy(buffer_ + offset, src, len);
+    src += len;
+    size -= len;
+    written += len;
+    header_->writtenBytes.store(written, std::memory_order_release);
+  }
+  return true;
+}
+
+bool SharedMemoryRing::writeMessage(const std::vector<char>& msg,
+                                    const AliveCallback& isReaderAlive) {
+  uint64_t size = msg.size();
+  return write(&size, sizeof(size), isReaderAlive) &&
+         write(msg.data(), msg.size(), isReaderAlive);
+}
+
+void SharedMemoryRing::close() {
+  header_->closed.store(true, std::memory_order_release);
+}
+
+bool SharedMemoryRing::read(void* data, size_t size,
+                            const AliveCallback& isWriterAlive) {
+  char* dst = reinterpret_cast<char*>(data);
+  size_t total = size;
+  size_t read = header_->readBytes.load(std::memory_order_relaxed);
+  bool writerDead = false;
+  Backoff backoff;
+  while (size > 0) {
+    // load closed before writtenBytes, the data written before closing is
+    // then visible.
+    bool closed = header_->closed.load(std::memory_order_acquire);
+    size_t written = header_->writtenBytes.load(std::memory_order_acquire);
+    size_t available = written - read;
+    if (available == 0) {
+      if (closed) {
+        CHECK_EQ(size, total) << "The writer closed in the middle of the data";
+        return false;
+      }
+      if (writerDead) {
+        return false;
+      }
+      if (backoff.shouldCheck() && isWriterAlive && !isWriterAlive()) {
+        // check once more, the writer may have written or closed just before
+        // exiting.
+        writerDead = true;
+        continue;
+      }
+      backoff.wait();
+      continue;
+    }
+    backoff = Backoff();
+    size_t offset = read % capacity_;
+    size_t len = std::min(std::min(available, size), capacity_ - offset);
+    memcpy(dst, buffer_ + offset, len);
+    dst += len;
+    size -= len;
+    read += len;
+    header_->readBytes.store(read, std::memory_order_release);
+  }
+  return true;
+}
+
+bool SharedMemoryRing::readMessage(std::vector<char>* msg,
+                                   const AliveCallback& isWriterAlive) {
+  uint64_t size;
+  if (!read(&size, sizeof(size), isWriterAlive)) {
+    return false;
+  }
+  msg->resize(size);
+  return size == 0 || read(msg->data(), size, isWriterAlive);
+}
+
+bool SharedMemoryRing::isClosed() const {
+  return header_->closed.load(std::memory_order_acquire);
+}
+
+void SharedMemoryRing::stop() {
+  header_->stopped.store(true, std::memory_order_release);
+}
+
+}  // namespace paddle
@@ -0,0 +1,126 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "DisableCopy.h"
+
+namespace paddle {
+
+/**
+ * A byte stream from one writer process to one reader process.
+ *
+ * The ring buffer is in an anonymous shared mapping, so the object must be
+ * created before fork(). Then one process writes and the other reads.
+ *
+ * The two sides only share atomic counters, no lock, so a process dying
+ * cannot leave the other one blocked on a lock. A waiting side sleeps a
+ * little between checks, and calls an AliveCallback from time to time so it
+ * does not wait forever for a dead process. The reader can tell a
+ * writer which finished from one which died by isClosed().
+ *
+ * @code{.cpp}
+ * SharedMemoryRing ring(1 << 20);
+ * if (fork() == 0) {
+ *   ring.writeMessage(data);
+ *   ring.close();
+ *   _exit(0);
+ * }
+ * std::vector<char> msg;
+ * while (ring.readMessage(&msg, isAlive)) {
+ *   process(msg);
+ * }
+ * @endcode
+ */
+class SharedMemoryRing {
+public:
+  /// returns false if the process on the other side died
+  typedef std::function<bool()> AliveCallback;
+
+  explicit SharedMemoryRing(size_t capacity);
+  ~SharedMemoryRing();
+  DISABLE_COPY(SharedMemoryRing);
+
+  /**
+   * Write size bytes, waiting for the reader to make room.
+   * @param isReaderAlive checked from time to time while waiting. Can be
+   *                      empty.
+   * @return false if the reader stopped reading, or if isReaderAlive
+   *         returned false.
+   */
+  bool write(const void* data, size_t size,
+             const AliveCallback& isReaderAlive = AliveCallback());
+
+  /**
+   * Write a message read as a whole by readMessage().
+   * @return false if the reader stopped reading, or if isReaderAlive
+   *         returned false.
+   */
+  bool writeMessage(const std::vector<char>& msg,
+                    const AliveCallback& isReaderAlive = AliveCallback());
+
+  /**
+   * Tell the reader nothing more will be written.
+   */
+  void close();
+
+  /**
+   * Read size bytes, waiting for the writer.
+   * @param isWriterAlive returns false if the writer died, or if the reader
+   *                      should stop waiting. Can be empty.
+   * @return false if the writer closed the ring before writing anything
+   *         more, or if isWriterAlive returned false. Fatal if the writer
+   *         closed it in the middle of the data.
+   */
+  bool read(void* data, size_t size, const AliveCallback& isWriterAlive);
+
+  /**
+   * Read a message written by writeMessage().
+   * @return false at the end of the stream, or if isWriterAlive returned
+   *         false.
+   */
+  bool readMessage(std::vector<char>* msg, const AliveCallback& isWriterAlive);
+
+  /**
+   * Whether the writer called close().
+   */
+  bool isClosed() const;
+
+  /**
+   * Tell the writer nothing more will be read, so it stops writing.
+   */
+  void stop();
+
+  size_t getCapacity() const { return capacity_; }
+
+private:
+  struct Header {
+    std::atomic<size_t> readBytes;
+    std::atomic<size_t> writtenBytes;
+    std::atomic<bool> closed;
+    std::atomic<bool> stopped;
+  };
+
+  size_t capacity_;
+  size_t mapSize_;
+  Header* header_;
+  char* buffer_;
+};
+
+}  // namespace paddle
@@ -16,6 +16,7 @@ limitations under the License. */
 
 #include <sys/syscall.h>  // for syscall()
 #include <sys/types.h>
+#include <cmath>
 #include <iomanip>
 #include <algorithm>
 
@@ -33,6 +34,29 @@ pid_t getTID() {
 
 StatSet globalStat("GlobalStatInfo");
 
+uint64_t StatHistogram::getPercentile(double ratio) const {
+  uint64_t count = 0;
+  for (auto n : counts_) {
+    count += n;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::min<uint64_t>(
+      count, std::max<uint64_t>(1, std::ceil(ratio * count)));
+  size_t bucket = 0;
+  for (uint64_t seen = counts_[0]; seen < rank; seen += counts_[++bucket]) {
+  }
+  if (bucket < 2 * kSubBuckets) {
+    return bucket;
+  }
+  // middle of the bucket
+  int exp = bucket / kSubBuckets + kSubBucketBits - 1;
+  int shift = exp - kSubBucketBits;
+  uint64_t low = (kSubBuckets + bucket % kSubBuckets) << shift;
+  return low + ((1UL << shift) >> 1);
+}
+
 void Stat::addSample(uint64_t value) {
   StatInfo* statInfo = statInfo_.get(false);
   if (!statInfo) {
@@ -49,6 +73,7 @@ void Stat::addSample(uint64_t value) {
   }
   statInfo->total_ += value;
   statInfo->count_++;
+  statInfo->histogram_.add(value);
 }
 
 void Stat::mergeThreadStat(StatInfo& allThreadStat) {
@@ -62,6 +87,7 @@ void Stat::mergeThreadStat(StatInfo& allThreadStat) {
     }
     allThreadStat.total_ += buf.first->total_;
     allThreadStat.count_ += buf.first->count_;
+    allThreadStat.histogram_.merge(buf.first->histogram_);
   }
 }
 
@@ -72,6 +98,19 @@ void Stat::reset() {
   }
 }
 
+std::vector<uint64_t> Stat::getPercentiles(const std::vector<double>& ratios) {
+  StatInfo info;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    mergeThreadStat(info);
+  }
+  std::vector<uint64_t> percentiles;
+  for (double ratio : ratios) {
+    percentiles.push_back(info.histogram_.getPercentile(ratio));
+  }
+  return percentiles;
+}
+
 std::ostream& operator<<(std::ostream& outPut, const Stat& stat) {
   std::lock_guard<std::mutex> guard(const_cast<Stat&>(stat).lock_);
   auto showStat = [&](const StatInfo* info, pid_t tid, bool isFirst = true) {
@@ -89,7 +128,15 @@ std::ostream& operator<<(std::ostream& outPut, const Stat& stat) {
              << " avg=" << std::setw(10) << average * 0.001
              << " max=" << std::setw(10) << info->max_ * 0.001
              << " min=" << std::setw(10) << info->min_ * 0.001
-             << " count=" << std::setw(10) << info->count_ << std::endl;
+             << " count=" << std::setw(10) << info->count_
+             << " p50=" << std::setw(10)
+             << info->histogram_.getPercentile(0.5) * 0.001
+             << " p90=" << std::setw(10)
+             << info->histogram_.getPercentile(0.9) * 0.001
+             << " p99=" << std::setw(10)
+             << info->histogram_.getPercentile(0.99) * 0.001
+             << " p999=" << std::setw(10)
+             << info->histogram_.getPercentile(0.999) * 0.001 << std::endl;
     }
   };
   if (!stat.getThreadInfo()) {
@@ -157,11 +204,26 @@ void StatSet::printBarrierTimerStatus() {
   }
 }
 
+void StatSet::printCounterStatus() {
+  ReadLockGuard guard(lock_);
+  if (counters_.empty()) {
+    return;
+  }
+  LOG(INFO) << std::setiosflags(std::ios::left) << std::setfill(' ')
+            << "======= CounterStatSet status ======" << std::endl;
+  for (auto& counter : counters_) {
+    LOG(INFO) << std::setiosflags(std::ios::left) << std::setfill(' ')
+              << "Counter=" << std::setw(30) << counter.first
+              << " value=" << counter.second();
+  }
+}
+
 void StatSet::printAllStatus() {
 #ifndef PADDLE_DISABLE_TIMER
   printSegTimerStatus();
 #endif
   printBarrierTimerStatus();
+  printCounterStatus();
   LOG(INFO) << std::setiosflags(std::ios::left)
             << "--------------------------------------------------"
             << std::endl;
@@ -199,6 +261,24 @@ void StatSet::deleteStat(const std::string& name) {
   statSet_.erase(iter);
 }
 
+void StatSet::registerCounter(const std::string& name,
+                              const std::function<int64_t()>& counter) {
+  std::lock_guard<RWLock> guard(lock_);
+  counters_[name] = counter;
+}
+
+void StatSet::deleteCounter(const std::string& name) {
+  std::lock_guard<RWLock> guard(lock_);
+  counters_.erase(name);
+}
+
+int64_t StatSet::getCounter(const std::string& name) {
+  ReadLockGuard guard(lock_);
+  auto iter = counters_.find(name);
+  CHECK(iter != counters_.end()) << name << " is not registed in " << name_;
+  return iter->second();
+}
+
 StatInfo::~StatInfo() {
   if (stat_) {
     std::lock_guard<std::mutex> guard(stat_->lock_);
@@ -210,6 +290,7 @@ StatInfo::~StatInfo() {
     }
     stat_->destructStat_.total_ += this->total_;
     stat_->destructStat_.count_ += this->count_;
+    stat_->destructStat_.histogram_.merge(this->histogram_);
     stat_->threadLocalBuf_.remove({this, getTID()});
   }
 }
@@ -15,24 +15,77 @@ limitations under the License. */
 #pragma once
 
 #include <stdint.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
 #include <string>
 #include <sys/time.h>
+#include <time.h>
 #include <memory>
 #include <iostream>
 #include <mutex>
 #include <unordered_map>
 #include <list>
+#include <vector>
 
 #include "Logging.h"
 #include "BarrierStat.h"
 #include "Locks.h"
 #include "ThreadLocal.h"
 #include "BarrierStat.h"
+#include "Timeline.h"
 
 namespace paddle {
 
 class Stat;
 
+/**
+ * @brief log-bucketed histogram of the samples of a Stat, to get their
+ * percentiles.
+ *
+ * The samples smaller than 2 * kSubBuckets are counted exactly. The larger
+ * ones are counted in kSubBuckets buckets per power of 2, so that a
+ * percentile is within 1 / (2 * kSubBuckets) of the exact value.
+ */
+class StatHistogram {
+public:
+  StatHistogram() { reset(); }
+
+  void reset() { counts_.fill(0); }
+
+  void add(uint64_t value) { ++counts_[getBucket(value)]; }
+
+  void merge(const StatHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+  }
+
+  /**
+   * @brief get the value under which the ratio of the samples are.
+   * @param ratio in [0, 1], e.g. 0.99 for the 99th percentile.
+   * @return 0 if there is no sample.
+   */
+  uint64_t getPercentile(double ratio) const;
+
+private:
+  static const int kSubBucketBits = 4;
+  static const size_t kSubBuckets = 1 << kSubBucketBits;
+  static const size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  static size_t getBucket(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    int exp = 63 - __builtin_clzll(value);
+    return (exp - kSubBucketBits + 1) * kSubBuckets +
+           ((value >> (exp - kSubBucketBits)) & (kSubBuckets - 1));
+  }
+
+  std::array<uint64_t, kNumBuckets> counts_;
+};
+
 class StatInfo {
 public:
   explicit StatInfo(Stat* stat = nullptr) : stat_(stat) {
@@ -47,6 +100,7 @@ public:
     count_ = 0;
     max_ = 0;
     min_ = UINT64_MAX;
+    histogram_.reset();
   }
 
   ~StatInfo();
@@ -56,6 +110,7 @@ public:
   uint64_t max_;
   uint64_t count_;
   uint64_t min_;
+  StatHistogram histogram_;
 };
 
 class Stat;
@@ -75,6 +130,7 @@ public:
   // print to LOG(INFO)
   void printSegTimerStatus();
   void printBarrierTimerStatus();
+  void printCounterStatus();
   void printAllStatus();
 
   void printStatus(const std::string& name);
@@ -98,6 +154,22 @@ public:
 
   void deleteStat(const std::string& name);
 
+  /**
+   * @brief register a counter, whose current value is printed with the
+   * timers, e.g. the memory of a pool. reset() does not change it.
+   *
+   * A counter of the same name is replaced. The owner of the counter has to
+   * delete it before the function becomes invalid.
+   */
+  void registerCounter(const std::string& name,
+                       const std::function<int64_t()>& counter);
+
+  /// delete the counter, if it is registered
+  void deleteCounter(const std::string& name);
+
+  /// the current value of a registered counter
+  int64_t getCounter(const std::string& name);
+
   // true for showing stats for each thread
   // false for showing stats aggragated over threads
   void setThreadInfo(const std::string& name, bool flag);
@@ -120,6 +192,7 @@ public:
 private:
   std::unordered_map<std::string, StatPtr> statSet_;
   std::unordered_map<std::string, BarrierStatPtr> barrierStatSet_;
+  std::map<std::string, std::function<int64_t()>> counters_;
   const std::string name_;
   RWLock lock_;
 };
@@ -130,18 +203,38 @@ extern StatSet globalStat;
 class Stat {
 public:
   explicit Stat(const std::string& statName)
-      : destructStat_(nullptr), name_(statName), openThreadInfo_(false) {}
+      : destructStat_(nullptr),
+        name_(statName),
+        openThreadInfo_(false),
+        timelineId_(-1) {}
   ~Stat() {}
 
   typedef std::list<std::pair<StatInfo*, pid_t>> ThreadLocalBuf;
 
   const std::string& getName() const { return name_; }
 
+  /// id of the name in Timeline
+  uint32_t getTimelineId() {
+    int64_t id = timelineId_.load(std::memory_order_relaxed);
+    if (id < 0) {
+      id = Timeline::getNameId(name_);
+      timelineId_.store(id, std::memory_order_relaxed);
+    }
+    return id;
+  }
+
   void addSample(uint64_t value);
 
   // clear all stats
   void reset();
 
+  /**
+   * @brief get the percentiles of the samples of all the threads since the
+   * last reset, e.g. {0.5, 0.99} for the median and the 99th percentile.
+   * The timers count in microseconds.
+   */
+  std::vector<uint64_t> getPercentiles(const std::vector<double>& ratios);
+
   friend std::ostream& operator<<(std::ostream& outPut, const Stat& stat);
 
   /*  Set operator << whether to print thread info.
@@ -162,6 +255,7 @@ private:
   ThreadLocal<StatInfo> statInfo_;
   const std::string name_;
   bool openThreadInfo_;
+  std::atomic<int64_t> timelineId_;
 };
 
 extern StatSet globalStat;
@@ -170,10 +264,24 @@ inline StatPtr getStat(const std::string& name) {
   return globalStat.getStat(name);
 }
 
+/**
+ * The timers use the monotonic clock, which does not jump with the system
+ * time.
+ */
 inline uint64_t nowInMicroSec() {
-  timeval tvTime;
-  (void)gettimeofday(&tvTime, NULL);
-  return tvTime.tv_sec * 1000000LU + tvTime.tv_usec;
+  timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LU + ts.tv_nsec / 1000;
+}
+
+/**
+ * The time of nowInMicroSec() as a timeval, for the barrier stats.
+ */
+inline void nowInTimeval(struct timeval* tv) {
+  timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  tv->tv_sec = ts.tv_sec;
+  tv->tv_usec = ts.tv_nsec / 1000;
 }
 
 /**
@@ -188,6 +296,7 @@ public:
   }
   void start() { startStamp_ = nowInMicroSec(); }
   void setStartStamp(uint64_t startStamp) { startStamp_ = startStamp; }
+  uint64_t getStartStamp() const { return startStamp_; }
   uint64_t stop() {
     total_ += nowInMicroSec() - startStamp_;
     return total_;
@@ -220,6 +329,9 @@ public:
                 << "] ";
     }
     stat_->addSample(span);
+    if (Timeline::enabled()) {
+      Timeline::addSpan(stat_->getTimelineId(), timer_.getStartStamp(), span);
+    }
   }
 
 private:
@@ -0,0 +1,325 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "Timeline.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Flags.h"
+#include "Logging.h"
+#include "ThreadLocal.h"
+#include "Util.h"
+
+P_DEFINE_string(timeline_file, "",
+                "If not empty, record the timers and the barriers of all the "
+                "threads and dump them in the Chrome trace event format to "
+                "<timeline_file>.<n>.json at the end of each pass");
+P_DEFINE_int32(timeline_buffer_size, 1 << 16,
+               "Number of the most recent events kept for each thread "
+               "between two dumps of the timeline");
+
+namespace paddle {
+
+pid_t getTID();
+
+bool Timeline::enabled_ = false;
+
+namespace {
+
+struct TimelineEvent {
+  /// start time in microseconds
+  uint64_t time;
+  /// duration of a span, or delta of a barrier
+  uint64_t value;
+  uint32_t nameId;
+  /// trainer of a barrier, -1 for a span
+  int32_t trainerId;
+};
+
+/**
+ * Ring buffer of the events of one thread. Only the owner thread writes it,
+ * so add() takes no lock. collect() may race with add(): the events which
+ * may have been overwritten while being copied are dropped.
+ */
+class ThreadBuffer {
+public:
+  explicit ThreadBuffer(size_t capacity)
+      : events_(capacity), written_(0), read_(0), tid_(getTID()) {}
+
+  void add(const TimelineEvent& event) {
+    size_t n = written_.load(std::memory_order_relaxed);
+    events_[n % events_.size()] = event;
+    written_.store(n + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief append the events written since the previous collect().
+   * @return number of events lost because the buffer was full.
+   */
+  size_t collect(std::vector<TimelineEvent>* events) {
+    size_t capacity = events_.size();
+    size_t end = written_.load(std::memory_order_acquire);
+    size_t begin = std::max(read_, end > capacity ? end - capacity : 0);
+    size_t size = events->size();
+    for (size_t i = begin; i < end; ++i) {
+      events->push_back(events_[i % capacity]);
+    }
+    // drop the events which the owner thread may have overwritten meanwhile.
+    size_t written = written_.load(std::memory_order_acquire);
+    if (written > capacity && written - capacity > begin) {
+      size_t numDropped = std::min(written - capacity, end) - begin;
+      events->erase(events->begin() + size,
+                    events->begin() + size + numDropped);
+      begin += numDropped;
+    }
+    size_t numLost = begin - read_;
+    read_ = end;
+    return numLost;
+  }
+
+  pid_t getTid() const { return tid_; }
+
+  void setName(const std::string& name) {
+    std::lock_guard<std::mutex> guard(lock_);
+    name_ = name;
+  }
+
+  std::string getName() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return name_;
+  }
+
+private:
+  std::vector<TimelineEvent> events_;
+  std::atomic<size_t> written_;
+  /// only accessed by collect(), which is serialized by gDumpLock.
+  size_t read_;
+  pid_t tid_;
+  std::mutex lock_;
+  std::string name_;
+};
+
+std::mutex gBuffersLock;
+/// buffers of all the running threads.
+std::vector<std::shared_ptr<ThreadBuffer>> gBuffers;
+
+std::mutex gNamesLock;
+std::unordered_map<std::string, uint32_t> gNameIds;
+std::vector<std::string> gNames;
+
+/// the events of an exited thread which have not been dumped yet.
+struct RetiredThread {
+  pid_t tid;
+  std::string name;
+  std::vector<TimelineEvent> events;
+  size_t numLost;
+};
+
+std::mutex gDumpLock;
+int gNumDumps = 0;
+/// guarded by gDumpLock.
+std::vector<RetiredThread> gRetiredThreads;
+
+__thread ThreadBuffer* gThreadBuffer = nullptr;
+
+/**
+ * Owns the buffer of a thread. When the thread exits, it moves the events
+ * which are not dumped yet out of the ring buffer, which is then freed.
+ */
+class ThreadBufferOwner {
+public:
+  void own(const std::shared_ptr<ThreadBuffer>& buffer) { buffer_ = buffer; }
+
+  ~ThreadBufferOwner() {
+    if (!buffer_) {
+      return;
+    }
+    gThreadBuffer = nullptr;
+    RetiredThread retired;
+    retired.tid = buffer_->getTid();
+    retired.name = buffer_->getName();
+    {
+      std::lock_guard<std::mutex> dumpGuard(gDumpLock);
+      retired.numLost = buffer_->collect(&retired.events);
+      if (!retired.events.empty() || retired.numLost > 0) {
+        gRetiredThreads.push_back(std::move(retired));
+      }
+    }
+    std::lock_guard<std::mutex> guard(gBuffersLock);
+    gBuffers.erase(std::find(gBuffers.begin(), gBuffers.end(), buffer_));
+  }
+
+private:
+  std::shared_ptr<ThreadBuffer> buffer_;
+};
+
+ThreadLocal<ThreadBufferOwner> gThreadBufferOwner;
+
+ThreadBuffer* getThreadBuffer() {
+  if (!gThreadBuffer) {
+    auto buffer = std::make_shared<ThreadBuffer>(
+        std::max(FLAGS_timeline_buffer_size, 1));
+    {
+      std::lock_guard<std::mutex> guard(gBuffersLock);
+      gBuffers.push_back(buffer);
+    }
+    gThreadBufferOwner.get()->own(buffer);
+    gThreadBuffer = buffer.get();
+  }
+  return gThreadBuffer;
+}
+
+void writeJsonString(std::ostream& os, const std::string& str) {
+  os << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << ' ';
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+static InitFunction __init_timeline([] { Timeline::init(); });
+
+void Timeline::init() { enabled_ = !FLAGS_timeline_file.empty(); }
+
+void Timeline::setThreadName(const std::string& name) {
+  if (enabled_) {
+    getThreadBuffer()->setName(name);
+  }
+}
+
+uint32_t Timeline::getNameId(const std::string& name) {
+  std::lock_guard<std::mutex> guard(gNamesLock);
+  auto ret = gNameIds.insert(std::make_pair(name, (uint32_t)gNames.size()));
+  if (ret.second) {
+    gNames.push_back(name);
+  }
+  return ret.first->second;
+}
+
+void Timeline::addSpan(uint32_t nameId, uint64_t start, uint64_t duration) {
+  getThreadBuffer()->add({start, duration, nameId, -1});
+}
+
+void Timeline::addBarrier(uint32_t nameId, uint64_t time, int32_t trainerId,
+                          uint64_t delta) {
+  getThreadBuffer()->add({time, delta, nameId, trainerId});
+}
+
+void Timeline::dump() {
+  if (!enabled_) {
+    return;
+  }
+  int n;
+  {
+    std::lock_guard<std::mutex> guard(gDumpLock);
+    n = gNumDumps++;
+  }
+  dump(FLAGS_timeline_file + "." + std::to_string(n) + ".json");
+}
+
+size_t Timeline::getNumThreadBuffers() {
+  std::lock_guard<std::mutex> guard(gBuffersLock);
+  return gBuffers.size();
+}
+
+void Timeline::dump(const std::string& fileName) {
+  std::lock_guard<std::mutex> dumpGuard(gDumpLock);
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> guard(gBuffersLock);
+    buffers = gBuffers;
+  }
+  std::vector<RetiredThread> retiredThreads;
+  retiredThreads.swap(gRetiredThreads);
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> guard(gNamesLock);
+    names = gNames;
+  }
+
+  std::ofstream os(fileName);
+  CHECK(os) << "Fail to open " << fileName;
+  pid_t pid = getpid();
+  size_t numEvents = 0;
+  size_t numLost = 0;
+  bool first = true;
+  auto separate = [&]() {
+    os << (first ? "\n" : ",\n");
+    first = false;
+  };
+  auto writeThread = [&](pid_t tid, const std::string& threadName,
+                         const std::vector<TimelineEvent>& events) {
+    numEvents += events.size();
+    if (!threadName.empty()) {
+      separate();
+      os << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+         << ", \"tid\": " << tid << ", \"args\": {\"name\": ";
+      writeJsonString(os, threadName);
+      os << "}}";
+    }
+    for (auto& event : events) {
+      separate();
+      os << "{\"name\": ";
+      writeJsonString(os, event.nameId < names.size() ? names[event.nameId]
+                                                      : std::string());
+      if (event.trainerId < 0) {
+        os << ", \"cat\": \"timer\", \"ph\": \"X\", \"ts\": " << event.time
+           << ", \"dur\": " << event.value;
+      } else {
+        os << ", \"cat\": \"barrier\", \"ph\": \"i\", \"s\": \"t\", \"ts\": "
+           << event.time << ", \"args\": {\"trainer\": " << event.trainerId;
+        if (event.value) {
+          os << ", \"delta\": " << event.value;
+        }
+        os << "}";
+      }
+      os << ", \"pid\": " << pid << ", \"tid\": " << tid << "}";
+    }
+  };
+  os << "{\"traceEvents\": [";
+  for (auto& retired : retiredThreads) {
+    numLost += retired.numLost;
+    writeThread(retired.tid, retired.name, retired.events);
+  }
+  std::vector<TimelineEvent> events;
+  for (auto& buffer : buffers) {
+    events.clear();
+    numLost += buffer->collect(&events);
+    writeThread(buffer->getTid(), buffer->getName(), events);
+  }
+  os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  CHECK(os) << "Fail to write " << fileName;
+  LOG(INFO) << "Dumped " << numEvents << " timeline events to " << fileName;
+  LOG_IF(WARNING, numLost > 0)
+      << numLost << " timeline events are lost, increase "
+      << "--timeline_buffer_size to keep them";
+}
+
+}  // namespace paddle
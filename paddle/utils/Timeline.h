@@ -0,0 +1,96 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace paddle {
+
+/**
+ * @brief Timeline of the timers and the barriers.
+ *
+ * When --timeline_file is set, the spans measured by REGISTER_TIMER* and the
+ * points of REGISTER_BARRIER_* are recorded, with their thread, so that one
+ * can see what overlaps with what. Each thread writes into its own ring
+ * buffer of --timeline_buffer_size events without any lock; when the buffer
+ * is full, the oldest events are overwritten. When a thread exits, its
+ * events are kept until the next dump and its buffer is freed.
+ *
+ * dump() writes the events recorded since the previous dump in the Chrome
+ * trace event format, which can be loaded in chrome://tracing. It is called
+ * at the end of each pass by the trainer and the parameter server, and can
+ * be called at any time from any thread.
+ */
+class Timeline {
+public:
+  /// whether --timeline_file is set.
+  static bool enabled() { return enabled_; }
+
+  /**
+   * @brief name the current thread in the dumped timeline.
+   */
+  static void setThreadName(const std::string& name);
+
+  /**
+   * @brief get the id of an event name, which is much cheaper to record
+   * than the name.
+   */
+  static uint32_t getNameId(const std::string& name);
+
+  /**
+   * @brief record a span of the current thread.
+   * @param start    start time in microseconds, see nowInMicroSec().
+   * @param duration duration in microseconds.
+   */
+  static void addSpan(uint32_t nameId, uint64_t start, uint64_t duration);
+
+  /**
+   * @brief record a barrier point of the current thread.
+   * @param time      time of the point in microseconds.
+   * @param trainerId the trainer which reaches the barrier.
+   * @param delta     delta of a BarrierDeltaStat, 0 for a BarrierEndStat.
+   */
+  static void addBarrier(uint32_t nameId, uint64_t time, int32_t trainerId,
+                         uint64_t delta);
+
+  /**
+   * @brief dump the events recorded since the previous dump to
+   * <timeline_file>.<n>.json, n counting the dumps.
+   *
+   * Do nothing if the timeline is not enabled.
+   */
+  static void dump();
+
+  /**
+   * @brief dump the events recorded since the previous dump to fileName.
+   */
+  static void dump(const std::string& fileName);
+
+  /// number of the ring buffers, one for each running thread which records.
+  static size_t getNumThreadBuffers();
+
+  /**
+   * @brief enable the timeline if --timeline_file is set.
+   *
+   * Called by initMain() through an InitFunction.
+   */
+  static void init();
+
+private:
+  static bool enabled_;
+};
+
+}  // namespace paddle
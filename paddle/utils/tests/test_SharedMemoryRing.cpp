@@ -0,0 +1,103 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "paddle/utils/SharedMemoryRing.h"
+
+using paddle::SharedMemoryRing;
+
+static bool isAlive(pid_t pid) {
+  return waitpid(pid, nullptr, WNOHANG) == 0;
+}
+
+static std::vector<char> makeMessage(size_t i) {
+  // messages larger than the ring wrap around it several times.
+  std::vector<char> msg(i * 37 % 5000);
+  for (size_t j = 0; j < msg.size(); ++j) {
+    msg[j] = static_cast<char>(i + j);
+  }
+  return msg;
+}
+
+TEST(SharedMemoryRing, messages) {
+  const size_t numMessages = 1000;
+  SharedMemoryRing ring(1000);
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    for (size_t i = 0; i < numMessages; ++i) {
+      if (!ring.writeMessage(makeMessage(i))) {
+        _exit(1);
+      }
+    }
+    ring.close();
+    _exit(0);
+  }
+
+  std::vector<char> msg;
+  size_t i = 0;
+  while (ring.readMessage(&msg, [pid] { return isAlive(pid); })) {
+    ASSERT_EQ(makeMessage(i), msg);
+    ++i;
+  }
+  EXPECT_EQ(numMessages, i);
+  EXPECT_TRUE(ring.isClosed());
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(SharedMemoryRing, writerDied) {
+  SharedMemoryRing ring(1000);
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    ring.writeMessage(makeMessage(1));
+    _exit(0);  // without closing the ring.
+  }
+
+  std::vector<char> msg;
+  ASSERT_TRUE(ring.readMessage(&msg, [pid] { return isAlive(pid); }));
+  ASSERT_EQ(makeMessage(1), msg);
+  ASSERT_FALSE(ring.readMessage(&msg, [pid] { return isAlive(pid); }));
+  EXPECT_FALSE(ring.isClosed());
+}
+
+TEST(SharedMemoryRing, stop) {
+  SharedMemoryRing ring(1000);
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // fills the ring, then waits for the reader until it stops.
+    while (ring.writeMessage(makeMessage(10))) {
+    }
+    _exit(0);
+  }
+
+  std::vector<char> msg;
+  ASSERT_TRUE(ring.readMessage(&msg, [pid] { return isAlive(pid); }));
+  ring.stop();
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2016 Baidu, Inc. All Rights Reserve.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "paddle/utils/Flags.h"
+#include "paddle/utils/Timeline.h"
+#include "paddle/utils/Util.h"
+
+P_DECLARE_string(timeline_file);
+P_DECLARE_int32(timeline_buffer_size);
+
+using paddle::Timeline;
+
+static std::string readFile(const std::string& fileName) {
+  std::ifstream is(fileName);
+  std::stringstream ss;
+  ss << is.rdbuf();
+  return ss.str();
+}
+
+static size_t countOf(const std::string& str, const std::string& pattern) {
+  size_t count = 0;
+  for (size_t pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+static std::string dumpToString() {
+  std::string fileName = "test_Timeline." + std::to_string(getpid());
+  Timeline::dump(fileName);
+  std::string content = readFile(fileName);
+  unlink(fileName.c_str());
+  return content;
+}
+
+TEST(Timeline, threads) {
+  const int numThreads = 4;
+  const int numSpans = 100;
+  uint32_t spanId = Timeline::getNameId("span");
+  uint32_t barrierId = Timeline::getNameId("barrier");
+  EXPECT_EQ(spanId, Timeline::getNameId("span"));
+
+  size_t numBuffers = Timeline::getNumThreadBuffers();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i) {
+    threads.emplace_back([=] {
+      Timeline::setThreadName("worker " + std::to_string(i));
+      for (int j = 0; j < numSpans; ++j) {
+        Timeline::addSpan(spanId, 1000 + j, 10);
+      }
+      Timeline::addBarrier(barrierId, 2000, i, i * 5);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // the buffers of the exited threads are freed, their events are kept.
+  EXPECT_EQ(numBuffers, Timeline::getNumThreadBuffers());
+
+  std::string content = dumpToString();
+  EXPECT_EQ(0UL, content.find("{\"traceEvents\": ["));
+  EXPECT_EQ(numThreads * numSpans, countOf(content, "\"ph\": \"X\""));
+  EXPECT_EQ(numThreads, countOf(content, "\"ph\": \"i\""));
+  EXPECT_EQ(numThreads, countOf(content, "\"thread_name\""));
+  for (int i = 0; i < numThreads; ++i) {
+    EXPECT_NE(std::string::npos,
+              content.find("\"worker " + std::to_string(i) + "\""));
+  }
+  // the delta of a barrier is only written if not 0.
+  EXPECT_EQ(numThreads - 1, countOf(content, "\"delta\""));
+
+  // the events are consumed by the dump.
+  content = dumpToString();
+  EXPECT_EQ(0UL, countOf(content, "\"ph\": \"X\""));
+}
+
+TEST(Timeline, overflow) {
+  const int bufferSize = 64;
+  int oldBufferSize = FLAGS_timeline_buffer_size;
+  FLAGS_timeline_buffer_size = bufferSize;
+  uint32_t spanId = Timeline::getNameId("overflow");
+  std::thread thread([=] {
+    for (int j = 0; j < bufferSize * 3; ++j) {
+      Timeline::addSpan(spanId, j, 1);
+    }
+  });
+  thread.join();
+  FLAGS_timeline_buffer_size = oldBufferSize;
+
+  // only the most recent events are kept.
+  std::string content = dumpToString();
+  EXPECT_EQ(bufferSize, countOf(content, "\"name\": \"overflow\""));
+  EXPECT_NE(std::string::npos,
+            content.find("\"ts\": " + std::to_string(bufferSize * 3 - 1)));
+  EXPECT_EQ(std::string::npos,
+            content.find("\"ts\": " + std::to_string(bufferSize * 2 - 1)));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  paddle::initMain(argc, argv);
+  FLAGS_timeline_file = "test_Timeline";
+  Timeline::init();
+  EXPECT_TRUE(Timeline::enabled());
+  return RUN_ALL_TESTS();
+}
@@ -80,5 +80,20 @@ sinclude(`DataConfigInter.proto.m4')
 
   // the usage ratio of instances. Setting to 1.0 means the use of all instances.
   optional real usage_ratio = 27 [default = 1.0];
+
+  /*
+   * Length-bucketed batching, for sequence data. A sequence goes to the first
+   * bucket whose boundary is no less than its length, or to the last bucket
+   * if it is longer than all the boundaries. e.g. the boundaries 10, 20 make
+   * the buckets [1, 10], [11, 20] and [21, inf). Each minibatch is made of
+   * sequences drawn from one bucket. Bucketing is disabled if it is empty.
+   */
+  repeated int32 bucket_boundaries = 28;
+  /*
+   * A bucket gives a minibatch once it has buffered bucket_pool_size
+   * samples. The minibatch is drawn randomly from these samples. 0 means
+   * 4 times the batch size.
+   */
+  optional int64 bucket_pool_size = 29 [default = 0];
 };
 
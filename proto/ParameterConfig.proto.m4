@@ -23,6 +23,17 @@ enum ParameterInitStrategy {
   PARAMETER_INIT_UNIFORM = 1;
 }
 
+// compression of the gradients a trainer sends to the pservers in
+// synchronous sgd, see GradientCompressor
+enum GradientCompression {
+  GRADIENT_COMPRESSION_NONE = 0;
+  // half precision
+  GRADIENT_COMPRESSION_FP16 = 1;
+  // only the largest elements of each block, the others are accumulated
+  // on the trainer and sent later
+  GRADIENT_COMPRESSION_TOP_K = 2;
+}
+
 message ParameterUpdaterHookConfig {
   required string type = 1;
   optional string purning_mask_filename = 2;
@@ -76,4 +87,10 @@ message ParameterConfig {
   optional bool is_shared = 23 [default = false];
   // parameter block size
   optional uint64 parameter_block_size = 24 [default = 0];
+
+  optional GradientCompression gradient_compression = 25
+      [default = GRADIENT_COMPRESSION_NONE];
+  // fraction of the elements of each block sent by
+  // GRADIENT_COMPRESSION_TOP_K
+  optional double gradient_compression_ratio = 26 [default = 0.01];
 }
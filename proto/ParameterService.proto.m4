@@ -50,6 +50,21 @@ message ParameterBlock {
   // actual size of block, size for last block is [endDim -beginDim],
   // others is parameter_block_size in ParameterConfig
   required uint64 block_size = 4;
+  // format of the data of a gradient block, see GradientCompressor
+  optional GradientCompression compression = 5
+      [default = GRADIENT_COMPRESSION_NONE];
+}
+
+// Rows of a sparse parameter sent in one piece, see --compact_sparse_rpc.
+// The values of the rows of all the SparseRows of a message are in one
+// data block following the blocks of the ParameterBlocks, in the order of
+// the rows.
+message SparseRows {
+  required uint64 para_id = 1;
+  // global sparse row id on the pserver
+  repeated uint32 row_ids = 2 [packed = true];
+  // local row id in the trainer, echoed back by the pserver
+  repeated uint32 local_rows = 3 [packed = true];
 }
 
 enum PServerStatus {
@@ -85,6 +100,9 @@ message SendParameterRequest {
   // forwardbackward time in usec
   optional uint64 forwardbackward_time = 9;
 
+  // sparse rows of PSERVER_UPDATE_MODE_ADD_GRADIENT and
+  // PSERVER_UPDATE_MODE_GET_PARAM_SPARSE, in addition to blocks
+  repeated SparseRows sparse_rows = 10;
 }
 
 message WaitPassStartRequest {
@@ -115,6 +133,7 @@ message SynchronizeResponse {
 
 message SendParameterResponse  {
   repeated ParameterBlock blocks = 1;
+  repeated SparseRows sparse_rows = 2;
 }
 
 message SetConfigRequest {
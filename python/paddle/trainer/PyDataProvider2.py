@@ -44,6 +44,11 @@ class CacheType(object):
     # memory during rest passes.
     CACHE_PASS_IN_MEM = 1
 
+    # First pass, read data from python. And store the converted slot data in
+    # memory in a compact binary format. Rest passes read it without calling
+    # python.
+    CACHE_PASS_IN_BINARY = 2
+
 
 class InputType(object):
     __slots__ = ['dim', 'seq_type', 'type']
@@ -209,6 +214,7 @@ def provider(input_types=None, should_shuffle=None, pool_size=-1,
              cache=CacheType.NO_CACHE,
              check=False, check_fail_continue=False,
              use_dynamic_order=True,
+             num_workers=0,
              init_hook=None, **kwargs):
     """
     Provider decorator. Use it to make a function into PyDataProvider2 object.
@@ -287,6 +293,14 @@ def provider(input_types=None, should_shuffle=None, pool_size=-1,
                               feature value. The tuples are still allowed when
                               use_dynmaic_order is True.
     :type use_dynamic_order: bool
+
+    :param num_workers: Number of worker processes running the generator. Each
+                        worker reads a shard of the file list, and sends the
+                        converted samples to the trainer through shared memory,
+                        so the python code runs on several cores. 0 means the
+                        generator runs in the trainer process. Cannot be used
+                        with CacheType.CACHE_PASS_IN_MEM.
+    :type num_workers: int
     """
 
     def __wrapper__(generator):
@@ -331,6 +345,7 @@ def provider(input_types=None, should_shuffle=None, pool_size=-1,
                 self.generator = generator
                 self.cache = cache
                 self.min_pool_size = min_pool_size
+                self.num_workers = num_workers
                 self.input_order = kwargs['input_order']
                 self.check = check
                 if init_hook is not None:
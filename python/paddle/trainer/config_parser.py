@@ -94,6 +94,9 @@ try:
     from paddle.proto.ModelConfig_pb2 import LinkConfig
     from paddle.proto.ParameterConfig_pb2 import ParameterConfig
     from paddle.proto.ParameterConfig_pb2 import ParameterUpdaterHookConfig
+    from paddle.proto.ParameterConfig_pb2 import GRADIENT_COMPRESSION_NONE
+    from paddle.proto.ParameterConfig_pb2 import GRADIENT_COMPRESSION_FP16
+    from paddle.proto.ParameterConfig_pb2 import GRADIENT_COMPRESSION_TOP_K
     from paddle.proto.TrainerConfig_pb2 import TrainerConfig
 
 except Exception as e:
@@ -438,6 +441,8 @@ class Bias(Cfg):
             gradient_clipping_threshold=None,
             is_static=None,
             is_shared=None,
+            gradient_compression=None,
+            gradient_compression_ratio=None,
             ):
         self.add_keys(locals())
 
@@ -469,6 +474,8 @@ class Input(Cfg):
             nnz=None,
             is_static=None,
             is_shared=None,
+            gradient_compression=None,
+            gradient_compression_ratio=None,
             update_hooks=None,
             input_layer_argument=None,
             ):
@@ -501,6 +508,8 @@ class Projection(Input):
             nnz=None,
             is_static=None,
             is_shared=None,
+            gradient_compression=None,
+            gradient_compression_ratio=None,
             update_hooks=None,
             input_layer_argument=None,
             ):
@@ -785,7 +794,9 @@ def DataBase(async_load_data=False,
              constant_slots=None,
              data_ratio=1,
              is_main_data=True,
-             usage_ratio=None):
+             usage_ratio=None,
+             bucket_boundaries=None,
+             bucket_pool_size=None):
     # default: all sub dataproviders are treat as "main data".
     # see proto/DataConfig.proto for is_main_data
     data_config = DataConfig()
@@ -802,6 +813,17 @@ def DataBase(async_load_data=False,
                   "The range of usage_ratio is [0, 1]")
     data_config.usage_ratio = usage_ratio
 
+    # length-bucketed batching, see proto/DataConfig.proto
+    if bucket_boundaries:
+        config_assert(all(b > 0 for b in bucket_boundaries) and
+                      sorted(set(bucket_boundaries)) == list(bucket_boundaries),
+                      "bucket_boundaries should be positive and increasing")
+        data_config.bucket_boundaries.extend(bucket_boundaries)
+    if bucket_pool_size is not None:
+        config_assert(bucket_pool_size >= 0,
+                      "bucket_pool_size should not be negative")
+        data_config.bucket_pool_size = bucket_pool_size
+
     return data_config
 
 @config_func
@@ -878,6 +900,7 @@ def ProtoData(
         load_file_count=None,
         constant_slots=None,
         load_thread_num=None,
+        buffer_capacity=None,
         **xargs):
     data_config = DataBase(**xargs)
     if type is None:
@@ -889,6 +912,10 @@ def ProtoData(
     # When type="proto_group", one data provider contains at most
     # load_file_count files, and there are at most
     # (queue_capacity + load_thread_num + 1) data providers in memory
+    # When type="proto_stream", load_thread_num threads parse the files into
+    # a shuffle buffer of at most buffer_capacity samples.
+    if buffer_capacity:
+        data_config.buffer_capacity = buffer_capacity
     if file_group_queue_capacity is not None:
         data_config.file_group_conf.queue_capacity = file_group_queue_capacity
     if load_file_count is not None:
@@ -1267,6 +1294,8 @@ class LayerBase(object):
                     gradient_clipping_threshold=bias.gradient_clipping_threshold,
                     is_static=bias.is_static,
                     is_shared=bias.is_shared,
+                    gradient_compression=bias.gradient_compression,
+                    gradient_compression_ratio=bias.gradient_compression_ratio,
                     )
             if for_self:
                 self.config.bias_parameter_name = bias.parameter_name
@@ -1324,7 +1353,9 @@ class LayerBase(object):
             format=format,
             is_static=input_config.is_static,
             is_shared=input_config.is_shared,
-            update_hooks=input_config.update_hooks
+            update_hooks=input_config.update_hooks,
+            gradient_compression=input_config.gradient_compression,
+            gradient_compression_ratio=input_config.gradient_compression_ratio,
             )
 
     def set_layer_size(self, size):
@@ -2842,7 +2873,9 @@ def Parameter(
         need_compact=None,
         is_static=None,
         is_shared=None,
-        update_hooks=None
+        update_hooks=None,
+        gradient_compression=None,
+        gradient_compression_ratio=None,
         ):
 
     config_assert(name not in g_parameter_map,
@@ -2915,6 +2948,20 @@ def Parameter(
     if is_shared is not None:
         para.is_shared = is_shared
 
+    if gradient_compression is not None:
+        compressions = {
+            'none': GRADIENT_COMPRESSION_NONE,
+            'fp16': GRADIENT_COMPRESSION_FP16,
+            'top_k': GRADIENT_COMPRESSION_TOP_K,
+        }
+        config_assert(gradient_compression in compressions,
+                      'Unknown gradient_compression: %s' % gradient_compression)
+        para.gradient_compression = compressions[gradient_compression]
+    if gradient_compression_ratio is not None:
+        config_assert(0 < gradient_compression_ratio <= 1,
+                      'gradient_compression_ratio should be in (0, 1]')
+        para.gradient_compression_ratio = gradient_compression_ratio
+
     update_hooks = default(update_hooks, g_default_update_hooks)
 
     if update_hooks is not None:
@@ -53,12 +53,23 @@ class ParameterAttribute(object):
     :param sparse_update: Enable sparse update for this parameter. It will
                           enable both local and remote sparse update.
     :type sparse_update: bool
+    :param gradient_compression: Compression of the gradient sent to the
+                                 parameter servers in synchronous training,
+                                 'fp16' or 'top_k'. None means no
+                                 compression. 'top_k' sends only the largest
+                                 elements and keeps the others on the trainer
+                                 for the next batches.
+    :type gradient_compression: basestring or None
+    :param gradient_compression_ratio: The fraction of the elements sent by
+                                       'top_k'. None means 0.01.
+    :type gradient_compression_ratio: float or None
     """
 
     def __init__(self, name=None, is_static=False, initial_std=None,
                  initial_mean=None, initial_max=None, initial_min=None,
                  l1_rate=None, l2_rate=None, learning_rate=None, momentum=None,
-                 sparse_update=False):
+                 sparse_update=False, gradient_compression=None,
+                 gradient_compression_ratio=None):
         # initialize strategy.
         if is_static:
             self.attr = {'is_static': True}
@@ -102,6 +113,13 @@ class ParameterAttribute(object):
             self.attr['sparse_update'] = True
             self.attr['sparse_remote_update'] = True
 
+        if gradient_compression is not None:
+            self.attr['gradient_compression'] = gradient_compression
+
+        if isinstance(gradient_compression_ratio, float):
+            self.attr['gradient_compression_ratio'] = \
+                gradient_compression_ratio
+
     def set_default_parameter_name(self, name):
         """
         Set default parameter name. If parameter not set, then will use default
@@ -28,7 +28,8 @@ __all__ = ['define_py_data_sources2']
 
 def define_py_data_source(file_list, cls, module,
                           obj, args=None, async=False,
-                          data_cls=PyData):
+                          data_cls=PyData, bucket_boundaries=None,
+                          bucket_pool_size=None):
     """
     Define a python data source.
 
@@ -61,6 +62,15 @@ def define_py_data_source(file_list, cls, module,
     :type args: string or picklable object
     :param async: Load Data asynchronously or not.
     :type async: bool
+    :param bucket_boundaries: Group the sequences of similar length into the
+                              same batch. A sequence goes to the first bucket
+                              whose boundary is no less than its length.
+                              Bucketing is disabled if it is None.
+    :type bucket_boundaries: list of int
+    :param bucket_pool_size: A batch is drawn from a bucket once it has buffered
+                             bucket_pool_size samples. The default is 4 times
+                             the batch size.
+    :type bucket_pool_size: int
     :return: None
     :rtype: None
     """
@@ -77,8 +87,9 @@ def define_py_data_source(file_list, cls, module,
 
     if data_cls is None:
         def py_data2(files, load_data_module, load_data_object, load_data_args,
-                    **kwargs):
-            data = DataBase()
+                    bucket_boundaries=None, bucket_pool_size=None, **kwargs):
+            data = DataBase(bucket_boundaries=bucket_boundaries,
+                            bucket_pool_size=bucket_pool_size)
             data.type = 'py2'
             data.files = files
             data.load_data_module = load_data_module
@@ -87,15 +98,23 @@ def define_py_data_source(file_list, cls, module,
             return data
         data_cls = py_data2
 
+    bucket_args = dict()
+    if bucket_boundaries is not None:
+        bucket_args['bucket_boundaries'] = bucket_boundaries
+    if bucket_pool_size is not None:
+        bucket_args['bucket_pool_size'] = bucket_pool_size
+
     cls(data_cls(files=file_list,
                  load_data_module=module,
                  load_data_object=obj,
                  load_data_args=args,
-                 async_load_data=async))
+                 async_load_data=async,
+                 **bucket_args))
 
 
 def define_py_data_sources(train_list, test_list, module, obj, args=None,
-                           train_async=False, data_cls=PyData):
+                           train_async=False, data_cls=PyData,
+                           bucket_boundaries=None, bucket_pool_size=None):
     """
     The annotation is almost the same as define_py_data_sources2, except that
     it can specific train_async and data_cls.
@@ -119,6 +138,12 @@ def define_py_data_sources(train_list, test_list, module, obj, args=None,
     :type args: string or picklable object or list or tuple.
     :param train_async: Is training data load asynchronously or not.
     :type train_async: bool
+    :param bucket_boundaries: Bucketing of the training data, see
+                              define_py_data_source.
+    :type bucket_boundaries: list of int
+    :param bucket_pool_size: Samples buffered in a bucket before a batch is
+                             drawn from it, see define_py_data_source.
+    :type bucket_pool_size: int
     :return: None
     :rtype: None
     """
@@ -150,14 +175,16 @@ def define_py_data_sources(train_list, test_list, module, obj, args=None,
 
     if train_list is not None:
         define_py_data_source(train_list, TrainData, train_module, train_obj,
-                              train_args, train_async, data_cls)
+                              train_args, train_async, data_cls,
+                              bucket_boundaries, bucket_pool_size)
 
     if test_list is not None:
         define_py_data_source(test_list, TestData, test_module, test_obj,
                               test_args, False, data_cls)
 
 
-def define_py_data_sources2(train_list, test_list, module, obj, args=None):
+def define_py_data_sources2(train_list, test_list, module, obj, args=None,
+                            bucket_boundaries=None, bucket_pool_size=None):
     """
     Define python Train/Test data sources in one method. If train/test use
     the same Data Provider configuration, module/obj/args contain one argument,
@@ -192,6 +219,12 @@ def define_py_data_sources2(train_list, test_list, module, obj, args=None):
                  arguments. If train and test is different, then pass a tuple 
                  or list to this argument.
     :type args: string or picklable object or list or tuple.
+    :param bucket_boundaries: Group the training sequences of similar length
+                              into the same batch, see define_py_data_source.
+    :type bucket_boundaries: list of int
+    :param bucket_pool_size: Samples buffered in a bucket before a batch is
+                             drawn from it, see define_py_data_source.
+    :type bucket_pool_size: int
     :return: None
     :rtype: None
     """
@@ -200,4 +233,6 @@ def define_py_data_sources2(train_list, test_list, module, obj, args=None):
                            module=module,
                            obj=obj,
                            args=args,
-                           data_cls=None)
+                           data_cls=None,
+                           bucket_boundaries=bucket_boundaries,
+                           bucket_pool_size=bucket_pool_size)